@@ -4,6 +4,7 @@
 #  FFTW3_FOUND - system has FFTW3
 #  FFTW3_INCLUDE_DIR - the FFTW3 include directory
 #  FFTW3_LIBRARIES - Link these to use FFTW3
+#  FFTW3_THREADS_FOUND - FFTW3 threads library found, already part of FFTW3_LIBRARIES
 #  FFTW3_VERSION_STRING - Human readable version number of fftw3
 #  FFTW3_VERSION_MAJOR  - Major version number of fftw3
 #  FFTW3_VERSION_MINOR  - Minor version number of fftw3
@@ -50,3 +51,18 @@ else (FFTW3_LIBRARIES)
   mark_as_advanced(FFTW3_LIBRARIES)
   
 endif (FFTW3_LIBRARIES)
+
+if (FFTW3_FOUND)
+  find_library(FFTW3_THREADS_LIBRARY NAMES fftw3_threads
+    PATHS
+    ${_obLinkDir}
+    ${GNUWIN32_DIR}/lib
+    /usr/local/lib
+  )
+  mark_as_advanced(FFTW3_THREADS_LIBRARY)
+
+  if (FFTW3_THREADS_LIBRARY)
+    set(FFTW3_THREADS_FOUND TRUE)
+    set(FFTW3_LIBRARIES ${FFTW3_THREADS_LIBRARY} ${FFTW3_LIBRARIES})
+  endif (FFTW3_THREADS_LIBRARY)
+endif (FFTW3_FOUND)
@@ -203,7 +203,9 @@ bool RadioSim::StartCapture(float duration)
     gettimeofday(&CapStart, nullptr);
     if(HasStreaming()) {
         Streamer->setPixelFormat(INDI_MONO, PrimaryDetector.getBPS());
-        Streamer->setSize(PrimaryDetector.getContinuumBufferSize() * 8 / abs(PrimaryDetector.getBPS()), 1);
+        // The spectrum analyzer sets the size of its own frames
+        if (StreamDataS[STREAM_DATA_CONTINUUM].s == ISS_ON)
+            Streamer->setSize(PrimaryDetector.getContinuumBufferSize() * 8 / abs(PrimaryDetector.getBPS()), 1);
     }
 
     // We're done
@@ -375,7 +377,7 @@ void * RadioSim::streamCapture()
             usleep(fabs(CaptureTime - deltas) * 1e6);
 
         uint32_t size = PrimaryDetector.getContinuumBufferSize();
-        Streamer->newFrame(PrimaryDetector.getContinuumBuffer(), size);
+        StreamContinuum(PrimaryDetector.getContinuumBuffer(), size);
 
         getitimer(ITIMER_REAL, &tframe2);
     }
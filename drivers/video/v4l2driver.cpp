@@ -165,6 +165,17 @@ bool V4L2_Driver::initProperties()
     IUFillSwitchVector(&ColorProcessingSP, ColorProcessingS, NARRAY(ColorProcessingS), getDeviceName(),
                        "V4L2_COLOR_PROCESSING", "Color Process", CAPTURE_FORMAT, IP_RW, ISR_NOFMANY, 0, IPS_IDLE);
 
+    /* Capture buffers */
+    IUFillNumber(&CaptureBuffersN[0], "COUNT", "Count", "%.f", 2, 32, 1, 4);
+    IUFillNumberVector(&CaptureBuffersNP, CaptureBuffersN, NARRAY(CaptureBuffersN), getDeviceName(), "V4L2_BUFFERS",
+                       "Capture Buffers", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    /* Zero-copy streaming */
+    IUFillSwitch(&DirectStreamS[0], "ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&DirectStreamS[1], "DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&DirectStreamSP, DirectStreamS, NARRAY(DirectStreamS), getDeviceName(), "V4L2_DIRECT_STREAM",
+                       "Zero-copy Stream", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+
     /* V4L2 Settings */
     IUFillNumberVector(&ImageAdjustNP, nullptr, 0, getDeviceName(), "Image Adjustments", "", IMAGE_GROUP, IP_RW, 60,
                        IPS_IDLE);
@@ -220,6 +231,8 @@ void V4L2_Driver::ISGetProperties(const char * dev)
             defineNumber(&FrameRateNP);
 
         defineSwitch(&StackModeSP);
+        defineNumber(&CaptureBuffersNP);
+        defineSwitch(&DirectStreamSP);
 
 #ifdef WITH_V4L2_EXPERIMENTS
         defineSwitch(&ImageDepthSP);
@@ -261,6 +274,8 @@ bool V4L2_Driver::updateProperties()
             defineNumber(&FrameRateNP);
 
         defineSwitch(&StackModeSP);
+        defineNumber(&CaptureBuffersNP);
+        defineSwitch(&DirectStreamSP);
 
 #ifdef WITH_V4L2_EXPERIMENTS
         defineSwitch(&ImageDepthSP);
@@ -330,6 +345,8 @@ bool V4L2_Driver::updateProperties()
         else if (FrameRateNP.np != nullptr)
             deleteProperty(FrameRateNP.name);
 
+        deleteProperty(CaptureBuffersNP.name);
+        deleteProperty(DirectStreamSP.name);
         deleteProperty(ImageAdjustNP.name);
         for (i = 0; i < v4loptions; i++)
             deleteProperty(Options[i].name);
@@ -626,6 +643,23 @@ bool V4L2_Driver::ISNewSwitch(const char * dev, const char * name, ISState * sta
         return true;
     }
 
+    /* Zero-copy Stream */
+    if (strcmp(name, DirectStreamSP.name) == 0)
+    {
+        if (Streamer->isBusy())
+        {
+            LOG_WARN("Can not change zero-copy streaming while streaming.");
+            DirectStreamSP.s = IPS_ALERT;
+            IDSetSwitch(&DirectStreamSP, nullptr);
+            return false;
+        }
+
+        IUUpdateSwitch(&DirectStreamSP, states, names, n);
+        DirectStreamSP.s = IPS_OK;
+        IDSetSwitch(&DirectStreamSP, nullptr);
+        return true;
+    }
+
     /* V4L2 Options/Menus */
     for (iopt = 0; iopt < v4loptions; iopt++)
         if (strcmp(Options[iopt].name, name) == 0)
@@ -824,6 +858,31 @@ bool V4L2_Driver::ISNewNumber(const char * dev, const char * name, double values
         return true;
     }
 
+    /* Capture Buffers */
+    if (strcmp(name, CaptureBuffersNP.name) == 0)
+    {
+        if (PrimaryCCD.isExposing() || Streamer->isBusy())
+        {
+            LOG_ERROR("Can not set the number of capture buffers while capturing.");
+            CaptureBuffersNP.s = IPS_ALERT;
+            IDSetNumber(&CaptureBuffersNP, nullptr);
+            return false;
+        }
+
+        IUUpdateNumber(&CaptureBuffersNP, values, names, n);
+        if (v4l_base->setBufferCount(static_cast<unsigned int>(CaptureBuffersN[0].value), errmsg) == -1)
+        {
+            LOGF_ERROR("ERROR (setbuffers): %s", errmsg);
+            CaptureBuffersNP.s = IPS_ALERT;
+            IDSetNumber(&CaptureBuffersNP, nullptr);
+            return false;
+        }
+
+        CaptureBuffersNP.s = IPS_OK;
+        IDSetNumber(&CaptureBuffersNP, nullptr);
+        return true;
+    }
+
     return INDI::CCD::ISNewNumber(dev, name, values, names, n);
 }
 
@@ -1256,6 +1315,22 @@ void V4L2_Driver::newFrame()
 {
     if (Streamer->isBusy())
     {
+        unsigned int directBytes = 0;
+        const unsigned char * direct = v4l_base->getDirectFrame(&directBytes);
+        if (direct != nullptr)
+        {
+            // The decoder does not run for lent buffers, so there is nothing else to stream for a short frame
+            if (directBytes < frameBytes)
+            {
+                LOGF_WARN("Dropping short frame (%u of %lu bytes).", directBytes, frameBytes);
+                return;
+            }
+
+            // Raw frame straight from the capture buffer, which is queued again once the streamer is done with it
+            Streamer->newFrame(direct, frameBytes, v4l_base->holdDirectFrame());
+            return;
+        }
+
         int width             = v4l_base->getWidth();
         int height            = v4l_base->getHeight();
         int bpp               = v4l_base->getBpp();
@@ -1316,8 +1391,8 @@ void V4L2_Driver::newFrame()
         {
             memcpy(PrimaryCCD.getFrameBuffer(), buffer, totalBytes);
             PrimaryCCD.binFrame();
-            guard.unlock();
             Streamer->newFrame(PrimaryCCD.getFrameBuffer(), frameBytes / PrimaryCCD.getBinX());
+            guard.unlock();
         }
         else
         {
@@ -1729,8 +1804,23 @@ bool V4L2_Driver::StartStreaming()
         return false;
     }
 
+    bool direct = canStreamDirect();
+    if (DirectStreamS[0].s == ISS_ON)
+    {
+        if (direct)
+            LOG_INFO("Streaming frames directly from the capture buffers.");
+        else
+            LOG_INFO("Zero-copy streaming requires a full gray 8 or 16 bit frame without binning, frames are copied.");
+    }
+    v4l_base->setDirectFrames(direct);
+
     /* Callee will take care of checking states */
-    return start_capturing(true);
+    if (start_capturing(true) == false)
+    {
+        v4l_base->setDirectFrames(false);
+        return false;
+    }
+    return true;
 }
 
 bool V4L2_Driver::StopStreaming()
@@ -1743,13 +1833,48 @@ bool V4L2_Driver::StopStreaming()
         return false;
     }
 
-    return stop_capturing();
+    bool rc = stop_capturing();
+    v4l_base->setDirectFrames(false);
+    return rc;
+}
+
+bool V4L2_Driver::canStreamDirect()
+{
+    if (DirectStreamS[0].s != ISS_ON || v4l_base->io != INDI::V4L2_Base::IO_METHOD_MMAP)
+        return false;
+
+    // The raw frame must be exactly what the streamer expects: no binning, no cropping, no conversion
+    if (PrimaryCCD.getBinX() > 1 || PrimaryCCD.getBinY() > 1 || ImageColorS[IMAGE_GRAYSCALE].s != ISS_ON ||
+            v4l_base->cropset)
+        return false;
+
+    unsigned int bytesPerPixel;
+    switch (v4l_base->fmt.fmt.pix.pixelformat)
+    {
+        case V4L2_PIX_FMT_GREY:
+            bytesPerPixel = 1;
+            break;
+        case V4L2_PIX_FMT_Y16:
+            bytesPerPixel = 2;
+            break;
+        default:
+            return false;
+    }
+
+    if (Streamer->getPixelFormat() != INDI_MONO || Streamer->getPixelDepth() != bytesPerPixel * 8)
+        return false;
+
+    return v4l_base->fmt.fmt.pix.bytesperline == v4l_base->fmt.fmt.pix.width * bytesPerPixel &&
+           frameBytes == v4l_base->fmt.fmt.pix.width * v4l_base->fmt.fmt.pix.height * bytesPerPixel;
 }
 
 bool V4L2_Driver::saveConfigItems(FILE * fp)
 {
     INDI::CCD::saveConfigItems(fp);
 
+    IUSaveConfigNumber(fp, &CaptureBuffersNP);
+    IUSaveConfigSwitch(fp, &DirectStreamSP);
+
     if (ImageAdjustNP.nnp > 0)
         IUSaveConfigNumber(fp, &ImageAdjustNP);
 
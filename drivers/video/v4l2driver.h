@@ -114,6 +114,7 @@ class V4L2_Driver : public INDI::CCD
     ISwitch ImageDepthS[2];
     ISwitch StackModeS[5];
     ISwitch ColorProcessingS[3];
+    ISwitch DirectStreamS[2];
 
     /* Texts */
     IText PortT[1] {};
@@ -124,6 +125,7 @@ class V4L2_Driver : public INDI::CCD
     //INumber *ExposeTimeN;
     INumber *FrameN;
     INumber FrameRateN[1];
+    INumber CaptureBuffersN[1];
 
     /* Switch vectors */
     ISwitchVectorProperty *CompressSP;      /* Compress stream switch */
@@ -136,6 +138,7 @@ class V4L2_Driver : public INDI::CCD
     ISwitchVectorProperty FrameRatesSP;     /* Select Frame rate (Discrete) */
     ISwitchVectorProperty *Options;
     ISwitchVectorProperty ColorProcessingSP;
+    ISwitchVectorProperty DirectStreamSP;   /* Stream raw frames from the capture buffers */
 
     unsigned int v4loptions;
     unsigned int v4ladjustments;
@@ -147,6 +150,7 @@ class V4L2_Driver : public INDI::CCD
     INumberVectorProperty FrameRateNP;    /* Frame rate (Step/Continuous) */
     INumberVectorProperty *FrameNP;       /* Frame dimenstion */
     INumberVectorProperty ImageAdjustNP;  /* Image controls */
+    INumberVectorProperty CaptureBuffersNP; /* Number of capture buffers */
 
     /* Text vectors */
     ITextVectorProperty PortTP;
@@ -164,6 +168,7 @@ class V4L2_Driver : public INDI::CCD
     void allocateBuffers();
     void releaseBuffers();
     void updateFrameSize();
+    bool canStreamDirect();
 
     /* Shutter control */
     bool setShutter(double duration);
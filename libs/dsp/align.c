@@ -18,28 +18,26 @@
 
 #include "dsp.h"
 
-dsp_stream_p dsp_align_find_object(dsp_stream_p stream, dsp_stream_p object, int steps) {
-    dsp_stream_p tmp = dsp_stream_copy(stream);
-    dsp_stream_p rotated = dsp_stream_copy(object);
-    dsp_buffer_reverse(rotated->buf, rotated->len);
-    double *center = (double*)malloc(sizeof(double)*object->dims);
-    double *rotation = (double*)malloc(sizeof(double)*object->dims);
-    for(int dim = 0; dim < object->dims; dim++) {
-        center[dim] = object->sizes[dim]/2;
-    }
-    for(double x = 0; x < steps; x++) {
-        dsp_stream_scale(tmp, x/steps);
-        double angle = 0;
-        while (angle < pow(M_PI*2, object->dims)) {
-            for(int dim = 0; dim < object->dims; dim++) {
-                angle += M_PI*2/steps;
-                rotation[dim] += M_PI*2/steps;
-                rotated = dsp_stream_rotate(object, rotation, center);
-                dsp_stream_p tmp0 = dsp_convolution_convolution(tmp, rotated);
-                dsp_buffer_sum(tmp, tmp0->buf, tmp0->len);
-                dsp_stream_free(tmp0);
-            }
-        }
+/*
+ * The object is rotated by steps angles spread over a turn around its center and each rotation is correlated with
+ * the stream. Only one rotation and its correlation exist at a time, they are summed into the result and freed.
+ */
+dsp_stream_p dsp_align_find_object(dsp_stream_p stream, dsp_stream_p object, int steps)
+{
+    if(steps < 1 || object->dims < 2 || stream->dims < object->dims)
+        return NULL;
+    double center[2] = { (object->sizes[0] - 1) / 2.0, (object->sizes[1] - 1) / 2.0 };
+    dsp_stream_p result = dsp_stream_copy(stream);
+    dsp_buffer_clear(result);
+    for(int step = 0; step < steps; step++) {
+        double angle = M_PI * 2 * step / steps;
+        dsp_stream_p rotated = dsp_stream_rotate(object, &angle, center);
+        dsp_stream_p correlation = dsp_convolution_convolution(stream, rotated);
+        dsp_buffer_sum(result, correlation->buf, correlation->len);
+        dsp_stream_free_buffer(correlation);
+        dsp_stream_free(correlation);
+        dsp_stream_free_buffer(rotated);
+        dsp_stream_free(rotated);
     }
-    return tmp;
+    return result;
 }
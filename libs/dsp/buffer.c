@@ -203,30 +203,6 @@ void dsp_buffer_log1(dsp_stream_p stream, double val)
 
 }
 
-static int compare( const void* a, const void* b)
-{
-     double int_a = * ( (double*) a );
-     double int_b = * ( (double*) b );
-
-     if ( int_a == int_b ) return 0;
-     else if ( int_a < int_b ) return -1;
-     else return 1;
-}
-
-void dsp_buffer_median(dsp_stream_p stream, int size, int median)
-{
-
-	int k;
-    int mid = (size / 2) + (size % 2);
-    double* sorted = (double*)malloc(size * sizeof(double));
-    for(k = mid; k < stream->len; k++) {
-        memcpy (sorted, stream->buf + (k - mid), size * sizeof(double));
-        qsort(sorted, size, sizeof(double), compare);
-        stream->buf[k] = sorted[median];
-	}
-
-}
-
 void dsp_buffer_deviate(dsp_stream_p stream, double* deviation, double mindeviation, double maxdeviation)
 {
     dsp_stream_p tmp = dsp_stream_copy(stream);
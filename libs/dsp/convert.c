@@ -18,3 +18,163 @@
 
 #include "dsp.h"
 
+#include <stdint.h>
+
+/*
+ * Every kernel is generated once per sample type by the DSP_SAMPLE_TYPES list, with the C type of the samples
+ * and their range, then picked by a switch on the type.
+ */
+#define DSP_SAMPLE_TYPES(X) \
+    X(DSP_SAMPLE_U8, u8, uint8_t, 0, UINT8_MAX) \
+    X(DSP_SAMPLE_S16, s16, int16_t, INT16_MIN, INT16_MAX) \
+    X(DSP_SAMPLE_U16, u16, uint16_t, 0, UINT16_MAX) \
+    X(DSP_SAMPLE_U32, u32, uint32_t, 0, UINT32_MAX) \
+    X(DSP_SAMPLE_U64, u64, uint64_t, 0, UINT64_MAX) \
+    X(DSP_SAMPLE_F32, f32, float, -FLT_MAX, FLT_MAX) \
+    X(DSP_SAMPLE_F64, f64, double, -DBL_MAX, DBL_MAX)
+
+/* Out of range values are clamped and NaNs are stored as 0 */
+#define DSP_SAMPLE_STORE(ctype, lo, hi, v) \
+    ((v) != (v) ? (ctype)0 : ((v) <= (double)(lo) ? (ctype)(lo) : ((v) >= (double)(hi) ? (ctype)(hi) : (ctype)(v))))
+
+#define DSP_SAMPLE_KERNELS(type, name, ctype, lo, hi) \
+static void dsp_sample_to_double_##name(const ctype *buf, int len, double *out, double *min, double *max) \
+{ \
+    if(min == NULL || max == NULL) { \
+        for(int k = 0; k < len; k++) \
+            out[k] = (double)buf[k]; \
+        return; \
+    } \
+    double mn = len > 0 ? (double)buf[0] : 0, mx = mn; \
+    for(int k = 0; k < len; k++) { \
+        double v = (double)buf[k]; \
+        out[k] = v; \
+        mn = v < mn ? v : mn; \
+        mx = v > mx ? v : mx; \
+    } \
+    *min = mn; \
+    *max = mx; \
+} \
+static void dsp_sample_from_double_##name(const double *in, int len, ctype *buf, double scale, double offset) \
+{ \
+    if(scale == 1.0 && offset == 0.0) { \
+        for(int k = 0; k < len; k++) \
+            buf[k] = DSP_SAMPLE_STORE(ctype, lo, hi, in[k]); \
+        return; \
+    } \
+    for(int k = 0; k < len; k++) { \
+        double v = in[k] * scale + offset; \
+        buf[k] = DSP_SAMPLE_STORE(ctype, lo, hi, v); \
+    } \
+}
+
+DSP_SAMPLE_TYPES(DSP_SAMPLE_KERNELS)
+
+int dsp_sample_type_from_bits(int bits_per_sample)
+{
+    switch(bits_per_sample) {
+    case 8:
+        return DSP_SAMPLE_U8;
+    case 16:
+        return DSP_SAMPLE_U16;
+    case 32:
+        return DSP_SAMPLE_U32;
+    case 64:
+        return DSP_SAMPLE_U64;
+    case -32:
+        return DSP_SAMPLE_F32;
+    case -64:
+        return DSP_SAMPLE_F64;
+    default:
+        return -1;
+    }
+}
+
+int dsp_sample_size(dsp_sample_type type)
+{
+#define DSP_SAMPLE_SIZE(type, name, ctype, lo, hi) case type: return sizeof(ctype);
+    switch(type) {
+    DSP_SAMPLE_TYPES(DSP_SAMPLE_SIZE)
+    }
+#undef DSP_SAMPLE_SIZE
+    return 0;
+}
+
+void dsp_sample_to_double(const void *buf, dsp_sample_type type, int len, double *out, double *min, double *max)
+{
+#define DSP_SAMPLE_TO_DOUBLE(type, name, ctype, lo, hi) \
+    case type: dsp_sample_to_double_##name((const ctype*)buf, len, out, min, max); break;
+    switch(type) {
+    DSP_SAMPLE_TYPES(DSP_SAMPLE_TO_DOUBLE)
+    }
+#undef DSP_SAMPLE_TO_DOUBLE
+}
+
+void dsp_sample_from_double(const double *in, int len, void *buf, dsp_sample_type type)
+{
+#define DSP_SAMPLE_FROM_DOUBLE(type, name, ctype, lo, hi) \
+    case type: dsp_sample_from_double_##name(in, len, (ctype*)buf, 1.0, 0.0); break;
+    switch(type) {
+    DSP_SAMPLE_TYPES(DSP_SAMPLE_FROM_DOUBLE)
+    }
+#undef DSP_SAMPLE_FROM_DOUBLE
+}
+
+void dsp_sample_from_double_scaled(const double *in, int len, void *buf, dsp_sample_type type, double scale, double offset)
+{
+#define DSP_SAMPLE_FROM_SCALED(type, name, ctype, lo, hi) \
+    case type: dsp_sample_from_double_##name(in, len, (ctype*)buf, scale, offset); break;
+    switch(type) {
+    DSP_SAMPLE_TYPES(DSP_SAMPLE_FROM_SCALED)
+    }
+#undef DSP_SAMPLE_FROM_SCALED
+}
+
+void dsp_sample_stretch_from_double(const double *in, int len, void *buf, dsp_sample_type type, double lo, double hi)
+{
+    if(len < 1)
+        return;
+    /* Same mapping as dsp_buffer_stretch(), fused with the conversion */
+    double mn = in[0], mx = in[0];
+    for(int k = 1; k < len; k++) {
+        mn = Min(mn, in[k]);
+        mx = Max(mx, in[k]);
+    }
+    double range = mx - mn;
+    if(range == 0.0)
+        range = 1;
+    double scale = (hi - lo) / range;
+    dsp_sample_from_double_scaled(in, len, buf, type, scale, lo - mn * scale);
+}
+
+void dsp_sample_whitenoise(void *buf, dsp_sample_type type, int len)
+{
+    /* The levels of dsp_signals_whitenoise() over the range of integer samples, or from 0 to 1 */
+    double range = 1.0;
+    switch(type) {
+    case DSP_SAMPLE_U8:
+        range = UINT8_MAX;
+        break;
+    case DSP_SAMPLE_S16:
+    case DSP_SAMPLE_U16:
+        range = UINT16_MAX;
+        break;
+    case DSP_SAMPLE_U32:
+        range = UINT32_MAX;
+        break;
+    case DSP_SAMPLE_U64:
+        range = (double)UINT64_MAX;
+        break;
+    default:
+        break;
+    }
+    double offset = type == DSP_SAMPLE_S16 ? INT16_MIN : 0;
+    int size = dsp_sample_size(type);
+    double chunk[256];
+    for(int k = 0; k < len; k += 256) {
+        int n = Min(256, len - k);
+        for(int i = 0; i < n; i++)
+            chunk[i] = (rand() % 255) / 254.0;
+        dsp_sample_from_double_scaled(chunk, n, (char*)buf + (size_t)k * size, type, range, offset);
+    }
+}
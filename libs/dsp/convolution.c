@@ -17,20 +17,606 @@
  */
 
 #include "dsp.h"
+#include <unistd.h>
 
-dsp_stream_p dsp_convolution_convolution(dsp_stream_p stream, dsp_stream_p matrix) {
-    dsp_stream_p tmp = dsp_stream_copy(stream);
-    dsp_buffer_clear(tmp);
-    for(int y = 0; y < matrix->len; y++)
-    {
-        int* pos = dsp_stream_get_position(matrix, y);
-        int z = dsp_stream_set_position(stream, pos);
-        for(int x = -matrix->len + 1; x < stream->len; x++)
-        {
-            int i = x+z;
-            if(i >= 0 && i < stream->len && x >= 0 && x < stream->len)
-                tmp->buf[x] += stream->buf[i] * matrix->buf[y];
+#define DSP_CONVOLUTION_MAX_THREADS 4
+/* Multiply-adds below which a convolution is not worth splitting over several threads */
+#define DSP_CONVOLUTION_THREAD_MIN_WORK 262144
+/* Samples of a row processed per pass of the direct method, so that the row stays in cache for all the kernel */
+#define DSP_CONVOLUTION_TILE 2048
+/* Estimated cost of a transform of n samples, in multiply-adds per n * log2(n) */
+#define DSP_CONVOLUTION_FFT_COST 2.5
+/* Overlap-add blocks hold at least this many samples */
+#define DSP_CONVOLUTION_BLOCK_MIN_LEN 65536
+
+/* Kernel of the direct method with its zero elements removed */
+typedef struct dsp_convolution_tap_t
+{
+    double value;
+    /* Offset of the sample in the stream buffer */
+    long offset;
+    /* Position in the matrix */
+    int *pos;
+} dsp_convolution_tap;
+
+typedef struct dsp_convolution_t
+{
+    int dims;
+    /* Sizes and strides of the stream, sizes of the matrix, 1 in the dimensions it lacks */
+    int *n;
+    int *k;
+    long *stride;
+    long len;
+    const double *in;
+    double *out;
+    /* Direct method */
+    dsp_convolution_tap *taps;
+    int tap_count;
+    int rows;
+    /* Separable method: the pass dimension and its 1D kernel */
+    int dim;
+    const double *factor;
+} dsp_convolution;
+
+typedef void (*dsp_convolution_worker)(dsp_convolution *c, int start, int end);
+
+typedef struct dsp_convolution_job_t
+{
+    dsp_convolution_worker worker;
+    dsp_convolution *c;
+    int start;
+    int end;
+} dsp_convolution_job;
+
+static void *dsp_convolution_job_run(void *arg)
+{
+    dsp_convolution_job *job = (dsp_convolution_job*)arg;
+    job->worker(job->c, job->start, job->end);
+    return NULL;
+}
+
+/* Split units of work over up to DSP_CONVOLUTION_MAX_THREADS threads, the calling thread runs the first chunk */
+static void dsp_convolution_parallel(dsp_convolution_worker worker, dsp_convolution *c, int units, double work)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (int)Min(work / DSP_CONVOLUTION_THREAD_MIN_WORK, (double)Min(cores, (long)DSP_CONVOLUTION_MAX_THREADS));
+    threads = Max(Min(threads, units), 1);
+
+    dsp_convolution_job jobs[DSP_CONVOLUTION_MAX_THREADS];
+    pthread_t workers[DSP_CONVOLUTION_MAX_THREADS];
+    int started[DSP_CONVOLUTION_MAX_THREADS] = { 0 };
+    for(int t = 0; t < threads; t++) {
+        jobs[t].worker = worker;
+        jobs[t].c = c;
+        jobs[t].start = (int)((long)units * t / threads);
+        jobs[t].end = (int)((long)units * (t + 1) / threads);
+    }
+    for(int t = 1; t < threads; t++)
+        started[t] = !pthread_create(&workers[t], NULL, dsp_convolution_job_run, &jobs[t]);
+    dsp_convolution_job_run(&jobs[0]);
+    for(int t = 1; t < threads; t++) {
+        if(started[t])
+            pthread_join(workers[t], NULL);
+        else
+            dsp_convolution_job_run(&jobs[t]);
+    }
+}
+
+/*
+ * Direct method. Units are the rows of the output, or tiles of the single row of a monodimensional stream, and
+ * each kernel tap adds a shifted row of the stream with the bounds checked once per row.
+ */
+static void dsp_convolution_direct_rows(dsp_convolution *c, int start, int end)
+{
+    int n0 = c->n[0];
+    int tiles = c->rows == 1 ? (n0 + DSP_CONVOLUTION_TILE - 1) / DSP_CONVOLUTION_TILE : 1;
+    for(int unit = start; unit < end; unit++) {
+        int row = unit / tiles;
+        int x0 = 0, x1 = n0;
+        if(tiles > 1) {
+            x0 = (unit % tiles) * DSP_CONVOLUTION_TILE;
+            x1 = Min(x0 + DSP_CONVOLUTION_TILE, n0);
+        }
+        long base = (long)row * n0;
+        double *out = c->out + base;
+        for(int t0 = x0; t0 < x1; t0 += DSP_CONVOLUTION_TILE) {
+            int t1 = Min(t0 + DSP_CONVOLUTION_TILE, x1);
+            for(int t = 0; t < c->tap_count; t++) {
+                const dsp_convolution_tap *tap = &c->taps[t];
+                int valid = 1;
+                for(int d = 1, r = row; d < c->dims; d++) {
+                    if(r % c->n[d] + tap->pos[d] >= c->n[d]) {
+                        valid = 0;
+                        break;
+                    }
+                    r /= c->n[d];
+                }
+                int end0 = Min(t1, n0 - tap->pos[0]);
+                if(!valid || end0 <= t0)
+                    continue;
+                const double *in = c->in + base + tap->offset;
+                double v = tap->value;
+                for(int x = t0; x < end0; x++)
+                    out[x] += v * in[x];
+            }
+        }
+    }
+}
+
+static void dsp_convolution_direct(dsp_convolution *c, const double *matrix, int matrix_len)
+{
+    c->taps = (dsp_convolution_tap*)malloc(sizeof(dsp_convolution_tap) * matrix_len);
+    int *pos = (int*)malloc(sizeof(int) * c->dims * matrix_len);
+    c->tap_count = 0;
+    for(int y = 0; y < matrix_len; y++) {
+        if(matrix[y] == 0.0)
+            continue;
+        dsp_convolution_tap *tap = &c->taps[c->tap_count];
+        tap->value = matrix[y];
+        tap->pos = pos + c->dims * c->tap_count;
+        tap->offset = 0;
+        for(int d = 0, r = y; d < c->dims; d++) {
+            tap->pos[d] = r % c->k[d];
+            r /= c->k[d];
+            tap->offset += tap->pos[d] * c->stride[d];
+        }
+        c->tap_count++;
+    }
+    c->rows = (int)(c->len / c->n[0]);
+    int units = c->rows == 1 ? (c->n[0] + DSP_CONVOLUTION_TILE - 1) / DSP_CONVOLUTION_TILE : c->rows;
+    dsp_convolution_parallel(dsp_convolution_direct_rows, c, units, (double)c->len * c->tap_count);
+    free(pos);
+    free(c->taps);
+}
+
+/*
+ * Separable method, one pass of a 1D kernel along a dimension. Units are the rows of the first dimension, or the
+ * planes of the dimension of the pass, which are contiguous.
+ */
+static void dsp_convolution_pass(dsp_convolution *c, int start, int end)
+{
+    int d = c->dim;
+    int n = c->n[d];
+    long inner = c->stride[d];
+    for(int unit = start; unit < end; unit++) {
+        if(d == 0) {
+            const double *in = c->in + (long)unit * n;
+            double *out = c->out + (long)unit * n;
+            for(int q = 0; q < c->k[0]; q++) {
+                double v = c->factor[q];
+                if(v == 0.0)
+                    continue;
+                for(int x = 0; x < n - q; x++)
+                    out[x] += v * in[x + q];
+            }
+        } else {
+            int i = unit % n;
+            double *out = c->out + (long)unit * inner;
+            for(int q = 0; q < c->k[d] && i + q < n; q++) {
+                double v = c->factor[q];
+                if(v == 0.0)
+                    continue;
+                const double *in = c->in + (long)(unit + q) * inner;
+                for(long x = 0; x < inner; x++)
+                    out[x] += v * in[x];
+            }
         }
     }
+}
+
+/*
+ * Decompose the matrix into the product of 1D kernels, one per dimension, from the lines crossing its largest
+ * element. factors receives the kernels one after another, and the first of them is scaled by that element.
+ * Returns 0 if the matrix is not separable.
+ */
+static int dsp_convolution_factorize(dsp_convolution *c, const double *matrix, int matrix_len, double *factors)
+{
+    int m = 0;
+    for(int y = 1; y < matrix_len; y++) {
+        if(fabs(matrix[y]) > fabs(matrix[m]))
+            m = y;
+    }
+    double peak = matrix[m];
+    if(peak == 0.0)
+        return 0;
+
+    long *kstride = (long*)malloc(sizeof(long) * c->dims);
+    int *mpos = (int*)malloc(sizeof(int) * c->dims);
+    double *f = factors;
+    for(int d = 0, r = m; d < c->dims; d++) {
+        kstride[d] = d > 0 ? kstride[d - 1] * c->k[d - 1] : 1;
+        mpos[d] = r % c->k[d];
+        r /= c->k[d];
+    }
+    for(int d = 0; d < c->dims; d++) {
+        for(int i = 0; i < c->k[d]; i++)
+            f[i] = matrix[m + (i - mpos[d]) * kstride[d]] / peak;
+        f += c->k[d];
+    }
+
+    int separable = 1;
+    double tolerance = fabs(peak) * 1e-9;
+    for(int y = 0; y < matrix_len && separable; y++) {
+        double v = peak;
+        f = factors;
+        for(int d = 0, r = y; d < c->dims; d++) {
+            v *= f[r % c->k[d]];
+            r /= c->k[d];
+            f += c->k[d];
+        }
+        separable = fabs(v - matrix[y]) <= tolerance;
+    }
+    for(int i = 0; i < c->k[0]; i++)
+        factors[i] *= peak;
+    free(mpos);
+    free(kstride);
+    return separable;
+}
+
+static void dsp_convolution_separable(dsp_convolution *c, const double *factors)
+{
+    double *tmp = (double*)malloc(sizeof(double) * c->len);
+    double *out = c->out;
+    const double *in = c->in;
+    double scale = 1.0;
+    int passes = 0;
+    for(int d = 0; d < c->dims; d++) {
+        if(c->k[d] > 1)
+            passes++;
+    }
+    /* Ping-pong between the buffers so that the last pass writes the output */
+    double *dst = passes % 2 ? out : tmp;
+    for(int d = 0; d < c->dims; d++) {
+        const double *factor = factors;
+        factors += c->k[d];
+        if(c->k[d] == 1) {
+            scale *= factor[0];
+            continue;
+        }
+        memset(dst, 0, sizeof(double) * c->len);
+        c->dim = d;
+        c->factor = factor;
+        c->in = in;
+        c->out = dst;
+        if(d == 0)
+            dsp_convolution_parallel(dsp_convolution_pass, c, (int)(c->len / c->n[0]), (double)c->len * c->k[d]);
+        else
+            dsp_convolution_parallel(dsp_convolution_pass, c, (int)(c->len / c->stride[d]), (double)c->len * c->k[d]);
+        in = dst;
+        dst = dst == out ? tmp : out;
+    }
+    if(passes == 0)
+        memcpy(out, in, sizeof(double) * c->len);
+    if(scale != 1.0) {
+        for(long x = 0; x < c->len; x++)
+            out[x] *= scale;
+    }
+    c->in = NULL;
+    c->out = out;
+    free(tmp);
+}
+
+/* Smallest size not lower than n with no prime factor greater than 7, FFTW transforms them fastest */
+static int dsp_convolution_fft_size(int n)
+{
+    for(;; n++) {
+        int r = n;
+        while(r % 2 == 0) r /= 2;
+        while(r % 3 == 0) r /= 3;
+        while(r % 5 == 0) r /= 5;
+        while(r % 7 == 0) r /= 7;
+        if(r == 1)
+            return n;
+    }
+}
+
+/*
+ * Block size of the overlap-add method. Blocks span the whole stream in all dimensions but the last one, where
+ * they are sized to be at least 8 times the matrix and to hold DSP_CONVOLUTION_BLOCK_MIN_LEN samples.
+ * fft receives the padded transform sizes, the function returns the number of blocks.
+ */
+static int dsp_convolution_blocks(dsp_convolution *c, int *fft, int *block)
+{
+    int last = c->dims - 1;
+    long plane = 1;
+    for(int d = 0; d < last; d++) {
+        fft[d] = dsp_convolution_fft_size(c->n[d] + c->k[d] - 1);
+        plane *= fft[d];
+    }
+    int full = dsp_convolution_fft_size(c->n[last] + c->k[last] - 1);
+    int rows = (int)Max((long)8 * c->k[last], (DSP_CONVOLUTION_BLOCK_MIN_LEN + plane - 1) / plane);
+    fft[last] = Min(full, dsp_convolution_fft_size(rows));
+    *block = fft[last] - c->k[last] + 1;
+    return (c->n[last] + *block - 1) / *block;
+}
+
+static double dsp_convolution_fft_cost(dsp_convolution *c)
+{
+    int *fft = (int*)malloc(sizeof(int) * c->dims);
+    int block;
+    int blocks = dsp_convolution_blocks(c, fft, &block);
+    double len = 1;
+    for(int d = 0; d < c->dims; d++)
+        len *= fft[d];
+    free(fft);
+    double transform = DSP_CONVOLUTION_FFT_COST * len * log2(Max(len, 2.0));
+    /* The transforms of the matrix and of each block back and forth, the products and the copies */
+    return transform * (1 + 2 * blocks) + len * 6 * blocks;
+}
+
+/*
+ * Copy the samples of a box of positions between the stream and a block, lines of the first dimension at a time.
+ * shift is added to the positions in the stream to get those in the block. The stream samples are added to the
+ * block if add is 0, the block samples are added to the stream otherwise.
+ */
+static void dsp_convolution_box(dsp_convolution *c, const int *lo, const int *hi, const int *shift,
+                                const long *block_stride, double *stream, double *block, int add)
+{
+    int *pos = (int*)malloc(sizeof(int) * c->dims);
+    for(int d = 0; d < c->dims; d++) {
+        if(lo[d] >= hi[d]) {
+            free(pos);
+            return;
+        }
+        pos[d] = lo[d];
+    }
+    int count = hi[0] - lo[0];
+    for(;;) {
+        long s = 0, b = 0;
+        for(int d = 0; d < c->dims; d++) {
+            s += pos[d] * c->stride[d];
+            b += (pos[d] + shift[d]) * block_stride[d];
+        }
+        if(add) {
+            for(int x = 0; x < count; x++)
+                stream[s + x] += block[b + x];
+        } else {
+            for(int x = 0; x < count; x++)
+                block[b + x] = stream[s + x];
+        }
+        int d = 1;
+        for(; d < c->dims; d++) {
+            if(++pos[d] < hi[d])
+                break;
+            pos[d] = lo[d];
+        }
+        if(d >= c->dims)
+            break;
+    }
+    free(pos);
+}
+
+/*
+ * FFT overlap-add method. The matrix is flipped so that the linear convolution of a block with it, shifted back by
+ * the matrix size, is the correlation of the block.
+ */
+static void dsp_convolution_fft(dsp_convolution *c, const double *matrix, int matrix_len)
+{
+    int dims = c->dims, last = dims - 1;
+    int *fft = (int*)malloc(sizeof(int) * dims);
+    int *lo = (int*)malloc(sizeof(int) * dims * 3);
+    int *hi = lo + dims, *shift = hi + dims;
+    long *fft_stride = (long*)malloc(sizeof(long) * dims);
+    int block;
+    int blocks = dsp_convolution_blocks(c, fft, &block);
+
+    dsp_stream shape;
+    memset(&shape, 0, sizeof(dsp_stream));
+    shape.dims = dims;
+    shape.sizes = fft;
+    shape.len = 1;
+    for(int d = 0; d < dims; d++) {
+        fft_stride[d] = shape.len;
+        shape.len *= fft[d];
+    }
+    shape.buf = (double*)malloc(sizeof(double) * shape.len);
+    int half = dsp_fourier_half_len(&shape);
+    dsp_complex *kernel = (dsp_complex*)malloc(sizeof(dsp_complex) * half);
+    dsp_complex *spectrum = (dsp_complex*)malloc(sizeof(dsp_complex) * half);
+
+    memset(shape.buf, 0, sizeof(double) * shape.len);
+    for(int y = 0; y < matrix_len; y++) {
+        long b = 0;
+        for(int d = 0, r = y; d < dims; d++) {
+            b += (c->k[d] - 1 - r % c->k[d]) * fft_stride[d];
+            r /= c->k[d];
+        }
+        shape.buf[b] = matrix[y];
+    }
+    dsp_fourier_r2c(&shape, kernel);
+
+    for(int b0 = 0; b0 < blocks * block; b0 += block) {
+        memset(shape.buf, 0, sizeof(double) * shape.len);
+        for(int d = 0; d < dims; d++) {
+            lo[d] = 0;
+            hi[d] = c->n[d];
+            shift[d] = 0;
+        }
+        lo[last] = b0;
+        hi[last] = Min(b0 + block, c->n[last]);
+        shift[last] = -b0;
+        dsp_convolution_box(c, lo, hi, shift, fft_stride, (double*)c->in, shape.buf, 0);
+
+        dsp_fourier_r2c(&shape, spectrum);
+        for(int x = 0; x < half; x++) {
+            double re = spectrum[x].real * kernel[x].real - spectrum[x].imaginary * kernel[x].imaginary;
+            double im = spectrum[x].real * kernel[x].imaginary + spectrum[x].imaginary * kernel[x].real;
+            spectrum[x].real = re;
+            spectrum[x].imaginary = im;
+        }
+        dsp_fourier_c2r(&shape, spectrum);
+
+        for(int d = 0; d < dims; d++)
+            shift[d] = c->k[d] - 1;
+        lo[last] = Max(0, b0 - c->k[last] + 1);
+        hi[last] = Min(c->n[last], b0 + fft[last] - c->k[last] + 1);
+        shift[last] = c->k[last] - 1 - b0;
+        dsp_convolution_box(c, lo, hi, shift, fft_stride, c->out, shape.buf, 1);
+    }
+
+    free(spectrum);
+    free(kernel);
+    free(shape.buf);
+    free(fft_stride);
+    free(lo);
+    free(fft);
+}
+
+static int dsp_convolution_select(dsp_convolution *c, const double *matrix, int matrix_len, double *factors)
+{
+    double direct = (double)c->len * matrix_len;
+    double fft = dsp_convolution_fft_cost(c);
+    double separable = direct;
+    int active = 0;
+    for(int d = 0; d < c->dims; d++)
+        active += c->k[d] > 1;
+    if(active > 1 && dsp_convolution_factorize(c, matrix, matrix_len, factors)) {
+        separable = 0;
+        for(int d = 0; d < c->dims; d++)
+            separable += (double)c->len * c->k[d];
+    }
+    if(separable < direct && separable <= fft)
+        return DSP_CONVOLUTION_SEPARABLE;
+    if(fft < direct)
+        return DSP_CONVOLUTION_FFT;
+    return DSP_CONVOLUTION_DIRECT;
+}
+
+/*
+ * Correlate a buffer of the given sizes with a matrix into out, which is cleared first. Returns -1 if the matrix
+ * has more dimensions than the buffer.
+ */
+static int dsp_convolution_buffer(const double *in, double *out, int dims, const int *sizes, int len,
+                                  const double *matrix, int matrix_dims, const int *matrix_sizes, int matrix_len,
+                                  int method)
+{
+    for(int d = dims; d < matrix_dims; d++) {
+        if(matrix_sizes[d] > 1)
+            return -1;
+    }
+    memset(out, 0, sizeof(double) * Max(len, 0));
+    if(len < 1 || matrix_len < 1)
+        return 0;
+
+    dsp_convolution c;
+    memset(&c, 0, sizeof(dsp_convolution));
+    c.dims = Max(dims, 1);
+    c.n = (int*)malloc(sizeof(int) * c.dims * 2);
+    c.k = c.n + c.dims;
+    c.stride = (long*)malloc(sizeof(long) * c.dims);
+    c.len = len;
+    for(int d = 0; d < c.dims; d++) {
+        c.n[d] = d < dims ? sizes[d] : len;
+        c.k[d] = d < matrix_dims ? matrix_sizes[d] : 1;
+        c.stride[d] = d > 0 ? c.stride[d - 1] * c.n[d - 1] : 1;
+    }
+    if(matrix_dims == 0)
+        c.k[0] = matrix_len;
+    c.in = in;
+    c.out = out;
+
+    int factors_len = 0;
+    for(int d = 0; d < c.dims; d++)
+        factors_len += c.k[d];
+    double *factors = (double*)malloc(sizeof(double) * factors_len);
+    if(method == DSP_CONVOLUTION_AUTO)
+        method = dsp_convolution_select(&c, matrix, matrix_len, factors);
+    else if(method == DSP_CONVOLUTION_SEPARABLE && !dsp_convolution_factorize(&c, matrix, matrix_len, factors))
+        method = DSP_CONVOLUTION_DIRECT;
+
+    switch(method) {
+    case DSP_CONVOLUTION_SEPARABLE:
+        dsp_convolution_separable(&c, factors);
+        break;
+    case DSP_CONVOLUTION_FFT:
+        dsp_convolution_fft(&c, matrix, matrix_len);
+        break;
+    default:
+        dsp_convolution_direct(&c, matrix, matrix_len);
+        break;
+    }
+
+    free(factors);
+    free(c.stride);
+    free(c.n);
+    return 0;
+}
+
+dsp_stream_p dsp_convolution_convolution_method(dsp_stream_p stream, dsp_stream_p matrix, int method)
+{
+    for(int d = stream->dims; d < matrix->dims; d++) {
+        if(matrix->sizes[d] > 1)
+            return NULL;
+    }
+    dsp_stream_p tmp = dsp_stream_copy(stream);
+    dsp_convolution_buffer(stream->buf, tmp->buf, stream->dims, stream->sizes, stream->len,
+                           matrix->buf, matrix->dims, matrix->sizes, matrix->len, method);
     return tmp;
 }
+
+/*
+ * One scratch buffer is kept between the convolutions of native samples, which usually run on frames of the same
+ * size. A caller finding it taken allocates its own, and the largest buffer is kept when both are given back.
+ */
+static pthread_mutex_t dsp_convolution_scratch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static double *dsp_convolution_scratch = NULL;
+static size_t dsp_convolution_scratch_len = 0;
+
+static double *dsp_convolution_scratch_take(size_t len, size_t *size)
+{
+    pthread_mutex_lock(&dsp_convolution_scratch_mutex);
+    double *scratch = dsp_convolution_scratch;
+    *size = dsp_convolution_scratch_len;
+    dsp_convolution_scratch = NULL;
+    dsp_convolution_scratch_len = 0;
+    pthread_mutex_unlock(&dsp_convolution_scratch_mutex);
+    if(*size < len) {
+        free(scratch);
+        scratch = (double*)malloc(sizeof(double) * len);
+        *size = len;
+    }
+    return scratch;
+}
+
+static void dsp_convolution_scratch_give(double *scratch, size_t size)
+{
+    pthread_mutex_lock(&dsp_convolution_scratch_mutex);
+    if(size > dsp_convolution_scratch_len) {
+        double *old = dsp_convolution_scratch;
+        dsp_convolution_scratch = scratch;
+        dsp_convolution_scratch_len = size;
+        scratch = old;
+    }
+    pthread_mutex_unlock(&dsp_convolution_scratch_mutex);
+    free(scratch);
+}
+
+int dsp_sample_convolution(const void *buf, void *out, dsp_sample_type type, int dims, int *sizes,
+                           const void *matrix, int matrix_dims, int *matrix_sizes)
+{
+    int len = 1, matrix_len = 1;
+    for(int d = 0; d < dims; d++)
+        len *= sizes[d];
+    for(int d = 0; d < matrix_dims; d++) {
+        if(d >= dims && matrix_sizes[d] > 1)
+            return -1;
+        matrix_len *= matrix_sizes[d];
+    }
+    /* Samples are converted once, the output is written straight from the result */
+    size_t size;
+    double *in = dsp_convolution_scratch_take(len + (size_t)len + matrix_len, &size);
+    double *result = in + len;
+    double *kernel = result + len;
+    dsp_sample_to_double(buf, type, len, in, NULL, NULL);
+    dsp_sample_to_double(matrix, type, matrix_len, kernel, NULL, NULL);
+    int ret = dsp_convolution_buffer(in, result, dims, sizes, len, kernel, matrix_dims, matrix_sizes, matrix_len,
+                                     DSP_CONVOLUTION_AUTO);
+    if(ret == 0)
+        dsp_sample_from_double(result, len, out, type);
+    dsp_convolution_scratch_give(in, size);
+    return ret;
+}
+
+dsp_stream_p dsp_convolution_convolution(dsp_stream_p stream, dsp_stream_p matrix) {
+    return dsp_convolution_convolution_method(stream, matrix, DSP_CONVOLUTION_AUTO);
+}
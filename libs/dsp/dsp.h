@@ -33,6 +33,7 @@ extern "C" {
 #include <math.h>
 #include <float.h>
 #include <sys/types.h>
+#include <stdint.h>
 #include <time.h>
 #include <assert.h>
 #include <pthread.h>
@@ -68,6 +69,10 @@ extern "C" {
        __typeof__ (b) _b = (b); \
      _a > _b ? _a : _b; })
 #endif
+///Maximum number of dimensions walked by a dsp_iterator
+#ifndef DSP_MAX_DIMS
+#define DSP_MAX_DIMS 16
+#endif
 ///Logarithm of a with arbitrary base b
 #ifndef Log
 #define Log(a,b) \
@@ -178,6 +183,103 @@ typedef struct dsp_stream_t
     int star_count;
 } dsp_stream, *dsp_stream_p;
 
+/**
+* \brief Types of the native sample buffers, processed without converting them to a dsp_stream
+* \sa dsp_sample_type_from_bits
+*/
+typedef enum
+{
+/// 8 bit unsigned integers
+    DSP_SAMPLE_U8 = 0,
+/// 16 bit signed integers, such as SDR I/Q samples
+    DSP_SAMPLE_S16,
+/// 16 bit unsigned integers
+    DSP_SAMPLE_U16,
+/// 32 bit unsigned integers
+    DSP_SAMPLE_U32,
+/// 64 bit unsigned integers
+    DSP_SAMPLE_U64,
+/// single precision floating point
+    DSP_SAMPLE_F32,
+/// double precision floating point
+    DSP_SAMPLE_F64,
+} dsp_sample_type;
+
+/**
+* \brief Walks the elements of a region of a dsp_stream without allocating, the first dimension varying fastest
+* \sa dsp_stream_iterator
+* \sa dsp_iterator_next
+* \sa dsp_iterator_next_row
+*/
+typedef struct dsp_iterator_t
+{
+/// Number of dimensions walked
+    int dims;
+/// Current position in each dimension of the stream
+    int pos[DSP_MAX_DIMS];
+/// First position of the region in each dimension
+    int start[DSP_MAX_DIMS];
+/// Length of the region in each dimension
+    int len[DSP_MAX_DIMS];
+/// Distance in the buffer between consecutive positions of each dimension
+    long stride[DSP_MAX_DIMS];
+/// Index in the buffer of the current position
+    long index;
+/// Non zero until the end of the region is passed
+    int valid;
+} dsp_iterator;
+
+/**
+* \brief Running Welch estimate of the power spectral density of samples fed in chunks of any length
+* \sa dsp_fourier_welch_new
+* \sa dsp_fourier_welch_add
+* \sa dsp_fourier_welch_spectrum
+*/
+typedef struct dsp_welch_t
+{
+/// Samples per segment, the length of each transform
+    int size;
+/// Samples between the starts of consecutive segments
+    int step;
+/// Bins of the one sided spectrum, size / 2 + 1
+    int bins;
+/// Hann window applied to each segment
+    double *window;
+/// Samples of the segment being filled
+    double *segment;
+/// Samples already in the segment
+    int filled;
+/// Power of each bin summed over the segments
+    double *power;
+/// Segments summed into power
+    int segments;
+/// Inverse of the sum of the squared window
+    double norm;
+} dsp_welch;
+
+/**
+* \brief A FIR filter decimating or channelizing samples fed in blocks, keeping its state between them
+* \sa dsp_filter_fir_new
+* \sa dsp_filter_channelizer_new
+*/
+typedef struct dsp_fir_t
+{
+/// Taps of the filter in reverse order, padded to a multiple of the channels
+    double *taps;
+/// Number of taps
+    int len;
+/// Input samples per output sample or frame
+    int decimation;
+/// Channels of a channelizer, 1 for a decimator
+    int channels;
+/// The last len - 1 input samples, followed by the block being filtered
+    double *history;
+/// Input samples since the last output
+    int phase;
+/// Branch sums of a channelizer frame, followed by the frames of a block
+    double *branches;
+} dsp_fir;
+
 /*@}*/
 /**
  * \defgroup dsp_FourierTransform DSP API Fourier transform related functions
@@ -234,6 +336,111 @@ DLL_EXPORT void dsp_fourier_dft_magnitude(dsp_stream_p stream);
 */
 DLL_EXPORT void dsp_fourier_dft_phase(dsp_stream_p stream);
 
+/**
+* \brief Number of complex values in the half spectrum of a real stream
+* \param stream the input stream.
+* \return the length of the half spectrum, (sizes[0] / 2 + 1) * len / sizes[0]
+*/
+DLL_EXPORT int dsp_fourier_half_len(dsp_stream_p stream);
+
+/**
+* \brief Perform a real to complex Fourier Transform of a dsp_stream, keeping only the non redundant half spectrum
+* \param stream the input stream.
+* \param out the output half spectrum, dsp_fourier_half_len() values with the first dimension varying fastest.
+*/
+DLL_EXPORT void dsp_fourier_r2c(dsp_stream_p stream, dsp_complex* out);
+
+/**
+* \brief Perform dsp_fourier_r2c() on several buffers of the sizes of a dsp_stream, looking the transform up once
+* \param stream the stream whose sizes select the transform, its buffer is not used.
+* \param in count input buffers of stream->len values, one after the other.
+* \param count the number of buffers.
+* \param out count half spectra of dsp_fourier_half_len() values, one after the other.
+*/
+DLL_EXPORT void dsp_fourier_r2c_many(dsp_stream_p stream, const double* in, int count, dsp_complex* out);
+
+/**
+* \brief Perform the inverse of dsp_fourier_r2c() into the buffer of a dsp_stream
+* \param stream the output stream, its sizes select the transform.
+* \param in the input half spectrum. The output is normalized by the stream length.
+*/
+DLL_EXPORT void dsp_fourier_c2r(dsp_stream_p stream, dsp_complex* in);
+
+/**
+* \brief Create a Welch power spectrum estimator
+* The samples are split in segments overlapping by the given fraction, each one is windowed and transformed with
+* the cached plan of its size, and the power spectra are averaged until the spectrum is read.
+* \param size the number of samples of each segment, the spectrum has size / 2 + 1 bins.
+* \param overlap the fraction of each segment shared with the next one, from 0 to 0.95.
+* \return the new estimator, or NULL if size is less than 2.
+*/
+DLL_EXPORT dsp_welch *dsp_fourier_welch_new(int size, double overlap);
+
+/**
+* \brief Add native samples to a Welch estimator
+* The samples that do not fill a segment are kept for the next call, so chunks of any length may be added.
+* \param welch the estimator.
+* \param buf the samples.
+* \param type the sample type of the buffer.
+* \param len the number of samples.
+* \return the number of segments transformed.
+*/
+DLL_EXPORT int dsp_fourier_welch_add(dsp_welch *welch, const void *buf, dsp_sample_type type, int len);
+
+/**
+* \brief Read the averaged one sided power spectral density and start a new average
+* The samples of the segment being filled are kept.
+* \param welch the estimator.
+* \param out the spectrum, welch->bins values from DC to half the sample rate.
+* \param samplerate the sample rate in Hz, the density is per Hz. 0 gives the density per bin.
+* \return the number of segments averaged. out is not written when it is 0.
+*/
+DLL_EXPORT int dsp_fourier_welch_spectrum(dsp_welch *welch, double *out, double samplerate);
+
+/**
+* \brief Drop the samples and the sums of a Welch estimator
+* \param welch the estimator.
+*/
+DLL_EXPORT void dsp_fourier_welch_reset(dsp_welch *welch);
+
+/**
+* \brief Free a Welch estimator
+* \param welch the estimator.
+*/
+DLL_EXPORT void dsp_fourier_welch_free(dsp_welch *welch);
+
+/**
+* \brief Set the number of threads of the transforms planned from now on. Only effective with threaded FFTW.
+* \param threads the number of threads.
+*/
+DLL_EXPORT void dsp_fourier_set_threads(int threads);
+
+/**
+* \brief Select how transforms are planned. Measured plans take longer to create but run faster, which pays off
+* since plans are cached and reused by all the transforms of the same sizes.
+* \param measure non zero to measure plans, zero to estimate them.
+*/
+DLL_EXPORT void dsp_fourier_set_planning(int measure);
+
+/**
+* \brief Load FFTW wisdom, so measured plans are not measured again
+* \param filename the wisdom file.
+* \return non zero on success.
+*/
+DLL_EXPORT int dsp_fourier_load_wisdom(const char *filename);
+
+/**
+* \brief Save the FFTW wisdom gathered by the measured plans
+* \param filename the wisdom file.
+* \return non zero on success.
+*/
+DLL_EXPORT int dsp_fourier_save_wisdom(const char *filename);
+
+/**
+* \brief Destroy the cached plans and their buffers
+*/
+DLL_EXPORT void dsp_fourier_cleanup();
+
 /*@}*/
 /**
  * \defgroup dsp_Filters DSP API Linear buffer filtering functions
@@ -279,18 +486,133 @@ DLL_EXPORT void dsp_filter_bandpass(dsp_stream_p stream, double samplingfrequenc
 */
 DLL_EXPORT void dsp_filter_bandreject(dsp_stream_p stream, double samplingfrequency, double LowFrequency, double HighFrequency);
 
+/**
+* \brief A sliding order statistics filter
+* Each element is replaced by the given percentile of the input elements in a window centered on it. Positions of
+* the window outside the stream take the value of the nearest edge. Windows are ranked with heaps in O(log window)
+* per sample, or with a histogram for integer streams spanning up to 256 values. Large streams are split over
+* several threads.
+* \param stream the stream on which execute
+* \param sizes the window size in each dimension of the stream.
+* \param percentile the rank in the window, from 0 (the minimum) to 100 (the maximum).
+*/
+DLL_EXPORT void dsp_filter_percentile(dsp_stream_p stream, int* sizes, double percentile);
+
+/**
+* \brief A sliding median filter
+* \param stream the stream on which execute
+* \param sizes the window size in each dimension of the stream.
+* \sa dsp_filter_percentile
+*/
+DLL_EXPORT void dsp_filter_median(dsp_stream_p stream, int* sizes);
+
+/**
+* \brief Design a low pass FIR filter, a Blackman windowed sinc with unity gain at DC
+* \param len the number of taps.
+* \param cutoff the cutoff frequency as a fraction of the sample rate, up to 0.5.
+* \return the taps, to be freed by the caller.
+*/
+DLL_EXPORT double *dsp_filter_fir_lowpass_taps(int len, double cutoff);
+
+/**
+* \brief Create a decimating FIR filter
+* Only the outputs kept by the decimation are computed. The filter keeps the last input samples, so consecutive
+* blocks are filtered as a single stream.
+* \param taps the taps of the filter, copied.
+* \param len the number of taps.
+* \param decimation the number of input samples per output sample, 1 to filter without decimating.
+* \return the new filter, or NULL if the arguments are not valid.
+* \sa dsp_filter_fir_lowpass_taps
+*/
+DLL_EXPORT dsp_fir *dsp_filter_fir_new(const double *taps, int len, int decimation);
+
+/**
+* \brief Create a polyphase channelizer
+* The band from 0 to half the sample rate is split in channels / 2 + 1 channels centered every samplerate / channels
+* Hz, each one shifted to baseband, filtered by the prototype low pass filter and decimated by the number of
+* channels.
+* \param taps the taps of the prototype filter, usually with a cutoff of 0.5 / channels, copied.
+* \param len the number of taps.
+* \param channels the number of channels of the whole band, at least 2.
+* \return the new channelizer, or NULL if the arguments are not valid.
+*/
+DLL_EXPORT dsp_fir *dsp_filter_channelizer_new(const double *taps, int len, int channels);
+
+/**
+* \brief Filter and decimate a block of native samples
+* \param fir the filter.
+* \param in the input samples.
+* \param type the sample type of the input.
+* \param len the number of input samples.
+* \param out the output samples, up to len / decimation + 1 values.
+* \return the number of output samples.
+*/
+DLL_EXPORT int dsp_filter_fir_decimate(dsp_fir *fir, const void *in, dsp_sample_type type, int len, double *out);
+
+/**
+* \brief Channelize a block of native samples
+* \param fir the channelizer.
+* \param in the input samples.
+* \param type the sample type of the input.
+* \param len the number of input samples.
+* \param out the output frames of channels / 2 + 1 complex samples each, up to len / channels + 1 frames.
+* \return the number of output frames.
+*/
+DLL_EXPORT int dsp_filter_fir_channelize(dsp_fir *fir, const void *in, dsp_sample_type type, int len, dsp_complex *out);
+
+/**
+* \brief Clear the state of a FIR filter, the next block starts a new stream
+* \param fir the filter.
+*/
+DLL_EXPORT void dsp_filter_fir_reset(dsp_fir *fir);
+
+/**
+* \brief Free a FIR filter
+* \param fir the filter.
+*/
+DLL_EXPORT void dsp_filter_fir_free(dsp_fir *fir);
+
 /*@}*/
 /**
  * \defgroup dsp_Convolution DSP API Convolution and cross-correlation functions
 */
 /*@{*/
+/**
+* \brief Methods of dsp_convolution_convolution_method()
+*/
+typedef enum
+{
+/// Pick the cheapest method for the sizes of the stream and of the matrix
+    DSP_CONVOLUTION_AUTO = 0,
+/// Multiply-add every non zero element of the matrix, best for small matrices
+    DSP_CONVOLUTION_DIRECT,
+/// One 1D pass per dimension, only for matrices that are the product of 1D kernels
+    DSP_CONVOLUTION_SEPARABLE,
+/// FFT overlap-add over blocks of the last dimension, best for large matrices
+    DSP_CONVOLUTION_FFT,
+} dsp_convolution_method;
+
 /**
 * \brief A cross-convolution processor
+* Each output element is the sum of the matrix elements multiplied by the stream elements at the same offset
+* from it, samples outside the stream count as zero in every dimension. The method is picked automatically.
 * \param stream1 the first input stream.
-* \param stream2 the second input stream.
+* \param stream2 the second input stream, the matrix.
+* \return a new stream of the size of the first one, or NULL if the matrix has more dimensions than it
+* \sa dsp_convolution_convolution_method
 */
 DLL_EXPORT dsp_stream_p dsp_convolution_convolution(dsp_stream_p stream1, dsp_stream_p stream2);
 
+/**
+* \brief A cross-convolution processor using the given method
+* Large streams are processed by several threads, falls back to the direct method when the matrix is not separable.
+* \param stream1 the first input stream.
+* \param stream2 the second input stream, the matrix.
+* \param method one of dsp_convolution_method.
+* \return a new stream of the size of the first one, or NULL if the matrix has more dimensions than it
+*/
+DLL_EXPORT dsp_stream_p dsp_convolution_convolution_method(dsp_stream_p stream1, dsp_stream_p stream2, int method);
+
 /*@}*/
 /**
  * \defgroup dsp_Stats DSP API Buffer statistics functions
@@ -431,9 +753,28 @@ DLL_EXPORT dsp_stream_p dsp_convolution_convolution(dsp_stream_p stream1, dsp_st
 * \param size the length of the median.
 * \return the output stream if successfull elaboration. NULL if an
 * error is encountered.
+* Values are counted in a single pass, large streams are split over several threads.
 */
 DLL_EXPORT double* dsp_stats_histogram(dsp_stream_p stream, int size);
 
+/**
+* \brief Histogram of an 8 bit buffer, same as dsp_stats_histogram() without converting it to a stream first
+* \param buf the input buffer
+* \param len the length in elements of the buffer.
+* \param size the number of bins.
+* \return the histogram, to be freed by the caller.
+*/
+DLL_EXPORT double* dsp_stats_histogram_u8(const uint8_t* buf, int len, int size);
+
+/**
+* \brief Histogram of a 16 bit buffer, same as dsp_stats_histogram() without converting it to a stream first
+* \param buf the input buffer
+* \param len the length in elements of the buffer.
+* \param size the number of bins.
+* \return the histogram, to be freed by the caller.
+*/
+DLL_EXPORT double* dsp_stats_histogram_u16(const uint16_t* buf, int len, int size);
+
 /*@}*/
 /**
  * \defgroup dsp_Buffers DSP API Buffer editing functions
@@ -596,9 +937,12 @@ DLL_EXPORT void dsp_buffer_log1(dsp_stream_p stream, double val);
 
 /**
 * \brief Median elements of the inut stream
+* The buffer is filtered as a single row, each element from the size elements ending with the one after it, and the
+* first size / 2 + size % 2 elements are left unchanged.
 * \param stream the stream on which execute
 * \param size the length of the median.
 * \param median the location of the median value.
+* \sa dsp_filter_percentile
 */
 DLL_EXPORT void dsp_buffer_median(dsp_stream_p stream, int size, int median);
 
@@ -657,6 +1001,121 @@ DLL_EXPORT void dsp_buffer_deviate(dsp_stream_p stream, double* deviation, doubl
     })
 #endif
 
+/*@}*/
+/**
+ * \defgroup dsp_Samples DSP API Native sample buffer functions
+*
+* Capture buffers of 8, 16, 32 or 64 bit integers or floating point samples are processed as they are, converted
+* on the fly where double precision is needed, instead of being copied to a dsp_stream and back.<br>
+* Conversions to integer samples clamp to their range.
+*/
+/*@{*/
+
+/**
+* \brief Sample type of a buffer by its bits per sample, positive for unsigned integers and negative for floating
+* point as with FITS, 16 bits being unsigned.
+* \param bits_per_sample 8, 16, 32, 64, -32 or -64.
+* \return the dsp_sample_type, or -1 if unsupported.
+*/
+DLL_EXPORT int dsp_sample_type_from_bits(int bits_per_sample);
+
+/**
+* \brief Size in bytes of a sample
+* \param type the sample type.
+* \return the size of a sample.
+*/
+DLL_EXPORT int dsp_sample_size(dsp_sample_type type);
+
+/**
+* \brief Convert native samples to double precision
+* \param buf the input buffer.
+* \param type the sample type of the input buffer.
+* \param len the length in elements of the buffer.
+* \param out the output buffer.
+* \param min if not NULL with max, receives the minimum value.
+* \param max if not NULL with min, receives the maximum value.
+*/
+DLL_EXPORT void dsp_sample_to_double(const void *buf, dsp_sample_type type, int len, double *out, double *min, double *max);
+
+/**
+* \brief Convert double precision values to native samples, clamped to their range
+* \param in the input buffer.
+* \param len the length in elements of the buffer.
+* \param buf the output buffer.
+* \param type the sample type of the output buffer.
+*/
+DLL_EXPORT void dsp_sample_from_double(const double *in, int len, void *buf, dsp_sample_type type);
+
+/**
+* \brief Convert double precision values multiplied by scale plus offset to native samples, clamped to their range
+* \param in the input buffer.
+* \param len the length in elements of the buffer.
+* \param buf the output buffer.
+* \param type the sample type of the output buffer.
+* \param scale the factor applied to the values.
+* \param offset the value added after scaling.
+*/
+DLL_EXPORT void dsp_sample_from_double_scaled(const double *in, int len, void *buf, dsp_sample_type type, double scale, double offset);
+
+/**
+* \brief Stretch double precision values to a range and convert them to native samples, in a single pass
+* \param in the input buffer, unchanged.
+* \param len the length in elements of the buffer.
+* \param buf the output buffer.
+* \param type the sample type of the output buffer.
+* \param lo the output minimum.
+* \param hi the output maximum.
+* \sa dsp_buffer_stretch
+*/
+DLL_EXPORT void dsp_sample_stretch_from_double(const double *in, int len, void *buf, dsp_sample_type type, double lo, double hi);
+
+/**
+* \brief Fill a native buffer with white noise over the range of integer samples, or from 0 to 1
+* \param buf the output buffer.
+* \param type the sample type of the output buffer.
+* \param len the length in elements of the buffer.
+* \sa dsp_signals_whitenoise
+*/
+DLL_EXPORT void dsp_sample_whitenoise(void *buf, dsp_sample_type type, int len);
+
+/**
+* \brief Histogram of native samples, same as dsp_stats_histogram() without converting them to a stream first
+* \param buf the input buffer.
+* \param type the sample type of the input buffer.
+* \param len the length in elements of the buffer.
+* \param size the number of bins.
+* \return the histogram, to be freed by the caller.
+*/
+DLL_EXPORT double* dsp_sample_histogram(const void *buf, dsp_sample_type type, int len, int size);
+
+/**
+* \brief Magnitude of the Fourier transform of native samples, same as dsp_fourier_dft_magnitude()
+* The samples are converted straight into the transform input, and the magnitudes are clamped to the range of the
+* sample type. out may be the input buffer.
+* \param buf the input buffer.
+* \param out the output buffer, of the same type and length.
+* \param type the sample type of the buffers.
+* \param dims the number of dimensions.
+* \param sizes the size of each dimension, the first one varying fastest.
+*/
+DLL_EXPORT void dsp_sample_fourier_magnitude(const void *buf, void *out, dsp_sample_type type, int dims, int *sizes);
+
+/**
+* \brief Convolution of native samples, same as dsp_convolution_convolution()
+* The results are clamped to the range of the samples. out may be the input buffer.
+* \param buf the input buffer.
+* \param out the output buffer, of the same type and length.
+* \param type the sample type of the buffers and of the matrix.
+* \param dims the number of dimensions of the input.
+* \param sizes the size of each dimension of the input.
+* \param matrix the matrix buffer.
+* \param matrix_dims the number of dimensions of the matrix, not more than dims.
+* \param matrix_sizes the size of each dimension of the matrix.
+* \return 0 on success, -1 if the matrix has more dimensions than the input.
+*/
+DLL_EXPORT int dsp_sample_convolution(const void *buf, void *out, dsp_sample_type type, int dims, int *sizes,
+                                      const void *matrix, int matrix_dims, int *matrix_sizes);
+
 /*@}*/
 /**
  * \defgroup dsp_DSPStream DSP API Stream type management functions
@@ -780,6 +1239,63 @@ DLL_EXPORT int dsp_stream_set_position(dsp_stream_p stream, int *pos);
 */
 DLL_EXPORT int* dsp_stream_get_position(dsp_stream_p stream, int index);
 
+/**
+* \brief Fill the multidimensional positional indexes of a linear index, without allocating
+* \param stream the target DSP stream.
+* \param index the position of the index on a single dimension.
+* \param pos receives the position of the index on each dimension, stream->dims values.
+* \sa dsp_stream_get_position
+*/
+DLL_EXPORT void dsp_stream_position(dsp_stream_p stream, int index, int *pos);
+
+/**
+* \brief Start walking a region of a DSP stream
+* \param stream the target DSP stream.
+* \param region the region of each dimension, clipped to the stream. NULL walks the whole stream.
+* \param it the iterator to initialize, valid is 0 if the region is empty.
+* \return 0 on success, -1 if the stream has more than DSP_MAX_DIMS dimensions.
+* \sa dsp_iterator_next
+* \sa dsp_iterator_next_row
+*/
+DLL_EXPORT int dsp_stream_iterator(dsp_stream_p stream, dsp_region *region, dsp_iterator *it);
+
+/**
+* \brief Move an iterator to the next row of its region, the rows of the first dimension are contiguous
+* in the buffer and it->len[0] elements long, so they can be processed at once.
+* \param it the iterator.
+* \return the valid field of the iterator.
+*/
+static inline int dsp_iterator_next_row(dsp_iterator *it)
+{
+    int dim;
+    it->index -= (long)(it->pos[0] - it->start[0]) * it->stride[0];
+    it->pos[0] = it->start[0];
+    for(dim = 1; dim < it->dims; dim++) {
+        it->index += it->stride[dim];
+        if(++it->pos[dim] < it->start[dim] + it->len[dim])
+            return it->valid;
+        it->index -= (long)it->len[dim] * it->stride[dim];
+        it->pos[dim] = it->start[dim];
+    }
+    it->valid = 0;
+    return 0;
+}
+
+/**
+* \brief Move an iterator to the next element of its region
+* \param it the iterator.
+* \return the valid field of the iterator.
+*/
+static inline int dsp_iterator_next(dsp_iterator *it)
+{
+    if(++it->pos[0] < it->start[0] + it->len[0]) {
+        it->index += it->stride[0];
+        return it->valid;
+    }
+    it->pos[0]--;
+    return dsp_iterator_next_row(it);
+}
+
 /**
 * \brief Execute the function callback pointed by the func field of the passed stream
 * \param stream the target DSP stream.
@@ -792,12 +1308,32 @@ DLL_EXPORT void *dsp_stream_exec(dsp_stream_p stream);
 
 /**
 * \brief Crop the buffers of the stream passed as argument by reading the ROI field.
+* The ROI of each dimension is clipped to the stream, it covers the whole dimension after dsp_stream_add_dim().
 * \param stream the target DSP stream.
-* \return the cropped DSP stream.
+* \return the cropped DSP stream, NULL if the stream has no dimensions or the ROI is empty.
 * \sa dsp_stream_new
+* \sa dsp_stream_copy_region
 */
 DLL_EXPORT dsp_stream_p dsp_stream_crop(dsp_stream_p stream);
 
+/**
+* \brief Copy a region of a stream into another stream, a row at a time
+* \param dest the destination DSP stream, with as many dimensions as the source.
+* \param pos the position of the region in the destination, NULL for the origin.
+* \param src the source DSP stream.
+* \param region the region of each dimension of the source, NULL for the whole source.
+* The region is clipped to both streams.
+*/
+DLL_EXPORT void dsp_stream_copy_region(dsp_stream_p dest, int *pos, dsp_stream_p src, dsp_region *region);
+
+/**
+* \brief Resample a stream to new sizes with linear interpolation along each dimension, bilinear on images
+* \param stream the source DSP stream.
+* \param sizes the size of each dimension of the result.
+* \return the resampled DSP stream, NULL if the stream has no dimensions.
+*/
+DLL_EXPORT dsp_stream_p dsp_stream_resample(dsp_stream_p stream, int *sizes);
+
 /*@}*/
 /**
  * \defgroup dsp_SignalGen DSP API Signal generation functions
@@ -851,10 +1387,36 @@ DLL_EXPORT void dsp_modulation_frequency(dsp_stream_p stream, double samplefreq,
 */
 DLL_EXPORT void dsp_modulation_amplitude(dsp_stream_p stream, double samplefreq, double freq);
 
-DLL_EXPORT dsp_stream_p dsp_find_object(dsp_stream_p stream, dsp_stream_p object, int steps);
+/**
+* \brief Locate an object in a stream at any rotation
+* The object is rotated by steps angles evenly spread over a turn around its center, and the cross-correlations
+* of the stream with each rotation are summed.
+* \param stream the DSP stream to search.
+* \param object the object, with at least 2 dimensions and no more than the stream.
+* \param steps the number of rotations.
+* \return a new stream of the size of the first one, peaking where the first element of the object matches, or
+* NULL if the arguments are not valid.
+* \sa dsp_convolution_convolution
+*/
+DLL_EXPORT dsp_stream_p dsp_align_find_object(dsp_stream_p stream, dsp_stream_p object, int steps);
 
-DLL_EXPORT dsp_stream_p dsp_stream_rotate(dsp_stream_p stream, double *degrees, double *pivot);
+/**
+* \brief Rotate the planes of the first two dimensions of a stream, with bilinear interpolation
+* \param stream the source DSP stream, with at least 2 dimensions.
+* \param radians the rotation angle, only radians[0] is used.
+* \param pivot the center of the rotation in the first two dimensions.
+* \return the rotated DSP stream of the same sizes, zero where no source element maps, or NULL if the stream
+* has less than 2 dimensions.
+*/
+DLL_EXPORT dsp_stream_p dsp_stream_rotate(dsp_stream_p stream, double *radians, double *pivot);
 
+/**
+* \brief Scale all the dimensions of a stream by the same ratio
+* \param stream the source DSP stream.
+* \param ratio the scale factor, sizes are truncated and at least 1.
+* \return the scaled DSP stream, NULL if the stream has no dimensions.
+* \sa dsp_stream_resample
+*/
 DLL_EXPORT dsp_stream_p dsp_stream_scale(dsp_stream_p stream, double ratio);
 
 /*@}*/
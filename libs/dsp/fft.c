@@ -53,45 +53,509 @@ double* dsp_fourier_complex_array_get_phase(dsp_complex* in, int len)
     return out;
 }
 
+/*
+ * Plans are expensive to create, so they are cached by direction and sizes and reused by the following transforms
+ * of the same shape. The least recently used plan that is not running is destroyed when the cache is full. The
+ * cache and the planner are guarded by a single mutex, since the FFTW planner is not thread safe. Transforms only
+ * hold the mutex to find their plan and take a reference on it, then run on their own aligned buffers with the
+ * new-array execute functions, which may be called from several threads at once.
+ *
+ * Real input uses r2c transforms, which take half the time and memory of a complex transform. FFTW stores arrays
+ * in row-major order, so the dsp sizes, whose first dimension varies fastest, are passed in reverse order.
+ */
+#define DSP_FOURIER_CACHE_SIZE 16
+/* Transforms smaller than this run on a single thread */
+#define DSP_FOURIER_THREADS_MIN_LEN 65536
+
+typedef enum
+{
+    DSP_FOURIER_R2C,
+    DSP_FOURIER_C2R
+} dsp_fourier_direction;
+
+typedef struct dsp_fourier_plan_t
+{
+    dsp_fourier_direction direction;
+    int dims;
+    int *sizes;
+    /* real samples and complex samples of the half spectrum */
+    int len;
+    int half_len;
+    double *real;
+    fftw_complex *complex;
+    fftw_plan plan;
+    /* transforms running the plan, and whether it was dropped from the cache meanwhile */
+    int users;
+    int detached;
+    struct dsp_fourier_plan_t *next;
+} dsp_fourier_plan;
+
+static pthread_mutex_t dsp_fourier_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dsp_fourier_plan *dsp_fourier_plans = NULL;
+static int dsp_fourier_plan_count = 0;
+#ifdef HAVE_FFTW3_THREADS
+static int dsp_fourier_threads = 1;
+#endif
+static unsigned dsp_fourier_flags = FFTW_ESTIMATE;
+
+static void dsp_fourier_plan_free(dsp_fourier_plan *p)
+{
+    fftw_destroy_plan(p->plan);
+    fftw_free(p->real);
+    fftw_free(p->complex);
+    free(p->sizes);
+    free(p);
+}
+
+static void dsp_fourier_plans_flush()
+{
+    while(dsp_fourier_plans != NULL) {
+        dsp_fourier_plan *next = dsp_fourier_plans->next;
+        /* Running plans are freed by their last user */
+        if(dsp_fourier_plans->users > 0)
+            dsp_fourier_plans->detached = 1;
+        else
+            dsp_fourier_plan_free(dsp_fourier_plans);
+        dsp_fourier_plans = next;
+    }
+    dsp_fourier_plan_count = 0;
+}
+
+/* Find or create the plan of a stream shape, called with the mutex locked */
+static dsp_fourier_plan *dsp_fourier_plan_get(dsp_stream_p stream, dsp_fourier_direction direction)
+{
+    dsp_fourier_plan *p, *prev = NULL;
+    for(p = dsp_fourier_plans; p != NULL; prev = p, p = p->next) {
+        if(p->direction == direction && p->dims == stream->dims &&
+           !memcmp(p->sizes, stream->sizes, sizeof(int) * stream->dims))
+            break;
+    }
+
+    if(p != NULL) {
+        /* Most recently used first */
+        if(prev != NULL) {
+            prev->next = p->next;
+            p->next = dsp_fourier_plans;
+            dsp_fourier_plans = p;
+        }
+        return p;
+    }
+
+    p = (dsp_fourier_plan*)malloc(sizeof(dsp_fourier_plan));
+    p->direction = direction;
+    p->dims = stream->dims;
+    p->sizes = (int*)malloc(sizeof(int) * stream->dims);
+    memcpy(p->sizes, stream->sizes, sizeof(int) * stream->dims);
+    p->len = stream->len;
+    p->half_len = stream->len / stream->sizes[0] * (stream->sizes[0] / 2 + 1);
+    p->real = fftw_alloc_real(p->len);
+    p->complex = fftw_alloc_complex(p->half_len);
+    p->users = 0;
+    p->detached = 0;
+
+    int* n = (int*)malloc(sizeof(int) * stream->dims);
+    for(int dim = 0; dim < stream->dims; dim++)
+        n[dim] = stream->sizes[stream->dims - 1 - dim];
+#ifdef HAVE_FFTW3_THREADS
+    fftw_plan_with_nthreads(p->len >= DSP_FOURIER_THREADS_MIN_LEN ? dsp_fourier_threads : 1);
+#endif
+    if(direction == DSP_FOURIER_R2C)
+        p->plan = fftw_plan_dft_r2c(p->dims, n, p->real, p->complex, dsp_fourier_flags);
+    else
+        p->plan = fftw_plan_dft_c2r(p->dims, n, p->complex, p->real, dsp_fourier_flags);
+    free(n);
+
+    if(dsp_fourier_plan_count >= DSP_FOURIER_CACHE_SIZE) {
+        /* The cache grows past its size while all plans are running */
+        dsp_fourier_plan *last = NULL, *last_prev = NULL, *q;
+        for(q = dsp_fourier_plans, prev = NULL; q != NULL; prev = q, q = q->next) {
+            if(q->users == 0) {
+                last = q;
+                last_prev = prev;
+            }
+        }
+        if(last != NULL) {
+            if(last_prev != NULL)
+                last_prev->next = last->next;
+            else
+                dsp_fourier_plans = last->next;
+            dsp_fourier_plan_free(last);
+            dsp_fourier_plan_count--;
+        }
+    }
+    p->next = dsp_fourier_plans;
+    dsp_fourier_plans = p;
+    dsp_fourier_plan_count++;
+    return p;
+}
+
+/* Find or create the plan of a stream shape and take a reference on it, so it can run unlocked */
+static dsp_fourier_plan *dsp_fourier_plan_acquire(dsp_stream_p stream, dsp_fourier_direction direction)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    dsp_fourier_plan *p = dsp_fourier_plan_get(stream, direction);
+    p->users++;
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+    return p;
+}
+
+static void dsp_fourier_plan_release(dsp_fourier_plan *p)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    if(--p->users == 0 && p->detached)
+        dsp_fourier_plan_free(p);
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+}
+
+/* New-array execution needs buffers aligned like the planning buffers, which come from fftw_malloc */
+static int dsp_fourier_aligned(const void *buf)
+{
+    return fftw_alignment_of((double*)buf) == 0;
+}
+
+/* Run the forward transform of the stream into complex, which holds the half spectrum */
+static void dsp_fourier_forward(dsp_fourier_plan *p, dsp_stream_p stream, fftw_complex *complex)
+{
+    /* r2c transforms preserve their input */
+    if(dsp_fourier_aligned(stream->buf)) {
+        fftw_execute_dft_r2c(p->plan, stream->buf, complex);
+        return;
+    }
+    double *real = fftw_alloc_real(p->len);
+    memcpy(real, stream->buf, sizeof(double) * p->len);
+    fftw_execute_dft_r2c(p->plan, real, complex);
+    fftw_free(real);
+}
+
+/*
+ * Index in the half spectrum of the row mirrored through the origin, whose conjugate values are the missing
+ * half of the given row.
+ */
+static int dsp_fourier_mirror_row(dsp_fourier_plan *p, int row)
+{
+    int mirror = 0, m = 1;
+    for(int dim = 1; dim < p->dims; dim++) {
+        int pos = row % p->sizes[dim];
+        row /= p->sizes[dim];
+        mirror += m * ((p->sizes[dim] - pos) % p->sizes[dim]);
+        m *= p->sizes[dim];
+    }
+    return mirror;
+}
+
+void dsp_fourier_set_threads(int threads)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+#ifdef HAVE_FFTW3_THREADS
+    static int initialized = 0;
+    if(!initialized)
+        initialized = fftw_init_threads();
+    if(initialized && threads != dsp_fourier_threads) {
+        dsp_fourier_threads = Max(threads, 1);
+        dsp_fourier_plans_flush();
+    }
+#else
+    (void)threads;
+#endif
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+}
+
+void dsp_fourier_set_planning(int measure)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    unsigned flags = measure ? FFTW_MEASURE : FFTW_ESTIMATE;
+    if(flags != dsp_fourier_flags) {
+        dsp_fourier_flags = flags;
+        dsp_fourier_plans_flush();
+    }
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+}
+
+int dsp_fourier_load_wisdom(const char *filename)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    int ret = fftw_import_wisdom_from_filename(filename);
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+    return ret;
+}
+
+int dsp_fourier_save_wisdom(const char *filename)
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    int ret = fftw_export_wisdom_to_filename(filename);
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+    return ret;
+}
+
+void dsp_fourier_cleanup()
+{
+    pthread_mutex_lock(&dsp_fourier_mutex);
+    dsp_fourier_plans_flush();
+    pthread_mutex_unlock(&dsp_fourier_mutex);
+}
+
+int dsp_fourier_half_len(dsp_stream_p stream)
+{
+    return stream->len / stream->sizes[0] * (stream->sizes[0] / 2 + 1);
+}
+
+void dsp_fourier_r2c(dsp_stream_p stream, dsp_complex* out)
+{
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(stream, DSP_FOURIER_R2C);
+    /* dsp_complex has the layout of fftw_complex */
+    if(dsp_fourier_aligned(out)) {
+        dsp_fourier_forward(p, stream, (fftw_complex*)out);
+    } else {
+        fftw_complex *complex = fftw_alloc_complex(p->half_len);
+        dsp_fourier_forward(p, stream, complex);
+        memcpy(out, complex, sizeof(dsp_complex) * p->half_len);
+        fftw_free(complex);
+    }
+    dsp_fourier_plan_release(p);
+}
+
+void dsp_fourier_r2c_many(dsp_stream_p stream, const double* in, int count, dsp_complex* out)
+{
+    if(count < 1)
+        return;
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(stream, DSP_FOURIER_R2C);
+    /* Buffers are only copied when they are not aligned like the planning buffers */
+    double *real = NULL;
+    fftw_complex *complex = NULL;
+    for(int i = 0; i < count; i++) {
+        double *src = (double*)in + (size_t)i * p->len;
+        fftw_complex *dst = (fftw_complex*)(out + (size_t)i * p->half_len);
+        if(!dsp_fourier_aligned(src)) {
+            if(real == NULL)
+                real = fftw_alloc_real(p->len);
+            memcpy(real, src, sizeof(double) * p->len);
+            src = real;
+        }
+        if(dsp_fourier_aligned(dst)) {
+            fftw_execute_dft_r2c(p->plan, src, dst);
+            continue;
+        }
+        if(complex == NULL)
+            complex = fftw_alloc_complex(p->half_len);
+        fftw_execute_dft_r2c(p->plan, src, complex);
+        memcpy(dst, complex, sizeof(dsp_complex) * p->half_len);
+    }
+    dsp_fourier_plan_release(p);
+    fftw_free(real);
+    fftw_free(complex);
+}
+
+void dsp_fourier_c2r(dsp_stream_p stream, dsp_complex* in)
+{
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(stream, DSP_FOURIER_C2R);
+    /* c2r plans overwrite their input */
+    fftw_complex *complex = fftw_alloc_complex(p->half_len);
+    memcpy(complex, in, sizeof(dsp_complex) * p->half_len);
+    double *real = dsp_fourier_aligned(stream->buf) ? stream->buf : fftw_alloc_real(p->len);
+    fftw_execute_dft_c2r(p->plan, complex, real);
+    double scale = 1.0 / p->len;
+    for(int x = 0; x < p->len; x++)
+        stream->buf[x] = real[x] * scale;
+    if(real != stream->buf)
+        fftw_free(real);
+    fftw_free(complex);
+    dsp_fourier_plan_release(p);
+}
+
 dsp_complex* dsp_fourier_dft(dsp_stream_p stream)
 {
-    dsp_complex* dft = (dsp_complex*)malloc(sizeof(dsp_complex) * stream->len);
     dsp_complex* out = (dsp_complex*)malloc(sizeof(dsp_complex) * stream->len);
-    fftw_plan plan = fftw_plan_dft(stream->dims, stream->sizes, (fftw_complex*)dft, (fftw_complex*)out, -1, FFTW_ESTIMATE);
-    for (int x=0; x<stream->len; x++) {
-        dft[x].real = stream->buf[x];
-        dft[x].imaginary = 0;
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(stream, DSP_FOURIER_R2C);
+    fftw_complex *complex = fftw_alloc_complex(p->half_len);
+    dsp_fourier_forward(p, stream, complex);
+    int width = p->sizes[0], half = width / 2 + 1, rows = p->len / width;
+    for(int row = 0; row < rows; row++) {
+        const fftw_complex *src = complex + (size_t)row * half;
+        const fftw_complex *mirror = complex + (size_t)dsp_fourier_mirror_row(p, row) * half;
+        dsp_complex *dst = out + (size_t)row * width;
+        for(int x = 0; x < half; x++) {
+            dst[x].real = src[x][0];
+            dst[x].imaginary = src[x][1];
+        }
+        for(int x = half; x < width; x++) {
+            dst[x].real = mirror[width - x][0];
+            dst[x].imaginary = -mirror[width - x][1];
+        }
     }
-    fftw_execute(plan);
-    fftw_free(plan);
-    free(dft);
+    fftw_free(complex);
+    dsp_fourier_plan_release(p);
     return out;
 }
 
 void dsp_fourier_dft_magnitude(dsp_stream_p stream)
 {
-    double mn = dsp_stats_min(stream->buf, stream->len);
-    double mx = dsp_stats_min(stream->buf, stream->len);
-    (void)mn;
-    (void)mx;
-    dsp_complex* dft = dsp_fourier_dft(stream);
-    double* mag = dsp_fourier_complex_array_get_magnitude(dft, stream->len);
-    dsp_buffer_stretch(mag, stream->len, mn, mx);
-    free(dft);
-    dsp_buffer_copy(mag, stream->buf, stream->len);
-    free(mag);
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(stream, DSP_FOURIER_R2C);
+    fftw_complex *complex = fftw_alloc_complex(p->half_len);
+    dsp_fourier_forward(p, stream, complex);
+    int width = p->sizes[0], half = width / 2 + 1, rows = p->len / width;
+    for(int row = 0; row < rows; row++) {
+        const fftw_complex *src = complex + (size_t)row * half;
+        const fftw_complex *mirror = complex + (size_t)dsp_fourier_mirror_row(p, row) * half;
+        double *dst = stream->buf + (size_t)row * width;
+        for(int x = 0; x < half; x++)
+            dst[x] = sqrt(src[x][0] * src[x][0] + src[x][1] * src[x][1]);
+        for(int x = half; x < width; x++)
+            dst[x] = sqrt(mirror[width - x][0] * mirror[width - x][0] + mirror[width - x][1] * mirror[width - x][1]);
+    }
+    fftw_free(complex);
+    dsp_fourier_plan_release(p);
+}
+
+void dsp_sample_fourier_magnitude(const void *buf, void *out, dsp_sample_type type, int dims, int *sizes)
+{
+    dsp_stream shape;
+    memset(&shape, 0, sizeof(dsp_stream));
+    shape.dims = dims;
+    shape.sizes = sizes;
+    shape.len = 1;
+    for(int dim = 0; dim < dims; dim++)
+        shape.len *= sizes[dim];
+    if(dims < 1 || shape.len < 1)
+        return;
+    int size = dsp_sample_size(type);
+
+    dsp_fourier_plan *p = dsp_fourier_plan_acquire(&shape, DSP_FOURIER_R2C);
+    /* The samples go straight to the transform input */
+    double *real = fftw_alloc_real(p->len);
+    fftw_complex *complex = fftw_alloc_complex(p->half_len);
+    dsp_sample_to_double(buf, type, p->len, real, NULL, NULL);
+    fftw_execute_dft_r2c(p->plan, real, complex);
+    fftw_free(real);
+
+    int width = p->sizes[0], half = width / 2 + 1, rows = p->len / width;
+    double *line = (double*)malloc(sizeof(double) * width);
+    for(int row = 0; row < rows; row++) {
+        const fftw_complex *src = complex + (size_t)row * half;
+        const fftw_complex *mirror = complex + (size_t)dsp_fourier_mirror_row(p, row) * half;
+        for(int x = 0; x < half; x++)
+            line[x] = sqrt(src[x][0] * src[x][0] + src[x][1] * src[x][1]);
+        for(int x = half; x < width; x++)
+            line[x] = sqrt(mirror[width - x][0] * mirror[width - x][0] + mirror[width - x][1] * mirror[width - x][1]);
+        dsp_sample_from_double(line, width, (char*)out + (size_t)row * width * size, type);
+    }
+    dsp_fourier_plan_release(p);
+    free(line);
+    fftw_free(complex);
 }
 
 void dsp_fourier_dft_phase(dsp_stream_p stream)
 {
-    double mn = dsp_stats_min(stream->buf, stream->len);
-    double mx = dsp_stats_min(stream->buf, stream->len);
-    (void)mn;
-    (void)mx;
     dsp_complex* dft = dsp_fourier_dft(stream);
-    double* phi = dsp_fourier_complex_array_get_phase(dft, stream->len);
-    dsp_buffer_stretch(phi, stream->len, mn, mx);
+    for(int x = 0; x < stream->len; x++)
+        stream->buf[x] = dsp_fourier_complex_get_phase(dft[x]);
     free(dft);
-    dsp_buffer_copy(phi, stream->buf, stream->len);
-    free(phi);
+}
+
+/*
+ * Welch averaging: segments start every step samples, so consecutive segments share size - step samples. The
+ * overlap stays at the start of the segment buffer once a segment is transformed, and the following samples are
+ * appended to it.
+ */
+dsp_welch *dsp_fourier_welch_new(int size, double overlap)
+{
+    if(size < 2)
+        return NULL;
+    dsp_welch *welch = (dsp_welch*)malloc(sizeof(dsp_welch));
+    welch->size = size;
+    welch->step = Max(1, (int)round(size * (1.0 - Min(Max(overlap, 0.0), 0.95))));
+    welch->bins = size / 2 + 1;
+    welch->window = (double*)malloc(sizeof(double) * size);
+    welch->segment = (double*)malloc(sizeof(double) * size);
+    welch->power = (double*)calloc(welch->bins, sizeof(double));
+    welch->filled = 0;
+    welch->segments = 0;
+    /* Periodic Hann window, whose 50% overlapped segments add up to a constant */
+    double sum = 0;
+    for(int x = 0; x < size; x++) {
+        welch->window[x] = 0.5 - 0.5 * cos(2.0 * M_PI * x / size);
+        sum += welch->window[x] * welch->window[x];
+    }
+    welch->norm = 1.0 / sum;
+    return welch;
+}
+
+int dsp_fourier_welch_add(dsp_welch *welch, const void *buf, dsp_sample_type type, int len)
+{
+    const char *in = (const char*)buf;
+    int sample_size = dsp_sample_size(type);
+    int transformed = 0;
+    dsp_stream shape;
+    memset(&shape, 0, sizeof(dsp_stream));
+    shape.dims = 1;
+    shape.sizes = &welch->size;
+    shape.len = welch->size;
+    dsp_fourier_plan *p = NULL;
+    double *real = NULL;
+    fftw_complex *complex = NULL;
+
+    while(len > 0) {
+        int n = Min(len, welch->size - welch->filled);
+        dsp_sample_to_double(in, type, n, welch->segment + welch->filled, NULL, NULL);
+        welch->filled += n;
+        in += (size_t)n * sample_size;
+        len -= n;
+        if(welch->filled < welch->size)
+            break;
+
+        /* One plan reference and one pair of buffers for all the segments completed by these samples */
+        if(p == NULL) {
+            p = dsp_fourier_plan_acquire(&shape, DSP_FOURIER_R2C);
+            real = fftw_alloc_real(welch->size);
+            complex = fftw_alloc_complex(welch->bins);
+        }
+        for(int x = 0; x < welch->size; x++)
+            real[x] = welch->segment[x] * welch->window[x];
+        fftw_execute_dft_r2c(p->plan, real, complex);
+        for(int x = 0; x < welch->bins; x++)
+            welch->power[x] += complex[x][0] * complex[x][0] + complex[x][1] * complex[x][1];
+        welch->segments++;
+        transformed++;
+
+        welch->filled = welch->size - welch->step;
+        memmove(welch->segment, welch->segment + welch->step, sizeof(double) * welch->filled);
+    }
+    if(p != NULL) {
+        dsp_fourier_plan_release(p);
+        fftw_free(real);
+        fftw_free(complex);
+    }
+    return transformed;
+}
+
+int dsp_fourier_welch_spectrum(dsp_welch *welch, double *out, double samplerate)
+{
+    int segments = welch->segments;
+    if(segments == 0)
+        return 0;
+    double scale = welch->norm / (segments * (samplerate > 0 ? samplerate : 1.0));
+    /* The negative frequencies are folded on the positive ones, except for DC and the Nyquist bin of even sizes */
+    int last = (welch->size % 2) ? welch->bins : welch->bins - 1;
+    out[0] = welch->power[0] * scale;
+    for(int x = 1; x < welch->bins; x++)
+        out[x] = welch->power[x] * scale * (x < last ? 2.0 : 1.0);
+    memset(welch->power, 0, sizeof(double) * welch->bins);
+    welch->segments = 0;
+    return segments;
+}
+
+void dsp_fourier_welch_reset(dsp_welch *welch)
+{
+    memset(welch->power, 0, sizeof(double) * welch->bins);
+    welch->segments = 0;
+    welch->filled = 0;
+}
+
+void dsp_fourier_welch_free(dsp_welch *welch)
+{
+    if(welch == NULL)
+        return;
+    free(welch->window);
+    free(welch->segment);
+    free(welch->power);
+    free(welch);
 }
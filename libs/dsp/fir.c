@@ -0,0 +1,191 @@
+/*
+ *   libDSPAU - a digital signal processing library for astronomy usage
+ *   Copyright (C) 2017  Ilia Platone <info@iliaplatone.com>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp.h"
+
+/* Input samples converted at once, the history buffer holds a block after the last taps */
+#define DSP_FIR_BLOCK_LEN 4096
+
+/*
+ * The taps are stored reversed, so the output at a sample is the dot product of the taps with the window of
+ * history ending at that sample. Only the outputs kept by the decimation are computed, which is the cost of a
+ * polyphase decimator without splitting the taps in phases.
+ *
+ * A channelizer is a polyphase analysis filter bank: with M channels, branch p sums the products of the taps
+ * h[iM + p] with the window, and channel k is the sum of the branches rotated by exp(2 pi j p k / M), the inverse
+ * DFT of the branches. Its taps are padded to a multiple of M, so the branches are the columns of the window seen
+ * as rows of M samples and are summed row by row over contiguous samples.
+ */
+static dsp_fir *dsp_fir_alloc(const double *taps, int len, int decimation, int channels)
+{
+    if(taps == NULL || len < 1 || decimation < 1 || channels < 1)
+        return NULL;
+    dsp_fir *fir = (dsp_fir*)malloc(sizeof(dsp_fir));
+    fir->len = (len + channels - 1) / channels * channels;
+    fir->decimation = decimation;
+    fir->channels = channels;
+    fir->taps = (double*)calloc(fir->len, sizeof(double));
+    for(int x = 0; x < len; x++)
+        fir->taps[fir->len - 1 - x] = taps[x];
+    fir->history = (double*)malloc(sizeof(double) * (fir->len - 1 + DSP_FIR_BLOCK_LEN));
+    /* The frames of a block are transformed together */
+    fir->branches = channels > 1 ? (double*)malloc(sizeof(double) * channels * (DSP_FIR_BLOCK_LEN / decimation + 2)) :
+                    NULL;
+    dsp_filter_fir_reset(fir);
+    return fir;
+}
+
+/* Independent partial sums, so the loop is vectorized without reordering the additions of a single sum */
+static double dsp_fir_dot(const double *a, const double *b, int len)
+{
+    double sum[4] = { 0, 0, 0, 0 };
+    int x = 0;
+    for(; x + 4 <= len; x += 4) {
+        sum[0] += a[x] * b[x];
+        sum[1] += a[x + 1] * b[x + 1];
+        sum[2] += a[x + 2] * b[x + 2];
+        sum[3] += a[x + 3] * b[x + 3];
+    }
+    for(; x < len; x++)
+        sum[0] += a[x] * b[x];
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+/*
+ * Convert the next block of samples after the history and return its length. The window of the output at the
+ * n-th sample of the block starts at history + n.
+ */
+static int dsp_fir_load(dsp_fir *fir, const char **in, dsp_sample_type type, int *len)
+{
+    int n = Min(*len, DSP_FIR_BLOCK_LEN);
+    dsp_sample_to_double(*in, type, n, fir->history + fir->len - 1, NULL, NULL);
+    *in += (size_t)n * dsp_sample_size(type);
+    *len -= n;
+    return n;
+}
+
+/* Keep the last taps of the block for the next one */
+static void dsp_fir_shift(dsp_fir *fir, int n)
+{
+    fir->phase = (fir->phase + n) % fir->decimation;
+    memmove(fir->history, fir->history + n, sizeof(double) * (fir->len - 1));
+}
+
+double *dsp_filter_fir_lowpass_taps(int len, double cutoff)
+{
+    if(len < 1)
+        return NULL;
+    double *taps = (double*)malloc(sizeof(double) * len);
+    double center = (len - 1) / 2.0, sum = 0;
+    cutoff = Min(Max(cutoff, 0.0), 0.5);
+    for(int x = 0; x < len; x++) {
+        double t = x - center;
+        double sinc = (t == 0) ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        /* Blackman window, about 74 dB of stop band attenuation */
+        double window = (len > 1) ? 0.42 - 0.5 * cos(2 * M_PI * x / (len - 1)) + 0.08 * cos(4 * M_PI * x / (len - 1)) : 1;
+        taps[x] = sinc * window;
+        sum += taps[x];
+    }
+    /* Unity gain at DC */
+    for(int x = 0; x < len && sum != 0; x++)
+        taps[x] /= sum;
+    return taps;
+}
+
+dsp_fir *dsp_filter_fir_new(const double *taps, int len, int decimation)
+{
+    return dsp_fir_alloc(taps, len, decimation, 1);
+}
+
+dsp_fir *dsp_filter_channelizer_new(const double *taps, int len, int channels)
+{
+    if(channels < 2)
+        return NULL;
+    return dsp_fir_alloc(taps, len, channels, channels);
+}
+
+int dsp_filter_fir_decimate(dsp_fir *fir, const void *in, dsp_sample_type type, int len, double *out)
+{
+    const char *samples = (const char*)in;
+    int count = 0;
+    while(len > 0) {
+        int n = dsp_fir_load(fir, &samples, type, &len);
+        for(int x = fir->decimation - 1 - fir->phase; x < n; x += fir->decimation)
+            out[count++] = dsp_fir_dot(fir->taps, fir->history + x, fir->len);
+        dsp_fir_shift(fir, n);
+    }
+    return count;
+}
+
+int dsp_filter_fir_channelize(dsp_fir *fir, const void *in, dsp_sample_type type, int len, dsp_complex *out)
+{
+    const char *samples = (const char*)in;
+    int channels = fir->channels, rows = fir->len / channels, bins = channels / 2 + 1;
+    double *sums = fir->branches, *frames = fir->branches + channels;
+    dsp_stream shape;
+    memset(&shape, 0, sizeof(dsp_stream));
+    shape.dims = 1;
+    shape.sizes = &fir->channels;
+    shape.len = channels;
+
+    int count = 0;
+    while(len > 0) {
+        int n = dsp_fir_load(fir, &samples, type, &len);
+        int block = 0;
+        for(int x = fir->decimation - 1 - fir->phase; x < n; x += fir->decimation) {
+            double *frame = frames + (size_t)block * channels;
+            const double *window = fir->history + x;
+            memset(sums, 0, sizeof(double) * channels);
+            for(int row = 0; row < rows; row++) {
+                const double *t = fir->taps + row * channels;
+                const double *s = window + row * channels;
+                for(int c = 0; c < channels; c++)
+                    sums[c] += t[c] * s[c];
+            }
+            /* Column c of the reversed taps holds the branch channels - 1 - c */
+            for(int p = 0; p < channels; p++)
+                frame[p] = sums[channels - 1 - p];
+            block++;
+        }
+        /* The inverse DFT of real branches is the conjugate of their forward DFT */
+        dsp_complex *bin = out + (size_t)count * bins;
+        dsp_fourier_r2c_many(&shape, frames, block, bin);
+        for(int k = 0; k < block * bins; k++)
+            bin[k].imaginary = -bin[k].imaginary;
+        count += block;
+        dsp_fir_shift(fir, n);
+    }
+    return count;
+}
+
+void dsp_filter_fir_reset(dsp_fir *fir)
+{
+    memset(fir->history, 0, sizeof(double) * (fir->len - 1));
+    /* The first output is at the first sample */
+    fir->phase = fir->decimation - 1;
+}
+
+void dsp_filter_fir_free(dsp_fir *fir)
+{
+    if(fir == NULL)
+        return;
+    free(fir->taps);
+    free(fir->history);
+    free(fir->branches);
+    free(fir);
+}
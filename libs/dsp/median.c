@@ -0,0 +1,430 @@
+/*
+ *   libDSPAU - a digital signal processing library for astronomy usage
+ *   Copyright (C) 2017  Ilia Platone <info@iliaplatone.com>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp.h"
+#include <unistd.h>
+
+#define DSP_MEDIAN_MAX_THREADS 4
+/* Samples compared below which a filter is not worth splitting over several threads */
+#define DSP_MEDIAN_THREAD_MIN_WORK 262144
+/* Streams of integers spanning up to this many values are ranked with a histogram instead of heaps */
+#define DSP_MEDIAN_HISTOGRAM_RANGE 256
+/* Windows up to this size are kept sorted in an array, cheaper than heaps for them */
+#define DSP_MEDIAN_ARRAY_SIZE 32
+
+/*
+ * A sliding window of order statistics. The window holds a fixed number of slots, and moving it replaces the
+ * samples of some slots, so the rank of the samples kept below the output never changes.
+ *
+ * Array mode: the samples of small windows are kept sorted, a replaced sample is moved to its new place.
+ * Heap mode: the rank + 1 lowest samples are in a max-heap, the others in a min-heap, with the position of every
+ * slot tracked so that a replaced sample is moved in place in O(log window).
+ * Histogram mode: integer samples are counted by value and the output value is tracked with the count of samples
+ * lower than it, which moves by the difference between consecutive outputs.
+ */
+typedef struct dsp_median_window_t
+{
+    int size;
+    int rank;
+    double *value;
+    /* Heap mode */
+    int *low;
+    int *high;
+    int low_count;
+    int high_count;
+    /* Heap of each slot, 0 for low and 1 for high, and its position there */
+    unsigned char *side;
+    int *pos;
+    /* Slots sorted by value when the window is filled */
+    struct dsp_median_sample_t *sorted;
+    /* Array mode */
+    double *array;
+    /* Histogram mode */
+    int *histogram;
+    int current;
+    int below;
+} dsp_median_window;
+
+typedef struct dsp_median_t
+{
+    int dims;
+    int *n;
+    int *w;
+    /* Offset of the window from the output position, in each dimension */
+    int *lo;
+    long *stride;
+    long len;
+    int rank;
+    const double *in;
+    double *out;
+    /* Lowest sample in histogram mode, NaN in heap mode */
+    double offset;
+    /* Rows of the first dimension and pieces each row is split into */
+    int rows;
+    int pieces;
+} dsp_median;
+
+static inline int dsp_median_before(dsp_median_window *m, int heap, int a, int b)
+{
+    return heap ? m->value[a] < m->value[b] : m->value[a] > m->value[b];
+}
+
+static void dsp_median_sift(dsp_median_window *m, int heap, int i)
+{
+    int *h = heap ? m->high : m->low;
+    int count = heap ? m->high_count : m->low_count;
+    int slot = h[i];
+    while(i > 0 && dsp_median_before(m, heap, slot, h[(i - 1) / 2])) {
+        h[i] = h[(i - 1) / 2];
+        m->pos[h[i]] = i;
+        i = (i - 1) / 2;
+    }
+    for(;;) {
+        int child = 2 * i + 1;
+        if(child >= count)
+            break;
+        if(child + 1 < count && dsp_median_before(m, heap, h[child + 1], h[child]))
+            child++;
+        if(!dsp_median_before(m, heap, h[child], slot))
+            break;
+        h[i] = h[child];
+        m->pos[h[i]] = i;
+        i = child;
+    }
+    h[i] = slot;
+    m->pos[slot] = i;
+}
+
+typedef struct dsp_median_sample_t
+{
+    double value;
+    int slot;
+} dsp_median_sample;
+
+static int dsp_median_compare_values(const void *a, const void *b)
+{
+    double va = *(const double*)a, vb = *(const double*)b;
+    return (va > vb) - (va < vb);
+}
+
+static int dsp_median_compare(const void *a, const void *b)
+{
+    double va = ((const dsp_median_sample*)a)->value, vb = ((const dsp_median_sample*)b)->value;
+    return (va > vb) - (va < vb);
+}
+
+/* Fill the window structures once all the slot values are set */
+static void dsp_median_init(dsp_median_window *m, double offset)
+{
+    if(m->histogram != NULL) {
+        memset(m->histogram, 0, sizeof(int) * DSP_MEDIAN_HISTOGRAM_RANGE);
+        for(int s = 0; s < m->size; s++)
+            m->histogram[(int)(m->value[s] - offset)]++;
+        m->current = 0;
+        m->below = 0;
+        while(m->below + m->histogram[m->current] <= m->rank)
+            m->below += m->histogram[m->current++];
+        return;
+    }
+    if(m->array != NULL) {
+        memcpy(m->array, m->value, sizeof(double) * m->size);
+        qsort(m->array, m->size, sizeof(double), dsp_median_compare_values);
+        return;
+    }
+    /* Sorted slots make valid heaps, the low one in descending order */
+    for(int s = 0; s < m->size; s++) {
+        m->sorted[s].value = m->value[s];
+        m->sorted[s].slot = s;
+    }
+    qsort(m->sorted, m->size, sizeof(dsp_median_sample), dsp_median_compare);
+    m->low_count = m->rank + 1;
+    m->high_count = m->size - m->low_count;
+    for(int i = 0; i < m->low_count; i++) {
+        m->low[i] = m->sorted[m->rank - i].slot;
+        m->side[m->low[i]] = 0;
+        m->pos[m->low[i]] = i;
+    }
+    for(int i = 0; i < m->high_count; i++) {
+        m->high[i] = m->sorted[m->low_count + i].slot;
+        m->side[m->high[i]] = 1;
+        m->pos[m->high[i]] = i;
+    }
+}
+
+static void dsp_median_replace(dsp_median_window *m, int slot, double v, double offset)
+{
+    double old = m->value[slot];
+    if(old == v)
+        return;
+    m->value[slot] = v;
+    if(m->histogram != NULL) {
+        int o = (int)(old - offset), k = (int)(v - offset);
+        m->histogram[o]--;
+        m->histogram[k]++;
+        m->below += (k < m->current) - (o < m->current);
+        while(m->below > m->rank)
+            m->below -= m->histogram[--m->current];
+        while(m->below + m->histogram[m->current] <= m->rank)
+            m->below += m->histogram[m->current++];
+        return;
+    }
+    if(m->array != NULL) {
+        double *a = m->array;
+        int i = 0;
+        while(i < m->size - 1 && a[i] != old)
+            i++;
+        for(; i > 0 && a[i - 1] > v; i--)
+            a[i] = a[i - 1];
+        for(; i < m->size - 1 && a[i + 1] < v; i++)
+            a[i] = a[i + 1];
+        a[i] = v;
+        return;
+    }
+    dsp_median_sift(m, m->side[slot], m->pos[slot]);
+    if(m->high_count > 0 && m->value[m->low[0]] > m->value[m->high[0]]) {
+        int a = m->low[0], b = m->high[0];
+        m->low[0] = b;
+        m->side[b] = 0;
+        m->high[0] = a;
+        m->side[a] = 1;
+        dsp_median_sift(m, 0, 0);
+        dsp_median_sift(m, 1, 0);
+    }
+}
+
+static inline double dsp_median_value(dsp_median_window *m, double offset)
+{
+    if(m->histogram != NULL)
+        return m->current + offset;
+    return m->array != NULL ? m->array[m->rank] : m->value[m->low[0]];
+}
+
+static inline int dsp_median_clamp(int x, int n)
+{
+    return x < 0 ? 0 : (x >= n ? n - 1 : x);
+}
+
+/*
+ * Filter pieces of rows of the first dimension. The window slides along the row, where each step replaces the
+ * samples of one column of the window: slot column c holds the samples at the positions congruent to c.
+ * Positions outside the stream take the value of the nearest edge.
+ */
+static void dsp_median_rows(dsp_median *f, int start, int end)
+{
+    int n0 = f->n[0], w0 = f->w[0];
+    int columns = 1;
+    for(int d = 1; d < f->dims; d++)
+        columns *= f->w[d];
+    dsp_median_window m;
+    memset(&m, 0, sizeof(dsp_median_window));
+    m.size = w0 * columns;
+    m.rank = f->rank;
+    m.value = (double*)malloc(sizeof(double) * m.size);
+    m.low = (int*)malloc(sizeof(int) * m.size * 3);
+    m.high = m.low + m.size;
+    m.pos = m.high + m.size;
+    m.side = (unsigned char*)malloc(m.size);
+    if(f->offset == f->offset)
+        m.histogram = (int*)malloc(sizeof(int) * DSP_MEDIAN_HISTOGRAM_RANGE);
+    else if(m.size <= DSP_MEDIAN_ARRAY_SIZE)
+        m.array = (double*)malloc(sizeof(double) * m.size);
+    else
+        m.sorted = (dsp_median_sample*)malloc(sizeof(dsp_median_sample) * m.size);
+    long *row = (long*)malloc(sizeof(long) * columns);
+    int *pos = (int*)malloc(sizeof(int) * f->dims);
+
+    for(int unit = start; unit < end; unit++) {
+        int r = unit / f->pieces, piece = unit % f->pieces;
+        int x0 = (int)((long)n0 * piece / f->pieces), x1 = (int)((long)n0 * (piece + 1) / f->pieces);
+        long base = (long)r * n0;
+        if(x0 >= x1)
+            continue;
+
+        /* Offsets of the rows of the window, clamped to the stream */
+        for(int d = 1, q = r; d < f->dims; d++) {
+            pos[d] = q % f->n[d];
+            q /= f->n[d];
+        }
+        for(int j = 0; j < columns; j++) {
+            row[j] = 0;
+            for(int d = 1, q = j; d < f->dims; d++) {
+                row[j] += dsp_median_clamp(pos[d] + f->lo[d] + q % f->w[d], f->n[d]) * f->stride[d];
+                q /= f->w[d];
+            }
+        }
+
+        for(int c = 0; c < w0; c++) {
+            int x = x0 + f->lo[0] + c;
+            int slot = ((x % w0) + w0) % w0 * columns;
+            x = dsp_median_clamp(x, n0);
+            for(int j = 0; j < columns; j++)
+                m.value[slot + j] = f->in[row[j] + x];
+        }
+        dsp_median_init(&m, f->offset);
+        f->out[base + x0] = dsp_median_value(&m, f->offset);
+
+        for(int x = x0 + 1; x < x1; x++) {
+            int enter = x + f->lo[0] + w0 - 1;
+            int slot = ((enter % w0) + w0) % w0 * columns;
+            int sx = dsp_median_clamp(enter, n0);
+            for(int j = 0; j < columns; j++)
+                dsp_median_replace(&m, slot + j, f->in[row[j] + sx], f->offset);
+            f->out[base + x] = dsp_median_value(&m, f->offset);
+        }
+    }
+
+    free(pos);
+    free(row);
+    free(m.array);
+    free(m.sorted);
+    free(m.histogram);
+    free(m.side);
+    free(m.low);
+    free(m.value);
+}
+
+typedef struct dsp_median_job_t
+{
+    dsp_median *f;
+    int start;
+    int end;
+} dsp_median_job;
+
+static void *dsp_median_job_run(void *arg)
+{
+    dsp_median_job *job = (dsp_median_job*)arg;
+    dsp_median_rows(job->f, job->start, job->end);
+    return NULL;
+}
+
+/* Filter a stream whose sizes, window and rank are set, the calling thread runs the first chunk */
+static void dsp_median_run(dsp_median *f)
+{
+    int window = 1;
+    for(int d = 0; d < f->dims; d++)
+        window *= f->w[d];
+    double work = (double)f->len * (window / f->w[0]) * log2(window + 1.0);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (int)Min(work / DSP_MEDIAN_THREAD_MIN_WORK, (double)Min(cores, (long)DSP_MEDIAN_MAX_THREADS));
+    threads = Max(threads, 1);
+
+    /* Rows are split only when there are fewer of them than threads */
+    f->rows = (int)(f->len / f->n[0]);
+    f->pieces = f->rows >= threads ? 1 : Min(threads, Max(1, f->n[0] / (window * 4)));
+    int units = f->rows * f->pieces;
+    threads = Max(Min(threads, units), 1);
+
+    /* Integers in a short range are ranked with a histogram */
+    double lo = f->in[0], hi = f->in[0];
+    int integers = 1;
+    for(long x = 0; x < f->len && integers; x++) {
+        double v = f->in[x];
+        integers = v == floor(v);
+        lo = Min(lo, v);
+        hi = Max(hi, v);
+    }
+    f->offset = integers && hi - lo < DSP_MEDIAN_HISTOGRAM_RANGE ? lo : NAN;
+
+    dsp_median_job jobs[DSP_MEDIAN_MAX_THREADS];
+    pthread_t workers[DSP_MEDIAN_MAX_THREADS];
+    int started[DSP_MEDIAN_MAX_THREADS] = { 0 };
+    for(int t = 0; t < threads; t++) {
+        jobs[t].f = f;
+        jobs[t].start = (int)((long)units * t / threads);
+        jobs[t].end = (int)((long)units * (t + 1) / threads);
+    }
+    for(int t = 1; t < threads; t++)
+        started[t] = !pthread_create(&workers[t], NULL, dsp_median_job_run, &jobs[t]);
+    dsp_median_job_run(&jobs[0]);
+    for(int t = 1; t < threads; t++) {
+        if(started[t])
+            pthread_join(workers[t], NULL);
+        else
+            dsp_median_job_run(&jobs[t]);
+    }
+}
+
+/*
+ * Run the filter with a window of the given sizes and offsets, 1 and 0 in the dimensions they lack.
+ * A flat filter runs over the buffer as a single row.
+ */
+static void dsp_median_filter(dsp_stream_p stream, int dims, const int *sizes, const int *offsets, int rank, int flat)
+{
+    if(stream->len < 1)
+        return;
+    dsp_median f;
+    memset(&f, 0, sizeof(dsp_median));
+    f.dims = flat ? 1 : Max(stream->dims, 1);
+    f.n = (int*)malloc(sizeof(int) * f.dims * 3);
+    f.w = f.n + f.dims;
+    f.lo = f.w + f.dims;
+    f.stride = (long*)malloc(sizeof(long) * f.dims);
+    f.len = stream->len;
+    int window = 1;
+    for(int d = 0; d < f.dims; d++) {
+        f.n[d] = d < stream->dims && !flat ? stream->sizes[d] : (int)stream->len;
+        f.w[d] = d < dims ? Max(sizes[d], 1) : 1;
+        f.lo[d] = d < dims ? offsets[d] : 0;
+        f.stride[d] = d > 0 ? f.stride[d - 1] * f.n[d - 1] : 1;
+        window *= f.w[d];
+    }
+    f.rank = Max(0, Min(rank, window - 1));
+    double *in = (double*)malloc(sizeof(double) * stream->len);
+    memcpy(in, stream->buf, sizeof(double) * stream->len);
+    f.in = in;
+    f.out = stream->buf;
+
+    dsp_median_run(&f);
+
+    free(in);
+    free(f.stride);
+    free(f.n);
+}
+
+void dsp_filter_percentile(dsp_stream_p stream, int* sizes, double percentile)
+{
+    int dims = Max(stream->dims, 1);
+    int *offsets = (int*)malloc(sizeof(int) * dims);
+    int window = 1;
+    for(int d = 0; d < dims; d++) {
+        offsets[d] = -(Max(sizes[d], 1) - 1) / 2;
+        window *= Max(sizes[d], 1);
+    }
+    percentile = Max(0.0, Min(percentile, 100.0));
+    dsp_median_filter(stream, dims, sizes, offsets, (int)round(percentile * (window - 1) / 100.0), 0);
+    free(offsets);
+}
+
+void dsp_filter_median(dsp_stream_p stream, int* sizes)
+{
+    dsp_filter_percentile(stream, sizes, 50.0);
+}
+
+void dsp_buffer_median(dsp_stream_p stream, int size, int median)
+{
+    /* The window of each sample ends after it, and the first samples keep their value */
+    int mid = (size / 2) + (size % 2);
+    if(size < 1 || mid >= stream->len)
+        return;
+    double *head = (double*)malloc(sizeof(double) * mid);
+    memcpy(head, stream->buf, sizeof(double) * mid);
+    int offset = -mid;
+    dsp_median_filter(stream, 1, &size, &offset, median, 1);
+    memcpy(stream->buf, head, sizeof(double) * mid);
+    free(head);
+}
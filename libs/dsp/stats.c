@@ -18,23 +18,154 @@
 
 #include "dsp.h"
 
-double* dsp_stats_histogram(dsp_stream_p stream, int size)
+#include <unistd.h>
+
+/* Histograms of more samples than this are split over several threads */
+#define DSP_HISTOGRAM_THREAD_MIN_LEN 262144
+#define DSP_HISTOGRAM_MAX_THREADS 4
+/*
+ * Consecutive samples often fall in the same bin, which serializes the increments on a single counter. Samples are
+ * counted in interleaved sub-histograms instead, summed at the end.
+ */
+#define DSP_HISTOGRAM_LANES 4
+
+typedef struct dsp_histogram_job_t
+{
+    const void *buf;
+    dsp_sample_type type;
+    int len;
+    int size;
+    /* DSP_HISTOGRAM_LANES sub-histograms of size bins */
+    unsigned int *counts;
+} dsp_histogram_job;
+
+/*
+ * Samples are clamped to [0, size] and truncated to their bin, so negative samples are counted in the first bin
+ * while samples of size or more and NaNs are not counted.
+ */
+static void *dsp_histogram_count(void *arg)
+{
+    dsp_histogram_job *job = (dsp_histogram_job*)arg;
+    unsigned int *counts = job->counts;
+    int size = job->size;
+    int x = 0;
+
+/* Samples of the types with a range larger than the bins are compared as doubles */
+#define DSP_HISTOGRAM_COUNT(ctype) { \
+        const ctype *buf = (const ctype*)job->buf; \
+        for(; x < job->len; x++) { \
+            double v = (double)buf[x]; \
+            if(v < size) \
+                counts[(x & (DSP_HISTOGRAM_LANES - 1)) * size + (v > 0 ? (int)v : 0)]++; \
+        } \
+        break; \
+    }
+
+    switch(job->type) {
+    case DSP_SAMPLE_F64:
+        DSP_HISTOGRAM_COUNT(double)
+    case DSP_SAMPLE_F32:
+        DSP_HISTOGRAM_COUNT(float)
+    case DSP_SAMPLE_S16:
+        DSP_HISTOGRAM_COUNT(int16_t)
+    case DSP_SAMPLE_U32:
+        DSP_HISTOGRAM_COUNT(uint32_t)
+    case DSP_SAMPLE_U64:
+        DSP_HISTOGRAM_COUNT(uint64_t)
+    case DSP_SAMPLE_U8: {
+        const uint8_t *buf = (const uint8_t*)job->buf;
+        for(; x + 4 <= job->len; x += 4) {
+            if(buf[x] < size) counts[buf[x]]++;
+            if(buf[x + 1] < size) counts[size + buf[x + 1]]++;
+            if(buf[x + 2] < size) counts[2 * size + buf[x + 2]]++;
+            if(buf[x + 3] < size) counts[3 * size + buf[x + 3]]++;
+        }
+        for(; x < job->len; x++) {
+            if(buf[x] < size) counts[buf[x]]++;
+        }
+        break;
+    }
+    case DSP_SAMPLE_U16: {
+        const uint16_t *buf = (const uint16_t*)job->buf;
+        for(; x + 4 <= job->len; x += 4) {
+            if(buf[x] < size) counts[buf[x]]++;
+            if(buf[x + 1] < size) counts[size + buf[x + 1]]++;
+            if(buf[x + 2] < size) counts[2 * size + buf[x + 2]]++;
+            if(buf[x + 3] < size) counts[3 * size + buf[x + 3]]++;
+        }
+        for(; x < job->len; x++) {
+            if(buf[x] < size) counts[buf[x]]++;
+        }
+        break;
+    }
+    }
+    return NULL;
+}
+
+static double *dsp_histogram(const void *buf, dsp_sample_type type, int len, int size)
 {
-    int k;
-    dsp_stream_p o = dsp_stream_copy(stream);
+    int sample_size = dsp_sample_size(type);
     double* out = (double*)malloc(sizeof(double) * size);
-    long* i = (long*)malloc(sizeof(long) * o->len);
-    dsp_buffer_normalize(o->buf, o->len, 0.0, size);
-    dsp_buffer_copy(o->buf, i, o->len);
-    dsp_buffer_copy(i, o->buf, o->len);
-    for(k = 0; k < size; k++) {
-        out[k] = dsp_stats_val_count(o->buf, o->len, k);
+    if(size <= 0)
+        return out;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = Min(len / DSP_HISTOGRAM_THREAD_MIN_LEN, (int)Min(cores, (long)DSP_HISTOGRAM_MAX_THREADS));
+    threads = Max(threads, 1);
+
+    dsp_histogram_job jobs[DSP_HISTOGRAM_MAX_THREADS];
+    pthread_t workers[DSP_HISTOGRAM_MAX_THREADS];
+    int started[DSP_HISTOGRAM_MAX_THREADS] = { 0 };
+    int chunk = len / threads;
+    for(int t = 0; t < threads; t++) {
+        jobs[t].buf = (const char*)buf + (size_t)t * chunk * sample_size;
+        jobs[t].type = type;
+        jobs[t].len = (t == threads - 1) ? len - t * chunk : chunk;
+        jobs[t].size = size;
+        jobs[t].counts = (unsigned int*)calloc((size_t)size * DSP_HISTOGRAM_LANES, sizeof(unsigned int));
     }
-    free(i);
-    dsp_stream_free_buffer(o);
-    dsp_stream_set_buffer(o, out, size);
-    dsp_buffer_stretch(o->buf, o->len, 0, size);
-    dsp_stream_free(o);
+    /* The calling thread counts the first chunk */
+    for(int t = 1; t < threads; t++)
+        started[t] = !pthread_create(&workers[t], NULL, dsp_histogram_count, &jobs[t]);
+    dsp_histogram_count(&jobs[0]);
+
+    for(int k = 0; k < size; k++)
+        out[k] = 0;
+    for(int t = 0; t < threads; t++) {
+        if(t > 0) {
+            if(started[t])
+                pthread_join(workers[t], NULL);
+            else
+                dsp_histogram_count(&jobs[t]);
+        }
+        for(int lane = 0; lane < DSP_HISTOGRAM_LANES; lane++) {
+            const unsigned int *counts = jobs[t].counts + (size_t)lane * size;
+            for(int k = 0; k < size; k++)
+                out[k] += counts[k];
+        }
+        free(jobs[t].counts);
+    }
+
+    dsp_buffer_stretch(out, size, 0, size);
     return out;
 }
 
+double* dsp_stats_histogram(dsp_stream_p stream, int size)
+{
+    return dsp_histogram(stream->buf, DSP_SAMPLE_F64, stream->len, size);
+}
+
+double* dsp_stats_histogram_u8(const uint8_t* buf, int len, int size)
+{
+    return dsp_histogram(buf, DSP_SAMPLE_U8, len, size);
+}
+
+double* dsp_stats_histogram_u16(const uint16_t* buf, int len, int size)
+{
+    return dsp_histogram(buf, DSP_SAMPLE_U16, len, size);
+}
+
+double* dsp_sample_histogram(const void *buf, dsp_sample_type type, int len, int size)
+{
+    return dsp_histogram(buf, type, len, size);
+}
@@ -59,6 +59,7 @@ dsp_stream_p dsp_stream_new()
     stream->target = (double*)malloc(sizeof(double) * 3);
     stream->stars = (dsp_star**)malloc(sizeof(dsp_star*) * 1);
     stream->child_count = 0;
+    stream->star_count = 0;
     stream->parent = NULL;
     stream->dims = 0;
     stream->len = 1;
@@ -73,6 +74,10 @@ void dsp_stream_free(dsp_stream_p stream)
         return;
     free(stream->sizes);
     free(stream->children);
+    free(stream->ROI);
+    free(stream->location);
+    free(stream->target);
+    free(stream->stars);
     free(stream);
 }
 
@@ -97,6 +102,8 @@ void dsp_stream_add_dim(dsp_stream_p stream, int size)
     stream->len *= size;
     stream->dims ++;
     stream->ROI = (dsp_region*)realloc(stream->ROI, sizeof(dsp_region) * (stream->dims + 1));
+    stream->ROI[stream->dims - 1].start = 0;
+    stream->ROI[stream->dims - 1].len = size;
     stream->sizes = (int*)realloc(stream->sizes, sizeof(int) * (stream->dims + 1));
 }
 
@@ -143,17 +150,16 @@ void dsp_stream_del_child(dsp_stream_p stream, int index)
     }
 }
 
+void dsp_stream_position(dsp_stream_p stream, int index, int* pos) {
+    for (int dim = 0; dim < stream->dims; dim++) {
+        pos[dim] = index % stream->sizes[dim];
+        index /= stream->sizes[dim];
+    }
+}
+
 int* dsp_stream_get_position(dsp_stream_p stream, int index) {
-    int dim = 0;
-    int y = 0;
-    int m = 1;
     int* pos = (int*)malloc(sizeof(int) * stream->dims);
-    for (dim = 0; dim < stream->dims; dim++) {
-        y = index / m;
-        y %= stream->sizes[dim];
-        m *= stream->sizes[dim];
-        pos[dim] = y;
-    }
+    dsp_stream_position(stream, index, pos);
     return pos;
 }
 
@@ -175,70 +181,228 @@ void *dsp_stream_exec(dsp_stream_p stream) {
     return NULL;
 }
 
+int dsp_stream_iterator(dsp_stream_p stream, dsp_region *region, dsp_iterator *it)
+{
+    if(stream->dims > DSP_MAX_DIMS)
+        return -1;
+    it->dims = Max(stream->dims, 1);
+    it->index = 0;
+    it->valid = stream->len > 0;
+    long stride = 1;
+    for(int dim = 0; dim < it->dims; dim++) {
+        int size = stream->dims > 0 ? stream->sizes[dim] : stream->len;
+        int start = 0, len = size;
+        if(region != NULL) {
+            start = Max(0, region[dim].start);
+            len = Min(size, region[dim].start + region[dim].len) - start;
+        }
+        if(len <= 0) {
+            it->valid = 0;
+            len = 0;
+        }
+        it->start[dim] = start;
+        it->len[dim] = len;
+        it->pos[dim] = start;
+        it->stride[dim] = stride;
+        it->index += start * stride;
+        stride *= size;
+    }
+    return 0;
+}
+
+void dsp_stream_copy_region(dsp_stream_p dest, int *pos, dsp_stream_p src, dsp_region *region)
+{
+    if(dest->dims != src->dims || src->dims > DSP_MAX_DIMS || src->dims == 0)
+        return;
+    /* Clip the region to the source, then to the destination */
+    dsp_region clip[DSP_MAX_DIMS];
+    int offset[DSP_MAX_DIMS];
+    for(int dim = 0; dim < src->dims; dim++) {
+        int start = region != NULL ? region[dim].start : 0;
+        int len = region != NULL ? region[dim].len : src->sizes[dim];
+        int at = pos != NULL ? pos[dim] : 0;
+        int skip = Max(Max(0, -start), -at);
+        start += skip;
+        at += skip;
+        len = Min(len - skip, Min(src->sizes[dim] - start, dest->sizes[dim] - at));
+        if(len <= 0)
+            return;
+        clip[dim].start = start;
+        clip[dim].len = len;
+        offset[dim] = at - start;
+    }
+    dsp_iterator it;
+    dsp_stream_iterator(src, clip, &it);
+    long shift = 0, stride = 1;
+    for(int dim = 0; dim < src->dims; dim++) {
+        shift += offset[dim] * stride;
+        stride *= dest->sizes[dim];
+    }
+    /* The destination position of a source element depends on its position, not only its index */
+    for(; it.valid; dsp_iterator_next_row(&it)) {
+        long index = 0;
+        stride = 1;
+        for(int dim = 0; dim < src->dims; dim++) {
+            index += it.pos[dim] * stride;
+            stride *= dest->sizes[dim];
+        }
+        memcpy(dest->buf + index + shift, src->buf + it.index, sizeof(double) * it.len[0]);
+    }
+}
+
 dsp_stream_p dsp_stream_crop(dsp_stream_p in)
 {
-    int dims = in->dims;
-    if(dims == 0)
+    if(in->dims == 0 || in->dims > DSP_MAX_DIMS)
+        return NULL;
+    dsp_iterator it;
+    dsp_stream_iterator(in, in->ROI, &it);
+    if(!it.valid)
         return NULL;
     dsp_stream_p ret = dsp_stream_new();
     for(int dim = 0; dim < in->dims; dim++) {
-        dsp_stream_add_dim(ret, in->ROI[dim].len);
+        dsp_stream_add_dim(ret, it.len[dim]);
     }
     dsp_stream_alloc_buffer(ret, ret->len);
-    int x = 0;
-    for (int index = 0; index<in->len; index++)
-    {
-        int* pos = dsp_stream_get_position(in, index);
-        for(int dim = 0; dim < in->dims; dim++) {
-            if(pos[dim] >= in->ROI[dim].start &&  (pos[dim]-in->ROI[dim].start) < in->ROI[dim].len) {
-                ret->buf[x] = in->buf[index];
-                x++;
+    double *out = ret->buf;
+    for(; it.valid; dsp_iterator_next_row(&it)) {
+        memcpy(out, in->buf + it.index, sizeof(double) * it.len[0]);
+        out += it.len[0];
+    }
+    return ret;
+}
+
+/*
+ * Linear interpolation along one dimension, from a buffer with the sizes of the result in the dimensions before it
+ * and of the source in the others. Source positions are those of the result centers, clamped to the edges.
+ */
+static void dsp_stream_resample_dim(const double *in, double *out, const int *sizes, int dims, int dim, int from, int to)
+{
+    long inner = 1, outer = 1;
+    for(int d = 0; d < dims; d++) {
+        if(d < dim)
+            inner *= sizes[d];
+        else if(d > dim)
+            outer *= sizes[d];
+    }
+    int *index = (int*)malloc(sizeof(int) * to);
+    double *weight = (double*)malloc(sizeof(double) * to);
+    double ratio = (double)from / to;
+    for(int x = 0; x < to; x++) {
+        double s = Max(0.0, Min((x + 0.5) * ratio - 0.5, from - 1.0));
+        index[x] = Min((int)s, from - 2);
+        weight[x] = s - index[x];
+        if(from == 1) {
+            index[x] = 0;
+            weight[x] = 0;
+        }
+    }
+    int next = from > 1 ? 1 : 0;
+    for(long o = 0; o < outer; o++) {
+        const double *src = in + o * from * inner;
+        double *dst = out + o * to * inner;
+        for(int x = 0; x < to; x++) {
+            const double *a = src + index[x] * inner;
+            const double *b = a + next * inner;
+            double w = weight[x];
+            if(inner == 1) {
+                dst[x] = a[0] + (b[0] - a[0]) * w;
+                continue;
             }
+            for(long i = 0; i < inner; i++)
+                dst[x * inner + i] = a[i] + (b[i] - a[i]) * w;
         }
-        free(pos);
     }
-    return ret;
+    free(weight);
+    free(index);
 }
 
-dsp_stream_p dsp_stream_scale(dsp_stream_p in, double ratio)
+dsp_stream_p dsp_stream_resample(dsp_stream_p in, int *sizes)
 {
-    int dims = in->dims;
-    if(dims == 0)
+    if(in->dims == 0)
         return NULL;
     dsp_stream_p ret = dsp_stream_new();
     for(int dim = 0; dim < in->dims; dim++) {
-        dsp_stream_add_dim(ret, in->sizes[dim] * ratio);
+        dsp_stream_add_dim(ret, Max(sizes[dim], 1));
     }
     dsp_stream_alloc_buffer(ret, ret->len);
-    if(ratio>1.0) {
-        for (int index = 0; index<ret->len; index++)
-        {
-            ret->buf[index] = in->buf[(int)(index/ratio)];
-        }
-    } else {
-        for (int index = 0; index<in->len; index++)
-        {
-            ret->buf[(int)(index*ratio)] = in->buf[index];
-        }
+    ret->lambda = in->lambda;
+    ret->samplerate = in->samplerate;
+
+    /* Each pass resizes one dimension, so the sizes of the intermediate buffers change */
+    int *current = (int*)malloc(sizeof(int) * in->dims);
+    memcpy(current, in->sizes, sizeof(int) * in->dims);
+    long largest = Max((long)in->len, (long)ret->len);
+    long len = in->len;
+    for(int dim = 0; dim < in->dims; dim++) {
+        len = len / current[dim] * ret->sizes[dim];
+        largest = Max(largest, len);
+    }
+    double *tmp = (double*)malloc(sizeof(double) * largest * 2);
+    double *src = tmp, *dst = tmp + largest;
+    memcpy(src, in->buf, sizeof(double) * in->len);
+    for(int dim = 0; dim < in->dims; dim++) {
+        if(current[dim] == ret->sizes[dim])
+            continue;
+        dsp_stream_resample_dim(src, dst, current, in->dims, dim, current[dim], ret->sizes[dim]);
+        current[dim] = ret->sizes[dim];
+        double *swap = src;
+        src = dst;
+        dst = swap;
     }
+    memcpy(ret->buf, src, sizeof(double) * ret->len);
+    free(tmp);
+    free(current);
+    return ret;
+}
+
+dsp_stream_p dsp_stream_scale(dsp_stream_p in, double ratio)
+{
+    if(in->dims == 0)
+        return NULL;
+    int *sizes = (int*)malloc(sizeof(int) * in->dims);
+    for(int dim = 0; dim < in->dims; dim++) {
+        sizes[dim] = Max((int)(in->sizes[dim] * ratio), 1);
+    }
+    dsp_stream_p ret = dsp_stream_resample(in, sizes);
+    free(sizes);
     return ret;
 }
 
 dsp_stream_p dsp_stream_rotate(dsp_stream_p in, double* radians, double* pivot)
 {
-    int dims = in->dims;
-    if(dims < 2)
+    if(in->dims < 2)
         return NULL;
     dsp_stream_p ret = dsp_stream_copy(in);
-    double tilt = 1;
-    double center = 1;
-    for (int dim = 0; dim < in->dims; dim++) {
-        tilt *= cos(radians[dim]);
-        center *= pivot[dim];
-    }
-    for (int index = 0; index < ret->len; index++)
-    {
-        ret->buf[index] = in->buf[(int)((center-index)*tilt+center)];
+    int w = in->sizes[0], h = in->sizes[1];
+    long plane = (long)w * h;
+    double c = cos(radians[0]), s = sin(radians[0]);
+    /* Each element takes the source value at its position rotated back around the pivot */
+    for(long p = 0; p < in->len / plane; p++) {
+        const double *src = in->buf + p * plane;
+        double *dst = ret->buf + p * plane;
+        for(int y = 0; y < h; y++) {
+            double dy = y - pivot[1];
+            double sx = pivot[0] - pivot[0] * c + dy * s;
+            double sy = pivot[1] + pivot[0] * s + dy * c;
+            for(int x = 0; x < w; x++, sx += c, sy -= s) {
+                double value = 0;
+                if(sx > -1 && sy > -1 && sx < w && sy < h) {
+                    int x0 = (int)floor(sx), y0 = (int)floor(sy);
+                    double fx = sx - x0, fy = sy - y0;
+                    double v00 = 0, v10 = 0, v01 = 0, v11 = 0;
+                    if(y0 >= 0) {
+                        if(x0 >= 0) v00 = src[(long)y0 * w + x0];
+                        if(x0 + 1 < w) v10 = src[(long)y0 * w + x0 + 1];
+                    }
+                    if(y0 + 1 < h) {
+                        if(x0 >= 0) v01 = src[(long)(y0 + 1) * w + x0];
+                        if(x0 + 1 < w) v11 = src[(long)(y0 + 1) * w + x0 + 1];
+                    }
+                    value = (v00 * (1 - fx) + v10 * fx) * (1 - fy) + (v01 * (1 - fx) + v11 * fx) * fy;
+                }
+                dst[(long)y * w + x] = value;
+            }
+        }
     }
     return ret;
 }
@@ -30,6 +30,10 @@
 #include "indiccd.h"
 
 #include "fpack/fpack.h"
+#include "indifitsheader.h"
+#include "indiguidestar.h"
+#include "indiimagewriter.h"
+#include "inditiledpreview.h"
 #include "indicom.h"
 #include "stream/streammanager.h"
 #include "locale_compat.h"
@@ -42,8 +46,8 @@
 #include <libnova/transform.h>
 #include <libnova/ln_types.h>
 
+#include <algorithm>
 #include <cmath>
-#include <regex>
 
 #include <dirent.h>
 #include <cerrno>
@@ -85,6 +89,33 @@ static int _ccd_mkdir(const char * dir, mode_t mode)
     return 0;
 }
 
+// Replace all occurrences of a literal pattern, avoids compiling a std::regex for every saved frame
+static void replaceAll(std::string &input, const std::string &pattern, const std::string &replace)
+{
+    for (size_t pos = input.find(pattern); pos != std::string::npos; pos = input.find(pattern, pos + replace.size()))
+        input.replace(pos, pattern.size(), replace);
+}
+
+// Substitute XXX placeholder in file prefix with zero-padded index
+static std::string formatFileIndex(std::string prefix, int index)
+{
+    char indexString[16];
+    snprintf(indexString, sizeof(indexString), "%03d", index);
+    replaceAll(prefix, "XXX", indexString);
+    return prefix;
+}
+
+// Sexagesimal with spaces as separators, as used by OBJCTRA and OBJCTDEC
+static void formatSexaSpaces(char * out, double value)
+{
+    fs_sexa(out, value, 2, 360000);
+    for (char * p = out; *p != '\0'; p++)
+    {
+        if (*p == ':')
+            *p = ' ';
+    }
+}
+
 namespace INDI
 {
 
@@ -99,6 +130,19 @@ CCD::CCD()
     //GuiderRapidGuideEnabled = false;
     m_ValidCCDRotation        = false;
 
+    m_ImageWriter.reset(new ImageWriter());
+    // Runs on the writer thread, so only queue the result for the main loop
+    m_ImageWriter->setWriteCallback([this](const std::string & filename, int error, size_t bytes, double seconds)
+    {
+        std::lock_guard<std::mutex> lock(m_WriteResultsLock);
+        m_WriteResults.push_back({ filename, error, bytes, seconds });
+    });
+
+    m_TiledPreview.reset(new TiledPreview());
+
+    m_FITSHeader[0].reset(new FITSHeaderTemplate());
+    m_FITSHeader[1].reset(new FITSHeaderTemplate());
+
     AutoLoop         = false;
     SendImage        = false;
     ShowMarker       = false;
@@ -124,6 +168,11 @@ CCD::CCD()
 
 CCD::~CCD()
 {
+    if (m_WriteTimerID != -1)
+        IERmTimer(m_WriteTimerID);
+
+    // Finish pending writes and join the writer while the rest of the CCD is still intact
+    m_ImageWriter.reset();
 }
 
 void CCD::SetCCDCapability(uint32_t cap)
@@ -213,6 +262,23 @@ bool CCD::initProperties()
     IUFillBLOBVector(&PrimaryCCD.FitsBP, &PrimaryCCD.FitsB, 1, getDeviceName(), "CCD1", "Image Data", IMAGE_INFO_TAB,
                      IP_RO, 60, IPS_IDLE);
 
+    // Primary CCD Preview Mode
+    IUFillSwitch(&PreviewS[PREVIEW_FULL], "PREVIEW_FULL", "Full frame", ISS_ON);
+    IUFillSwitch(&PreviewS[PREVIEW_TILES], "PREVIEW_TILES", "Changed tiles", ISS_OFF);
+    IUFillSwitchVector(&PreviewSP, PreviewS, 2, getDeviceName(), "CCD_PREVIEW_MODE", "Preview", IMAGE_SETTINGS_TAB, IP_RW,
+                       ISR_1OFMANY, 60, IPS_IDLE);
+
+    IUFillNumber(&PreviewSettingsN[PREVIEW_TILE_SIZE], "PREVIEW_TILE_SIZE", "Tile size (px)", "%.f", 16, 1024, 16, 64);
+    IUFillNumber(&PreviewSettingsN[PREVIEW_THRESHOLD], "PREVIEW_THRESHOLD", "Threshold (ADU)", "%.1f", 0, 10000, 1, 2);
+    IUFillNumber(&PreviewSettingsN[PREVIEW_SCALE], "PREVIEW_SCALE", "Thumbnail scale", "%.f", 1, 16, 1, 4);
+    IUFillNumberVector(&PreviewSettingsNP, PreviewSettingsN, 3, getDeviceName(), "CCD_PREVIEW_SETTINGS", "Preview Settings",
+                       IMAGE_SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+
+    IUFillBLOB(&PreviewB[PREVIEW_THUMBNAIL], "PREVIEW_THUMBNAIL", "Thumbnail", "");
+    IUFillBLOB(&PreviewB[PREVIEW_TILE_DATA], "PREVIEW_TILES", "Tiles", "");
+    IUFillBLOBVector(&PreviewBP, PreviewB, 2, getDeviceName(), "CCD_PREVIEW", "Preview Data", IMAGE_INFO_TAB, IP_RO, 60,
+                     IPS_IDLE);
+
     // Bayer
     IUFillText(&BayerT[0], "CFA_OFFSET_X", "X Offset", "0");
     IUFillText(&BayerT[1], "CFA_OFFSET_Y", "Y Offset", "0");
@@ -367,6 +433,19 @@ bool CCD::initProperties()
     IUFillTextVector(&FileNameTP, FileNameT, 1, getDeviceName(), "CCD_FILE_PATH", "Filename", IMAGE_INFO_TAB, IP_RO, 60,
                      IPS_IDLE);
 
+    // Local File Durability
+    IUFillSwitch(&FileSyncS[FILE_SYNC_NONE], "FILE_SYNC_NONE", "Cached", ISS_ON);
+    IUFillSwitch(&FileSyncS[FILE_SYNC_DATA], "FILE_SYNC_DATA", "Flush", ISS_OFF);
+    IUFillSwitch(&FileSyncS[FILE_SYNC_DIRECT], "FILE_SYNC_DIRECT", "Direct", ISS_OFF);
+    IUFillSwitchVector(&FileSyncSP, FileSyncS, 3, getDeviceName(), "CCD_FILE_SYNC", "File Sync", OPTIONS_TAB, IP_RW,
+                       ISR_1OFMANY, 0, IPS_IDLE);
+
+    // Local File Writer Statistics
+    IUFillNumber(&FileWriterN[FILE_WRITER_QUEUE], "FILE_WRITER_QUEUE", "Queue", "%.f", 0, 100, 0, 0);
+    IUFillNumber(&FileWriterN[FILE_WRITER_RATE], "FILE_WRITER_RATE", "MB/s", "%.2f", 0, 10000, 0, 0);
+    IUFillNumberVector(&FileWriterNP, FileWriterN, 2, getDeviceName(), "CCD_FILE_WRITER", "File Writer", IMAGE_INFO_TAB,
+                       IP_RO, 60, IPS_IDLE);
+
     /**********************************************/
     /****************** FITS Header****************/
     /**********************************************/
@@ -454,6 +533,9 @@ void CCD::ISGetProperties(const char * dev)
     defineText(&ActiveDeviceTP);
     loadConfig(true, "ACTIVE_DEVICES");
 
+    // A client connecting during a preview needs all tiles once, not only the changed ones
+    m_TiledPreview->reset();
+
     if (HasStreaming())
         Streamer->ISGetProperties(dev);
 }
@@ -498,6 +580,9 @@ bool CCD::updateProperties()
         }
         defineSwitch(&PrimaryCCD.CompressSP);
         defineBLOB(&PrimaryCCD.FitsBP);
+        defineSwitch(&PreviewSP);
+        defineNumber(&PreviewSettingsNP);
+        defineBLOB(&PreviewBP);
         if (HasGuideHead())
         {
             defineSwitch(&GuideCCD.CompressSP);
@@ -544,6 +629,7 @@ bool CCD::updateProperties()
         if (UploadSettingsT[UPLOAD_DIR].text == nullptr)
             IUSaveText(&UploadSettingsT[UPLOAD_DIR], getenv("HOME"));
         defineText(&UploadSettingsTP);
+        defineSwitch(&FileSyncSP);
 
 #ifdef HAVE_WEBSOCKET
         if (HasWebSocket())
@@ -568,6 +654,15 @@ bool CCD::updateProperties()
             deleteProperty(PrimaryCCD.AbortExposureSP.name);
         deleteProperty(PrimaryCCD.FitsBP.name);
         deleteProperty(PrimaryCCD.CompressSP.name);
+        deleteProperty(PreviewSP.name);
+        deleteProperty(PreviewSettingsNP.name);
+        deleteProperty(PreviewBP.name);
+
+        if (m_WriteTimerID != -1)
+        {
+            IERmTimer(m_WriteTimerID);
+            m_WriteTimerID = -1;
+        }
 
 #if 0
         deleteProperty(PrimaryCCD.RapidGuideSP.name);
@@ -624,12 +719,14 @@ bool CCD::updateProperties()
         deleteProperty(WorldCoordSP.name);
         deleteProperty(UploadSP.name);
         deleteProperty(UploadSettingsTP.name);
+        deleteProperty(FileSyncSP.name);
 
 #ifdef HAVE_WEBSOCKET
         if (HasWebSocket())
         {
             deleteProperty(WebSocketSP.name);
             deleteProperty(WebSocketSettingsNP.name);
+            removeWebSocketStats();
         }
 #endif
 #ifdef WITH_EXPOSURE_LOOPING
@@ -929,6 +1026,19 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
             return true;
         }
 
+        if (!strcmp(name, PreviewSettingsNP.name))
+        {
+            IUUpdateNumber(&PreviewSettingsNP, values, names, n);
+            std::unique_lock<std::mutex> guard(ccdBufferLock);
+            m_TiledPreview->setTileSize(PreviewSettingsN[PREVIEW_TILE_SIZE].value);
+            m_TiledPreview->setThreshold(PreviewSettingsN[PREVIEW_THRESHOLD].value);
+            m_TiledPreview->setThumbnailScale(PreviewSettingsN[PREVIEW_SCALE].value);
+            guard.unlock();
+            PreviewSettingsNP.s = IPS_OK;
+            IDSetNumber(&PreviewSettingsNP, nullptr);
+            return true;
+        }
+
         if (!strcmp(name, "CCD_BINNING"))
         {
             //  We are being asked to set camera binning
@@ -1182,17 +1292,22 @@ bool CCD::ISNewSwitch(const char * dev, const char * name, ISState * states, cha
                 {
                     DEBUG(Logger::DBG_SESSION, "Upload settings set to client only.");
                     if (prevMode != 0)
+                    {
                         deleteProperty(FileNameTP.name);
+                        deleteProperty(FileWriterNP.name);
+                    }
                 }
                 else if (UploadS[UPLOAD_LOCAL].s == ISS_ON)
                 {
                     DEBUG(Logger::DBG_SESSION, "Upload settings set to local only.");
                     defineText(&FileNameTP);
+                    defineNumber(&FileWriterNP);
                 }
                 else
                 {
                     DEBUG(Logger::DBG_SESSION, "Upload settings set to client and local.");
                     defineText(&FileNameTP);
+                    defineNumber(&FileWriterNP);
                 }
 
                 UploadSP.s = IPS_OK;
@@ -1209,6 +1324,40 @@ bool CCD::ISNewSwitch(const char * dev, const char * name, ISState * states, cha
             return true;
         }
 
+        // Preview Mode
+        if (!strcmp(name, PreviewSP.name))
+        {
+            IUUpdateSwitch(&PreviewSP, states, names, n);
+            // Client must receive a complete set of tiles before it can apply updates.
+            std::unique_lock<std::mutex> guard(ccdBufferLock);
+            m_TiledPreview->reset();
+            guard.unlock();
+            PreviewSP.s = IPS_OK;
+            IDSetSwitch(&PreviewSP, nullptr);
+            return true;
+        }
+
+        // Local File Durability
+        if (!strcmp(name, FileSyncSP.name))
+        {
+            IUUpdateSwitch(&FileSyncSP, states, names, n);
+            switch (IUFindOnSwitchIndex(&FileSyncSP))
+            {
+                case FILE_SYNC_DATA:
+                    m_ImageWriter->setSyncMode(ImageWriter::SYNC_DATA);
+                    break;
+                case FILE_SYNC_DIRECT:
+                    m_ImageWriter->setSyncMode(ImageWriter::SYNC_DIRECT);
+                    break;
+                default:
+                    m_ImageWriter->setSyncMode(ImageWriter::SYNC_NONE);
+                    break;
+            }
+            FileSyncSP.s = IPS_OK;
+            IDSetSwitch(&FileSyncSP, nullptr);
+            return true;
+        }
+
         if (!strcmp(name, TelescopeTypeSP.name))
         {
             IUUpdateSwitch(&TelescopeTypeSP, states, names, n);
@@ -1241,12 +1390,18 @@ bool CCD::ISNewSwitch(const char * dev, const char * name, ISState * states, cha
                 WebSocketSettingsN[WS_SETTINGS_PORT].value = wsServer.generatePort();
                 WebSocketSettingsNP.s = IPS_OK;
                 defineNumber(&WebSocketSettingsNP);
+                if (wsStatsTimerID == -1)
+                {
+                    wsStatsTime = std::chrono::steady_clock::now();
+                    wsStatsTimerID = IEAddTimer(1000, wsStatsHelper, this);
+                }
             }
             else if (wsServer.is_running())
             {
                 wsServer.stop();
                 wsThread.join();
                 deleteProperty(WebSocketSettingsNP.name);
+                removeWebSocketStats();
             }
 
             IDSetSwitch(&WebSocketSP, nullptr);
@@ -1606,206 +1761,261 @@ bool CCD::UpdateGuiderFrameType(CCDChip::CCD_FRAME fType)
 void CCD::addFITSKeywords(fitsfile * fptr, CCDChip * targetChip)
 {
     int status = 0;
-    char dev_name[32];
-    char exp_start[32];
     double pixSize1, pixSize2;
 
     AutoCNumeric locale;
-    fits_update_key_str(fptr, "INSTRUME", getDeviceName(), "CCD Name", &status);
+
+    FITSHeaderTemplate &header = *m_FITSHeader[(targetChip == &GuideCCD) ? 1 : 0];
+
+    pixSize1 = static_cast<double>(targetChip->getPixelSizeX());
+    pixSize2 = static_cast<double>(targetChip->getPixelSizeY());
+
+    // If the camera has a cooler OR if the temperature permission was explicitly set to Read-Only, then record the temperature
+    bool hasTemperature = HasCooler() || TemperatureNP.p == IP_RO;
+    bool hasFilter      = CurrentFilterSlot != -1 && CurrentFilterSlot <= static_cast<int>(FilterNames.size());
+    bool hasBayer       = HasBayer() && targetChip->getNAxis() == 2;
+    bool hasCoords      = targetChip->getFrameType() == CCDChip::LIGHT_FRAME && !std::isnan(J2000RA) && !std::isnan(J2000DE);
+    bool hasSite        = !std::isnan(Latitude) && !std::isnan(Longitude);
+    bool hasWCS         = WorldCoordS[0].s == ISS_ON && m_ValidCCDRotation && primaryFocalLength != -1;
+#ifdef WITH_MINMAX
+    bool hasMinMax      = targetChip->getNAxis() == 2;
+#else
+    bool hasMinMax      = false;
+#endif
+
+    double focalLength = -1;
+    if (TelescopeTypeS[TELESCOPE_PRIMARY].s == ISS_ON && primaryFocalLength != -1)
+        focalLength = primaryFocalLength;
+    else if (TelescopeTypeS[TELESCOPE_GUIDE].s == ISS_ON && guiderFocalLength != -1)
+        focalLength = guiderFocalLength;
+
+    // Everything that selects or formats a static card goes into the signature. Values that change every frame
+    // (exposure, temperature, airmass, sky quality, rotator angle, coordinates, site, rotation, timestamps, min/max)
+    // only select their card and are patched below.
+    char signature[MAXRBUF];
+    snprintf(signature, MAXRBUF, "%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%.17g|%.17g|%d|%d|%d|%d|%d|%.17g|%.17g|%.17g",
+             targetChip->getFrameType(), hasTemperature, hasFilter, hasBayer, hasCoords, hasSite, hasWCS, hasMinMax,
+             !std::isnan(MPSAS), !std::isnan(RotatorAngle), !std::isnan(Airmass), targetChip->getBinX(), targetChip->getBinY(),
+             pixSize1, pixSize2, targetChip->getSubW(), targetChip->getSubH(), hasFilter ? CurrentFilterSlot : 0,
+             CurrentFilterSlot, TelescopeTypeS[TELESCOPE_PRIMARY].s, focalLength, primaryFocalLength,
+             static_cast<double>(FilterNames.size()));
+    std::string key = signature;
+    key += std::string("|") + getDeviceName() + "|" + ActiveDeviceT[0].text + "|" + FITSHeaderT[FITS_OBSERVER].text + "|" +
+           FITSHeaderT[FITS_OBJECT].text;
+    if (hasFilter)
+        key += "|" + FilterNames.at(CurrentFilterSlot - 1);
+    if (hasBayer)
+        key += std::string("|") + BayerT[0].text + "|" + BayerT[1].text + "|" + BayerT[2].text;
+
+    if (!header.isValid(key))
+        buildFITSHeader(header, key, targetChip);
+
+    // Patch per-frame values
+    header.setDouble("EXPTIME", targetChip->getExposureDuration());
+    header.setDouble("DARKTIME", targetChip->getExposureDuration());
+    header.setDouble("CCD-TEMP", TemperatureN[0].value);
+#ifdef WITH_MINMAX
+    if (hasMinMax)
+    {
+        double min_val, max_val;
+        getMinMax(&min_val, &max_val, targetChip);
+
+        header.setDouble("DATAMIN", min_val);
+        header.setDouble("DATAMAX", max_val);
+    }
+#endif
+    header.setDouble("MPSAS", MPSAS);
+    header.setDouble("ROTATANG", RotatorAngle);
+    header.setDouble("AIRMASS", Airmass);
+    header.setString("DATE-OBS", targetChip->getExposureStartTime());
+
+    if (hasCoords)
+    {
+        char ra_str[32] = {0}, de_str[32] = {0};
+        formatSexaSpaces(ra_str, J2000RA);
+        formatSexaSpaces(de_str, J2000DE);
+
+        header.setString("OBJCTRA", ra_str);
+        header.setString("OBJCTDEC", de_str);
+        header.setDouble("RA", J2000RA * 15);
+        header.setDouble("DEC", J2000DE);
+        header.setDouble("SITELAT", Latitude);
+        header.setDouble("SITELONG", Longitude);
+
+        if (hasWCS)
+        {
+            double rotation = 360 - CCDRotationN[0].value;
+            if (rotation > 360)
+                rotation -= 360;
+
+            header.setDouble("CRVAL1", J2000RA * 15);
+            header.setDouble("CRVAL2", J2000DE);
+            header.setDouble("CROTA1", rotation);
+            header.setDouble("CROTA2", rotation);
+        }
+    }
+
+    header.write(fptr, &status);
+}
+
+void CCD::buildFITSHeader(FITSHeaderTemplate &header, const std::string &signature, CCDChip * targetChip)
+{
+    double pixSize1 = static_cast<double>(targetChip->getPixelSizeX());
+    double pixSize2 = static_cast<double>(targetChip->getPixelSizeY());
+
+    header.reset(signature);
+
+    header.addString("INSTRUME", getDeviceName(), "CCD Name");
 
     // Telescope
     if (strlen(ActiveDeviceT[0].text) > 0)
     {
-        fits_update_key_str(fptr, "TELESCOP", ActiveDeviceT[0].text, "Telescope name", &status);
+        header.addString("TELESCOP", ActiveDeviceT[0].text, "Telescope name");
     }
 
     // Observer
-    fits_update_key_str(fptr, "OBSERVER", FITSHeaderT[FITS_OBSERVER].text, "Observer name", &status);
+    header.addString("OBSERVER", FITSHeaderT[FITS_OBSERVER].text, "Observer name");
 
     // Object
-    fits_update_key_str(fptr, "OBJECT", FITSHeaderT[FITS_OBJECT].text, "Object name", &status);
-
-    pixSize1 = static_cast<double>(targetChip->getPixelSizeX());
-    pixSize2 = static_cast<double>(targetChip->getPixelSizeY());
+    header.addString("OBJECT", FITSHeaderT[FITS_OBJECT].text, "Object name");
 
-    strncpy(dev_name, getDeviceName(), 32);
-    strncpy(exp_start, targetChip->getExposureStartTime(), 32);
-
-    fits_update_key_dbl(fptr, "EXPTIME", targetChip->getExposureDuration(), 6, "Total Exposure Time (s)", &status);
+    header.addDouble("EXPTIME", targetChip->getExposureDuration(), 6, "Total Exposure Time (s)");
 
     if (targetChip->getFrameType() == CCDChip::DARK_FRAME)
-        fits_update_key_dbl(fptr, "DARKTIME", targetChip->getExposureDuration(), 6, "Total Dark Exposure Time (s)", &status);
+        header.addDouble("DARKTIME", targetChip->getExposureDuration(), 6, "Total Dark Exposure Time (s)");
 
     // If the camera has a cooler OR if the temperature permission was explicitly set to Read-Only, then record the temperature
     if (HasCooler() || TemperatureNP.p == IP_RO)
-        fits_update_key_dbl(fptr, "CCD-TEMP", TemperatureN[0].value, 2, "CCD Temperature (Celsius)", &status);
+        header.addDouble("CCD-TEMP", TemperatureN[0].value, 2, "CCD Temperature (Celsius)");
 
-    fits_update_key_dbl(fptr, "PIXSIZE1", targetChip->getPixelSizeX(), 6, "Pixel Size 1 (microns)", &status);
-    fits_update_key_dbl(fptr, "PIXSIZE2", targetChip->getPixelSizeY(), 6, "Pixel Size 2 (microns)", &status);
-    fits_update_key_lng(fptr, "XBINNING", targetChip->getBinX(), "Binning factor in width", &status);
-    fits_update_key_lng(fptr, "YBINNING", targetChip->getBinY(), "Binning factor in height", &status);
+    header.addDouble("PIXSIZE1", pixSize1, 6, "Pixel Size 1 (microns)");
+    header.addDouble("PIXSIZE2", pixSize2, 6, "Pixel Size 2 (microns)");
+    header.addLong("XBINNING", targetChip->getBinX(), "Binning factor in width");
+    header.addLong("YBINNING", targetChip->getBinY(), "Binning factor in height");
     // XPIXSZ and YPIXSZ are logical sizes including the binning factor
     double xpixsz = pixSize1 * targetChip->getBinX();
     double ypixsz = pixSize2 * targetChip->getBinY();
-    fits_update_key_dbl(fptr, "XPIXSZ", xpixsz, 6, "X binned pixel size in microns", &status);
-    fits_update_key_dbl(fptr, "YPIXSZ", ypixsz, 6, "Y binned pixel size in microns", &status);
+    header.addDouble("XPIXSZ", xpixsz, 6, "X binned pixel size in microns");
+    header.addDouble("YPIXSZ", ypixsz, 6, "Y binned pixel size in microns");
 
     switch (targetChip->getFrameType())
     {
         case CCDChip::LIGHT_FRAME:
-            fits_update_key_str(fptr, "FRAME", "Light", "Frame Type", &status);
+            header.addString("FRAME", "Light", "Frame Type");
             break;
         case CCDChip::BIAS_FRAME:
-            fits_update_key_str(fptr, "FRAME", "Bias", "Frame Type", &status);
+            header.addString("FRAME", "Bias", "Frame Type");
             break;
         case CCDChip::FLAT_FRAME:
-            fits_update_key_str(fptr, "FRAME", "Flat", "Frame Type", &status);
+            header.addString("FRAME", "Flat", "Frame Type");
             break;
         case CCDChip::DARK_FRAME:
-            fits_update_key_str(fptr, "FRAME", "Dark", "Frame Type", &status);
+            header.addString("FRAME", "Dark", "Frame Type");
             break;
     }
 
     if (CurrentFilterSlot != -1 && CurrentFilterSlot <= static_cast<int>(FilterNames.size()))
     {
-        fits_update_key_str(fptr, "FILTER", FilterNames.at(CurrentFilterSlot - 1).c_str(), "Filter", &status);
+        header.addString("FILTER", FilterNames.at(CurrentFilterSlot - 1).c_str(), "Filter");
     }
 
 #ifdef WITH_MINMAX
     if (targetChip->getNAxis() == 2)
     {
-        double min_val, max_val;
-        getMinMax(&min_val, &max_val, targetChip);
-
-        fits_update_key_dbl(fptr, "DATAMIN", min_val, 6, "Minimum value", &status);
-        fits_update_key_dbl(fptr, "DATAMAX", max_val, 6, "Maximum value", &status);
+        header.addDouble("DATAMIN", 0, 6, "Minimum value");
+        header.addDouble("DATAMAX", 0, 6, "Maximum value");
     }
 #endif
 
     if (HasBayer() && targetChip->getNAxis() == 2)
     {
-        fits_update_key_lng(fptr, "XBAYROFF", atoi(BayerT[0].text), "X offset of Bayer array", &status);
-        fits_update_key_lng(fptr, "YBAYROFF", atoi(BayerT[1].text), "Y offset of Bayer array", &status);
-        fits_update_key_str(fptr, "BAYERPAT", BayerT[2].text, "Bayer color pattern", &status);
+        header.addLong("XBAYROFF", atoi(BayerT[0].text), "X offset of Bayer array");
+        header.addLong("YBAYROFF", atoi(BayerT[1].text), "Y offset of Bayer array");
+        header.addString("BAYERPAT", BayerT[2].text, "Bayer color pattern");
     }
 
     if (TelescopeTypeS[TELESCOPE_PRIMARY].s == ISS_ON && primaryFocalLength != -1)
-        fits_update_key_dbl(fptr, "FOCALLEN", primaryFocalLength, 2, "Focal Length (mm)", &status);
+        header.addDouble("FOCALLEN", primaryFocalLength, 2, "Focal Length (mm)");
     else if (TelescopeTypeS[TELESCOPE_GUIDE].s == ISS_ON && guiderFocalLength != -1)
-        fits_update_key_dbl(fptr, "FOCALLEN", guiderFocalLength, 2, "Focal Length (mm)", &status);
+        header.addDouble("FOCALLEN", guiderFocalLength, 2, "Focal Length (mm)");
 
     if (!std::isnan(MPSAS))
     {
-        fits_update_key_dbl(fptr, "MPSAS", MPSAS, 6, "Sky Quality (mag per arcsec^2)", &status);
+        header.addDouble("MPSAS", MPSAS, 6, "Sky Quality (mag per arcsec^2)");
     }
 
     if (!std::isnan(RotatorAngle))
     {
-        fits_update_key_dbl(fptr, "ROTATANG", RotatorAngle, 3, "Rotator angle in degrees", &status);
+        header.addDouble("ROTATANG", RotatorAngle, 3, "Rotator angle in degrees");
     }
 
     // SCALE assuming square-pixels
     double pixScale = pixSize1 / primaryFocalLength * 206.3 * targetChip->getBinX();
-    fits_update_key_dbl(fptr, "SCALE", pixScale, 6, "arcsecs per pixel", &status);
+    header.addDouble("SCALE", pixScale, 6, "arcsecs per pixel");
 
     if (targetChip->getFrameType() == CCDChip::LIGHT_FRAME && !std::isnan(J2000RA) && !std::isnan(J2000DE))
     {
         char ra_str[32] = {0}, de_str[32] = {0};
-
-        fs_sexa(ra_str, J2000RA, 2, 360000);
-        fs_sexa(de_str, J2000DE, 2, 360000);
-
-        char * raPtr = ra_str, *dePtr = de_str;
-        while (*raPtr != '\0')
-        {
-            if (*raPtr == ':')
-                *raPtr = ' ';
-            raPtr++;
-        }
-        while (*dePtr != '\0')
-        {
-            if (*dePtr == ':')
-                *dePtr = ' ';
-            dePtr++;
-        }
+        formatSexaSpaces(ra_str, J2000RA);
+        formatSexaSpaces(de_str, J2000DE);
 
         if (!std::isnan(Latitude) && !std::isnan(Longitude))
         {
-            fits_update_key_dbl(fptr, "SITELAT", Latitude, 6, "Latitude of the imaging site in degrees", &status);
-            fits_update_key_dbl(fptr, "SITELONG", Longitude, 6, "Longitude of the imaging site in degrees", &status);
+            header.addDouble("SITELAT", Latitude, 6, "Latitude of the imaging site in degrees");
+            header.addDouble("SITELONG", Longitude, 6, "Longitude of the imaging site in degrees");
         }
         if (!std::isnan(Airmass))
-            //fits_update_key_s(fptr, TDOUBLE, "AIRMASS", &Airmass, "Airmass", &status);
-            fits_update_key_dbl(fptr, "AIRMASS", Airmass, 6, "Airmass", &status);
+            header.addDouble("AIRMASS", Airmass, 6, "Airmass");
 
-        fits_update_key_str(fptr, "OBJCTRA", ra_str, "Object J2000 RA in Hours", &status);
-        fits_update_key_str(fptr, "OBJCTDEC", de_str, "Object J2000 DEC in Degrees", &status);
+        header.addString("OBJCTRA", ra_str, "Object J2000 RA in Hours");
+        header.addString("OBJCTDEC", de_str, "Object J2000 DEC in Degrees");
 
-        fits_update_key_dbl(fptr, "RA", J2000RA * 15, 6, "Object J2000 RA in Degrees", &status);
-        fits_update_key_dbl(fptr, "DEC", J2000DE, 6, "Object J2000 DEC in Degrees", &status);
+        header.addDouble("RA", J2000RA * 15, 6, "Object J2000 RA in Degrees");
+        header.addDouble("DEC", J2000DE, 6, "Object J2000 DEC in Degrees");
 
-        //fits_update_key_s(fptr, TINT, "EPOCH", &epoch, "Epoch", &status);
-        fits_update_key_lng(fptr, "EQUINOX", 2000, "Equinox", &status);
+        header.addLong("EQUINOX", 2000, "Equinox");
 
         // Add WCS Info
         if (WorldCoordS[0].s == ISS_ON && m_ValidCCDRotation && primaryFocalLength != -1)
         {
             double J2000RAHours = J2000RA * 15;
-            fits_update_key_dbl(fptr, "CRVAL1", J2000RAHours, 10, "CRVAL1", &status);
-            fits_update_key_dbl(fptr, "CRVAL2", J2000DE, 10, "CRVAL1", &status);
+            header.addDouble("CRVAL1", J2000RAHours, 10, "CRVAL1");
+            header.addDouble("CRVAL2", J2000DE, 10, "CRVAL1");
 
-            char radecsys[8] = "FK5";
-            char ctype1[16]  = "RA---TAN";
-            char ctype2[16]  = "DEC--TAN";
-
-            fits_update_key_str(fptr, "RADECSYS", radecsys, "RADECSYS", &status);
-            fits_update_key_str(fptr, "CTYPE1", ctype1, "CTYPE1", &status);
-            fits_update_key_str(fptr, "CTYPE2", ctype2, "CTYPE2", &status);
+            header.addString("RADECSYS", "FK5", "RADECSYS");
+            header.addString("CTYPE1", "RA---TAN", "CTYPE1");
+            header.addString("CTYPE2", "DEC--TAN", "CTYPE2");
 
             double crpix1 = targetChip->getSubW() / targetChip->getBinX() / 2.0;
             double crpix2 = targetChip->getSubH() / targetChip->getBinY() / 2.0;
 
-            fits_update_key_dbl(fptr, "CRPIX1", crpix1, 10, "CRPIX1", &status);
-            fits_update_key_dbl(fptr, "CRPIX2", crpix2, 10, "CRPIX2", &status);
+            header.addDouble("CRPIX1", crpix1, 10, "CRPIX1");
+            header.addDouble("CRPIX2", crpix2, 10, "CRPIX2");
 
             double secpix1 = pixSize1 / primaryFocalLength * 206.3 * targetChip->getBinX();
             double secpix2 = pixSize2 / primaryFocalLength * 206.3 * targetChip->getBinY();
 
-            //double secpix1 = pixSize1 / FocalLength * 206.3;
-            //double secpix2 = pixSize2 / FocalLength * 206.3;
-
-            fits_update_key_dbl(fptr, "SECPIX1", secpix1, 10, "SECPIX1", &status);
-            fits_update_key_dbl(fptr, "SECPIX2", secpix2, 10, "SECPIX2", &status);
+            header.addDouble("SECPIX1", secpix1, 10, "SECPIX1");
+            header.addDouble("SECPIX2", secpix2, 10, "SECPIX2");
 
             double degpix1 = secpix1 / 3600.0;
             double degpix2 = secpix2 / 3600.0;
 
-            fits_update_key_dbl(fptr, "CDELT1", degpix1, 10, "CDELT1", &status);
-            fits_update_key_dbl(fptr, "CDELT2", degpix2, 10, "CDELT2", &status);
+            header.addDouble("CDELT1", degpix1, 10, "CDELT1");
+            header.addDouble("CDELT2", degpix2, 10, "CDELT2");
 
             // Rotation is CW, we need to convert it to CCW per CROTA1 definition
             double rotation = 360 - CCDRotationN[0].value;
             if (rotation > 360)
                 rotation -= 360;
 
-            fits_update_key_dbl(fptr, "CROTA1", rotation, 10, "CROTA1", &status);
-            fits_update_key_dbl(fptr, "CROTA2", rotation, 10, "CROTA2", &status);
-
-            /*double cd[4];
-            cd[0] = degpix1;
-            cd[1] = 0;
-            cd[2] = 0;
-            cd[3] = degpix2;
-
-            fits_update_key_s(fptr, TDOUBLE, "CD1_1", &cd[0], "CD1_1", &status);
-            fits_update_key_s(fptr, TDOUBLE, "CD1_2", &cd[1], "CD1_2", &status);
-            fits_update_key_s(fptr, TDOUBLE, "CD2_1", &cd[2], "CD2_1", &status);
-            fits_update_key_s(fptr, TDOUBLE, "CD2_2", &cd[3], "CD2_2", &status);*/
+            header.addDouble("CROTA1", rotation, 10, "CROTA1");
+            header.addDouble("CROTA2", rotation, 10, "CROTA2");
         }
     }
 
-    fits_update_key_str(fptr, "DATE-OBS", exp_start, "UTC start date of observation", &status);
-    fits_write_comment(fptr, "Generated by INDI", &status);
+    header.addString("DATE-OBS", targetChip->getExposureStartTime(), "UTC start date of observation");
+    header.addComment("Generated by INDI");
 }
 
 void CCD::fits_update_key_s(fitsfile * fptr, int type, std::string name, void * p, std::string explanation,
@@ -1820,8 +2030,21 @@ bool CCD::ExposureComplete(CCDChip * targetChip)
     // Reset POLLMS to default value
     POLLMS = getPollingPeriod();
 
+    // The frame is saved by the image writer, poll its results until the write is done
+    bool saving = UploadS[UPLOAD_CLIENT].s != ISS_ON;
+    if (saving)
+    {
+        m_CompletingExposures++;
+        armWriteResults();
+    }
+
     // Run async
-    std::thread(&CCD::ExposureCompletePrivate, this, targetChip).detach();
+    std::thread([this, targetChip, saving]()
+    {
+        ExposureCompletePrivate(targetChip);
+        if (saving)
+            m_CompletingExposures--;
+    }).detach();
 
     return true;
 }
@@ -1911,334 +2134,28 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 
     if (sendData)
     {
-        static double P0 = 0.906, P1 = 0.584, P2 = 0.365, P3 = 0.117, P4 = 0.049, P5 = -0.05, P6 = -0.064, P7 = -0.074,
-                      P8               = -0.094;
         targetChip->RapidGuideDataNP.s = IPS_BUSY;
         int width                      = targetChip->getSubW() / targetChip->getBinX();
         int height                     = targetChip->getSubH() / targetChip->getBinY();
         void * src                      = (unsigned short *)targetChip->getFrameBuffer();
-        int i0, i1, i2, i3, i4, i5, i6, i7, i8;
-        int ix = 0, iy = 0;
-        int xM4;
-        double average, fit, bestFit = 0;
-        int minx = 4;
-        int maxx = width - 4;
-        int miny = 4;
-        int maxy = height - 4;
-        if (targetChip->lastRapidX > 0 && targetChip->lastRapidY > 0)
-        {
-            minx = std::max(targetChip->lastRapidX - 20, 4);
-            maxx = std::min(targetChip->lastRapidX + 20, width - 4);
-            miny = std::max(targetChip->lastRapidY - 20, 4);
-            maxy = std::min(targetChip->lastRapidY + 20, height - 4);
-        }
-        if (targetChip->getBPP() == 16)
-        {
-            unsigned short * p;
-            for (int x = minx; x < maxx; x++)
-                for (int y = miny; y < maxy; y++)
-                {
-                    i0 = i1 = i2 = i3 = i4 = i5 = i6 = i7 = i8 = 0;
-                    xM4                                        = x - 4;
-                    p                                          = (unsigned short *)src + (y - 4) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y - 3) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i6 += *p++;
-                    i7 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y - 2) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i5 += *p++;
-                    i4 += *p++;
-                    i3 += *p++;
-                    i4 += *p++;
-                    i5 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y - 1) * width + xM4;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i4 += *p++;
-                    i2 += *p++;
-                    i1 += *p++;
-                    i2 += *p++;
-                    i4 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y + 0) * width + xM4;
-                    i8 += *p++;
-                    i6 += *p++;
-                    i3 += *p++;
-                    i1 += *p++;
-                    i0 += *p++;
-                    i1 += *p++;
-                    i3 += *p++;
-                    i6 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y + 1) * width + xM4;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i4 += *p++;
-                    i2 += *p++;
-                    i1 += *p++;
-                    i2 += *p++;
-                    i4 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y + 2) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i5 += *p++;
-                    i4 += *p++;
-                    i3 += *p++;
-                    i4 += *p++;
-                    i5 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y + 3) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i6 += *p++;
-                    i7 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned short *)src + (y + 4) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    average = (i0 + i1 + i2 + i3 + i4 + i5 + i6 + i7 + i8) / 85.0;
-                    fit     = P0 * (i0 - average) + P1 * (i1 - 4 * average) + P2 * (i2 - 4 * average) +
-                              P3 * (i3 - 4 * average) + P4 * (i4 - 8 * average) + P5 * (i5 - 4 * average) +
-                              P6 * (i6 - 4 * average) + P7 * (i7 - 8 * average) + P8 * (i8 - 48 * average);
-                    if (bestFit < fit)
-                    {
-                        bestFit = fit;
-                        ix      = x;
-                        iy      = y;
-                    }
-                }
-        }
-        else
-        {
-            unsigned char * p;
-            for (int x = minx; x < maxx; x++)
-                for (int y = miny; y < maxy; y++)
-                {
-                    i0 = i1 = i2 = i3 = i4 = i5 = i6 = i7 = i8 = 0;
-                    xM4                                        = x - 4;
-                    p                                          = (unsigned char *)src + (y - 4) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y - 3) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i6 += *p++;
-                    i7 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y - 2) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i5 += *p++;
-                    i4 += *p++;
-                    i3 += *p++;
-                    i4 += *p++;
-                    i5 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y - 1) * width + xM4;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i4 += *p++;
-                    i2 += *p++;
-                    i1 += *p++;
-                    i2 += *p++;
-                    i4 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y + 0) * width + xM4;
-                    i8 += *p++;
-                    i6 += *p++;
-                    i3 += *p++;
-                    i1 += *p++;
-                    i0 += *p++;
-                    i1 += *p++;
-                    i3 += *p++;
-                    i6 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y + 1) * width + xM4;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i4 += *p++;
-                    i2 += *p++;
-                    i1 += *p++;
-                    i2 += *p++;
-                    i4 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y + 2) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i5 += *p++;
-                    i4 += *p++;
-                    i3 += *p++;
-                    i4 += *p++;
-                    i5 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y + 3) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i7 += *p++;
-                    i6 += *p++;
-                    i7 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    p = (unsigned char *)src + (y + 4) * width + xM4;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    i8 += *p++;
-                    average = (i0 + i1 + i2 + i3 + i4 + i5 + i6 + i7 + i8) / 85.0;
-                    fit     = P0 * (i0 - average) + P1 * (i1 - 4 * average) + P2 * (i2 - 4 * average) +
-                              P3 * (i3 - 4 * average) + P4 * (i4 - 8 * average) + P5 * (i5 - 4 * average) +
-                              P6 * (i6 - 4 * average) + P7 * (i7 - 8 * average) + P8 * (i8 - 48 * average);
-                    if (bestFit < fit)
-                    {
-                        bestFit = fit;
-                        ix      = x;
-                        iy      = y;
-                    }
-                }
-        }
-
-        targetChip->RapidGuideDataN[0].value = ix;
-        targetChip->RapidGuideDataN[1].value = iy;
-        targetChip->RapidGuideDataN[2].value = bestFit;
-        targetChip->lastRapidX               = ix;
-        targetChip->lastRapidY               = iy;
-        if (bestFit > 50)
-        {
-            int sumX           = 0;
-            int sumY           = 0;
-            int total          = 0;
-            int max            = 0;
-            int noiseThreshold = 0;
 
-            if (targetChip->getBPP() == 16)
-            {
-                unsigned short * p;
-                for (int y = iy - 4; y <= iy + 4; y++)
-                {
-                    p = (unsigned short *)src + y * width + ix - 4;
-                    for (int x = ix - 4; x <= ix + 4; x++)
-                    {
-                        int w = *p++;
-                        noiseThreshold += w;
-                        if (w > max)
-                            max = w;
-                    }
-                }
-                noiseThreshold = (noiseThreshold / 81 + max) / 2; // set threshold between peak and average
-                for (int y = iy - 4; y <= iy + 4; y++)
-                {
-                    p = (unsigned short *)src + y * width + ix - 4;
-                    for (int x = ix - 4; x <= ix + 4; x++)
-                    {
-                        int w = *p++;
-                        if (w < noiseThreshold)
-                            w = 0;
-                        sumX += x * w;
-                        sumY += y * w;
-                        total += w;
-                    }
-                }
-            }
-            else
-            {
-                unsigned char * p;
-                for (int y = iy - 4; y <= iy + 4; y++)
-                {
-                    p = (unsigned char *)src + y * width + ix - 4;
-                    for (int x = ix - 4; x <= ix + 4; x++)
-                    {
-                        int w = *p++;
-                        noiseThreshold += w;
-                        if (w > max)
-                            max = w;
-                    }
-                }
-                noiseThreshold = (noiseThreshold / 81 + max) / 2; // set threshold between peak and average
-                for (int y = iy - 4; y <= iy + 4; y++)
-                {
-                    p = (unsigned char *)src + y * width + ix - 4;
-                    for (int x = ix - 4; x <= ix + 4; x++)
-                    {
-                        int w = *p++;
-                        if (w < noiseThreshold)
-                            w = 0;
-                        sumX += x * w;
-                        sumY += y * w;
-                        total += w;
-                    }
-                }
-            }
+        GuideStarFinder finder;
+        GuideStar star = finder.find(targetChip->getFrameBuffer(), width, height, targetChip->getBPP(),
+                                     targetChip->lastRapidX, targetChip->lastRapidY);
+        int ix = star.valid ? static_cast<int>(std::lround(star.x)) : 0;
+        int iy = star.valid ? static_cast<int>(std::lround(star.y)) : 0;
 
-            if (total > 0)
-            {
-                targetChip->RapidGuideDataN[0].value = ((double)sumX) / total;
-                targetChip->RapidGuideDataN[1].value = ((double)sumY) / total;
-                targetChip->RapidGuideDataNP.s       = IPS_OK;
+        targetChip->RapidGuideDataN[2].value = star.fit;
+        if (star.valid)
+        {
+            targetChip->RapidGuideDataN[0].value = star.x;
+            targetChip->RapidGuideDataN[1].value = star.y;
+            targetChip->RapidGuideDataNP.s       = IPS_OK;
+            targetChip->lastRapidX               = ix;
+            targetChip->lastRapidY               = iy;
 
-                DEBUGF(Logger::DBG_DEBUG, "Guide Star X: %g Y: %g FIT: %g", targetChip->RapidGuideDataN[0].value,
-                       targetChip->RapidGuideDataN[1].value, targetChip->RapidGuideDataN[2].value);
-            }
-            else
-            {
-                targetChip->RapidGuideDataNP.s = IPS_ALERT;
-                targetChip->lastRapidX = targetChip->lastRapidY = -1;
-            }
+            DEBUGF(Logger::DBG_DEBUG, "Guide Star X: %g Y: %g FIT: %g", targetChip->RapidGuideDataN[0].value,
+                   targetChip->RapidGuideDataN[1].value, targetChip->RapidGuideDataN[2].value);
         }
         else
         {
@@ -2326,6 +2243,17 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     }
 #endif
 
+    // In tiled preview mode the client only receives the changed tiles, full frame is still saved locally if requested.
+    if (sendImage && targetChip == &PrimaryCCD && PreviewS[PREVIEW_TILES].s == ISS_ON)
+    {
+        std::unique_lock<std::mutex> guard(ccdBufferLock);
+        bool rc = sendTiledPreview(targetChip);
+        guard.unlock();
+
+        if (rc)
+            sendImage = false;
+    }
+
     if (sendImage || saveImage /* || useSolver*/)
     {
         if (!strcmp(targetChip->getImageExtension(), "fits"))
@@ -2540,7 +2468,6 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
         targetChip->FitsB.bloblen = totalBytes;
         snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
 
-        FILE * fp = nullptr;
         char imageFileName[MAXRBUF];
 
         std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
@@ -2562,37 +2489,39 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
             time(&t);
             tp = localtime(&t);
             strftime(ts, sizeof(ts), "%Y-%m-%dT%H-%M-%S", tp);
-            std::string filets(ts);
-            prefix = std::regex_replace(prefix, std::regex("ISO8601"), filets);
+            replaceAll(prefix, "ISO8601", ts);
+
+            // The cached index may be stale if files were added behind our back, so rescan once on collision.
+            if (prefix.find("XXX") != std::string::npos)
+            {
+                snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text,
+                         formatFileIndex(prefix, maxIndex).c_str(), targetChip->FitsB.format);
 
-            char indexString[8];
-            snprintf(indexString, 8, "%03d", maxIndex);
-            std::string prefixIndex = indexString;
-            //prefix.replace(prefix.find("XXX"), std::string::npos, prefixIndex);
-            prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
+                struct stat st;
+                if (stat(imageFileName, &st) == 0)
+                {
+                    maxIndex = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
+                                            targetChip->FitsB.format, true);
+                    if (maxIndex < 0)
+                    {
+                        LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
+                                   strerror(errno));
+                        return false;
+                    }
+                }
+
+                prefix = formatFileIndex(prefix, maxIndex);
+            }
         }
 
         snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
 
-        fp = fopen(imageFileName, "w");
-        if (fp == nullptr)
+        // Data is copied so the frame buffer can be released while the file is written in the background.
+        if (m_ImageWriter->queue(imageFileName, fitsData, totalBytes) == false)
         {
-            LOGF_ERROR("Unable to save image file (%s). %s", imageFileName, strerror(errno));
+            LOGF_ERROR("Unable to save image file (%s). Out of memory.", imageFileName);
             return false;
         }
-
-        int n = 0;
-        for (int nr = 0; nr < (int)targetChip->FitsB.bloblen; nr += n)
-            n = fwrite((static_cast<char *>(targetChip->FitsB.blob) + nr), 1, targetChip->FitsB.bloblen - nr, fp);
-
-        fclose(fp);
-
-        // Save image file path
-        IUSaveText(&FileNameT[0], imageFileName);
-
-        DEBUGF(Logger::DBG_SESSION, "Image saved to %s", imageFileName);
-        FileNameTP.s = IPS_OK;
-        IDSetText(&FileNameTP, nullptr);
     }
 
     if (targetChip->SendCompressed)
@@ -2716,7 +2645,8 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
 
             // Send format/size/..etc first later
             wsServer.send_text(std::string(targetChip->FitsB.format));
-            wsServer.send_binary(targetChip->FitsB.blob, targetChip->FitsB.bloblen);
+            // Captured images are never dropped, unlike stream frames
+            wsServer.send_binary(targetChip->FitsB.blob, targetChip->FitsB.bloblen, false);
 
             auto end = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> diff = end - start;
@@ -2741,6 +2671,127 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
     return true;
 }
 
+bool CCD::sendTiledPreview(CCDChip * targetChip)
+{
+    uint8_t planes = (targetChip->getNAxis() == 3) ? 3 : 1;
+    int width      = targetChip->getSubW() / targetChip->getBinX();
+    int height     = targetChip->getSubH() / targetChip->getBinY();
+
+    if (m_TiledPreview->update(targetChip->getFrameBuffer(), width, height, targetChip->getBPP(), planes) == false)
+    {
+        LOGF_DEBUG("Tiled preview is not supported for %d bits per pixel, sending full frame.", targetChip->getBPP());
+        return false;
+    }
+
+    const std::vector<uint8_t> * packets[2] = { &m_TiledPreview->getThumbnail(), &m_TiledPreview->getTiles() };
+    const char * formats[2] = { ".thumb", ".tiles" };
+
+    for (int i = 0; i < 2; i++)
+    {
+        const std::vector<uint8_t> &packet = *packets[i];
+
+        if (targetChip->SendCompressed)
+        {
+            uLong compressedBytes = packet.size() + packet.size() / 64 + 16 + 3;
+            m_CompressedPreview[i].resize(compressedBytes);
+            if (compress2(m_CompressedPreview[i].data(), &compressedBytes, packet.data(), packet.size(), 4) != Z_OK)
+            {
+                LOG_ERROR("Error: Failed to compress preview");
+                return false;
+            }
+
+            PreviewB[i].blob    = m_CompressedPreview[i].data();
+            PreviewB[i].bloblen = compressedBytes;
+            snprintf(PreviewB[i].format, MAXINDIBLOBFMT, "%s.z", formats[i]);
+        }
+        else
+        {
+            PreviewB[i].blob    = const_cast<uint8_t *>(packet.data());
+            PreviewB[i].bloblen = packet.size();
+            snprintf(PreviewB[i].format, MAXINDIBLOBFMT, "%s", formats[i]);
+        }
+        PreviewB[i].size = packet.size();
+    }
+
+    LOGF_DEBUG("Sending preview with %d of %d tiles changed.", m_TiledPreview->getChangedTiles(),
+               m_TiledPreview->getTotalTiles());
+
+    PreviewBP.s = IPS_OK;
+    IDSetBLOB(&PreviewBP, nullptr);
+    return true;
+}
+
+void CCD::writeResultsHelper(void * context)
+{
+    static_cast<CCD *>(context)->processWriteResults();
+}
+
+void CCD::armWriteResults()
+{
+    if (m_WriteTimerID == -1 && isConnected())
+        m_WriteTimerID = IEAddTimer(500, writeResultsHelper, this);
+}
+
+void CCD::processWriteResults()
+{
+    m_WriteTimerID = -1;
+
+    std::deque<ImageWriteResult> results;
+    {
+        std::lock_guard<std::mutex> lock(m_WriteResultsLock);
+        results.swap(m_WriteResults);
+    }
+
+    for (const ImageWriteResult &result : results)
+        imageWriteComplete(result);
+
+    size_t pending = m_ImageWriter->pending();
+    if (pending != m_WriterPending)
+    {
+        m_WriterPending = pending;
+        FileWriterN[FILE_WRITER_QUEUE].value = pending;
+        IDSetNumber(&FileWriterNP, nullptr);
+    }
+
+    // Poll only while writes are about to be queued, are queued, or their results are waiting
+    bool waiting;
+    {
+        std::lock_guard<std::mutex> lock(m_WriteResultsLock);
+        waiting = !m_WriteResults.empty();
+    }
+    if (m_CompletingExposures > 0 || pending > 0 || waiting)
+        armWriteResults();
+}
+
+void CCD::imageWriteComplete(const ImageWriteResult &result)
+{
+    const std::string &filename = result.filename;
+    double seconds = result.seconds;
+
+    if (result.error)
+    {
+        // Keep counting from the cached index, a rescan could hand out the index of a file still queued
+        LOGF_ERROR("Unable to save image file (%s). %s", filename.c_str(), strerror(result.error));
+        FileWriterNP.s = IPS_ALERT;
+        IDSetNumber(&FileWriterNP, nullptr);
+        FileNameTP.s = IPS_ALERT;
+        IDSetText(&FileNameTP, nullptr);
+        return;
+    }
+
+    if (seconds > 0)
+        FileWriterN[FILE_WRITER_RATE].value = result.bytes / seconds / 1e6;
+    FileWriterNP.s = IPS_OK;
+    IDSetNumber(&FileWriterNP, nullptr);
+
+    // Save image file path
+    IUSaveText(&FileNameT[0], filename.c_str());
+
+    DEBUGF(Logger::DBG_SESSION, "Image saved to %s", filename.c_str());
+    FileNameTP.s = IPS_OK;
+    IDSetText(&FileNameTP, nullptr);
+}
+
 void CCD::SetCCDParams(int x, int y, int bpp, float xf, float yf)
 {
     PrimaryCCD.setResolution(x, y);
@@ -2768,12 +2819,15 @@ bool CCD::saveConfigItems(FILE * fp)
     IUSaveConfigText(fp, &ActiveDeviceTP);
     IUSaveConfigSwitch(fp, &UploadSP);
     IUSaveConfigText(fp, &UploadSettingsTP);
+    IUSaveConfigSwitch(fp, &FileSyncSP);
     IUSaveConfigSwitch(fp, &TelescopeTypeSP);
 #ifdef WITH_EXPOSURE_LOOPING
     IUSaveConfigSwitch(fp, &ExposureLoopSP);
 #endif
 
     IUSaveConfigSwitch(fp, &PrimaryCCD.CompressSP);
+    IUSaveConfigSwitch(fp, &PreviewSP);
+    IUSaveConfigNumber(fp, &PreviewSettingsNP);
 
     if (HasGuideHead())
     {
@@ -2888,24 +2942,41 @@ void CCD::getMinMax(double * min, double * max, CCDChip * targetChip)
     *max = lmax;
 }
 
-std::string regex_replace_compat(const std::string &input, const std::string &pattern, const std::string &replace)
+int CCD::getFileIndex(const char * dir, const char * prefix, const char * ext, bool rescan)
 {
-    std::stringstream s;
-    std::regex_replace(std::ostreambuf_iterator<char>(s), input.begin(), input.end(), std::regex(pattern), replace);
-    return s.str();
+    INDI_UNUSED(ext);
+
+    // Only scan the directory when it or the prefix changed since the last save, otherwise keep counting.
+    bool cached = m_FileIndex.next > 0 && m_FileIndex.dir == dir && m_FileIndex.prefix == prefix;
+    if (cached && rescan == false)
+        return m_FileIndex.next++;
+
+    int index = scanFileIndex(dir, prefix);
+    if (index < 0)
+    {
+        m_FileIndex.next = 0;
+        return index;
+    }
+
+    // Files still queued in the image writer are not on disk yet, so a rescan never goes back on the cached index
+    if (cached)
+        index = std::max(index, static_cast<int>(m_FileIndex.next));
+
+    m_FileIndex.dir    = dir;
+    m_FileIndex.prefix = prefix;
+    m_FileIndex.next   = index + 1;
+    return index;
 }
 
-int CCD::getFileIndex(const char * dir, const char * prefix, const char * ext)
+int CCD::scanFileIndex(const char * dir, const char * prefix)
 {
-    INDI_UNUSED(ext);
-
     DIR * dpdf = nullptr;
     struct dirent * epdf = nullptr;
     std::vector<std::string> files = std::vector<std::string>();
 
     std::string prefixIndex = prefix;
-    prefixIndex             = regex_replace_compat(prefixIndex, "_ISO8601", "");
-    prefixIndex             = regex_replace_compat(prefixIndex, "_XXX", "");
+    replaceAll(prefixIndex, "_ISO8601", "");
+    replaceAll(prefixIndex, "_XXX", "");
 
     // Create directory if does not exist
     struct stat st;
@@ -2987,6 +3058,82 @@ void CCD::wsThreadEntry()
 {
     wsServer.run();
 }
+
+void CCD::wsStatsHelper(void * context)
+{
+    static_cast<CCD *>(context)->updateWebSocketStats();
+}
+
+void CCD::updateWebSocketStats()
+{
+    wsStatsTimerID = -1;
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - wsStatsTime).count();
+    wsStatsTime = now;
+
+    std::vector<INDIWSServer::ClientStats> stats = wsServer.get_stats();
+
+    // Remove the properties of closed connections
+    for (auto it = wsClients.begin(); it != wsClients.end();)
+    {
+        bool open = std::any_of(stats.begin(), stats.end(), [&](const INDIWSServer::ClientStats & one)
+        {
+            return one.id == it->first;
+        });
+        if (open)
+            ++it;
+        else
+        {
+            deleteProperty(it->second.StatsNP.name);
+            it = wsClients.erase(it);
+        }
+    }
+
+    for (const INDIWSServer::ClientStats &one : stats)
+    {
+        bool created = (wsClients.count(one.id) == 0);
+        WebSocketClient &client = wsClients[one.id];
+        if (created)
+        {
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, MAXINDINAME, "CCD_WEBSOCKET_CLIENT_%u", one.id);
+            snprintf(label, MAXINDILABEL, "WS %s", one.address.c_str());
+            IUFillNumber(&client.StatsN[WS_CLIENT_FRAMES], "FRAMES", "Frames", "%.f", 0, 1e9, 0, 0);
+            IUFillNumber(&client.StatsN[WS_CLIENT_RATE], "RATE", "Rate (kB/s)", "%.1f", 0, 1e9, 0, 0);
+            IUFillNumber(&client.StatsN[WS_CLIENT_DROPPED], "DROPPED", "Dropped", "%.f", 0, 1e9, 0, 0);
+            IUFillNumber(&client.StatsN[WS_CLIENT_QUEUED], "QUEUED", "Queued", "%.f", 0, INDIWSServer::QUEUE_SIZE, 0, 0);
+            IUFillNumberVector(&client.StatsNP, client.StatsN, 4, getDeviceName(), name, label, OPTIONS_TAB, IP_RO, 60,
+                               IPS_IDLE);
+            client.bytes = one.bytes;
+            defineNumber(&client.StatsNP);
+        }
+
+        // Busy while the client drops frames
+        client.StatsNP.s = (one.dropped > client.StatsN[WS_CLIENT_DROPPED].value) ? IPS_BUSY : IPS_OK;
+        client.StatsN[WS_CLIENT_FRAMES].value  = one.frames;
+        client.StatsN[WS_CLIENT_RATE].value    = seconds > 0 ? (one.bytes - client.bytes) / 1024.0 / seconds : 0;
+        client.StatsN[WS_CLIENT_DROPPED].value = one.dropped;
+        client.StatsN[WS_CLIENT_QUEUED].value  = one.queued;
+        client.bytes = one.bytes;
+        IDSetNumber(&client.StatsNP, nullptr);
+    }
+
+    wsStatsTimerID = IEAddTimer(1000, wsStatsHelper, this);
+}
+
+void CCD::removeWebSocketStats()
+{
+    if (wsStatsTimerID != -1)
+    {
+        IERmTimer(wsStatsTimerID);
+        wsStatsTimerID = -1;
+    }
+
+    for (auto &it : wsClients)
+        deleteProperty(it.second.StatsNP.name);
+    wsClients.clear();
+}
 #endif
 
 }
@@ -36,6 +36,9 @@
 
 #include <fitsio.h>
 
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
 #include <cstring>
 #include <chrono>
@@ -55,6 +58,9 @@ namespace INDI
 {
 
 class StreamManager;
+class ImageWriter;
+class TiledPreview;
+class FITSHeaderTemplate;
 
 /**
  * \class CCD
@@ -454,6 +460,10 @@ class CCD : public DefaultDevice, GuiderInterface
          *
          * To add additional information, override this function in the child class and ensure to call
          * CCD::addFITSKeywords.
+         *
+         * \note The keywords above are formatted once and cached until one of their inputs (device, filter,
+         * binning, coordinates...) changes. Only per-frame values are reformatted, and the cards are appended
+         * to the header without searching it, so call CCD::addFITSKeywords before adding your own keywords.
          */
         virtual void addFITSKeywords(fitsfile * fptr, CCDChip * targetChip);
 
@@ -582,6 +592,61 @@ class CCD : public DefaultDevice, GuiderInterface
             UPLOAD_PREFIX
         };
 
+        /**
+         * @brief FileSyncSP Durability of locally saved images. Images are written by a background thread,
+         * this selects whether data is left to the page cache, flushed to disk, or written with direct I/O.
+         */
+        ISwitch FileSyncS[3];
+        ISwitchVectorProperty FileSyncSP;
+        enum
+        {
+            FILE_SYNC_NONE,
+            FILE_SYNC_DATA,
+            FILE_SYNC_DIRECT
+        };
+
+        /**
+         * @brief FileWriterNP Read-only statistics of the background image writer: number of images
+         * waiting to be written and throughput of the last write in MB/s.
+         */
+        INumber FileWriterN[2];
+        INumberVectorProperty FileWriterNP;
+        enum
+        {
+            FILE_WRITER_QUEUE,
+            FILE_WRITER_RATE
+        };
+
+        /**
+         * @brief PreviewSP Select how images are sent to the client. In tiled mode, only tiles that changed since
+         * the last frame are sent via PreviewBP together with a downsampled thumbnail of the full frame.
+         * See INDI::TiledPreview for the packet layout.
+         */
+        ISwitch PreviewS[2];
+        ISwitchVectorProperty PreviewSP;
+        enum
+        {
+            PREVIEW_FULL,
+            PREVIEW_TILES
+        };
+
+        INumber PreviewSettingsN[3];
+        INumberVectorProperty PreviewSettingsNP;
+        enum
+        {
+            PREVIEW_TILE_SIZE,
+            PREVIEW_THRESHOLD,
+            PREVIEW_SCALE
+        };
+
+        IBLOB PreviewB[2];
+        IBLOBVectorProperty PreviewBP;
+        enum
+        {
+            PREVIEW_THUMBNAIL,
+            PREVIEW_TILE_DATA
+        };
+
         ISwitch TelescopeTypeS[2];
         ISwitchVectorProperty TelescopeTypeSP;
         enum
@@ -647,19 +712,82 @@ class CCD : public DefaultDevice, GuiderInterface
 
         bool m_ValidCCDRotation;
 
+        // Cached file sequence index so that the upload directory is only scanned once per directory and prefix.
+        struct
+        {
+            std::string dir;
+            std::string prefix;
+            std::atomic<int> next { 0 };
+        } m_FileIndex;
+
+        // Background writer for locally saved images
+        std::unique_ptr<ImageWriter> m_ImageWriter;
+
+        // Completed writes are queued by the writer thread and applied on the main loop
+        struct ImageWriteResult
+        {
+            std::string filename;
+            int error;
+            size_t bytes;
+            double seconds;
+        };
+        std::deque<ImageWriteResult> m_WriteResults;
+        std::mutex m_WriteResultsLock;
+        size_t m_WriterPending { 0 };
+        // Exposures being completed on their own thread, whose frame is about to be queued in the writer
+        std::atomic<int> m_CompletingExposures { 0 };
+        int m_WriteTimerID { -1 };
+        static void writeResultsHelper(void * context);
+        // Start polling the writer results, called on the main loop when an exposure to be saved completes
+        void armWriteResults();
+        void processWriteResults();
+
+        // Changed tiles preview
+        std::unique_ptr<TiledPreview> m_TiledPreview;
+        std::vector<uint8_t> m_CompressedPreview[2];
+
+        // Preformatted FITS header cards for the primary and guide chips
+        std::unique_ptr<FITSHeaderTemplate> m_FITSHeader[2];
+
         ///////////////////////////////////////////////////////////////////////////////
         /// Utility Functions
         ///////////////////////////////////////////////////////////////////////////////
         bool uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage, bool saveImage);
         void getMinMax(double * min, double * max, CCDChip * targetChip);
-        int getFileIndex(const char * dir, const char * prefix, const char * ext);
+        // A rescan is forced on a file name collision, but never goes back on the cached index
+        int getFileIndex(const char * dir, const char * prefix, const char * ext, bool rescan = false);
+        int scanFileIndex(const char * dir, const char * prefix);
         bool ExposureCompletePrivate(CCDChip * targetChip);
+        bool sendTiledPreview(CCDChip * targetChip);
+        void buildFITSHeader(FITSHeaderTemplate &header, const std::string &signature, CCDChip * targetChip);
+        void imageWriteComplete(const ImageWriteResult &result);
 
         // Threading for Websocket
 #ifdef HAVE_WEBSOCKET
         std::thread wsThread;
         void wsThreadEntry();
         INDIWSServer wsServer;
+
+        // Websocket client statistics, one read-only property per connection
+        struct WebSocketClient
+        {
+            INumber StatsN[4];
+            INumberVectorProperty StatsNP;
+            uint64_t bytes { 0 };
+        };
+        enum
+        {
+            WS_CLIENT_FRAMES,
+            WS_CLIENT_RATE,
+            WS_CLIENT_DROPPED,
+            WS_CLIENT_QUEUED,
+        };
+        std::map<uint32_t, WebSocketClient> wsClients;
+        std::chrono::steady_clock::time_point wsStatsTime;
+        int wsStatsTimerID { -1 };
+        static void wsStatsHelper(void * context);
+        void updateWebSocketStats();
+        void removeWebSocketStats();
 #endif
 
         /////////////////////////////////////////////////////////////////////////////
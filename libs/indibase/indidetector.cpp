@@ -30,6 +30,8 @@
 #include <libnova/ln_types.h>
 #include <libnova/precession.h>
 
+#include <algorithm>
+#include <cmath>
 #include <regex>
 
 #include <dirent.h>
@@ -42,6 +44,7 @@
 
 const char *CAPTURE_SETTINGS_TAB = "Capture Settings";
 const char *CAPTURE_INFO_TAB     = "Capture Info";
+static const char *SPECTRUM_STREAM_TAB = "Streaming";
 
 // Create dir recursively
 static int _det_mkdir(const char *dir, mode_t mode)
@@ -276,10 +279,16 @@ Detector::Detector()
     Lon             = -1000;
     El              = -1000;
     primaryAperture = primaryFocalLength - 1;
+
+    // Large spectra are transformed on up to 4 threads
+    dsp_fourier_set_threads(std::max(1U, std::min(4U, std::thread::hardware_concurrency())));
 }
 
 Detector::~Detector()
 {
+    stopSpectrumAnalyzer();
+    dsp_filter_fir_free(m_Decimator);
+    dsp_filter_fir_free(m_Channelizer);
 }
 
 void Detector::SetDetectorCapability(uint32_t cap)
@@ -373,6 +382,23 @@ bool Detector::initProperties()
     IUFillTextVector(&FileNameTP, FileNameT, 1, getDeviceName(), "DETECTOR_FILE_PATH", "Filename", OPTIONS_TAB, IP_RO, 60,
                      IPS_IDLE);
 
+    /**********************************************/
+    /************* Spectrum Streaming *************/
+    /**********************************************/
+
+    // Streamed data
+    IUFillSwitch(&StreamDataS[STREAM_DATA_CONTINUUM], "STREAM_CONTINUUM", "Continuum", ISS_ON);
+    IUFillSwitch(&StreamDataS[STREAM_DATA_SPECTRUM], "STREAM_SPECTRUM", "Spectrum", ISS_OFF);
+    IUFillSwitchVector(&StreamDataSP, StreamDataS, 2, getDeviceName(), "DETECTOR_STREAM_MODE", "Stream Mode",
+                       SPECTRUM_STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    // Spectrum analyzer, whose segment / 2 + 1 bins must fit the 16 bit width of a stream frame
+    IUFillNumber(&SpectrumStreamN[SPECTRUM_SEGMENT], "SPECTRUM_SEGMENT", "Segment (samples)", "%.f", 16, 131068, 16, 4096);
+    IUFillNumber(&SpectrumStreamN[SPECTRUM_OVERLAP], "SPECTRUM_OVERLAP", "Overlap (%)", "%.f", 0, 95, 5, 50);
+    IUFillNumber(&SpectrumStreamN[SPECTRUM_RATE], "SPECTRUM_RATE", "Rate (Hz)", "%.2f", 0.1, 50, 0.1, 2);
+    IUFillNumberVector(&SpectrumStreamNP, SpectrumStreamN, 3, getDeviceName(), "DETECTOR_STREAM_SPECTRUM",
+                       "Spectrum Analyzer", SPECTRUM_STREAM_TAB, IP_RW, 60, IPS_IDLE);
+
     /**********************************************/
     /****************** FITS Header****************/
     /**********************************************/
@@ -448,6 +474,12 @@ bool Detector::updateProperties()
         if (UploadSettingsT[UPLOAD_DIR].text == nullptr)
             IUSaveText(&UploadSettingsT[UPLOAD_DIR], getenv("HOME"));
         defineText(&UploadSettingsTP);
+
+        if (HasStreaming())
+        {
+            defineSwitch(&StreamDataSP);
+            defineNumber(&SpectrumStreamNP);
+        }
     }
     else
     {
@@ -467,6 +499,12 @@ bool Detector::updateProperties()
 
         deleteProperty(UploadSP.name);
         deleteProperty(UploadSettingsTP.name);
+
+        if (HasStreaming())
+        {
+            deleteProperty(StreamDataSP.name);
+            deleteProperty(SpectrumStreamNP.name);
+        }
     }
 
     if (HasStreaming())
@@ -641,6 +679,25 @@ bool Detector::ISNewNumber(const char *dev, const char *name, double values[], c
             SetDetectorParams(values[DetectorDevice::DETECTOR_SAMPLERATE], values[DetectorDevice::DETECTOR_FREQUENCY], values[DetectorDevice::DETECTOR_BITSPERSAMPLE], values[DetectorDevice::DETECTOR_BANDWIDTH], values[DetectorDevice::DETECTOR_GAIN]);
             return true;
         }
+
+        // Spectrum analyzer settings, applied to the next spectrum
+        if (!strcmp(name, SpectrumStreamNP.name))
+        {
+            std::lock_guard<std::mutex> lock(m_SpectrumMutex);
+            if (IUUpdateNumber(&SpectrumStreamNP, values, names, n) < 0)
+            {
+                SpectrumStreamNP.s = IPS_ALERT;
+                IDSetNumber(&SpectrumStreamNP, nullptr);
+                return false;
+            }
+            SpectrumStreamN[SPECTRUM_SEGMENT].value = std::round(SpectrumStreamN[SPECTRUM_SEGMENT].value);
+            m_SpectrumReset = true;
+            if (HasStreaming() && m_SpectrumThread.joinable())
+                Streamer->setSize(static_cast<int>(SpectrumStreamN[SPECTRUM_SEGMENT].value) / 2 + 1, 1);
+            SpectrumStreamNP.s = IPS_OK;
+            IDSetNumber(&SpectrumStreamNP, nullptr);
+            return true;
+        }
     }
 
     if (HasStreaming())
@@ -687,6 +744,25 @@ bool Detector::ISNewSwitch(const char *dev, const char *name, ISState *states, c
             return true;
         }
 
+        if (!strcmp(name, StreamDataSP.name))
+        {
+            IUUpdateSwitch(&StreamDataSP, states, names, n);
+            StreamDataSP.s = IPS_OK;
+            IDSetSwitch(&StreamDataSP, nullptr);
+
+            if (StreamDataS[STREAM_DATA_SPECTRUM].s == ISS_ON)
+            {
+                DEBUG(Logger::DBG_SESSION, "Streaming the spectrum of the continuum.");
+                startSpectrumAnalyzer();
+            }
+            else
+            {
+                DEBUG(Logger::DBG_SESSION, "Streaming the continuum.");
+                stopSpectrumAnalyzer();
+            }
+            return true;
+        }
+
         // Primary Device Abort Expsoure
         if (strcmp(name, PrimaryDetector.AbortCaptureSP.name) == 0)
         {
@@ -887,19 +963,13 @@ void Detector::fits_update_key_s(fitsfile *fptr, int type, std::string name, voi
     fits_update_key(fptr, type, name.c_str(), p, const_cast<char *>(explanation.c_str()), status);
 }
 
-void* Detector::sendFITS(DetectorDevice *targetDevice, int type, uint8_t *buf, int len)
+bool Detector::openFITS(DetectorDevice *targetDevice, FITSProduct &product)
 {
-    bool sendCapture = (UploadS[0].s == ISS_ON || UploadS[2].s == ISS_ON);
-    bool saveCapture = (UploadS[1].s == ISS_ON || UploadS[2].s == ISS_ON);
-    fitsfile *fptr = nullptr;
-    void *memptr;
-    size_t memsize;
     int img_type  = 0;
     int byte_type = 0;
     int status    = 0;
     long naxis    = 2;
     long naxes[2] = {0};
-    int nelements = 0;
     std::string bit_depth;
     char error_status[MAXRBUF];
     switch (targetDevice->getBPS())
@@ -942,67 +1012,97 @@ void* Detector::sendFITS(DetectorDevice *targetDevice, int type, uint8_t *buf, i
 
         default:
             DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", targetDevice->getBPS());
-            return nullptr;
+            return false;
     }
-    naxes[0] = len;
+    product.byteType = byte_type;
+    naxes[0] = product.len;
     naxes[0] = naxes[0] < 1 ? 1 : naxes[0];
     naxes[1] = 1;
-    nelements = naxes[0];
 
     /*DEBUGF(Logger::DBG_DEBUG, "Exposure complete. Image Depth: %s. Width: %d Height: %d nelements: %d", bit_depth.c_str(), naxes[0],
             naxes[1], nelements);*/
 
-    //  Now we have to send fits format data to the client
-    memsize = 5760;
-    memptr  = malloc(memsize);
-    if (!memptr)
+    // Two header blocks and the data padded to whole blocks, so that the memory file is not grown while written
+    product.memsize = 5760 + (static_cast<size_t>(naxes[0]) * abs(targetDevice->getBPS()) / 8 + 2879) / 2880 * 2880;
+    product.memptr  = malloc(product.memsize);
+    if (!product.memptr)
     {
-        DEBUGF(Logger::DBG_ERROR, "Error: failed to allocate memory: %lu", static_cast<unsigned long>(memsize));
+        DEBUGF(Logger::DBG_ERROR, "Error: failed to allocate memory: %lu", static_cast<unsigned long>(product.memsize));
+        return false;
     }
 
-    fits_create_memfile(&fptr, &memptr, &memsize, 2880, realloc, &status);
+    fits_create_memfile(&product.fptr, &product.memptr, &product.memsize, 2880, realloc, &status);
+
+    if (!status)
+        fits_create_img(product.fptr, img_type, naxis, naxes, &status);
 
     if (status)
     {
         fits_report_error(stderr, status); /* print out any error messages */
         fits_get_errstatus(status, error_status);
         DEBUGF(Logger::DBG_ERROR, "FITS Error: %s", error_status);
-        if(memptr != nullptr)
-            free(memptr);
-        return nullptr;
+        if (product.fptr != nullptr)
+        {
+            int close_status = 0;
+            fits_close_file(product.fptr, &close_status);
+            product.fptr = nullptr;
+        }
+        free(product.memptr);
+        product.memptr = nullptr;
+        return false;
     }
 
-    fits_create_img(fptr, img_type, naxis, naxes, &status);
+    addFITSKeywords(product.fptr, targetDevice, product.buf, product.len);
 
-    if (status)
-    {
-        fits_report_error(stderr, status); /* print out any error messages */
-        fits_get_errstatus(status, error_status);
-        DEBUGF(Logger::DBG_ERROR, "FITS Error: %s", error_status);
-        if(memptr != nullptr)
-            free(memptr);
-        return nullptr;
-    }
+    return true;
+}
 
-    addFITSKeywords(fptr, targetDevice, buf, len);
+void Detector::writeFITS(FITSProduct &product)
+{
+    LONGLONG dataend = 0;
+
+    fits_write_img(product.fptr, product.byteType, 1, product.len < 1 ? 1 : product.len, product.buf, &product.status);
+    // The presized memory file may be larger than the FITS file, which ends with the padded data
+    fits_get_hduaddrll(product.fptr, nullptr, nullptr, &dataend, &product.status);
+    product.size = static_cast<size_t>(dataend);
+    // Closed even after an error
+    fits_close_file(product.fptr, &product.status);
+    product.fptr = nullptr;
+}
 
-    fits_write_img(fptr, byte_type, 1, nelements, buf, &status);
+bool Detector::closeFITS(FITSProduct &product)
+{
+    char error_status[MAXRBUF];
 
-    if (status)
-    {
-        fits_report_error(stderr, status); /* print out any error messages */
-        fits_get_errstatus(status, error_status);
-        DEBUGF(Logger::DBG_ERROR, "FITS Error: %s", error_status);
-        if(memptr != nullptr)
-            free(memptr);
-        return nullptr;
-    }
+    if (!product.status)
+        return true;
+
+    fits_report_error(stderr, product.status); /* print out any error messages */
+    fits_get_errstatus(product.status, error_status);
+    DEBUGF(Logger::DBG_ERROR, "FITS Error: %s", error_status);
+    free(product.memptr);
+    product.memptr = nullptr;
+    return false;
+}
 
-    fits_close_file(fptr, &status);
+void* Detector::sendFITS(DetectorDevice *targetDevice, int type, uint8_t *buf, int len)
+{
+    bool sendCapture = (UploadS[0].s == ISS_ON || UploadS[2].s == ISS_ON);
+    bool saveCapture = (UploadS[1].s == ISS_ON || UploadS[2].s == ISS_ON);
+    FITSProduct product;
+    product.blobIndex = type;
+    product.buf       = buf;
+    product.len       = len;
 
-    uploadFile(targetDevice, memptr, memsize, sendCapture, saveCapture, type);
+    if (!openFITS(targetDevice, product))
+        return nullptr;
+    writeFITS(product);
+    if (!closeFITS(product))
+        return nullptr;
 
-    return memptr;
+    uploadFile(targetDevice, product.memptr, product.size, sendCapture, saveCapture, type);
+
+    return product.memptr;
 }
 
 bool Detector::CaptureComplete(DetectorDevice *targetDevice)
@@ -1013,15 +1113,19 @@ bool Detector::CaptureComplete(DetectorDevice *targetDevice)
 
     if (sendCapture || saveCapture)
     {
-        void* continuum = nullptr;
-        void* spectrum = nullptr;
-        void* tdev = nullptr;
+        bool fits = !strcmp(targetDevice->getCaptureExtension(), "fits");
+        // Continuum, spectrum and time deviation FITS files, built in place
+        FITSProduct products[3];
+        int count = 0;
         int idx = 0;
         if(HasContinuum())
         {
-            if (!strcmp(targetDevice->getCaptureExtension(), "fits"))
+            if (fits)
             {
-                continuum = sendFITS(targetDevice, idx, targetDevice->getContinuumBuffer(), targetDevice->getContinuumBufferSize() * 8 / abs(targetDevice->getBPS()));
+                products[count].blobIndex = idx;
+                products[count].buf       = targetDevice->getContinuumBuffer();
+                products[count].len       = targetDevice->getContinuumBufferSize() * 8 / abs(targetDevice->getBPS());
+                count++;
             }
             else
             {
@@ -1032,9 +1136,12 @@ bool Detector::CaptureComplete(DetectorDevice *targetDevice)
         }
         if(HasSpectrum())
         {
-            if (!strcmp(targetDevice->getCaptureExtension(), "fits"))
+            if (fits)
             {
-                spectrum = sendFITS(targetDevice, idx, targetDevice->getSpectrumBuffer(), targetDevice->getSpectrumBufferSize() * 8 / abs(targetDevice->getBPS()));
+                products[count].blobIndex = idx;
+                products[count].buf       = targetDevice->getSpectrumBuffer();
+                products[count].len       = targetDevice->getSpectrumBufferSize() * 8 / abs(targetDevice->getBPS());
+                count++;
             }
             else
             {
@@ -1045,9 +1152,12 @@ bool Detector::CaptureComplete(DetectorDevice *targetDevice)
         }
         if(HasTimeDeviation())
         {
-            if (!strcmp(targetDevice->getCaptureExtension(), "fits"))
+            if (fits)
             {
-                tdev = sendFITS(targetDevice, idx, targetDevice->getTimeDeviationBuffer(), targetDevice->getTimeDeviationBufferSize() * 8 / abs(targetDevice->getBPS()));
+                products[count].blobIndex = idx;
+                products[count].buf       = targetDevice->getTimeDeviationBuffer();
+                products[count].len       = targetDevice->getTimeDeviationBufferSize() * 8 / abs(targetDevice->getBPS());
+                count++;
             }
             else
             {
@@ -1057,14 +1167,49 @@ bool Detector::CaptureComplete(DetectorDevice *targetDevice)
             idx++;
         }
 
+        // The headers are written here, then the data of each product by its own thread when cfitsio allows it
+        bool opened[3] = { false, false, false };
+        for (int i = 0; i < count; i++)
+            opened[i] = openFITS(targetDevice, products[i]);
+
+        std::thread writers[3];
+        for (int i = 0; i < count; i++)
+        {
+            if (!opened[i])
+                continue;
+            FITSProduct *product = &products[i];
+            if (fits_is_reentrant() && i < count - 1)
+                writers[i] = std::thread([product]()
+                {
+                    writeFITS(*product);
+                });
+            else
+                writeFITS(*product);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (writers[i].joinable())
+                writers[i].join();
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (opened[i] && closeFITS(products[i]))
+            {
+                uploadFile(targetDevice, products[i].memptr, products[i].size, sendCapture, saveCapture, products[i].blobIndex);
+                continue;
+            }
+            // Do not send the file of the previous capture again
+            targetDevice->FitsB[products[i].blobIndex].blob    = nullptr;
+            targetDevice->FitsB[products[i].blobIndex].bloblen = 0;
+            targetDevice->FitsB[products[i].blobIndex].size    = 0;
+        }
+
+        // All the products of the capture in a single message
         if (sendCapture)
             IDSetBLOB(&targetDevice->FitsBP, nullptr);
-        if(spectrum != nullptr)
-            free(spectrum);
-        if(continuum != nullptr)
-            free(continuum);
-        if(tdev != nullptr)
-            free(tdev);
+        for (int i = 0; i < count; i++)
+            free(products[i].memptr);
 
         DEBUG(Logger::DBG_DEBUG, "Upload complete");
     }
@@ -1187,7 +1332,11 @@ bool Detector::saveConfigItems(FILE *fp)
     IUSaveConfigSwitch(fp, &TelescopeTypeSP);
 
     if (HasStreaming())
+    {
         Streamer->saveConfigItems(fp);
+        IUSaveConfigSwitch(fp, &StreamDataSP);
+        IUSaveConfigNumber(fp, &SpectrumStreamNP);
+    }
 
     return true;
 }
@@ -1370,10 +1519,11 @@ int Detector::getFileIndex(const char *dir, const char *prefix, const char *ext)
 }
 
 //DSP API functions
+//The capture buffers are processed in their own sample type, without converting them to dsp streams
 
 void Detector::Spectrum(void *buf, void *out, int n_elements, int size, int bits_per_sample)
 {
-    void* fourier = malloc(n_elements * bits_per_sample / 8);
+    void* fourier = malloc(static_cast<size_t>(n_elements) * abs(bits_per_sample) / 8);
     FourierTransform(buf, fourier, 1, &n_elements, bits_per_sample);
     Histogram(fourier, out, n_elements, size, bits_per_sample);
     free(fourier);
@@ -1381,242 +1531,120 @@ void Detector::Spectrum(void *buf, void *out, int n_elements, int size, int bits
 
 void Detector::Histogram(void *buf, void *out, int n_elements, int histogram_size, int bits_per_sample)
 {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    dsp_stream_add_dim(stream, n_elements);
-    dsp_stream_alloc_buffer(stream, stream->len);
-    //Create the spectrum
-    switch (bits_per_sample)
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy((static_cast<uint8_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy((static_cast<uint16_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy((static_cast<uint32_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-            break;
-        default:
-            DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-            dsp_stream_free_buffer(stream);
-            //Destroy the dsp stream
-            dsp_stream_free(stream);
-            return;
-    }
-    double *histo = dsp_stats_histogram(stream, histogram_size);
-    dsp_stream_free_buffer(stream);
-    //Destroy the dsp stream
-    dsp_stream_free(stream);
-    switch (bits_per_sample)
-    {
-        case 8:
-            dsp_buffer_copy(histo, (static_cast<uint8_t *>(out)), histogram_size);
-            break;
-        case 16:
-            dsp_buffer_copy(histo, (static_cast<uint16_t *>(out)), histogram_size);
-            break;
-        case 32:
-            dsp_buffer_copy(histo, (static_cast<uint32_t *>(out)), histogram_size);
-            break;
-        case 64:
-            dsp_buffer_copy(histo, (static_cast<unsigned long *>(out)), histogram_size);
-            break;
-        case -32:
-            dsp_buffer_copy(histo, (static_cast<float *>(out)), histogram_size);
-            break;
-        case -64:
-            dsp_buffer_copy(histo, (static_cast<double *>(out)), histogram_size);
-            break;
-        default:
-            break;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return;
     }
+    double *histo = dsp_sample_histogram(buf, static_cast<dsp_sample_type>(type), n_elements, histogram_size);
+    if (histo == nullptr)
+        return;
+    dsp_sample_from_double(histo, histogram_size, out, static_cast<dsp_sample_type>(type));
     free(histo);
 }
 
 void Detector::FourierTransform(void *buf, void *out, int dims, int *sizes, int bits_per_sample)
 {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    for(int dim = 0; dim < dims; dim++)
-        dsp_stream_add_dim(stream, sizes[dim]);
-    dsp_stream_alloc_buffer(stream, stream->len);
-    switch (bits_per_sample)
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy((static_cast<uint8_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy((static_cast<uint16_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy((static_cast<uint32_t *>(buf)), stream->buf, stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-            break;
-        default:
-            DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-            dsp_stream_free_buffer(stream);
-            //Destroy the dsp stream
-            dsp_stream_free(stream);
-            return;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return;
     }
-    dsp_fourier_dft_magnitude(stream);
-    switch (bits_per_sample)
+    dsp_sample_fourier_magnitude(buf, out, static_cast<dsp_sample_type>(type), dims, sizes);
+}
+
+void Detector::Convolution(void *buf, void *matrix, void *out, int dims, int *sizes, int matrix_dims, int *matrix_sizes, int bits_per_sample)
+{
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy(stream->buf, (static_cast<uint8_t *>(out)), stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy(stream->buf, (static_cast<uint16_t *>(out)), stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy(stream->buf, (static_cast<uint32_t *>(out)), stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy(stream->buf, (static_cast<unsigned long *>(out)), stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy(stream->buf, (static_cast<float *>(out)), stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy(stream->buf, (static_cast<double *>(out)), stream->len);
-            break;
-        default:
-            break;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return;
     }
-    //Destroy the dsp stream
-    dsp_stream_free_buffer(stream);
-    dsp_stream_free(stream);
+    if (dsp_sample_convolution(buf, out, static_cast<dsp_sample_type>(type), dims, sizes, matrix, matrix_dims,
+                               matrix_sizes) < 0)
+        DEBUGF(Logger::DBG_ERROR, "The convolution matrix has more dimensions than the buffer (%d > %d)", matrix_dims, dims);
 }
 
-void Detector::Convolution(void *buf, void *matrix, void *out, int dims, int *sizes, int matrix_dims, int *matrix_sizes, int bits_per_sample)
+void Detector::WhiteNoise(void *buf, int n_elements, int bits_per_sample)
 {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    for(int dim = 0; dim < dims; dim++)
-        dsp_stream_add_dim(stream, sizes[dim]);
-    dsp_stream_alloc_buffer(stream, stream->len);
-    dsp_stream_p matrix_stream = dsp_stream_new();
-    for(int dim = 0; dim < matrix_dims; dim++)
-        dsp_stream_add_dim(matrix_stream, matrix_sizes[dim]);
-    dsp_stream_alloc_buffer(matrix_stream, matrix_stream->len);
-    switch (bits_per_sample)
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy((static_cast<uint8_t *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<uint8_t *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy((static_cast<uint16_t *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<uint16_t *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy((static_cast<uint32_t *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<uint32_t *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy((static_cast<unsigned long *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<unsigned long *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy((static_cast<float *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<float *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy((static_cast<double *>(buf)), stream->buf, stream->len);
-            dsp_buffer_copy((static_cast<double *>(matrix)), matrix_stream->buf, matrix_stream->len);
-            break;
-        default:
-            DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
-            //Destroy the dsp streams
-            dsp_stream_free_buffer(stream);
-            dsp_stream_free_buffer(matrix_stream);
-            dsp_stream_free(stream);
-            dsp_stream_free(matrix_stream);
-            return;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return;
     }
-    dsp_convolution_convolution(stream, matrix_stream);
-    switch (bits_per_sample)
+    dsp_sample_whitenoise(buf, static_cast<dsp_sample_type>(type), n_elements);
+}
+
+void Detector::SetDecimation(int decimation, double cutoff, int taps)
+{
+    decimation = std::max(decimation, 1);
+    if (cutoff <= 0)
+        cutoff = 0.4 / decimation;
+    if (taps <= 0)
+        taps = 16 * decimation;
+
+    double *lowpass = dsp_filter_fir_lowpass_taps(taps, cutoff);
+    std::lock_guard<std::mutex> lock(m_FilterMutex);
+    dsp_filter_fir_free(m_Decimator);
+    m_Decimator = dsp_filter_fir_new(lowpass, taps, decimation);
+    free(lowpass);
+}
+
+int Detector::Decimate(void *buf, void *out, int n_elements, int bits_per_sample)
+{
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy(stream->buf, (static_cast<uint8_t *>(out)), stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy(stream->buf, (static_cast<uint16_t *>(out)), stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy(stream->buf, (static_cast<uint32_t *>(out)), stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy(stream->buf, (static_cast<unsigned long *>(out)), stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy(stream->buf, (static_cast<float *>(out)), stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy(stream->buf, (static_cast<double *>(out)), stream->len);
-            break;
-        default:
-            break;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_FilterMutex);
+    if (m_Decimator == nullptr)
+    {
+        DEBUG(Logger::DBG_ERROR, "Decimation is not set up.");
+        return -1;
     }
-    //Destroy the dsp streams
-    dsp_stream_free_buffer(stream);
-    dsp_stream_free(stream);
-    dsp_stream_free_buffer(matrix_stream);
-    dsp_stream_free(matrix_stream);
+    m_FilterOutput.resize(n_elements / m_Decimator->decimation + 1);
+    int count = dsp_filter_fir_decimate(m_Decimator, buf, static_cast<dsp_sample_type>(type), n_elements,
+                                        m_FilterOutput.data());
+    dsp_sample_from_double(m_FilterOutput.data(), count, out, static_cast<dsp_sample_type>(type));
+    return count;
 }
 
-void Detector::WhiteNoise(void *buf, int n_elements, int bits_per_sample)
+void Detector::SetChannels(int channels, int taps)
+{
+    channels = std::max(channels, 2);
+    if (taps <= 0)
+        taps = 16 * channels;
+
+    double *prototype = dsp_filter_fir_lowpass_taps(taps, 0.5 / channels);
+    std::lock_guard<std::mutex> lock(m_FilterMutex);
+    dsp_filter_fir_free(m_Channelizer);
+    m_Channelizer = dsp_filter_channelizer_new(prototype, taps, channels);
+    free(prototype);
+}
+
+int Detector::Channelize(void *buf, dsp_complex *out, int n_elements, int bits_per_sample)
 {
-    //Create the dsp stream
-    dsp_stream_p stream = dsp_stream_new();
-    dsp_stream_add_dim(stream, n_elements);
-    dsp_stream_alloc_buffer(stream, stream->len);
-    dsp_signals_whitenoise (stream);
-    dsp_buffer_stretch(stream->buf, stream->len, 0, (1 << abs(bits_per_sample)));
-    switch (bits_per_sample)
+    int type = dsp_sample_type_from_bits(bits_per_sample);
+    if (type < 0)
     {
-        case 8:
-            dsp_buffer_copy(stream->buf, (static_cast<uint8_t *>(buf)), stream->len);
-            break;
-        case 16:
-            dsp_buffer_copy(stream->buf, (static_cast<uint16_t *>(buf)), stream->len);
-            break;
-        case 32:
-            dsp_buffer_copy(stream->buf, (static_cast<uint32_t *>(buf)), stream->len);
-            break;
-        case 64:
-            dsp_buffer_copy(stream->buf, (static_cast<unsigned long *>(buf)), stream->len);
-            break;
-        case -32:
-            dsp_buffer_copy(stream->buf, (static_cast<float *>(buf)), stream->len);
-            break;
-        case -64:
-            dsp_buffer_copy(stream->buf, (static_cast<double *>(buf)), stream->len);
-            break;
-        default:
-            break;
+        DEBUGF(Logger::DBG_ERROR, "Unsupported bits per sample value %d", bits_per_sample);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_FilterMutex);
+    if (m_Channelizer == nullptr)
+    {
+        DEBUG(Logger::DBG_ERROR, "Channels are not set up.");
+        return -1;
     }
-    //Destroy the dsp streams
-    dsp_stream_free_buffer(stream);
-    dsp_stream_free(stream);
+    return dsp_filter_fir_channelize(m_Channelizer, buf, static_cast<dsp_sample_type>(type), n_elements, out);
 }
 
 
@@ -1632,5 +1660,141 @@ bool Detector::StopStreaming()
     return false;
 }
 
+void Detector::StreamContinuum(const uint8_t *buffer, uint32_t nbytes)
+{
+    if (HasStreaming() == false)
+        return;
+
+    if (StreamDataS[STREAM_DATA_SPECTRUM].s != ISS_ON)
+    {
+        Streamer->newFrame(buffer, nbytes);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_SpectrumMutex);
+        int bps = PrimaryDetector.getBPS();
+        if (bps != m_SpectrumInputBPS)
+        {
+            if (dsp_sample_type_from_bits(bps) < 0)
+                DEBUGF(Logger::DBG_ERROR, "Cannot analyze the spectrum of %d bits per sample.", bps);
+            m_SpectrumInput.clear();
+            m_SpectrumInputBPS = bps;
+            m_SpectrumReset = true;
+        }
+        if (dsp_sample_type_from_bits(bps) < 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(detectorBufferLock);
+            m_SpectrumInput.insert(m_SpectrumInput.end(), buffer, buffer + nbytes);
+        }
+        // Drop the oldest samples if the analyzer falls more than a few chunks behind
+        size_t limit = static_cast<size_t>(nbytes) * 8;
+        if (m_SpectrumInput.size() > limit)
+            m_SpectrumInput.erase(m_SpectrumInput.begin(), m_SpectrumInput.end() - limit);
+    }
+    m_SpectrumCV.notify_one();
+}
+
+void Detector::startSpectrumAnalyzer()
+{
+    if (m_SpectrumThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_SpectrumMutex);
+        m_SpectrumExit  = false;
+        m_SpectrumReset = true;
+        m_SpectrumInput.clear();
+        if (HasStreaming())
+            Streamer->setSize(static_cast<int>(SpectrumStreamN[SPECTRUM_SEGMENT].value) / 2 + 1, 1);
+    }
+    m_SpectrumThread = std::thread(&Detector::spectrumWorker, this);
+}
+
+void Detector::stopSpectrumAnalyzer()
+{
+    if (m_SpectrumThread.joinable() == false)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_SpectrumMutex);
+        m_SpectrumExit = true;
+    }
+    m_SpectrumCV.notify_one();
+    m_SpectrumThread.join();
+
+    std::lock_guard<std::mutex> lock(m_SpectrumMutex);
+    m_SpectrumInput.clear();
+
+    // Back to the frames of the continuum
+    int bps = PrimaryDetector.getBPS();
+    if (HasStreaming() && bps != 0 && PrimaryDetector.getContinuumBufferSize() > 0)
+        Streamer->setSize(PrimaryDetector.getContinuumBufferSize() * 8 / abs(bps), 1);
+}
+
+void Detector::spectrumWorker()
+{
+    dsp_welch *welch = nullptr;
+    std::vector<uint8_t> input, frame;
+    std::vector<double> spectrum;
+    auto lastSpectrum = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_SpectrumMutex);
+    while (true)
+    {
+        std::chrono::duration<double> period(1.0 / SpectrumStreamN[SPECTRUM_RATE].value);
+        m_SpectrumCV.wait_for(lock, period, [this] { return m_SpectrumExit || !m_SpectrumInput.empty(); });
+        if (m_SpectrumExit)
+            break;
+
+        if (m_SpectrumReset)
+        {
+            dsp_fourier_welch_free(welch);
+            welch = dsp_fourier_welch_new(static_cast<int>(SpectrumStreamN[SPECTRUM_SEGMENT].value),
+                                          SpectrumStreamN[SPECTRUM_OVERLAP].value / 100.0);
+            m_SpectrumReset = false;
+        }
+        // Take the queued samples, the capture thread refills the other vector meanwhile
+        input.swap(m_SpectrumInput);
+        m_SpectrumInput.clear();
+        int bps = m_SpectrumInputBPS;
+        lock.unlock();
+
+        int type = dsp_sample_type_from_bits(bps);
+        if (type >= 0 && input.size() > 0)
+            dsp_fourier_welch_add(welch, input.data(), static_cast<dsp_sample_type>(type),
+                                  input.size() / (abs(bps) / 8));
+
+        auto now = std::chrono::steady_clock::now();
+        bool due = type >= 0 && now - lastSpectrum >= period && welch->segments > 0;
+        if (due)
+        {
+            lastSpectrum = now;
+            spectrum.resize(welch->bins);
+            dsp_fourier_welch_spectrum(welch, spectrum.data(), PrimaryDetector.getSampleRate());
+            for (auto &value : spectrum)
+                value = 10.0 * std::log10(std::max(value, 1e-30));
+
+            // Integer samples span their whole range, floating point samples are in dB
+            frame.resize(spectrum.size() * abs(bps) / 8);
+            if (bps > 0)
+                dsp_sample_stretch_from_double(spectrum.data(), spectrum.size(), frame.data(),
+                                               static_cast<dsp_sample_type>(type), 0, std::ldexp(1.0, bps) - 1);
+            else
+                dsp_sample_from_double(spectrum.data(), spectrum.size(), frame.data(), static_cast<dsp_sample_type>(type));
+        }
+        input.clear();
+
+        lock.lock();
+        // The stream size is set with the segment, so a spectrum of a segment changed meanwhile is dropped
+        if (due && m_SpectrumReset == false)
+            Streamer->newFrame(frame.data(), frame.size());
+    }
+
+    dsp_fourier_welch_free(welch);
+}
+
 
 }
@@ -34,6 +34,8 @@
 #include <stdint.h>
 #include <mutex>
 #include <thread>
+#include <condition_variable>
+#include <vector>
 
 //JM 2019-01-17: Disabled until further notice
 //#define WITH_EXPOSURE_LOOPING
@@ -593,6 +595,7 @@ class Detector : public DefaultDevice
          * @param dims the number of dimensions of the input buffer
          * @param sizes the sizes of each dimension
          * @param bits_per_sample can be one of 8,16,32,64 for unsigned types, -32,-64 for floating single and double types
+         * @note out may be the input buffer.
          */
         void FourierTransform(void *buf, void *out, int dims, int *sizes, int bits_per_sample);
 
@@ -616,6 +619,7 @@ class Detector : public DefaultDevice
          * @param matrix_dims the number of dimensions of the matrix
          * @param matrix_sizes the sizes of each dimension of the matrix
          * @param bits_per_sample can be one of 8,16,32,64 for unsigned types, -32,-64 for floating single and double types
+         * @note out may be the input buffer, results are clamped to the range of the sample type.
          */
         void Convolution(void *buf, void *matrix, void *out, int dims, int *sizes, int matrix_dims, int *matrix_sizes, int bits_per_sample);
 
@@ -627,6 +631,45 @@ class Detector : public DefaultDevice
          */
         void WhiteNoise(void *out, int size, int bits_per_sample);
 
+        /**
+         * @brief Setup the low pass filter of Decimate(), clearing its state
+         * @param decimation the number of input samples per output sample, 1 to filter without decimating
+         * @param cutoff the cutoff frequency as a fraction of the input sample rate, up to 0.5. 0 selects 0.4 / decimation
+         * @param taps the number of taps of the filter, 0 selects 16 taps per output sample
+         */
+        void SetDecimation(int decimation, double cutoff = 0, int taps = 0);
+
+        /**
+         * @brief Low pass filter and decimate a capture. The filter keeps its state, so consecutive captures are
+         * filtered as a single stream.
+         * @param buf the buffer to decimate
+         * @param out the buffer where to copy the decimated samples, of the same type, up to n_elements / decimation + 1 samples
+         * @param n_elements the number of samples of the input buffer
+         * @param bits_per_sample can be one of 8,16,32,64 for unsigned types, -32,-64 for floating single and double types
+         * @return the number of output samples, or -1 on error.
+         * @note out may be the input buffer.
+         */
+        int Decimate(void *buf, void *out, int n_elements, int bits_per_sample);
+
+        /**
+         * @brief Setup the polyphase filter bank of Channelize(), clearing its state
+         * @param channels the number of channels of the whole band, at least 2
+         * @param taps the number of taps of the prototype filter, 0 selects 16 taps per channel
+         */
+        void SetChannels(int channels, int taps = 0);
+
+        /**
+         * @brief Split a capture in channels / 2 + 1 complex channels centered every samplerate / channels Hz from 0 Hz,
+         * each one decimated by channels. The filter bank keeps its state, so consecutive captures are split as a
+         * single stream.
+         * @param buf the buffer to split
+         * @param out the output frames of channels / 2 + 1 values each, up to n_elements / channels + 1 frames
+         * @param n_elements the number of samples of the input buffer
+         * @param bits_per_sample can be one of 8,16,32,64 for unsigned types, -32,-64 for floating single and double types
+         * @return the number of output frames, or -1 on error.
+         */
+        int Channelize(void *buf, dsp_complex *out, int n_elements, int bits_per_sample);
+
 
         /**
          * @brief StartStreaming Start live video streaming
@@ -639,6 +682,20 @@ class Detector : public DefaultDevice
          * @return True if successful, false otherwise.
          */
         virtual bool StopStreaming();
+
+        /**
+         * @brief StreamContinuum Stream a chunk of the continuum. Drivers call this function while streaming instead
+         * of Streamer->newFrame(). In spectrum mode (DETECTOR_STREAM_MODE) the chunk goes to the spectrum analyzer,
+         * which averages the power spectra of overlapping Hann windowed segments (Welch method) on a worker thread
+         * and streams the spectrum in dB at the rate set in DETECTOR_STREAM_SPECTRUM. Otherwise the chunk is
+         * streamed as is.
+         * @param buffer the samples, of the depth of the primary detector.
+         * @param nbytes size of the chunk in bytes.
+         * @note The chunk is copied, the buffer may be reused as soon as the function returns. The caller must not
+         * hold detectorBufferLock.
+         */
+        void StreamContinuum(const uint8_t *buffer, uint32_t nbytes);
+
         /**
          * \brief Add FITS keywords to a fits file
          * \param fptr pointer to a valid FITS file.
@@ -730,6 +787,25 @@ class Detector : public DefaultDevice
             TELESCOPE_PRIMARY
         };
 
+        // Streamed data
+        ISwitch StreamDataS[2];
+        ISwitchVectorProperty StreamDataSP;
+        enum
+        {
+            STREAM_DATA_CONTINUUM,
+            STREAM_DATA_SPECTRUM
+        };
+
+        // Spectrum analyzer settings
+        INumber SpectrumStreamN[3];
+        INumberVectorProperty SpectrumStreamNP;
+        enum
+        {
+            SPECTRUM_SEGMENT,
+            SPECTRUM_OVERLAP,
+            SPECTRUM_RATE
+        };
+
         // FITS Header
         IText FITSHeaderT[2] {};
         ITextVectorProperty FITSHeaderTP;
@@ -745,9 +821,66 @@ class Detector : public DefaultDevice
         uint32_t capability;
 
         bool uploadFile(DetectorDevice *targetDevice, const void *fitsData, size_t totalBytes, bool sendCapture, bool saveCapture, int blobindex);
+
+        // A FITS file of a capture being built in memory. cfitsio keeps the address of memptr until the file is
+        // closed, so a product must not be moved in between.
+        struct FITSProduct
+        {
+            int blobIndex { 0 };
+            uint8_t *buf { nullptr };
+            int len { 0 };
+            int byteType { 0 };
+            fitsfile *fptr { nullptr };
+            void *memptr { nullptr };
+            size_t memsize { 0 };
+            // Length of the FITS file, up to memsize
+            size_t size { 0 };
+            int status { 0 };
+        };
+
+        /**
+         * @brief openFITS Create the memory file of a product, sized for its header and data, and write its
+         * header. Runs on the calling thread, as addFITSKeywords reads the device properties.
+         * @return true on success, otherwise the error is logged and nothing is left allocated.
+         */
+        bool openFITS(DetectorDevice *targetDevice, FITSProduct &product);
+        /**
+         * @brief writeFITS Write the data of a product and close its memory file. Independent products may be
+         * written by several threads when cfitsio is reentrant.
+         */
+        static void writeFITS(FITSProduct &product);
+        /**
+         * @brief closeFITS Log the error of a written product and free its memory file if it failed.
+         * @return true if the product is ready to upload.
+         */
+        bool closeFITS(FITSProduct &product);
         void getMinMax(double *min, double *max, uint8_t *buf, int len, int bpp);
         int getFileIndex(const char *dir, const char *prefix, const char *ext);
 
+        /**
+         * @brief spectrumWorker Spectrum analyzer thread. Adds the queued continuum to the Welch estimator and
+         * streams the averaged spectrum when it is due, until the analyzer is stopped.
+         */
+        void spectrumWorker();
+        void startSpectrumAnalyzer();
+        void stopSpectrumAnalyzer();
+
+        std::thread m_SpectrumThread;
+        std::mutex m_SpectrumMutex;
+        std::condition_variable m_SpectrumCV;
+        bool m_SpectrumExit { false };
+        // Set when the estimator must be created again, after a change of its settings or of the sample depth
+        bool m_SpectrumReset { true };
+        // Continuum queued by StreamContinuum() and its depth
+        std::vector<uint8_t> m_SpectrumInput;
+        int m_SpectrumInputBPS { 0 };
+
+        // Filters of Decimate() and Channelize(), kept between captures
+        std::mutex m_FilterMutex;
+        dsp_fir *m_Decimator { nullptr };
+        dsp_fir *m_Channelizer { nullptr };
+        std::vector<double> m_FilterOutput;
+
         /////////////////////////////////////////////////////////////////////////////
         /// Misc.
         /////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,140 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indifitsheader.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace INDI
+{
+
+void FITSHeaderTemplate::reset(const std::string &signature)
+{
+    m_Signature = signature;
+    m_Valid     = true;
+    m_Cards.clear();
+    m_Index.clear();
+}
+
+void FITSHeaderTemplate::format(Card &card, const char *value)
+{
+    // Formatting errors leave a blank card behind which write() skips
+    int status = 0;
+    card.record[0] = '\0';
+    ffmkky(card.key.c_str(), const_cast<char *>(value), card.comment.c_str(), card.record, &status);
+    if (status)
+        card.record[0] = '\0';
+}
+
+void FITSHeaderTemplate::append(const char *key, const char *value, int decimals, const char *comment)
+{
+    Card card;
+    card.key      = key;
+    card.comment  = comment;
+    card.decimals = decimals;
+    format(card, value);
+
+    m_Index[card.key] = m_Cards.size();
+    m_Cards.push_back(card);
+}
+
+FITSHeaderTemplate::Card *FITSHeaderTemplate::findCard(const char *key)
+{
+    auto it = m_Index.find(key);
+    return (it == m_Index.end()) ? nullptr : &m_Cards[it->second];
+}
+
+void FITSHeaderTemplate::addString(const char *key, const char *value, const char *comment)
+{
+    int status = 0;
+    char quoted[FLEN_VALUE] = {0};
+    ffs2c(value, quoted, &status);
+    append(key, quoted, 0, comment);
+}
+
+void FITSHeaderTemplate::addDouble(const char *key, double value, int decimals, const char *comment)
+{
+    int status = 0;
+    char number[FLEN_VALUE] = {0};
+    ffd2e(value, decimals, number, &status);
+    append(key, number, decimals, comment);
+}
+
+void FITSHeaderTemplate::addLong(const char *key, long value, const char *comment)
+{
+    int status = 0;
+    char number[FLEN_VALUE] = {0};
+    ffi2c(value, number, &status);
+    append(key, number, 0, comment);
+}
+
+void FITSHeaderTemplate::addComment(const char *comment)
+{
+    Card card;
+    card.decimals = 0;
+    snprintf(card.record, FLEN_CARD, "COMMENT %.72s", comment);
+    m_Cards.push_back(card);
+}
+
+void FITSHeaderTemplate::setString(const char *key, const char *value)
+{
+    Card *card = findCard(key);
+    if (card == nullptr)
+        return;
+
+    int status = 0;
+    char quoted[FLEN_VALUE] = {0};
+    ffs2c(value, quoted, &status);
+    format(*card, quoted);
+}
+
+void FITSHeaderTemplate::setDouble(const char *key, double value)
+{
+    Card *card = findCard(key);
+    if (card == nullptr)
+        return;
+
+    int status = 0;
+    char number[FLEN_VALUE] = {0};
+    ffd2e(value, card->decimals, number, &status);
+    format(*card, number);
+}
+
+void FITSHeaderTemplate::setLong(const char *key, long value)
+{
+    Card *card = findCard(key);
+    if (card == nullptr)
+        return;
+
+    int status = 0;
+    char number[FLEN_VALUE] = {0};
+    ffi2c(value, number, &status);
+    format(*card, number);
+}
+
+void FITSHeaderTemplate::write(fitsfile *fptr, int *status) const
+{
+    for (const auto &card : m_Cards)
+    {
+        if (card.record[0] != '\0')
+            fits_write_record(fptr, card.record, status);
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <fitsio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief The FITSHeaderTemplate class holds a list of preformatted FITS header cards.
+ *
+ * Cards are formatted once when the template is built and appended to a new header with
+ * fits_write_record(), which avoids the keyword search that fits_update_key performs for every call.
+ * Values that change every frame are patched in place by keyword. The template records a signature
+ * of the inputs it was built from so callers only rebuild it when one of them changes.
+ */
+class FITSHeaderTemplate
+{
+    public:
+        /**
+         * @return True if the template was built from inputs matching signature.
+         */
+        bool isValid(const std::string &signature) const
+        {
+            return m_Valid && signature == m_Signature;
+        }
+
+        /**
+         * @brief reset Drop all cards and start a new template for signature.
+         */
+        void reset(const std::string &signature);
+
+        void addString(const char *key, const char *value, const char *comment);
+        void addDouble(const char *key, double value, int decimals, const char *comment);
+        void addLong(const char *key, long value, const char *comment);
+        void addComment(const char *comment);
+
+        /**
+         * @brief Update the value of an existing card. Unknown keywords are ignored.
+         */
+        void setString(const char *key, const char *value);
+        void setDouble(const char *key, double value);
+        void setLong(const char *key, long value);
+
+        /**
+         * @brief write Append all cards to the current header of fptr.
+         */
+        void write(fitsfile *fptr, int *status) const;
+
+    private:
+        struct Card
+        {
+            std::string key;
+            std::string comment;
+            int decimals;
+            char record[FLEN_CARD];
+        };
+
+        Card *findCard(const char *key);
+        void append(const char *key, const char *value, int decimals, const char *comment);
+        static void format(Card &card, const char *value);
+
+        std::string m_Signature;
+        bool m_Valid { false };
+        std::vector<Card> m_Cards;
+        std::map<std::string, size_t> m_Index;
+};
+
+}
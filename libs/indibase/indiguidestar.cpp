@@ -0,0 +1,357 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ Star detection is based on the rapid guide algorithm by CloudMakers, s. r. o.
+ and PHD Guiding by Craig Stark.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indiguidestar.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace INDI
+{
+
+// Candidates need a complete 9x9 box around them
+static const int BOX_BORDER = 4;
+
+static GuideStar invalidStar()
+{
+    GuideStar star;
+    star.x = star.y = -1;
+    star.fit = star.flux = 0;
+    star.valid = false;
+    return star;
+}
+
+GuideStarFinder::GuideStarFinder()
+{
+}
+
+void GuideStarFinder::setSearchRadius(int radius)
+{
+    m_SearchRadius = std::max(radius, 1);
+}
+
+void GuideStarFinder::setMinimumFit(double fit)
+{
+    m_MinimumFit = fit;
+}
+
+template <typename T> void GuideStarFinder::scoreWindow(const T *frame, int width, int x0, int y0, int x1, int y1)
+{
+    m_ScoreX0 = x0;
+    m_ScoreY0 = y0;
+    m_ScoreW  = x1 - x0;
+    m_ScoreH  = y1 - y0;
+
+    int cols = m_ScoreW + 2 * BOX_BORDER;
+    m_Scores.resize(static_cast<size_t>(m_ScoreW) * m_ScoreH);
+    m_Col3.assign(cols, 0);
+    m_Col9.assign(cols, 0);
+
+    uint32_t *col3 = m_Col3.data();
+    uint32_t *col9 = m_Col9.data();
+    const T *base  = frame + (x0 - BOX_BORDER);
+
+    // Column sums of the first 9 and 3 rows around y0
+    for (int y = y0 - BOX_BORDER; y <= y0 + BOX_BORDER; y++)
+    {
+        const T *row = base + static_cast<size_t>(y) * width;
+        for (int c = 0; c < cols; c++)
+            col9[c] += row[c];
+        if (y >= y0 - 1 && y <= y0 + 1)
+            for (int c = 0; c < cols; c++)
+                col3[c] += row[c];
+    }
+
+    for (int y = y0; y < y1; y++)
+    {
+        if (y > y0)
+        {
+            // Slide column sums down by one row
+            const T *add9 = base + static_cast<size_t>(y + BOX_BORDER) * width;
+            const T *sub9 = base + static_cast<size_t>(y - BOX_BORDER - 1) * width;
+            const T *add3 = base + static_cast<size_t>(y + 1) * width;
+            const T *sub3 = base + static_cast<size_t>(y - 2) * width;
+            for (int c = 0; c < cols; c++)
+            {
+                col9[c] += add9[c] - sub9[c];
+                col3[c] += add3[c] - sub3[c];
+            }
+        }
+
+        int32_t s9 = 0, s3 = 0;
+        for (int c = 0; c < 9; c++)
+            s9 += col9[c];
+        s3 = col3[3] + col3[4] + col3[5];
+
+        int32_t *out = m_Scores.data() + static_cast<size_t>(y - y0) * m_ScoreW;
+        for (int i = 0; i < m_ScoreW; i++)
+        {
+            out[i] = 9 * s3 - s9;
+            if (i + 1 < m_ScoreW)
+            {
+                s9 += col9[i + 9] - col9[i];
+                s3 += col3[i + 6] - col3[i + 3];
+            }
+        }
+    }
+}
+
+template <typename T> GuideStar GuideStarFinder::refine(const T *frame, int width, int height, int ix, int iy,
+        double fit)
+{
+    GuideStar star = invalidStar();
+    star.fit = fit;
+
+    // Background from the border of the 9x9 box, peak and threshold from the whole box
+    double ring = 0, total = 0;
+    int maxValue = 0, mx = ix, my = iy;
+    for (int y = iy - BOX_BORDER; y <= iy + BOX_BORDER; y++)
+    {
+        const T *row = frame + static_cast<size_t>(y) * width;
+        for (int x = ix - BOX_BORDER; x <= ix + BOX_BORDER; x++)
+        {
+            int v = row[x];
+            total += v;
+            if (std::abs(x - ix) == BOX_BORDER || std::abs(y - iy) == BOX_BORDER)
+                ring += v;
+            if (v > maxValue && std::abs(x - ix) <= 1 && std::abs(y - iy) <= 1)
+            {
+                maxValue = v;
+                mx = x;
+                my = y;
+            }
+        }
+    }
+    double background = ring / 32.0;
+    star.flux = total - background * 81;
+
+    // Set threshold between peak and average
+    double threshold = (total / 81.0 + maxValue) / 2.0;
+    double sumX = 0, sumY = 0, sum = 0;
+    for (int y = iy - BOX_BORDER; y <= iy + BOX_BORDER; y++)
+    {
+        const T *row = frame + static_cast<size_t>(y) * width;
+        for (int x = ix - BOX_BORDER; x <= ix + BOX_BORDER; x++)
+        {
+            double w = row[x] - threshold;
+            if (w <= 0)
+                continue;
+            sumX += x * w;
+            sumY += y * w;
+            sum += w;
+        }
+    }
+
+    if (sum <= 0)
+        return star;
+
+    star.x     = sumX / sum;
+    star.y     = sumY / sum;
+    star.valid = true;
+
+    // Gaussian refinement: a parabola through the log of the three samples around the peak on each axis
+    // is exact for a Gaussian profile. Skip it if the peak touches the box edge or is flat (saturated).
+    if (mx <= 0 || my <= 0 || mx >= width - 1 || my >= height - 1)
+        return star;
+
+    const T *row = frame + static_cast<size_t>(my) * width;
+    double c = row[mx] - background;
+    double l = row[mx - 1] - background, r = row[mx + 1] - background;
+    double u = frame[static_cast<size_t>(my - 1) * width + mx] - background;
+    double d = frame[static_cast<size_t>(my + 1) * width + mx] - background;
+
+    if (c <= 0 || l <= 0 || r <= 0 || u <= 0 || d <= 0)
+        return star;
+
+    double lc = std::log(c);
+    double denX = std::log(l) - 2 * lc + std::log(r);
+    double denY = std::log(u) - 2 * lc + std::log(d);
+    if (denX >= 0 || denY >= 0)
+        return star;
+
+    double dx = 0.5 * (std::log(l) - std::log(r)) / denX;
+    double dy = 0.5 * (std::log(u) - std::log(d)) / denY;
+    if (std::fabs(dx) < 1 && std::fabs(dy) < 1)
+    {
+        star.x = mx + dx;
+        star.y = my + dy;
+    }
+
+    return star;
+}
+
+GuideStar GuideStarFinder::bestInWindow(const uint8_t *frame, int width, int height, int bpp, int x0, int y0, int x1,
+                                        int y1)
+{
+    x0 = std::max(x0, BOX_BORDER);
+    y0 = std::max(y0, BOX_BORDER);
+    x1 = std::min(x1, width - BOX_BORDER);
+    y1 = std::min(y1, height - BOX_BORDER);
+
+    if (x1 <= x0 || y1 <= y0 || (bpp != 8 && bpp != 16))
+        return invalidStar();
+
+    if (bpp == 16)
+        scoreWindow(reinterpret_cast<const uint16_t *>(frame), width, x0, y0, x1, y1);
+    else
+        scoreWindow(frame, width, x0, y0, x1, y1);
+
+    auto best  = std::max_element(m_Scores.begin(), m_Scores.end());
+    size_t idx = best - m_Scores.begin();
+    int ix     = m_ScoreX0 + static_cast<int>(idx % m_ScoreW);
+    int iy     = m_ScoreY0 + static_cast<int>(idx / m_ScoreW);
+    double fit = *best / 81.0;
+
+    if (fit < m_MinimumFit)
+    {
+        GuideStar star = invalidStar();
+        star.fit = fit;
+        return star;
+    }
+
+    if (bpp == 16)
+        return refine(reinterpret_cast<const uint16_t *>(frame), width, height, ix, iy, fit);
+    return refine(frame, width, height, ix, iy, fit);
+}
+
+GuideStar GuideStarFinder::find(const uint8_t *frame, int width, int height, int bpp, int hintX, int hintY)
+{
+    if (hintX < 0 || hintY < 0)
+        return bestInWindow(frame, width, height, bpp, 0, 0, width, height);
+
+    return bestInWindow(frame, width, height, bpp, hintX - m_SearchRadius, hintY - m_SearchRadius,
+                        hintX + m_SearchRadius + 1, hintY + m_SearchRadius + 1);
+}
+
+std::vector<GuideStar> GuideStarFinder::detect(const uint8_t *frame, int width, int height, int bpp, int maxStars)
+{
+    std::vector<GuideStar> stars;
+
+    if (maxStars <= 0 || width <= 2 * BOX_BORDER || height <= 2 * BOX_BORDER || (bpp != 8 && bpp != 16))
+        return stars;
+
+    if (bpp == 16)
+        scoreWindow(reinterpret_cast<const uint16_t *>(frame), width, BOX_BORDER, BOX_BORDER, width - BOX_BORDER,
+                    height - BOX_BORDER);
+    else
+        scoreWindow(frame, width, BOX_BORDER, BOX_BORDER, width - BOX_BORDER, height - BOX_BORDER);
+
+    // Local maxima above the minimum fit
+    int32_t minScore = static_cast<int32_t>(std::ceil(m_MinimumFit * 81));
+    std::vector<std::pair<int32_t, size_t>> peaks;
+    for (int y = 1; y < m_ScoreH - 1; y++)
+    {
+        const int32_t *row = m_Scores.data() + static_cast<size_t>(y) * m_ScoreW;
+        for (int x = 1; x < m_ScoreW - 1; x++)
+        {
+            int32_t v = row[x];
+            if (v < minScore || v < row[x - 1] || v < row[x + 1] || v < row[x - m_ScoreW] || v < row[x + m_ScoreW])
+                continue;
+            peaks.push_back(std::make_pair(v, static_cast<size_t>(y) * m_ScoreW + x));
+        }
+    }
+
+    std::sort(peaks.begin(), peaks.end(), [](const std::pair<int32_t, size_t> &a, const std::pair<int32_t, size_t> &b)
+    {
+        return a.first > b.first;
+    });
+
+    // Positions are collected first since refine() does not need the score map
+    std::vector<std::pair<int, int>> accepted;
+    for (const auto &peak : peaks)
+    {
+        int ix = m_ScoreX0 + static_cast<int>(peak.second % m_ScoreW);
+        int iy = m_ScoreY0 + static_cast<int>(peak.second / m_ScoreW);
+
+        bool separated = std::none_of(accepted.begin(), accepted.end(), [ix, iy](const std::pair<int, int> &p)
+        {
+            return std::abs(p.first - ix) <= 2 * BOX_BORDER && std::abs(p.second - iy) <= 2 * BOX_BORDER;
+        });
+        if (!separated)
+            continue;
+
+        accepted.push_back(std::make_pair(ix, iy));
+
+        GuideStar star = (bpp == 16) ?
+                         refine(reinterpret_cast<const uint16_t *>(frame), width, height, ix, iy, peak.first / 81.0) :
+                         refine(frame, width, height, ix, iy, peak.first / 81.0);
+        if (star.valid)
+            stars.push_back(star);
+
+        if (static_cast<int>(stars.size()) >= maxStars)
+            break;
+    }
+
+    return stars;
+}
+
+const std::vector<GuideStar> &GuideStarFinder::track(const uint8_t *frame, int width, int height, int bpp,
+        int maxStars)
+{
+    if (m_Tracked.empty())
+    {
+        m_Tracked   = detect(frame, width, height, bpp, maxStars);
+        m_Reference = m_Tracked;
+        return m_Tracked;
+    }
+
+    for (auto &star : m_Tracked)
+    {
+        GuideStar next = find(frame, width, height, bpp, static_cast<int>(std::lround(star.x)),
+                              static_cast<int>(std::lround(star.y)));
+        if (next.valid)
+            star = next;
+        else
+            star.valid = false;
+    }
+
+    return m_Tracked;
+}
+
+bool GuideStarFinder::getOffset(double &dx, double &dy) const
+{
+    double sumX = 0, sumY = 0;
+    int count = 0;
+
+    for (size_t i = 0; i < m_Tracked.size() && i < m_Reference.size(); i++)
+    {
+        if (!m_Tracked[i].valid)
+            continue;
+        sumX += m_Tracked[i].x - m_Reference[i].x;
+        sumY += m_Tracked[i].y - m_Reference[i].y;
+        count++;
+    }
+
+    if (count == 0)
+        return false;
+
+    dx = sumX / count;
+    dy = sumY / count;
+    return true;
+}
+
+void GuideStarFinder::resetTracking()
+{
+    m_Tracked.clear();
+    m_Reference.clear();
+}
+
+}
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ Star detection is based on the rapid guide algorithm by CloudMakers, s. r. o.
+ and PHD Guiding by Craig Stark.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief GuideStar Position and quality of a star found by GuideStarFinder.
+ */
+typedef struct
+{
+    /// Sub-pixel position of the star, -1 if not found.
+    double x;
+    double y;
+    /// Contrast of the star: mean of the central 3x3 box minus mean of the surrounding 9x9 box (ADU).
+    double fit;
+    /// Background subtracted flux within the 9x9 box (ADU).
+    double flux;
+    bool valid;
+} GuideStar;
+
+/**
+ * @brief The GuideStarFinder class locates and tracks guide stars in 8 or 16 bit mono frames.
+ *
+ * Candidates are scored with integer box sums computed with running column and row sums, so the cost
+ * per pixel is constant regardless of the box sizes and the inner loops are plain array additions that
+ * the compiler vectorizes. The brightest candidate is refined to sub-pixel accuracy with a Gaussian
+ * (log-parabola) fit through the peak, falling back to a thresholded centroid for saturated or flat peaks.
+ *
+ * For rapid guiding, find() searches a small window around the last known position. track() follows
+ * several stars at once and getOffset() reports their mean drift against the positions at the start of
+ * tracking, which is more robust against seeing than a single star.
+ */
+class GuideStarFinder
+{
+    public:
+        GuideStarFinder();
+
+        /**
+         * @brief setSearchRadius Half size of the search window used when a position hint is given.
+         */
+        void setSearchRadius(int radius);
+        int getSearchRadius() const
+        {
+            return m_SearchRadius;
+        }
+
+        /**
+         * @brief setMinimumFit Minimum contrast (ADU) for a candidate to be accepted as a star.
+         */
+        void setMinimumFit(double fit);
+        double getMinimumFit() const
+        {
+            return m_MinimumFit;
+        }
+
+        /**
+         * @brief find Find the best star in the frame.
+         * @param frame 8 or 16 bit mono frame.
+         * @param width frame width in pixels.
+         * @param height frame height in pixels.
+         * @param bpp bits per pixel, 8 or 16.
+         * @param hintX last known X position, or -1 to search the whole frame.
+         * @param hintY last known Y position, or -1 to search the whole frame.
+         * @return star, valid is false if no star with sufficient contrast was found.
+         */
+        GuideStar find(const uint8_t *frame, int width, int height, int bpp, int hintX = -1, int hintY = -1);
+
+        /**
+         * @brief detect Find up to maxStars separated stars in the whole frame, brightest first.
+         */
+        std::vector<GuideStar> detect(const uint8_t *frame, int width, int height, int bpp, int maxStars);
+
+        /**
+         * @brief track Update tracked stars with a new frame. If no stars are tracked yet, up to
+         * maxStars are detected and their positions become the reference for getOffset().
+         * @return tracked stars, lost stars are marked invalid and keep their last position.
+         */
+        const std::vector<GuideStar> &track(const uint8_t *frame, int width, int height, int bpp, int maxStars = 5);
+
+        /**
+         * @brief getOffset Mean drift of valid tracked stars against the reference positions.
+         * @return False if no tracked star is currently valid.
+         */
+        bool getOffset(double &dx, double &dy) const;
+
+        /**
+         * @brief resetTracking Forget tracked stars so the next track() call detects new ones.
+         */
+        void resetTracking();
+
+    private:
+        template <typename T> void scoreWindow(const T *frame, int width, int x0, int y0, int x1, int y1);
+        template <typename T> GuideStar refine(const T *frame, int width, int height, int ix, int iy, double fit);
+        GuideStar bestInWindow(const uint8_t *frame, int width, int height, int bpp, int x0, int y0, int x1, int y1);
+
+        int m_SearchRadius { 20 };
+        double m_MinimumFit { 50 };
+
+        // Score of each candidate in the last scored window, 81 times the fit.
+        std::vector<int32_t> m_Scores;
+        std::vector<uint32_t> m_Col3, m_Col9;
+        int m_ScoreX0 { 0 }, m_ScoreY0 { 0 }, m_ScoreW { 0 }, m_ScoreH { 0 };
+
+        std::vector<GuideStar> m_Tracked;
+        std::vector<GuideStar> m_Reference;
+};
+
+}
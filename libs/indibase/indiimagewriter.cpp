@@ -0,0 +1,218 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+// fallocate and O_DIRECT
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "indiimagewriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define fdatasync fsync
+#endif
+
+namespace INDI
+{
+
+// Alignment required by O_DIRECT on all common file systems
+static const size_t WRITER_ALIGNMENT  = 4096;
+// Large writes keep the number of syscalls low without holding the page cache hostage
+static const size_t WRITER_CHUNK_SIZE = 4 * 1024 * 1024;
+
+ImageWriter::ImageWriter(size_t maxQueueSize) : m_MaxQueueSize(maxQueueSize > 0 ? maxQueueSize : 1)
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Exit = true;
+    }
+    m_NotEmpty.notify_all();
+
+    // Worker drains the queue before exiting so no image is lost on shutdown.
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+bool ImageWriter::queue(const std::string &filename, const void *data, size_t size)
+{
+    Job job;
+    job.filename = filename;
+    job.size     = size;
+
+    size_t allocSize = (size + WRITER_ALIGNMENT - 1) & ~(WRITER_ALIGNMENT - 1);
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, WRITER_ALIGNMENT, allocSize > 0 ? allocSize : WRITER_ALIGNMENT) != 0)
+        return false;
+    job.buffer = static_cast<uint8_t *>(buffer);
+    memcpy(job.buffer, data, size);
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_NotFull.wait(lock, [this]()
+    {
+        return m_Queue.size() < m_MaxQueueSize;
+    });
+
+    job.sync = m_SyncMode;
+    m_Queue.push_back(job);
+
+    if (!m_Thread.joinable())
+        m_Thread = std::thread(&ImageWriter::workerThread, this);
+
+    lock.unlock();
+    m_NotEmpty.notify_one();
+    return true;
+}
+
+void ImageWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Drained.wait(lock, [this]()
+    {
+        return m_Queue.empty() && !m_Busy;
+    });
+}
+
+void ImageWriter::setSyncMode(SyncMode mode)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_SyncMode = mode;
+}
+
+void ImageWriter::setWriteCallback(WriteCallback callback)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Callback = callback;
+}
+
+size_t ImageWriter::pending()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return m_Queue.size() + (m_Busy ? 1 : 0);
+}
+
+void ImageWriter::workerThread()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for (;;)
+    {
+        m_NotEmpty.wait(lock, [this]()
+        {
+            return m_Exit || !m_Queue.empty();
+        });
+
+        if (m_Queue.empty())
+            break;
+
+        Job job = m_Queue.front();
+        m_Queue.pop_front();
+        m_Busy = true;
+        WriteCallback callback = m_Callback;
+        lock.unlock();
+        m_NotFull.notify_one();
+
+        auto start = std::chrono::steady_clock::now();
+        int error  = writeFile(job);
+        std::chrono::duration<double> diff = std::chrono::steady_clock::now() - start;
+
+        free(job.buffer);
+
+        if (callback)
+            callback(job.filename, error, error ? 0 : job.size, diff.count());
+
+        lock.lock();
+        m_Busy = false;
+        if (m_Queue.empty())
+            m_Drained.notify_all();
+    }
+}
+
+int ImageWriter::writeFile(const Job &job)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd    = -1;
+
+#ifdef O_DIRECT
+    if (job.sync == SYNC_DIRECT)
+        fd = open(job.filename.c_str(), flags | O_DIRECT, 0644);
+    // Not every file system supports direct I/O (e.g. tmpfs), fall back to buffered writes.
+    if (fd < 0)
+#endif
+        fd = open(job.filename.c_str(), flags, 0644);
+
+    if (fd < 0)
+        return errno;
+
+#ifdef __linux__
+    // Reserve the extents up front to limit fragmentation. Not all file systems support it, so errors are ignored.
+    if (job.size > 0)
+        (void)fallocate(fd, 0, 0, job.size);
+#endif
+
+    size_t written = 0;
+    size_t aligned = job.size & ~(WRITER_ALIGNMENT - 1);
+    int error = 0;
+
+    while (written < job.size)
+    {
+#ifdef O_DIRECT
+        // The unaligned tail (or a short write) cannot continue with O_DIRECT
+        if (written == aligned || (written & (WRITER_ALIGNMENT - 1)))
+        {
+            int fl = fcntl(fd, F_GETFL);
+            if (fl != -1 && (fl & O_DIRECT))
+                fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+        }
+#endif
+        size_t limit = (written < aligned) ? aligned : job.size;
+        size_t chunk = std::min(WRITER_CHUNK_SIZE, limit - written);
+
+        ssize_t n = write(fd, job.buffer + written, chunk);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+        written += n;
+    }
+
+    if (error == 0 && job.sync != SYNC_NONE && fdatasync(fd) != 0)
+        error = errno;
+
+    if (close(fd) != 0 && error == 0)
+        error = errno;
+
+    return error;
+}
+
+}
@@ -0,0 +1,113 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The ImageWriter class saves image files to the local disk in a background thread.
+ *
+ * Files are queued with a copy of their data so the caller can release the source buffer immediately.
+ * The queue is bounded: queue() blocks when it is full so memory use stays limited when the disk is
+ * slower than the camera. Each file is preallocated and written in large aligned chunks. Durability is
+ * selected with setSyncMode().
+ */
+class ImageWriter
+{
+    public:
+        typedef enum
+        {
+            SYNC_NONE,   /*!< Leave dirty pages to the kernel. Fastest, data may be lost on power failure. */
+            SYNC_DATA,   /*!< Flush file data to disk before reporting the file as saved. */
+            SYNC_DIRECT  /*!< Bypass the page cache (O_DIRECT) where supported and flush file data. */
+        } SyncMode;
+
+        /**
+         * @brief WriteCallback is invoked from the writer thread once a file is processed.
+         * @param filename full path of the file.
+         * @param error 0 on success, errno value otherwise.
+         * @param bytes number of bytes written.
+         * @param seconds time spent writing the file.
+         */
+        typedef std::function<void(const std::string &filename, int error, size_t bytes, double seconds)> WriteCallback;
+
+        explicit ImageWriter(size_t maxQueueSize = 4);
+        ~ImageWriter();
+
+        /**
+         * @brief queue Copy data and schedule it to be written to filename.
+         * @return True if queued, false if out of memory.
+         * @note Blocks while the queue is full.
+         */
+        bool queue(const std::string &filename, const void *data, size_t size);
+
+        /**
+         * @brief flush Wait until all queued files are written.
+         */
+        void flush();
+
+        void setSyncMode(SyncMode mode);
+        SyncMode getSyncMode() const
+        {
+            return m_SyncMode;
+        }
+
+        void setWriteCallback(WriteCallback callback);
+
+        /**
+         * @return Number of files waiting to be written, including the one in progress.
+         */
+        size_t pending();
+
+    private:
+        struct Job
+        {
+            std::string filename;
+            uint8_t *buffer { nullptr };
+            size_t size { 0 };
+            SyncMode sync { SYNC_NONE };
+        };
+
+        void workerThread();
+        int writeFile(const Job &job);
+
+        std::thread m_Thread;
+        std::mutex m_Lock;
+        std::condition_variable m_NotEmpty;
+        std::condition_variable m_NotFull;
+        std::condition_variable m_Drained;
+        std::deque<Job> m_Queue;
+        size_t m_MaxQueueSize;
+        bool m_Busy { false };
+        bool m_Exit { false };
+        SyncMode m_SyncMode { SYNC_NONE };
+        WriteCallback m_Callback;
+};
+
+}
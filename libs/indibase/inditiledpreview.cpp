@@ -0,0 +1,250 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "inditiledpreview.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+namespace INDI
+{
+
+static const uint16_t PREVIEW_VERSION = 1;
+static const size_t PREVIEW_HEADER_SIZE = 24;
+
+// Packets are little-endian whatever the host byte order
+template <typename T> static void appendValue(std::vector<uint8_t> &out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); i++)
+        out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+}
+
+static bool isBigEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t *>(&one) == 0;
+}
+
+// Swap 16 bit pixels written in host order to little-endian
+static void toLittleEndian(uint8_t *data, size_t bytes, uint8_t bpp)
+{
+    if (bpp != 16 || isBigEndian() == false)
+        return;
+    for (size_t i = 0; i + 1 < bytes; i += 2)
+        std::swap(data[i], data[i + 1]);
+}
+
+static void appendHeader(std::vector<uint8_t> &out, const char *magic, uint8_t bpp, uint8_t planes, uint32_t width,
+                         uint32_t height, uint16_t tileSize, uint16_t scale, uint32_t count)
+{
+    out.insert(out.end(), magic, magic + 4);
+    appendValue<uint16_t>(out, PREVIEW_VERSION);
+    appendValue<uint8_t>(out, bpp);
+    appendValue<uint8_t>(out, planes);
+    appendValue<uint32_t>(out, width);
+    appendValue<uint32_t>(out, height);
+    appendValue<uint16_t>(out, tileSize);
+    appendValue<uint16_t>(out, scale);
+    appendValue<uint32_t>(out, count);
+}
+
+TiledPreview::TiledPreview()
+{
+}
+
+void TiledPreview::setTileSize(uint32_t size)
+{
+    size = std::max<uint32_t>(8, std::min<uint32_t>(size, 4096));
+    if (size != m_TileSize)
+    {
+        m_TileSize = size;
+        m_KeyFrame = true;
+    }
+}
+
+void TiledPreview::setThreshold(double threshold)
+{
+    m_Threshold = std::max(0.0, threshold);
+}
+
+void TiledPreview::setThumbnailScale(uint32_t scale)
+{
+    m_Scale = std::max<uint32_t>(1, std::min<uint32_t>(scale, 64));
+}
+
+void TiledPreview::reset()
+{
+    m_KeyFrame = true;
+}
+
+bool TiledPreview::update(const uint8_t *frame, uint32_t width, uint32_t height, uint8_t bpp, uint8_t planes)
+{
+    if (frame == nullptr || width == 0 || height == 0 || (bpp != 8 && bpp != 16) || (planes != 1 && planes != 3))
+        return false;
+
+    size_t frameBytes = static_cast<size_t>(width) * height * planes * (bpp / 8);
+    // reset() may be called from another thread meanwhile, it then applies to the next update
+    m_SendAll = m_KeyFrame.exchange(false);
+
+    if (width != m_Width || height != m_Height || bpp != m_BPP || planes != m_Planes || m_Reference.size() != frameBytes)
+    {
+        m_Width  = width;
+        m_Height = height;
+        m_BPP    = bpp;
+        m_Planes = planes;
+        m_Reference.resize(frameBytes);
+        m_SendAll = true;
+    }
+
+    if (bpp == 8)
+    {
+        buildThumbnail(frame);
+        buildTiles(frame, m_Reference.data());
+    }
+    else
+    {
+        buildThumbnail(reinterpret_cast<const uint16_t *>(frame));
+        buildTiles(reinterpret_cast<const uint16_t *>(frame), reinterpret_cast<uint16_t *>(m_Reference.data()));
+    }
+
+    return true;
+}
+
+template <typename T> void TiledPreview::buildThumbnail(const T *frame)
+{
+    uint32_t tw = std::max<uint32_t>(1, m_Width / m_Scale);
+    uint32_t th = std::max<uint32_t>(1, m_Height / m_Scale);
+    // Box size may be smaller than the scale for frames narrower than the scale factor.
+    uint32_t bw = std::min(m_Scale, m_Width);
+    uint32_t bh = std::min(m_Scale, m_Height);
+    uint32_t area = bw * bh;
+
+    m_Thumbnail.clear();
+    m_Thumbnail.reserve(PREVIEW_HEADER_SIZE + static_cast<size_t>(tw) * th * m_Planes * sizeof(T));
+    appendHeader(m_Thumbnail, "ITHB", m_BPP, m_Planes, tw, th, m_TileSize, m_Scale, 0);
+
+    size_t offset = m_Thumbnail.size();
+    m_Thumbnail.resize(offset + static_cast<size_t>(tw) * th * m_Planes * sizeof(T));
+    T *out = reinterpret_cast<T *>(m_Thumbnail.data() + offset);
+
+    // Accumulate complete rows of boxes at once to walk the source sequentially.
+    std::vector<uint32_t> sums(tw);
+    for (uint8_t p = 0; p < m_Planes; p++)
+    {
+        const T *plane = frame + static_cast<size_t>(p) * m_Width * m_Height;
+        for (uint32_t ty = 0; ty < th; ty++)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (uint32_t y = ty * bh; y < ty * bh + bh; y++)
+            {
+                const T *row = plane + static_cast<size_t>(y) * m_Width;
+                for (uint32_t tx = 0; tx < tw; tx++)
+                {
+                    const T *box = row + tx * bw;
+                    uint32_t sum = 0;
+                    for (uint32_t x = 0; x < bw; x++)
+                        sum += box[x];
+                    sums[tx] += sum;
+                }
+            }
+            for (uint32_t tx = 0; tx < tw; tx++)
+                *out++ = static_cast<T>(sums[tx] / area);
+        }
+    }
+    toLittleEndian(m_Thumbnail.data() + offset, m_Thumbnail.size() - offset, m_BPP);
+}
+
+template <typename T> void TiledPreview::buildTiles(const T *frame, T *reference)
+{
+    uint32_t cols = (m_Width + m_TileSize - 1) / m_TileSize;
+    uint32_t rows = (m_Height + m_TileSize - 1) / m_TileSize;
+
+    m_TotalTiles   = cols * rows;
+    m_ChangedTiles = 0;
+
+    m_Tiles.clear();
+    appendHeader(m_Tiles, "ITIL", m_BPP, m_Planes, m_Width, m_Height, m_TileSize, m_Scale, 0);
+
+    size_t planeSize = static_cast<size_t>(m_Width) * m_Height;
+
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        uint32_t y0 = row * m_TileSize;
+        uint32_t h  = std::min(m_TileSize, m_Height - y0);
+
+        for (uint32_t col = 0; col < cols; col++)
+        {
+            uint32_t x0 = col * m_TileSize;
+            uint32_t w  = std::min(m_TileSize, m_Width - x0);
+
+            bool changed = m_SendAll;
+            if (!changed)
+            {
+                // Mean absolute difference against what the client already has.
+                uint64_t limit = static_cast<uint64_t>(m_Threshold * w * h * m_Planes);
+                uint64_t sad   = 0;
+                for (uint8_t p = 0; p < m_Planes && sad <= limit; p++)
+                {
+                    for (uint32_t y = y0; y < y0 + h; y++)
+                    {
+                        size_t index = p * planeSize + static_cast<size_t>(y) * m_Width + x0;
+                        const T *src = frame + index;
+                        const T *ref = reference + index;
+                        uint32_t rowSum = 0;
+                        for (uint32_t x = 0; x < w; x++)
+                            rowSum += std::abs(static_cast<int32_t>(src[x]) - static_cast<int32_t>(ref[x]));
+                        sad += rowSum;
+                    }
+                }
+                changed = sad > limit;
+            }
+
+            if (!changed)
+                continue;
+
+            m_ChangedTiles++;
+            appendValue<uint32_t>(m_Tiles, x0);
+            appendValue<uint32_t>(m_Tiles, y0);
+            appendValue<uint32_t>(m_Tiles, w);
+            appendValue<uint32_t>(m_Tiles, h);
+
+            size_t offset = m_Tiles.size();
+            m_Tiles.resize(offset + static_cast<size_t>(w) * h * m_Planes * sizeof(T));
+            uint8_t *out = m_Tiles.data() + offset;
+
+            for (uint8_t p = 0; p < m_Planes; p++)
+            {
+                for (uint32_t y = y0; y < y0 + h; y++)
+                {
+                    size_t index = p * planeSize + static_cast<size_t>(y) * m_Width + x0;
+                    memcpy(out, frame + index, w * sizeof(T));
+                    memcpy(reference + index, frame + index, w * sizeof(T));
+                    out += w * sizeof(T);
+                }
+            }
+            toLittleEndian(m_Tiles.data() + offset, m_Tiles.size() - offset, m_BPP);
+        }
+    }
+
+    // Patch tile count now that it is known
+    for (size_t i = 0; i < sizeof(uint32_t); i++)
+        m_Tiles[PREVIEW_HEADER_SIZE - sizeof(uint32_t) + i] = static_cast<uint8_t>(m_ChangedTiles >> (8 * i));
+}
+
+}
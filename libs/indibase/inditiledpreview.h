@@ -0,0 +1,112 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The TiledPreview class produces bandwidth friendly live previews of CCD frames.
+ *
+ * The frame is split into square tiles. Only tiles whose mean absolute difference against the last
+ * transmitted content exceeds a threshold are packed, together with a box-averaged thumbnail of the
+ * complete frame. The first frame, any frame after a geometry change and the frame after reset() send all tiles.
+ *
+ * Both packets are little-endian whatever the host byte order, and start with a 24 byte header:
+ * <ul>
+ * <li>char[4] magic: "ITHB" for the thumbnail, "ITIL" for tiles</li>
+ * <li>uint16 version (1), uint8 bits per pixel, uint8 number of planes</li>
+ * <li>uint32 width, uint32 height: thumbnail size, or full frame size for tiles</li>
+ * <li>uint16 tile size, uint16 thumbnail scale</li>
+ * <li>uint32 number of tiles that follow (0 for the thumbnail)</li>
+ * </ul>
+ * The thumbnail header is followed by its planar pixel data. Each tile is a uint32 x, y, width, height
+ * record in frame pixels followed by planar pixel rows. 16 bit pixels are little-endian too.
+ */
+class TiledPreview
+{
+    public:
+        TiledPreview();
+
+        void setTileSize(uint32_t size);
+        void setThreshold(double threshold);
+        void setThumbnailScale(uint32_t scale);
+
+        /**
+         * @brief reset Force all tiles to be sent with the next update, for instance to a client that just
+         * connected. May be called while another thread updates the preview.
+         */
+        void reset();
+
+        /**
+         * @brief update Compare frame against the last transmitted content and rebuild the packets.
+         * @param frame planar frame buffer.
+         * @param width frame width in pixels.
+         * @param height frame height in pixels.
+         * @param bpp bits per pixel, 8 or 16.
+         * @param planes 1 for mono, 3 for RGB.
+         * @return True if packets were built, false if the format is not supported.
+         */
+        bool update(const uint8_t *frame, uint32_t width, uint32_t height, uint8_t bpp, uint8_t planes);
+
+        const std::vector<uint8_t> &getThumbnail() const
+        {
+            return m_Thumbnail;
+        }
+        const std::vector<uint8_t> &getTiles() const
+        {
+            return m_Tiles;
+        }
+        uint32_t getChangedTiles() const
+        {
+            return m_ChangedTiles;
+        }
+        uint32_t getTotalTiles() const
+        {
+            return m_TotalTiles;
+        }
+
+    private:
+        template <typename T> void buildThumbnail(const T *frame);
+        template <typename T> void buildTiles(const T *frame, T *reference);
+
+        uint32_t m_TileSize { 64 };
+        uint32_t m_Scale { 4 };
+        double m_Threshold { 2 };
+
+        uint32_t m_Width { 0 }, m_Height { 0 };
+        uint8_t m_BPP { 0 }, m_Planes { 0 };
+        std::atomic<bool> m_KeyFrame { true };
+        // All tiles are sent by the current update
+        bool m_SendAll { true };
+
+        uint32_t m_ChangedTiles { 0 };
+        uint32_t m_TotalTiles { 0 };
+
+        // Content last transmitted to the client, per tile.
+        std::vector<uint8_t> m_Reference;
+        std::vector<uint8_t> m_Thumbnail;
+        std::vector<uint8_t> m_Tiles;
+};
+
+}
@@ -18,7 +18,13 @@
 
 #pragma once
 
-#include <set>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/extensions/permessage_deflate/enabled.hpp>
@@ -43,9 +49,40 @@ using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
 
+/**
+ * @brief The INDIWSServer class sends images and stream frames to web clients.
+ *
+ * Each connection has its own bounded queue so a slow client cannot stall the sender or the other clients. Messages
+ * are handed to websocketpp only once the previous ones left its send buffer. When a queue is full, the oldest
+ * droppable frame is discarded so the client always gets the latest frame. Binary frames are sent without
+ * permessage-deflate since images and JPEG frames do not compress, only text messages are deflated.
+ *
+ * send_binary() and send_text() may be called from any thread. Payloads are copied once into a websocketpp message
+ * shared by all queues. Binary messages are framed once as well, so websocketpp sends the same buffer to every
+ * connection. Text messages are deflated, which websocketpp does per connection.
+ *
+ * Pre-framed messages bypass the websocketpp processor of the connection, so only RFC 6455 framing is supported.
+ * Clients of the draft hixie-76 (hybi00) protocol, which has no binary frames, are refused during the handshake.
+ */
 class INDIWSServer
 {
     public:
+        /** Statistics of a connection */
+        struct ClientStats
+        {
+            uint32_t id;
+            std::string address;
+            uint64_t frames;
+            uint64_t bytes;
+            uint64_t dropped;
+            uint32_t queued;
+        };
+
+        // Frames queued per connection
+        static constexpr size_t QUEUE_SIZE = 2;
+        // Delay in milliseconds before checking again a connection that is still sending
+        static constexpr long FLUSH_INTERVAL = 5;
+
         INDIWSServer()  {}
 
         uint16_t generatePort()
@@ -57,11 +94,40 @@ class INDIWSServer
 
         void on_open(connection_hdl hdl)
         {
-            m_connections.insert(hdl);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Client &client = m_connections[hdl];
+            client.id = ++m_last_id;
+
+            websocketpp::lib::error_code ec;
+            server::connection_ptr con = m_server->get_con_from_hdl(hdl, ec);
+            if (!ec)
+                client.address = con->get_remote_endpoint();
+        }
+
+        /**
+         * @brief on_validate Refuse hybi00 clients, which do not send Sec-WebSocket-Version. Versions 7 and 8 frame
+         * server messages as RFC 6455 (version 13) does.
+         */
+        bool on_validate(connection_hdl hdl)
+        {
+            websocketpp::lib::error_code ec;
+            server::connection_ptr con = m_server->get_con_from_hdl(hdl, ec);
+            if (ec)
+                return false;
+
+            const std::string &version = con->get_request_header("Sec-WebSocket-Version");
+            if (version != "13" && version != "8" && version != "7")
+            {
+                std::cerr << "Refusing websocket client " << con->get_remote_endpoint() << " using protocol version '"
+                          << version << "', only RFC 6455 is supported." << std::endl;
+                return false;
+            }
+            return true;
         }
 
         void on_close(connection_hdl hdl)
         {
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_connections.erase(hdl);
         }
 
@@ -73,58 +139,80 @@ class INDIWSServer
         //        }
         //    }
 
-        void send_binary(void const * payload, size_t len)
+        /**
+         * @brief send_binary Queue a binary frame to all connections.
+         * @param droppable False for frames that must be delivered, such as captured images. Stream frames are
+         * droppable and may be replaced by newer frames while a client is busy.
+         */
+        void send_binary(void const * payload, size_t len, bool droppable = true)
         {
-            for (auto it : m_connections)
-            {
-                try
-                {
-                    m_server->send(it, payload, len, websocketpp::frame::opcode::binary);
-                }
-                catch (websocketpp::exception const &e)
-                {
-                    std::cerr << e.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cerr << "other exception" << std::endl;
-                }
+            server::message_ptr msg = std::make_shared<deflate_server_config::message_type>(
+                                          nullptr, websocketpp::frame::opcode::binary, len);
+            msg->set_payload(payload, len);
+
+            // Server frames are not masked, so the RFC 6455 frame is the same for all connections.
+            // Images do not compress, so the frame is sent without permessage-deflate.
+            websocketpp::frame::basic_header header(websocketpp::frame::opcode::binary, len, true, false);
+            websocketpp::frame::extended_header extended(len);
+            msg->set_header(websocketpp::frame::prepare_header(header, extended));
+            msg->set_compressed(false);
+            msg->set_prepared(true);
+
+            queue(msg, droppable);
+        }
+
+        void send_text(const std::string &payload)
+        {
+            server::message_ptr msg = std::make_shared<deflate_server_config::message_type>(
+                                          nullptr, websocketpp::frame::opcode::text, payload.size());
+            msg->set_payload(payload);
+            // Prepared per connection by websocketpp, which deflates it if the client supports it
+            msg->set_compressed(true);
 
+            queue(msg, false);
+        }
+
+        /**
+         * @return Statistics of all open connections.
+         */
+        std::vector<ClientStats> get_stats()
+        {
+            std::vector<ClientStats> stats;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &it : m_connections)
+            {
+                const Client &client = it.second;
+                stats.push_back({client.id, client.address, client.frames, client.bytes, client.dropped,
+                                 static_cast<uint32_t>(client.queue.size())});
             }
+            return stats;
         }
 
-        void send_text(const std::string &payload)
+        void stop()
         {
-            for (auto it : m_connections)
+            std::unique_lock<std::mutex> lock(m_mutex);
+            con_list connections;
+            connections.swap(m_connections);
+            lock.unlock();
+
+            for (auto &it : connections)
             {
                 try
                 {
-                    m_server->send(it, payload, websocketpp::frame::opcode::text);
+                    m_server->close(it.first, websocketpp::close::status::normal, "Switched off by user.");
                 }
                 catch (websocketpp::exception const &e)
                 {
                     std::cerr << e.what() << std::endl;
                 }
-                catch (...)
-                {
-                    std::cerr << "other exception" << std::endl;
-                }
-
             }
-        }
 
-        void stop()
-        {
-            for (auto it : m_connections)
-                m_server->close(it, websocketpp::close::status::normal, "Switched off by user.");
-
-            m_connections.clear();
             m_server->stop();
         }
 
         bool is_running()
         {
-            return m_server->is_listening();
+            return m_server && m_server->is_listening();
         }
 
         void run()
@@ -137,6 +225,7 @@ class INDIWSServer
                 m_server->set_reuse_addr(true);
 
 
+                m_server->set_validate_handler(bind(&INDIWSServer::on_validate, this, ::_1));
                 m_server->set_open_handler(bind(&INDIWSServer::on_open, this, ::_1));
                 m_server->set_close_handler(bind(&INDIWSServer::on_close, this, ::_1));
                 //m_server->set_message_handler(bind(&INDIWSServer::on_message,this,::_1,::_2));
@@ -158,11 +247,148 @@ class INDIWSServer
         }
 
     private:
-        typedef std::set<connection_hdl, std::owner_less<connection_hdl>> con_list;
+        struct Message
+        {
+            server::message_ptr msg;
+            bool droppable;
+        };
+
+        struct Client
+        {
+            uint32_t id { 0 };
+            std::string address;
+            std::deque<Message> queue;
+            // A message was taken from the queue and is being handed to websocketpp
+            bool sending { false };
+            uint64_t frames { 0 };
+            uint64_t bytes { 0 };
+            uint64_t dropped { 0 };
+        };
+
+        void queue(const server::message_ptr &msg, bool droppable)
+        {
+            if (!m_server)
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto &it : m_connections)
+                {
+                    Client &client = it.second;
+                    // Latest frame wins: make room by dropping the oldest frame that may be dropped
+                    if (client.queue.size() >= QUEUE_SIZE)
+                    {
+                        for (auto message = client.queue.begin(); message != client.queue.end(); ++message)
+                        {
+                            if (message->droppable)
+                            {
+                                client.queue.erase(message);
+                                client.dropped++;
+                                break;
+                            }
+                        }
+                    }
+                    client.queue.push_back({msg, droppable});
+                }
+            }
+
+            flush();
+        }
+
+        /**
+         * @brief flush Hand the next queued message of each connection to websocketpp once its send buffer is empty.
+         * Called from the sending threads and from the server thread, until all queues are empty.
+         */
+        void flush()
+        {
+            std::vector<std::pair<server::connection_ptr, Message>> sends;
+            bool pending = false;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto &it : m_connections)
+                {
+                    Client &client = it.second;
+                    if (client.queue.empty())
+                        continue;
+
+                    // Another thread is handing over the previous message
+                    if (client.sending)
+                    {
+                        pending = true;
+                        continue;
+                    }
+
+                    websocketpp::lib::error_code ec;
+                    server::connection_ptr con = m_server->get_con_from_hdl(it.first, ec);
+                    if (ec || con->get_state() != websocketpp::session::state::open)
+                    {
+                        client.queue.clear();
+                        continue;
+                    }
+
+                    // Still writing the previous message
+                    if (con->get_buffered_amount() > 0)
+                    {
+                        pending = true;
+                        continue;
+                    }
+
+                    Message &message = client.queue.front();
+                    if (message.msg->get_opcode() == websocketpp::frame::opcode::binary)
+                    {
+                        client.frames++;
+                        client.bytes += message.msg->get_payload().size();
+                    }
+                    sends.emplace_back(con, std::move(message));
+                    client.queue.pop_front();
+                    client.sending = true;
+                    pending |= !client.queue.empty();
+                }
+
+                if (pending && !m_flush_scheduled)
+                {
+                    m_flush_scheduled = true;
+                    m_server->set_timer(FLUSH_INTERVAL, [this](websocketpp::lib::error_code const & ec)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(m_mutex);
+                            m_flush_scheduled = false;
+                        }
+                        if (!ec)
+                            flush();
+                    });
+                }
+            }
+
+            // Send unlocked, websocketpp may call the close handler on errors
+            for (auto &send : sends)
+            {
+                websocketpp::lib::error_code ec = send.first->send(send.second.msg);
+                if (ec)
+                    std::cerr << ec.message() << std::endl;
+            }
+
+            if (sends.empty())
+                return;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &send : sends)
+            {
+                auto it = m_connections.find(send.first->get_handle());
+                if (it != m_connections.end())
+                    it->second.sending = false;
+            }
+        }
+
+        typedef std::map<connection_hdl, Client, std::owner_less<connection_hdl>> con_list;
 
         std::unique_ptr<server> m_server;
+        // Protects the connections and their queues
+        std::mutex m_mutex;
         con_list m_connections;
+        bool m_flush_scheduled { false };
+        uint32_t m_last_id { 0 };
         uint16_t m_port;
         static uint16_t m_global_port;
 };
-
@@ -0,0 +1,905 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Vectorized color space conversion and debayering
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "ccvt_simd.h"
+#include "streamthreadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CCVT_SIMD_X86
+#include <immintrin.h>
+#define CCVT_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CCVT_TARGET_AVX2  __attribute__((target("avx2")))
+#define CCVT_INLINE       inline __attribute__((always_inline))
+#endif
+
+// Frames smaller than this are converted in the calling thread
+#define CCVT_MIN_PIXELS_PER_THREAD (256 * 1024)
+
+namespace
+{
+
+enum
+{
+    YUV_LAYOUT_YUYV,
+    YUV_LAYOUT_UYVY,
+    YUV_LAYOUT_PLANAR,
+    YUV_LAYOUT_SEMIPLANAR
+};
+
+enum
+{
+    YUV_OUT_RGB24,
+    YUV_OUT_BGR32
+};
+
+// Kind of the pixel at a given position of the color filter array
+enum
+{
+    BAYER_RED,
+    BAYER_BLUE,
+    BAYER_GREEN_RED_ROW,
+    BAYER_GREEN_BLUE_ROW
+};
+
+// Values interpolated at each pixel, see bayerSource()
+enum
+{
+    BAYER_CENTER,
+    BAYER_HORIZONTAL,
+    BAYER_VERTICAL,
+    BAYER_DIAGONAL,
+    BAYER_GREEN
+};
+
+std::atomic<int> s_Backend(CCVT_SIMD_AUTO);
+std::atomic<int> s_Threads(0);
+
+int ccvtDetectBackend()
+{
+#ifdef CCVT_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CCVT_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return CCVT_SIMD_SSE41;
+#endif
+    return CCVT_SIMD_SCALAR;
+}
+
+int ccvtBackend()
+{
+    int backend = s_Backend.load();
+    if (backend == CCVT_SIMD_AUTO)
+    {
+        backend = ccvtDetectBackend();
+        s_Backend.store(backend);
+    }
+    return backend;
+}
+
+void ccvtParallelRows(int rows, int pixelsPerRow, const std::function<void(int, int)> &function)
+{
+    int threads = s_Threads.load();
+    if (threads <= 0)
+        threads = std::min(4u, INDI::StreamThreadPool::instance().size());
+    threads = std::min<long>(threads, static_cast<long>(rows) * pixelsPerRow / CCVT_MIN_PIXELS_PER_THREAD);
+    threads = std::max(1, std::min(threads, rows));
+    if (threads == 1)
+    {
+        function(0, rows);
+        return;
+    }
+
+    int step = (rows + threads - 1) / threads;
+    INDI::StreamThreadPool::instance().run((rows + step - 1) / step, [&](uint32_t t)
+    {
+        int start = t * step;
+        function(start, std::min(rows, start + step));
+    });
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// YUV to RGB
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*YUVRowFunction)(const uint8_t *y, const uint8_t *u, const uint8_t *v, bool swapuv, uint8_t *dst,
+                               int width);
+
+inline uint8_t ccvtClamp(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+template <int Out>
+inline void yuvPutPixel(uint8_t *dst, int x, int y, int cr, int cg, int cb)
+{
+    if (Out == YUV_OUT_RGB24)
+    {
+        dst += 3 * x;
+        dst[0] = ccvtClamp(y + cr);
+        dst[1] = ccvtClamp(y - cg);
+        dst[2] = ccvtClamp(y + cb);
+    }
+    else
+    {
+        dst += 4 * x;
+        dst[0] = ccvtClamp(y + cb);
+        dst[1] = ccvtClamp(y - cg);
+        dst[2] = ccvtClamp(y + cr);
+        dst[3] = 0;
+    }
+}
+
+// Same fixed point arithmetic as ccvt, so the results are identical
+template <int Layout, int Out>
+void yuvRowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, bool swapuv, uint8_t *dst, int x0, int x1)
+{
+    for (int x = x0; x < x1; x += 2)
+    {
+        int y0, y1, cu, cv;
+        switch (Layout)
+        {
+            case YUV_LAYOUT_YUYV:
+                y0 = y[2 * x];
+                cu = y[2 * x + 1];
+                y1 = y[2 * x + 2];
+                cv = y[2 * x + 3];
+                break;
+            case YUV_LAYOUT_UYVY:
+                cu = y[2 * x];
+                y0 = y[2 * x + 1];
+                cv = y[2 * x + 2];
+                y1 = y[2 * x + 3];
+                break;
+            case YUV_LAYOUT_PLANAR:
+                y0 = y[x];
+                y1 = y[x + 1];
+                cu = u[x / 2];
+                cv = v[x / 2];
+                break;
+            default:
+                y0 = y[x];
+                y1 = y[x + 1];
+                cu = u[x];
+                cv = u[x + 1];
+                if (swapuv)
+                    std::swap(cu, cv);
+                break;
+        }
+
+        int cb = ((cu - 128) * 454) >> 8;
+        int cr = ((cv - 128) * 359) >> 8;
+        int cg = ((cv - 128) * 183 + (cu - 128) * 88) >> 8;
+        yuvPutPixel<Out>(dst, x, y0, cr, cg, cb);
+        yuvPutPixel<Out>(dst, x + 1, y1, cr, cg, cb);
+    }
+}
+
+template <int Layout, int Out>
+void yuvRowC(const uint8_t *y, const uint8_t *u, const uint8_t *v, bool swapuv, uint8_t *dst, int width)
+{
+    yuvRowScalar<Layout, Out>(y, u, v, swapuv, dst, 0, width);
+}
+
+#ifdef CCVT_SIMD_X86
+
+// Interleave 16 pixels of each channel to 48 bytes
+CCVT_TARGET_SSE41 CCVT_INLINE void storeRGB24(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    __m128i *out = reinterpret_cast<__m128i *>(dst);
+    _mm_storeu_si128(out, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)),
+                                       _mm_shuffle_epi8(b, b0)));
+    _mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)),
+                                           _mm_shuffle_epi8(b, b1)));
+    _mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)),
+                                           _mm_shuffle_epi8(b, b2)));
+}
+
+// Interleave 8 pixels of each channel to 24 words
+CCVT_TARGET_SSE41 CCVT_INLINE void storeRGB48(uint16_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1);
+    const __m128i g0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15);
+
+    __m128i *out = reinterpret_cast<__m128i *>(dst);
+    _mm_storeu_si128(out, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)),
+                                       _mm_shuffle_epi8(b, b0)));
+    _mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)),
+                                           _mm_shuffle_epi8(b, b1)));
+    _mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)),
+                                           _mm_shuffle_epi8(b, b2)));
+}
+
+// Interleave 16 pixels of each channel to 64 bytes, alpha is zero
+CCVT_TARGET_SSE41 CCVT_INLINE void storeBGR32(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i bgLow  = _mm_unpacklo_epi8(b, g), bgHigh = _mm_unpackhi_epi8(b, g);
+    __m128i r0Low  = _mm_unpacklo_epi8(r, zero), r0High = _mm_unpackhi_epi8(r, zero);
+
+    __m128i *out = reinterpret_cast<__m128i *>(dst);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(bgLow, r0Low));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bgLow, r0Low));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bgHigh, r0High));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bgHigh, r0High));
+}
+
+template <int Out>
+CCVT_TARGET_SSE41 CCVT_INLINE void storeYUVPixels(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    if (Out == YUV_OUT_RGB24)
+        storeRGB24(dst, r, g, b);
+    else
+        storeBGR32(dst, r, g, b);
+}
+
+// Chroma offsets of 8 pairs of pixels: (u - 128) * 454 >> 8, (v - 128) * 359 >> 8 and
+// ((v - 128) * 183 + (u - 128) * 88) >> 8, computed on 32 bits with madd like the scalar code.
+CCVT_TARGET_SSE41 CCVT_INLINE void chromaSSE41(__m128i u, __m128i v, __m128i &cr, __m128i &cg, __m128i &cb)
+{
+    const __m128i zero = _mm_setzero_si128(), offset = _mm_set1_epi16(128);
+    const __m128i kb = _mm_set1_epi32(454), kr = _mm_set1_epi32(359), kg = _mm_set1_epi32(88 | (183 << 16));
+
+    u = _mm_sub_epi16(u, offset);
+    v = _mm_sub_epi16(v, offset);
+    cb = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(u, zero), kb), 8),
+                         _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(u, zero), kb), 8));
+    cr = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(v, zero), kr), 8),
+                         _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(v, zero), kr), 8));
+    cg = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(u, v), kg), 8),
+                         _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(u, v), kg), 8));
+}
+
+// 16 pixels: y holds 16 bytes, u and v 8 words
+CCVT_TARGET_SSE41 CCVT_INLINE void yuvToRGBSSE41(__m128i y, __m128i u, __m128i v, __m128i &r, __m128i &g,
+        __m128i &b)
+{
+    __m128i cr, cg, cb;
+    chromaSSE41(u, v, cr, cg, cb);
+
+    __m128i yLow = _mm_cvtepu8_epi16(y), yHigh = _mm_unpackhi_epi8(y, _mm_setzero_si128());
+    r = _mm_packus_epi16(_mm_add_epi16(yLow, _mm_unpacklo_epi16(cr, cr)),
+                         _mm_add_epi16(yHigh, _mm_unpackhi_epi16(cr, cr)));
+    g = _mm_packus_epi16(_mm_sub_epi16(yLow, _mm_unpacklo_epi16(cg, cg)),
+                         _mm_sub_epi16(yHigh, _mm_unpackhi_epi16(cg, cg)));
+    b = _mm_packus_epi16(_mm_add_epi16(yLow, _mm_unpacklo_epi16(cb, cb)),
+                         _mm_add_epi16(yHigh, _mm_unpackhi_epi16(cb, cb)));
+}
+
+template <int Layout, int Out>
+CCVT_TARGET_SSE41 void yuvRowSSE41(const uint8_t *y, const uint8_t *u, const uint8_t *v, bool swapuv, uint8_t *dst,
+                                   int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0xFF), lowWords = _mm_set1_epi32(0xFFFF);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i Y, U, V;
+        if (Layout == YUV_LAYOUT_YUYV || Layout == YUV_LAYOUT_UYVY)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + 2 * x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + 2 * x + 16));
+            __m128i ca, cb;
+            if (Layout == YUV_LAYOUT_YUYV)
+            {
+                Y  = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+                ca = _mm_srli_epi16(a, 8);
+                cb = _mm_srli_epi16(b, 8);
+            }
+            else
+            {
+                Y  = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+                ca = _mm_and_si128(a, lowBytes);
+                cb = _mm_and_si128(b, lowBytes);
+            }
+            U = _mm_packs_epi32(_mm_and_si128(ca, lowWords), _mm_and_si128(cb, lowWords));
+            V = _mm_packs_epi32(_mm_srli_epi32(ca, 16), _mm_srli_epi32(cb, 16));
+        }
+        else if (Layout == YUV_LAYOUT_PLANAR)
+        {
+            Y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+            U = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2)));
+            V = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2)));
+        }
+        else
+        {
+            Y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+            __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x));
+            U = _mm_and_si128(uv, lowBytes);
+            V = _mm_srli_epi16(uv, 8);
+            if (swapuv)
+                std::swap(U, V);
+        }
+
+        __m128i R, G, B;
+        yuvToRGBSSE41(Y, U, V, R, G, B);
+        storeYUVPixels<Out>(dst + (Out == YUV_OUT_RGB24 ? 3 : 4) * x, R, G, B);
+    }
+
+    yuvRowScalar<Layout, Out>(y, u, v, swapuv, dst, x, width);
+}
+
+// 32 pixels: y holds 32 bytes, u and v 16 words in order
+CCVT_TARGET_AVX2 CCVT_INLINE void yuvToRGBAVX2(__m256i y, __m256i u, __m256i v, __m256i &r, __m256i &g,
+        __m256i &b)
+{
+    const __m256i zero = _mm256_setzero_si256(), offset = _mm256_set1_epi16(128);
+    const __m256i kb = _mm256_set1_epi32(454), kr = _mm256_set1_epi32(359), kg = _mm256_set1_epi32(88 | (183 << 16));
+
+    // Unpacking and packing within each lane keeps the order
+    u = _mm256_sub_epi16(u, offset);
+    v = _mm256_sub_epi16(v, offset);
+    __m256i cb = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(u, zero), kb), 8),
+                                    _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(u, zero), kb), 8));
+    __m256i cr = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(v, zero), kr), 8),
+                                    _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(v, zero), kr), 8));
+    __m256i cg = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(u, v), kg), 8),
+                                    _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(u, v), kg), 8));
+
+    // Duplicate each chroma offset for its two pixels: reorder the 64 bit blocks so the in lane unpacks take
+    // offsets 0-7 for pixels 0-15 and 8-15 for pixels 16-31.
+    cb = _mm256_permute4x64_epi64(cb, 0xD8);
+    cr = _mm256_permute4x64_epi64(cr, 0xD8);
+    cg = _mm256_permute4x64_epi64(cg, 0xD8);
+
+    __m256i yLow  = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y));
+    __m256i yHigh = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1));
+    r = _mm256_packus_epi16(_mm256_add_epi16(yLow, _mm256_unpacklo_epi16(cr, cr)),
+                            _mm256_add_epi16(yHigh, _mm256_unpackhi_epi16(cr, cr)));
+    g = _mm256_packus_epi16(_mm256_sub_epi16(yLow, _mm256_unpacklo_epi16(cg, cg)),
+                            _mm256_sub_epi16(yHigh, _mm256_unpackhi_epi16(cg, cg)));
+    b = _mm256_packus_epi16(_mm256_add_epi16(yLow, _mm256_unpacklo_epi16(cb, cb)),
+                            _mm256_add_epi16(yHigh, _mm256_unpackhi_epi16(cb, cb)));
+    r = _mm256_permute4x64_epi64(r, 0xD8);
+    g = _mm256_permute4x64_epi64(g, 0xD8);
+    b = _mm256_permute4x64_epi64(b, 0xD8);
+}
+
+template <int Layout, int Out>
+CCVT_TARGET_AVX2 void yuvRowAVX2(const uint8_t *y, const uint8_t *u, const uint8_t *v, bool swapuv, uint8_t *dst,
+                                 int width)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0xFF), lowWords = _mm256_set1_epi32(0xFFFF);
+    const int bytesPerPixel = (Out == YUV_OUT_RGB24) ? 3 : 4;
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i Y, U, V;
+        if (Layout == YUV_LAYOUT_YUYV || Layout == YUV_LAYOUT_UYVY)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + 2 * x));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + 2 * x + 32));
+            __m256i ca, cb;
+            if (Layout == YUV_LAYOUT_YUYV)
+            {
+                Y  = _mm256_packus_epi16(_mm256_and_si256(a, lowBytes), _mm256_and_si256(b, lowBytes));
+                ca = _mm256_srli_epi16(a, 8);
+                cb = _mm256_srli_epi16(b, 8);
+            }
+            else
+            {
+                Y  = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+                ca = _mm256_and_si256(a, lowBytes);
+                cb = _mm256_and_si256(b, lowBytes);
+            }
+            Y = _mm256_permute4x64_epi64(Y, 0xD8);
+            U = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(ca, lowWords),
+                                         _mm256_and_si256(cb, lowWords)), 0xD8);
+            V = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(ca, 16), _mm256_srli_epi32(cb, 16)),
+                                         0xD8);
+        }
+        else if (Layout == YUV_LAYOUT_PLANAR)
+        {
+            Y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + x));
+            U = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x / 2)));
+            V = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x / 2)));
+        }
+        else
+        {
+            Y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + x));
+            __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u + x));
+            U = _mm256_and_si256(uv, lowBytes);
+            V = _mm256_srli_epi16(uv, 8);
+            if (swapuv)
+                std::swap(U, V);
+        }
+
+        __m256i R, G, B;
+        yuvToRGBAVX2(Y, U, V, R, G, B);
+        storeYUVPixels<Out>(dst + bytesPerPixel * x, _mm256_castsi256_si128(R), _mm256_castsi256_si128(G),
+                            _mm256_castsi256_si128(B));
+        storeYUVPixels<Out>(dst + bytesPerPixel * (x + 16), _mm256_extracti128_si256(R, 1),
+                            _mm256_extracti128_si256(G, 1), _mm256_extracti128_si256(B, 1));
+    }
+
+    yuvRowScalar<Layout, Out>(y, u, v, swapuv, dst, x, width);
+}
+
+#endif
+
+template <int Layout, int Out>
+YUVRowFunction yuvRowFunction()
+{
+    switch (ccvtBackend())
+    {
+#ifdef CCVT_SIMD_X86
+        case CCVT_SIMD_AVX2:
+            return yuvRowAVX2<Layout, Out>;
+        case CCVT_SIMD_SSE41:
+            return yuvRowSSE41<Layout, Out>;
+#endif
+        default:
+            return yuvRowC<Layout, Out>;
+    }
+}
+
+template <int Layout, int Out>
+void convertYUV(int width, int height, const void *src, void *dst, bool swapuv)
+{
+    if (width <= 0 || height <= 0 || (width & 1))
+        return;
+    if ((Layout == YUV_LAYOUT_PLANAR || Layout == YUV_LAYOUT_SEMIPLANAR) && (height & 1))
+        return;
+
+    YUVRowFunction row = yuvRowFunction<Layout, Out>();
+    const uint8_t *in = static_cast<const uint8_t *>(src);
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    const int bytesPerPixel = (Out == YUV_OUT_RGB24) ? 3 : 4;
+    const long pixels = static_cast<long>(width) * height;
+
+    ccvtParallelRows(height, width, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            const uint8_t *u = nullptr, *v = nullptr, *luma = in + static_cast<long>(y) * width;
+            switch (Layout)
+            {
+                case YUV_LAYOUT_YUYV:
+                case YUV_LAYOUT_UYVY:
+                    luma = in + 2L * y * width;
+                    break;
+                case YUV_LAYOUT_PLANAR:
+                    u = in + pixels + static_cast<long>(y / 2) * (width / 2);
+                    v = u + pixels / 4;
+                    break;
+                default:
+                    u = in + pixels + static_cast<long>(y / 2) * width;
+                    break;
+            }
+            row(luma, u, v, swapuv, out + static_cast<long>(y) * width * bytesPerPixel, width);
+        }
+    });
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// Debayering
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*Bayer8RowFunction)(const uint8_t *up, const uint8_t *cur, const uint8_t *down, uint8_t *dst, int width,
+                                  int evenKind, int oddKind, bool edgeAware);
+typedef void (*Bayer16RowFunction)(const uint16_t *up, const uint16_t *cur, const uint16_t *down, uint16_t *dst,
+                                   int width, int evenKind, int oddKind, bool edgeAware);
+
+// Value used for a channel of a pixel of a given kind. The interpolated green is either the average of the four
+// neighbours, or with edge awareness, the average along the direction of the smallest gradient.
+constexpr int bayerSource(int kind, int channel)
+{
+    return channel == 1 ? ((kind == BAYER_RED || kind == BAYER_BLUE) ? BAYER_GREEN : BAYER_CENTER) :
+           (kind == BAYER_GREEN_RED_ROW) ? (channel == 0 ? BAYER_HORIZONTAL : BAYER_VERTICAL) :
+           (kind == BAYER_GREEN_BLUE_ROW) ? (channel == 0 ? BAYER_VERTICAL : BAYER_HORIZONTAL) :
+           ((kind == BAYER_RED) == (channel == 0)) ? BAYER_CENTER : BAYER_DIAGONAL;
+}
+
+// Outer neighbours are mirrored, which keeps the color of the neighbours
+template <typename T>
+void bayerRowScalar(const T *up, const T *cur, const T *down, T *dst, int width, int x0, int x1, int evenKind,
+                    int oddKind, bool edgeAware)
+{
+    for (int x = x0; x < x1; x++)
+    {
+        int left = (x > 0) ? x - 1 : x + 1, right = (x < width - 1) ? x + 1 : x - 1;
+        uint32_t l = cur[left], r = cur[right], u = up[x], d = down[x];
+        T *pixel = dst + 3 * x;
+
+        switch ((x & 1) ? oddKind : evenKind)
+        {
+            case BAYER_RED:
+            case BAYER_BLUE:
+            {
+                uint32_t green = (l + r + u + d) >> 2;
+                if (edgeAware)
+                {
+                    uint32_t dh = (l > r) ? l - r : r - l, dv = (u > d) ? u - d : d - u;
+                    if (dh < dv)
+                        green = (l + r) >> 1;
+                    else if (dv < dh)
+                        green = (u + d) >> 1;
+                }
+                T diagonal = (up[left] + up[right] + down[left] + down[right]) >> 2;
+                bool red = (((x & 1) ? oddKind : evenKind) == BAYER_RED);
+                pixel[0] = red ? cur[x] : diagonal;
+                pixel[1] = green;
+                pixel[2] = red ? diagonal : cur[x];
+                break;
+            }
+            case BAYER_GREEN_RED_ROW:
+                pixel[0] = (l + r) >> 1;
+                pixel[1] = cur[x];
+                pixel[2] = (u + d) >> 1;
+                break;
+            default:
+                pixel[0] = (u + d) >> 1;
+                pixel[1] = cur[x];
+                pixel[2] = (l + r) >> 1;
+                break;
+        }
+    }
+}
+
+template <typename T>
+void bayerRowC(const T *up, const T *cur, const T *down, T *dst, int width, int evenKind, int oddKind,
+               bool edgeAware)
+{
+    bayerRowScalar(up, cur, down, dst, width, 0, width, evenKind, oddKind, edgeAware);
+}
+
+#ifdef CCVT_SIMD_X86
+
+// Arithmetic on widened samples for each instruction set and sample size. A block is processed as Parts vectors
+// of samples, starting on an even column.
+struct Bayer8SSE41
+{
+    typedef uint8_t T;
+    typedef __m128i V;
+    enum { Pixels = 16, Parts = 2 };
+
+    CCVT_TARGET_SSE41 static CCVT_INLINE V load(const T *p, int part)
+    {
+        return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + 8 * part)));
+    }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V add(V a, V b) { return _mm_add_epi16(a, b); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V half(V a) { return _mm_srli_epi16(a, 1); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V quarter(V a) { return _mm_srli_epi16(a, 2); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V absdiff(V a, V b) { return _mm_abs_epi16(_mm_sub_epi16(a, b)); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V less(V a, V b) { return _mm_cmplt_epi16(a, b); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V select(V mask, V a, V b) { return _mm_blendv_epi8(b, a, mask); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V even(V a, V b) { return _mm_blend_epi16(b, a, 0x55); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE void store(T *dst, const V *r, const V *g, const V *b)
+    {
+        storeRGB24(dst, _mm_packus_epi16(r[0], r[1]), _mm_packus_epi16(g[0], g[1]), _mm_packus_epi16(b[0], b[1]));
+    }
+};
+
+struct Bayer16SSE41
+{
+    typedef uint16_t T;
+    typedef __m128i V;
+    enum { Pixels = 8, Parts = 2 };
+
+    CCVT_TARGET_SSE41 static CCVT_INLINE V load(const T *p, int part)
+    {
+        return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + 4 * part)));
+    }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V add(V a, V b) { return _mm_add_epi32(a, b); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V half(V a) { return _mm_srli_epi32(a, 1); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V quarter(V a) { return _mm_srli_epi32(a, 2); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V absdiff(V a, V b) { return _mm_abs_epi32(_mm_sub_epi32(a, b)); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V less(V a, V b) { return _mm_cmplt_epi32(a, b); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V select(V mask, V a, V b) { return _mm_blendv_epi8(b, a, mask); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE V even(V a, V b) { return _mm_blend_epi16(b, a, 0x33); }
+    CCVT_TARGET_SSE41 static CCVT_INLINE void store(T *dst, const V *r, const V *g, const V *b)
+    {
+        storeRGB48(dst, _mm_packus_epi32(r[0], r[1]), _mm_packus_epi32(g[0], g[1]), _mm_packus_epi32(b[0], b[1]));
+    }
+};
+
+struct Bayer8AVX2
+{
+    typedef uint8_t T;
+    typedef __m256i V;
+    enum { Pixels = 16, Parts = 1 };
+
+    CCVT_TARGET_AVX2 static CCVT_INLINE V load(const T *p, int)
+    {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V add(V a, V b) { return _mm256_add_epi16(a, b); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V half(V a) { return _mm256_srli_epi16(a, 1); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V quarter(V a) { return _mm256_srli_epi16(a, 2); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V absdiff(V a, V b) { return _mm256_abs_epi16(_mm256_sub_epi16(a, b)); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V less(V a, V b) { return _mm256_cmpgt_epi16(b, a); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V select(V mask, V a, V b) { return _mm256_blendv_epi8(b, a, mask); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V even(V a, V b) { return _mm256_blend_epi16(b, a, 0x55); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE void store(T *dst, const V *r, const V *g, const V *b)
+    {
+        storeRGB24(dst, _mm_packus_epi16(_mm256_castsi256_si128(*r), _mm256_extracti128_si256(*r, 1)),
+                   _mm_packus_epi16(_mm256_castsi256_si128(*g), _mm256_extracti128_si256(*g, 1)),
+                   _mm_packus_epi16(_mm256_castsi256_si128(*b), _mm256_extracti128_si256(*b, 1)));
+    }
+};
+
+struct Bayer16AVX2
+{
+    typedef uint16_t T;
+    typedef __m256i V;
+    enum { Pixels = 8, Parts = 1 };
+
+    CCVT_TARGET_AVX2 static CCVT_INLINE V load(const T *p, int)
+    {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V add(V a, V b) { return _mm256_add_epi32(a, b); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V half(V a) { return _mm256_srli_epi32(a, 1); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V quarter(V a) { return _mm256_srli_epi32(a, 2); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V absdiff(V a, V b) { return _mm256_abs_epi32(_mm256_sub_epi32(a, b)); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V less(V a, V b) { return _mm256_cmpgt_epi32(b, a); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V select(V mask, V a, V b) { return _mm256_blendv_epi8(b, a, mask); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE V even(V a, V b) { return _mm256_blend_epi32(b, a, 0x55); }
+    CCVT_TARGET_AVX2 static CCVT_INLINE void store(T *dst, const V *r, const V *g, const V *b)
+    {
+        storeRGB48(dst, _mm_packus_epi32(_mm256_castsi256_si128(*r), _mm256_extracti128_si256(*r, 1)),
+                   _mm_packus_epi32(_mm256_castsi256_si128(*g), _mm256_extracti128_si256(*g, 1)),
+                   _mm_packus_epi32(_mm256_castsi256_si128(*b), _mm256_extracti128_si256(*b, 1)));
+    }
+};
+
+// Row kernel, expanded once per instruction set because functions of different targets can not be inlined into
+// each other. The first two columns and the columns missing a right neighbour for a full block go through the
+// scalar code.
+#define CCVT_BAYER_ROW(TARGET, NAME)                                                                                  \
+    template <class Ops, int EvenKind, int OddKind, bool EdgeAware>                                                   \
+    TARGET void NAME(const typename Ops::T *up, const typename Ops::T *cur, const typename Ops::T *down,              \
+                     typename Ops::T *dst, int width)                                                                 \
+    {                                                                                                                 \
+        typedef typename Ops::V V;                                                                                    \
+        int x = std::min(2, width);                                                                                   \
+        bayerRowScalar(up, cur, down, dst, width, 0, x, EvenKind, OddKind, EdgeAware);                                \
+        for (; x + Ops::Pixels < width; x += Ops::Pixels)                                                             \
+        {                                                                                                             \
+            V r[Ops::Parts], g[Ops::Parts], b[Ops::Parts];                                                            \
+            for (int part = 0; part < Ops::Parts; part++)                                                             \
+            {                                                                                                         \
+                V l = Ops::load(cur + x - 1, part), rt = Ops::load(cur + x + 1, part);                                \
+                V u = Ops::load(up + x, part), d = Ops::load(down + x, part);                                         \
+                V value[5];                                                                                           \
+                value[BAYER_CENTER]     = Ops::load(cur + x, part);                                                   \
+                value[BAYER_HORIZONTAL] = Ops::half(Ops::add(l, rt));                                                 \
+                value[BAYER_VERTICAL]   = Ops::half(Ops::add(u, d));                                                  \
+                value[BAYER_DIAGONAL]   = Ops::quarter(Ops::add(Ops::add(Ops::load(up + x - 1, part),                 \
+                                                   Ops::load(up + x + 1, part)), Ops::add(Ops::load(down + x - 1,     \
+                                                   part), Ops::load(down + x + 1, part))));                            \
+                value[BAYER_GREEN]      = Ops::quarter(Ops::add(Ops::add(l, rt), Ops::add(u, d)));                    \
+                if (EdgeAware)                                                                                        \
+                {                                                                                                     \
+                    V dh = Ops::absdiff(l, rt), dv = Ops::absdiff(u, d);                                              \
+                    value[BAYER_GREEN] = Ops::select(Ops::less(dh, dv), value[BAYER_HORIZONTAL],                      \
+                                                     Ops::select(Ops::less(dv, dh), value[BAYER_VERTICAL],            \
+                                                                 value[BAYER_GREEN]));                                \
+                }                                                                                                     \
+                r[part] = Ops::even(value[bayerSource(EvenKind, 0)], value[bayerSource(OddKind, 0)]);                 \
+                g[part] = Ops::even(value[bayerSource(EvenKind, 1)], value[bayerSource(OddKind, 1)]);                 \
+                b[part] = Ops::even(value[bayerSource(EvenKind, 2)], value[bayerSource(OddKind, 2)]);                 \
+            }                                                                                                         \
+            Ops::store(dst + 3 * x, r, g, b);                                                                         \
+        }                                                                                                             \
+        bayerRowScalar(up, cur, down, dst, width, x, width, EvenKind, OddKind, EdgeAware);                            \
+    }
+
+CCVT_BAYER_ROW(CCVT_TARGET_SSE41, bayerRowSSE41)
+CCVT_BAYER_ROW(CCVT_TARGET_AVX2, bayerRowAVX2)
+
+// Select the instantiation matching the kinds of the row
+#define CCVT_BAYER_DISPATCH(NAME, OPS)                                                                                \
+    void NAME##OPS(const OPS::T *up, const OPS::T *cur, const OPS::T *down, OPS::T *dst, int width, int evenKind,    \
+                   int oddKind, bool edgeAware)                                                                      \
+    {                                                                                                                 \
+        switch (evenKind * 2 + (edgeAware ? 1 : 0))                                                                   \
+        {                                                                                                             \
+            case BAYER_RED * 2:                                                                                       \
+                return NAME<OPS, BAYER_RED, BAYER_GREEN_RED_ROW, false>(up, cur, down, dst, width);                   \
+            case BAYER_RED * 2 + 1:                                                                                   \
+                return NAME<OPS, BAYER_RED, BAYER_GREEN_RED_ROW, true>(up, cur, down, dst, width);                    \
+            case BAYER_BLUE * 2:                                                                                      \
+                return NAME<OPS, BAYER_BLUE, BAYER_GREEN_BLUE_ROW, false>(up, cur, down, dst, width);                 \
+            case BAYER_BLUE * 2 + 1:                                                                                  \
+                return NAME<OPS, BAYER_BLUE, BAYER_GREEN_BLUE_ROW, true>(up, cur, down, dst, width);                  \
+            case BAYER_GREEN_RED_ROW * 2:                                                                             \
+                return NAME<OPS, BAYER_GREEN_RED_ROW, BAYER_RED, false>(up, cur, down, dst, width);                   \
+            case BAYER_GREEN_RED_ROW * 2 + 1:                                                                         \
+                return NAME<OPS, BAYER_GREEN_RED_ROW, BAYER_RED, true>(up, cur, down, dst, width);                    \
+            case BAYER_GREEN_BLUE_ROW * 2:                                                                            \
+                return NAME<OPS, BAYER_GREEN_BLUE_ROW, BAYER_BLUE, false>(up, cur, down, dst, width);                 \
+            default:                                                                                                  \
+                return NAME<OPS, BAYER_GREEN_BLUE_ROW, BAYER_BLUE, true>(up, cur, down, dst, width);                  \
+        }                                                                                                             \
+        (void)oddKind;                                                                                                \
+    }
+
+CCVT_BAYER_DISPATCH(bayerRowSSE41, Bayer8SSE41)
+CCVT_BAYER_DISPATCH(bayerRowSSE41, Bayer16SSE41)
+CCVT_BAYER_DISPATCH(bayerRowAVX2, Bayer8AVX2)
+CCVT_BAYER_DISPATCH(bayerRowAVX2, Bayer16AVX2)
+
+#endif
+
+Bayer8RowFunction bayer8RowFunction()
+{
+    switch (ccvtBackend())
+    {
+#ifdef CCVT_SIMD_X86
+        case CCVT_SIMD_AVX2:
+            return bayerRowAVX2Bayer8AVX2;
+        case CCVT_SIMD_SSE41:
+            return bayerRowSSE41Bayer8SSE41;
+#endif
+        default:
+            return bayerRowC<uint8_t>;
+    }
+}
+
+Bayer16RowFunction bayer16RowFunction()
+{
+    switch (ccvtBackend())
+    {
+#ifdef CCVT_SIMD_X86
+        case CCVT_SIMD_AVX2:
+            return bayerRowAVX2Bayer16AVX2;
+        case CCVT_SIMD_SSE41:
+            return bayerRowSSE41Bayer16SSE41;
+#endif
+        default:
+            return bayerRowC<uint16_t>;
+    }
+}
+
+int bayerKind(int pattern, int row, int column)
+{
+    static const char *colors[] = { "BGGR", "GBRG", "GRBG", "RGGB" };
+    const char *cfa = colors[(pattern >= 0 && pattern < 4) ? pattern : 0] + 2 * (row & 1);
+    switch (cfa[column & 1])
+    {
+        case 'R':
+            return BAYER_RED;
+        case 'B':
+            return BAYER_BLUE;
+        default:
+            return (cfa[(column + 1) & 1] == 'R') ? BAYER_GREEN_RED_ROW : BAYER_GREEN_BLUE_ROW;
+    }
+}
+
+template <typename T, typename RowFunction>
+void debayer(const T *src, T *dst, int width, int height, int pattern, bool edgeAware, RowFunction row)
+{
+    if (width < 2 || height < 2 || (width & 1))
+        return;
+
+    ccvtParallelRows(height, width, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            int up = (y > 0) ? y - 1 : y + 1, down = (y < height - 1) ? y + 1 : y - 1;
+            row(src + static_cast<long>(up) * width, src + static_cast<long>(y) * width,
+                src + static_cast<long>(down) * width, dst + 3L * y * width, width, bayerKind(pattern, y, 0),
+                bayerKind(pattern, y, 1), edgeAware);
+        }
+    });
+}
+
+}
+
+int ccvt_simd_set_backend(int backend)
+{
+    int best = ccvtDetectBackend();
+    if (backend == CCVT_SIMD_AUTO || backend > best || backend < CCVT_SIMD_SCALAR)
+        backend = best;
+    s_Backend.store(backend);
+    return backend;
+}
+
+int ccvt_simd_get_backend(void)
+{
+    return ccvtBackend();
+}
+
+const char *ccvt_simd_backend_name(int backend)
+{
+    switch (backend)
+    {
+        case CCVT_SIMD_SSE41:
+            return "SSE4.1";
+        case CCVT_SIMD_AVX2:
+            return "AVX2";
+        default:
+            return "C";
+    }
+}
+
+void ccvt_simd_set_threads(int threads)
+{
+    s_Threads.store(std::max(0, threads));
+}
+
+void ccvt_simd_yuyv_rgb24(int width, int height, const void *src, void *dst)
+{
+    convertYUV<YUV_LAYOUT_YUYV, YUV_OUT_RGB24>(width, height, src, dst, false);
+}
+
+void ccvt_simd_yuyv_bgr32(int width, int height, const void *src, void *dst)
+{
+    convertYUV<YUV_LAYOUT_YUYV, YUV_OUT_BGR32>(width, height, src, dst, false);
+}
+
+void ccvt_simd_uyvy_rgb24(int width, int height, const void *src, void *dst)
+{
+    convertYUV<YUV_LAYOUT_UYVY, YUV_OUT_RGB24>(width, height, src, dst, false);
+}
+
+void ccvt_simd_420p_rgb24(int width, int height, const void *src, void *dst)
+{
+    convertYUV<YUV_LAYOUT_PLANAR, YUV_OUT_RGB24>(width, height, src, dst, false);
+}
+
+void ccvt_simd_420p_bgr32(int width, int height, const void *src, void *dst)
+{
+    convertYUV<YUV_LAYOUT_PLANAR, YUV_OUT_BGR32>(width, height, src, dst, false);
+}
+
+void ccvt_simd_nv12_rgb24(int width, int height, const void *src, void *dst, int swapuv)
+{
+    convertYUV<YUV_LAYOUT_SEMIPLANAR, YUV_OUT_RGB24>(width, height, src, dst, swapuv != 0);
+}
+
+void ccvt_simd_nv12_bgr32(int width, int height, const void *src, void *dst, int swapuv)
+{
+    convertYUV<YUV_LAYOUT_SEMIPLANAR, YUV_OUT_BGR32>(width, height, src, dst, swapuv != 0);
+}
+
+void ccvt_simd_bayer8_rgb24(const uint8_t *src, uint8_t *dst, int width, int height, int pattern, int edgeaware)
+{
+    debayer(src, dst, width, height, pattern, edgeaware != 0, bayer8RowFunction());
+}
+
+void ccvt_simd_bayer16_rgb48(const uint16_t *src, uint16_t *dst, int width, int height, int pattern, int edgeaware)
+{
+    debayer(src, dst, width, height, pattern, edgeaware != 0, bayer16RowFunction());
+}
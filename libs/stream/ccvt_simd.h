@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Vectorized color space conversion and debayering
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup colorSpaceSIMD Vectorized color space conversion functions
+ *
+ * Drop-in replacements for the hot ccvt routines. The YUV conversions produce exactly the same pixels as their ccvt
+ * counterparts. Frames are split by rows over up to 4 threads of the shared stream thread pool, and each row is
+ * converted with the best instruction set of the CPU, selected once at run time: AVX2 or SSE4.1 on x86, plain C
+ * otherwise.
+ *
+ * Bayer frames are interpolated bilinearly like bayer2rgb24(), except on the outer pixels where the missing
+ * neighbours are mirrored. The edge aware variant interpolates green along the direction of the smallest gradient,
+ * which reduces the zipper artifacts of bilinear interpolation on sharp planetary and lunar edges.
+ *
+ * All widths must be even. bgr32 pixels are written with a zero alpha byte.
+ */
+
+/*@{*/
+
+enum ccvt_simd_backend
+{
+    CCVT_SIMD_AUTO = -1,
+    CCVT_SIMD_SCALAR,
+    CCVT_SIMD_SSE41,
+    CCVT_SIMD_AVX2
+};
+
+enum ccvt_bayer_pattern
+{
+    CCVT_BAYER_BGGR,
+    CCVT_BAYER_GBRG,
+    CCVT_BAYER_GRBG,
+    CCVT_BAYER_RGGB
+};
+
+/** Select the instruction set, CCVT_SIMD_AUTO selects the best one. Returns the backend actually used. */
+int ccvt_simd_set_backend(int backend);
+/** Currently used backend */
+int ccvt_simd_get_backend(void);
+/** Name of a backend, e.g. "AVX2" */
+const char *ccvt_simd_backend_name(int backend);
+/** Maximum number of threads per frame, 0 selects the size of the stream thread pool (up to 4) */
+void ccvt_simd_set_threads(int threads);
+
+/** 4:2:2 YUYV interlaced to RGB24 */
+void ccvt_simd_yuyv_rgb24(int width, int height, const void *src, void *dst);
+/** 4:2:2 YUYV interlaced to BGR32 */
+void ccvt_simd_yuyv_bgr32(int width, int height, const void *src, void *dst);
+/** 4:2:2 UYVY interlaced to RGB24 */
+void ccvt_simd_uyvy_rgb24(int width, int height, const void *src, void *dst);
+/** 4:2:0 YUV planar (I420) to RGB24 */
+void ccvt_simd_420p_rgb24(int width, int height, const void *src, void *dst);
+/** 4:2:0 YUV planar (I420) to BGR32 */
+void ccvt_simd_420p_bgr32(int width, int height, const void *src, void *dst);
+/** 4:2:0 NV12 (Y plane followed by interleaved UV plane) to RGB24. NV21 if swapuv is set. */
+void ccvt_simd_nv12_rgb24(int width, int height, const void *src, void *dst, int swapuv);
+/** 4:2:0 NV12 (Y plane followed by interleaved UV plane) to BGR32. NV21 if swapuv is set. */
+void ccvt_simd_nv12_bgr32(int width, int height, const void *src, void *dst, int swapuv);
+
+/** Bayer 8 bit to RGB24 */
+void ccvt_simd_bayer8_rgb24(const uint8_t *src, uint8_t *dst, int width, int height, int pattern, int edgeaware);
+/** Bayer 16 bit to RGB48 */
+void ccvt_simd_bayer16_rgb48(const uint16_t *src, uint16_t *dst, int width, int height, int pattern, int edgeaware);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,42 +21,100 @@
 
 #include "mjpegencoder.h"
 #include "stream/streammanager.h"
+#include "stream/streamthreadpool.h"
 #include "indiccd.h"
 
-#include <zlib.h>
+#include <algorithm>
+
+#include <csetjmp>
+#include <cstdio>
 #include <jpeglib.h>
 #include <jerror.h>
 
+namespace INDI
+{
+
+/**
+ * One horizontal slice of the frame. The compressor is created once and reused for every frame, and the output
+ * buffer keeps its capacity so steady state encoding does not allocate.
+ */
+struct MJPEGEncoder::Slice
+{
+    struct Destination
+    {
+        jpeg_destination_mgr pub;
+        Slice *slice;
+    } dest;
+
+    struct Error
+    {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+    } error;
+
+    jpeg_compress_struct cinfo;
+    std::vector<uint8_t> output;
+    size_t size { 0 };
+    bool ok { false };
+};
+
 static void init_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto dest = reinterpret_cast<MJPEGEncoder::Slice::Destination *>(cinfo->dest);
+    dest->pub.next_output_byte = dest->slice->output.data();
+    dest->pub.free_in_buffer   = dest->slice->output.size();
 }
 
 static boolean empty_output_buffer(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    // The whole buffer is full, grow it and continue after the data already written
+    auto dest = reinterpret_cast<MJPEGEncoder::Slice::Destination *>(cinfo->dest);
+    std::vector<uint8_t> &output = dest->slice->output;
+    size_t used = output.size();
+    output.resize(used * 2);
+    dest->pub.next_output_byte = output.data() + used;
+    dest->pub.free_in_buffer   = output.size() - used;
     return TRUE;
 }
 
 static void term_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* no work necessary here */
+    auto dest = reinterpret_cast<MJPEGEncoder::Slice::Destination *>(cinfo->dest);
+    dest->slice->size = dest->slice->output.size() - dest->pub.free_in_buffer;
 }
 
-namespace INDI
+static void error_exit(j_common_ptr cinfo)
 {
+    // Default libjpeg handler exits the process, return to encodeSlice instead
+    auto error = reinterpret_cast<MJPEGEncoder::Slice::Error *>(cinfo->err);
+    longjmp(error->jump, 1);
+}
+
+// Find the marker in the JPEG header, returns its offset or 0 if the start of scan is reached first.
+static size_t find_marker(const uint8_t *data, size_t size, uint8_t marker)
+{
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        if (data[pos + 1] == marker)
+            return pos;
+        if (data[pos + 1] == 0xDA)
+            break;
+        pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+    }
+    return 0;
+}
 
 MJPEGEncoder::MJPEGEncoder()
 {
-    name = "MJPEG";    
+    name = "MJPEG";
+    setThreads(0);
 }
 
 MJPEGEncoder::~MJPEGEncoder()
 {
-    delete [] jpegBuffer;
+    for (auto &slice : m_Slices)
+        jpeg_destroy_compress(&slice->cinfo);
 }
 
 const char *MJPEGEncoder::getDeviceName()
@@ -64,6 +122,18 @@ const char *MJPEGEncoder::getDeviceName()
     return currentDevice->getDeviceName();
 }
 
+void MJPEGEncoder::setQuality(int quality)
+{
+    m_Quality = std::max(1, std::min(quality, 100));
+}
+
+void MJPEGEncoder::setThreads(unsigned int threads)
+{
+    if (threads == 0)
+        threads = StreamThreadPool::instance().size();
+    m_Threads = std::max(1u, std::min(threads, 8u));
+}
+
 bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed)
 {
     // We do not support compression
@@ -73,118 +143,148 @@ bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, boo
         return false;
     }
 
-    INDI_UNUSED(nbytes);
-    int bufsize = rawWidth * rawHeight * ((pixelFormat == INDI_RGB) ? 3 : 1);
-    if (bufsize != jpegBufferSize)
+    const int components = (pixelFormat == INDI_RGB) ? 3 : 1;
+    if (nbytes < static_cast<uint32_t>(rawWidth * rawHeight * components))
+    {
+        LOGF_ERROR("MJPEG frame is too small (%u bytes) for %dx%d.", nbytes, rawWidth, rawHeight);
+        return false;
+    }
+
+    const uint16_t width  = rawWidth;
+    const uint16_t height = rawHeight;
+    if (width == 0 || height == 0)
+        return false;
+
+    // Slices must hold whole MCU rows: 16 rows for color (2x2 chroma subsampling), 8 for grayscale.
+    // The restart interval is the number of MCUs in one slice and must fit in 16 bits.
+    const int mcuSize       = (components == 3) ? 16 : 8;
+    const int mcusPerRow    = (width + mcuSize - 1) / mcuSize;
+    const int totalMCURows  = (height + mcuSize - 1) / mcuSize;
+    int mcuRowsPerSlice     = (totalMCURows + m_Threads - 1) / m_Threads;
+    mcuRowsPerSlice         = std::max(1, std::min(mcuRowsPerSlice, 65535 / mcusPerRow));
+    const size_t count      = (totalMCURows + mcuRowsPerSlice - 1) / mcuRowsPerSlice;
+    const int rowsPerSlice  = mcuRowsPerSlice * mcuSize;
+    const unsigned int restartInterval = (count > 1) ? mcuRowsPerSlice * mcusPerRow : 0;
+
+    while (m_Slices.size() < count)
     {
-        delete [] jpegBuffer;
-        jpegBuffer = new uint8_t[bufsize];
-        jpegBufferSize = bufsize;
+        std::unique_ptr<Slice> slice(new Slice());
+        slice->cinfo.err = jpeg_std_error(&slice->error.pub);
+        slice->error.pub.error_exit = error_exit;
+        jpeg_create_compress(&slice->cinfo);
+        slice->dest.pub.init_destination    = init_destination;
+        slice->dest.pub.empty_output_buffer = empty_output_buffer;
+        slice->dest.pub.term_destination    = term_destination;
+        slice->dest.slice = slice.get();
+        slice->cinfo.dest = &slice->dest.pub;
+        m_Slices.push_back(std::move(slice));
     }
 
-    if (pixelFormat == INDI_RGB)
-        jpeg_compress_8u_rgb(buffer, rawWidth, rawHeight, rawWidth*3, jpegBuffer, &bufsize, 70);
-    else
-        jpeg_compress_8u_gray(buffer, rawWidth, rawHeight, rawWidth, jpegBuffer, &bufsize, 70);
+    StreamThreadPool::instance().run(count, [&](uint32_t i)
+    {
+        Slice &slice = *m_Slices[i];
+        int firstRow = i * rowsPerSlice;
+        int rows = std::min(rowsPerSlice, height - firstRow);
+        const uint8_t *src = buffer + firstRow * width * components;
+        // First guess at the output size, the buffer grows if needed
+        if (slice.output.size() < 4096u + width * rows * components / 4)
+            slice.output.resize(4096u + width * rows * components / 4);
+        slice.ok = encodeSlice(slice, src, components, width, rows, restartInterval);
+    });
+
+    if (assemble(count, height) == false)
+    {
+        LOG_ERROR("MJPEG encoding failed.");
+        return false;
+    }
 
-    bp->blob    = jpegBuffer;
-    bp->bloblen = bufsize;
-    bp->size    = bufsize;
+    bp->blob    = m_JPEG.data();
+    bp->bloblen = m_JPEG.size();
+    bp->size    = m_JPEG.size();
     strcpy(bp->format, ".stream_jpg");
 
     return true;
 }
 
-/*
-FROM: https://svn.csail.mit.edu/rrg_pods/jpeg-utils/
-
-Name:         jpeg-utils
-Maintainers:  Albert Huang <albert@csail.mit.edu>
-Summary:      Wrapper functions around libjpeg to simplify JPEG compression and
-              decompression with in-memory buffers.
-Description:
-  note: This is a simple enough library that you could just copy the .c
-  and .h files in to your own programs.
+bool MJPEGEncoder::encodeSlice(Slice &slice, const uint8_t *rows, int components, uint16_t width, int nrows,
+                               unsigned int restartInterval)
+{
+    jpeg_compress_struct &cinfo = slice.cinfo;
+    JSAMPROW rowPointers[16];
 
-  To use the library, link against -ljpeg-utils, or use
-  pkg-config --cflags --libs jpeg-utils
+    if (setjmp(slice.error.jump))
+    {
+        jpeg_abort_compress(&cinfo);
+        return false;
+    }
 
-Requirements:
-  libjpeg62
+    cinfo.image_width      = width;
+    cinfo.image_height     = nrows;
+    cinfo.input_components = components;
+    cinfo.in_color_space   = (components == 3) ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, m_Quality, TRUE);
+    // All slices must share the default Huffman tables to be joined
+    cinfo.optimize_coding  = FALSE;
+    cinfo.restart_interval = restartInterval;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        int n = std::min<int>(16, cinfo.image_height - cinfo.next_scanline);
+        for (int i = 0; i < n; i++)
+            rowPointers[i] = const_cast<JSAMPROW>(rows + (cinfo.next_scanline + i) * width * components);
+        jpeg_write_scanlines(&cinfo, rowPointers, n);
+    }
+    jpeg_finish_compress(&cinfo);
 
-  For faster performance, install libjpeg-turbo, an SSE-accelerated
-  library that is ABI compatible with libjpeg62.
-*/
+    return true;
+}
 
-int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality)
+bool MJPEGEncoder::assemble(size_t count, uint16_t height)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    for (size_t i = 0; i < count; i++)
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        if (m_Slices[i]->ok == false || m_Slices[i]->size < 4)
+            return false;
     }
 
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
-}
+    // The first slice provides the headers, only the frame height needs to be corrected.
+    const Slice &first = *m_Slices[0];
+    size_t total = first.size;
+    for (size_t i = 1; i < count; i++)
+        total += m_Slices[i]->size;
+    m_JPEG.resize(total);
 
-int MJPEGEncoder::jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality)
-{
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    memcpy(m_JPEG.data(), first.output.data(), first.size - 2);
+    size_t length = first.size - 2;
+
+    size_t sof = find_marker(m_JPEG.data(), length, 0xC0);
+    if (sof == 0)
+        return false;
+    m_JPEG[sof + 5] = height >> 8;
+    m_JPEG[sof + 6] = height & 0xFF;
+
+    // Append the entropy coded data of the following slices, each one preceded by a restart marker
+    for (size_t i = 1; i < count; i++)
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        const Slice &slice = *m_Slices[i];
+        size_t sos = find_marker(slice.output.data(), slice.size, 0xDA);
+        if (sos == 0)
+            return false;
+        size_t start = sos + 2 + ((slice.output[sos + 2] << 8) | slice.output[sos + 3]);
+        size_t end   = slice.size - 2;
+
+        m_JPEG[length++] = 0xFF;
+        m_JPEG[length++] = 0xD0 + ((i - 1) & 7);
+        memcpy(m_JPEG.data() + length, slice.output.data() + start, end - start);
+        length += end - start;
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
+
+    m_JPEG[length++] = 0xFF;
+    m_JPEG[length++] = 0xD9;
+    m_JPEG.resize(length);
+    return true;
 }
 
 }
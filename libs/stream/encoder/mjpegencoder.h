@@ -23,13 +23,18 @@
 
 #include "encoderinterface.h"
 
+#include <memory>
+#include <vector>
+
 namespace INDI
 {
 
 /**
  * @brief The MJPEGEncoder class encodes frames in JPEG format before transmitting them to the client.
  *
- * The quality is now hard-coded at 70 when encoding the JPEG image. Further compression is not supported.
+ * Frames are split into horizontal slices that are encoded in parallel, each by its own libjpeg compressor which
+ * is kept between frames. The slices are joined into a single baseline JPEG using restart markers, so any JPEG
+ * decoder can read the stream. Frames arrive already downscaled by StreamScaler, see STREAM_PREVIEW_SCALE.
  */
 class MJPEGEncoder : public EncoderInterface
 {
@@ -39,13 +44,29 @@ public:
 
     virtual bool upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed=false) override;
 
+    /**
+     * @brief setQuality JPEG quality, 1 to 100. Default 70.
+     */
+    void setQuality(int quality);
+
+    /**
+     * @brief setThreads Number of slices a frame is split into. Slices are encoded in parallel on the shared
+     * StreamThreadPool. 0 selects the size of the pool.
+     */
+    void setThreads(unsigned int threads);
+
+    struct Slice;
+
 private:
     const char *getDeviceName();
-    int jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality);
-    int jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, uint8_t * dest, int * destsize, int quality);
-    uint8_t *jpegBuffer = nullptr;
-    uint16_t jpegBufferSize=1;
+    bool encodeSlice(Slice &slice, const uint8_t *rows, int components, uint16_t width, int nrows, unsigned int restartInterval);
+    bool assemble(size_t count, uint16_t height);
+
+    int m_Quality { 70 };
+    unsigned int m_Threads { 1 };
 
+    std::vector<std::unique_ptr<Slice>> m_Slices;
+    std::vector<uint8_t> m_JPEG;
 };
 
 }
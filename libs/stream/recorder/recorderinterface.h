@@ -75,6 +75,10 @@ class RecorderInterface
     // and no need to do any further subframing operations. Otherwise, subframing must be done.
     // This is to reduce process time and save memory for a dedicated subframe buffer
     virtual void setStreamEnabled(bool enable) = 0;
+    // Sustained write rate in MB/s since the recording was opened, 0 if not measured.
+    virtual double getWriteRate() { return 0; }
+    // Frames dropped because the storage could not keep up.
+    virtual uint32_t getDroppedFrames() { return 0; }
 
   protected:
     const char *name;
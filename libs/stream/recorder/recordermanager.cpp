@@ -24,6 +24,7 @@
 
 #include "recordermanager.h"
 #include "serrecorder.h"
+#include "serzrecorder.h"
 
 #ifdef HAVE_THEORA
 #include "theorarecorder.h"
@@ -35,6 +36,7 @@ namespace INDI
 RecorderManager::RecorderManager()
 {
     recorder_list.push_back(new SER_Recorder());
+    recorder_list.push_back(new SERZ_Recorder());
     #ifdef HAVE_THEORA
     recorder_list.push_back(new TheoraRecorder());
     #endif
@@ -54,7 +54,6 @@ SER_Recorder::SER_Recorder()
     else
         serh.LittleEndian = SER_BIG_ENDIAN;
     isRecordingActive = false;
-    f                 = nullptr;
 
     jpegBuffer = static_cast<uint8_t*>(malloc(1));
 }
@@ -71,49 +70,36 @@ bool SER_Recorder::is_little_endian()
     return black_magic == 0x01;
 }
 
-void SER_Recorder::write_int_le(uint32_t *i)
+uint8_t *SER_Recorder::encode_int_le(uint8_t *dest, uint32_t i)
 {
-    if (is_little_endian())
-        fwrite((const void *)(i), sizeof(uint32_t), 1, f);
-    else
-    {
-        unsigned char *c = (unsigned char *)i;
-        fwrite((const void *)(c + 3), sizeof(char), 1, f);
-        fwrite((const void *)(c + 2), sizeof(char), 1, f);
-        fwrite((const void *)(c + 1), sizeof(char), 1, f);
-        fwrite((const void *)(c), sizeof(char), 1, f);
-    }
+    dest[0] = i & 0xFF;
+    dest[1] = (i >> 8) & 0xFF;
+    dest[2] = (i >> 16) & 0xFF;
+    dest[3] = (i >> 24) & 0xFF;
+    return dest + 4;
 }
 
-void SER_Recorder::write_long_int_le(uint64_t *i)
+uint8_t *SER_Recorder::encode_long_int_le(uint8_t *dest, uint64_t i)
 {
-    if (is_little_endian())
-    {
-        fwrite((const void *)((uint32_t *)i), sizeof(int), 1, f);
-        fwrite((const void *)((uint32_t *)(i) + 1), sizeof(int), 1, f);
-    }
-    else
-    {
-        write_int_le((uint32_t *)(i) + 1);
-        write_int_le((uint32_t *)(i));
-    }
+    dest = encode_int_le(dest, i & 0xFFFFFFFF);
+    return encode_int_le(dest, i >> 32);
 }
 
-void SER_Recorder::write_header(ser_header *s)
+void SER_Recorder::encode_header(const ser_header *s, uint8_t *dest)
 {
-    fwrite((const void *)(s->FileID), sizeof(char), 14, f);
-    write_int_le(&(s->LuID));
-    write_int_le(&(s->ColorID));
-    write_int_le(&(s->LittleEndian));
-    write_int_le(&(s->ImageWidth));
-    write_int_le(&(s->ImageHeight));
-    write_int_le(&(s->PixelDepth));
-    write_int_le(&(s->FrameCount));
-    fwrite((const void *)(s->Observer), sizeof(char), 40, f);
-    fwrite((const void *)(s->Instrume), sizeof(char), 40, f);
-    fwrite((const void *)(s->Telescope), sizeof(char), 40, f);
-    write_long_int_le(&(s->DateTime));
-    write_long_int_le(&(s->DateTime_UTC));
+    memcpy(dest, s->FileID, 14);
+    dest = encode_int_le(dest + 14, s->LuID);
+    dest = encode_int_le(dest, s->ColorID);
+    dest = encode_int_le(dest, s->LittleEndian);
+    dest = encode_int_le(dest, s->ImageWidth);
+    dest = encode_int_le(dest, s->ImageHeight);
+    dest = encode_int_le(dest, s->PixelDepth);
+    dest = encode_int_le(dest, s->FrameCount);
+    memcpy(dest, s->Observer, 40);
+    memcpy(dest + 40, s->Instrume, 40);
+    memcpy(dest + 80, s->Telescope, 40);
+    dest = encode_long_int_le(dest + 120, s->DateTime);
+    encode_long_int_le(dest, s->DateTime_UTC);
 }
 
 bool SER_Recorder::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth)
@@ -176,41 +162,60 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
     if (isRecordingActive)
         return false;
     serh.FrameCount = 0;
-    if ((f = fopen(filename, "w")) == nullptr)
-    {
-        snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
+    if (m_Writer.open(filename, errmsg) == false)
         return false;
-    }
 
     serh.DateTime     = getLocalTimeStamp();
     serh.DateTime_UTC = getUTCTimeStamp();
-    write_header(&serh);
+
+    // Placeholder, the final header is written on close
+    uint8_t header[SER_HEADER_SIZE];
+    encode_header(&serh, header);
+    m_Writer.write(header, SER_HEADER_SIZE, true);
+
     frame_size        = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
     isRecordingActive = true;
+    m_DroppedFrames   = 0;
 
     frameStamps.clear();
+    // About 20 minutes at 100 FPS before the vector needs to grow
+    frameStamps.reserve(128 * 1024);
 
     return true;
 }
 
 bool SER_Recorder::close()
 {
-    if (f)
+    bool rc = true;
+
+    if (m_Writer.isOpen())
     {
-        // Write all timestamps
-        for (auto value : frameStamps)
-            write_long_int_le(&value);
+        // Write all timestamps in one block
+        if (is_little_endian() == false)
+        {
+            for (auto &value : frameStamps)
+            {
+                uint8_t le[8];
+                encode_long_int_le(le, value);
+                memcpy(&value, le, 8);
+            }
+        }
+        m_Writer.write(frameStamps.data(), frameStamps.size() * sizeof(uint64_t), true);
 
-        frameStamps.clear();
+        uint8_t header[SER_HEADER_SIZE];
+        encode_header(&serh, header);
+        rc = m_Writer.close(header, SER_HEADER_SIZE);
 
-        fseek(f, 0L, SEEK_SET);
-        write_header(&serh);
-        fclose(f);
-        f = nullptr;
+        if (m_DroppedFrames > 0)
+            IDLog("SER recorder dropped %u frames, the disk could not keep up (%.1f MB/s).\n",
+                  m_DroppedFrames.load(), m_Writer.getRate());
+
+        frameStamps.clear();
+        frameStamps.shrink_to_fit();
     }
 
     isRecordingActive = false;
-    return true;
+    return rc;
 }
 
 bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
@@ -254,7 +259,7 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
    }
 #endif
 
-    frameStamps.push_back(getUTCTimeStamp());
+    uint64_t timestamp = getUTCTimeStamp();
 
     // Not technically pixel format, but let's use this for now.
     if (m_PixelFormat == INDI_JPG)
@@ -267,10 +272,22 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
         serh.ImageWidth = w;
         serh.ImageHeight = h;
         serh.ColorID = (naxis == 3) ? SER_RGB : SER_MONO;
-        fwrite(jpegBuffer, memsize, 1, f);
+        frame  = jpegBuffer;
+        nbytes = memsize;
     }
-    else
-        fwrite(frame, nbytes, 1, f);
+
+    if (m_Writer.write(frame, nbytes) == false)
+    {
+        // Write error, recording must stop
+        if (m_Writer.getError())
+            return false;
+
+        // Buffers full, drop the frame
+        m_DroppedFrames++;
+        return true;
+    }
+
+    frameStamps.push_back(timestamp);
     serh.FrameCount += 1;
     return true;
 }
@@ -22,7 +22,9 @@
 #pragma once
 
 #include "recorderinterface.h"
+#include "streamfilewriter.h"
 
+#include <atomic>
 #include <cstdint>
 #include <stdio.h>
 
@@ -61,11 +63,18 @@ enum ser_color_id
 #define SER_BIG_ENDIAN    0
 #define SER_LITTLE_ENDIAN 1
 
+// Size of the header on disk, the structure above is not packed
+#define SER_HEADER_SIZE   178
+
 namespace INDI
 {
 
 /**
  * @brief The SER_Recorder class implements recording of video streams in SER format.
+ *
+ * Frames are copied to large aligned buffers and written by a dedicated I/O thread, see StreamFileWriter. If the
+ * disk cannot keep up, frames are dropped instead of stalling the stream and getDroppedFrames() reports how many.
+ * The frame timestamps are kept in memory and written as a single block when the recording is closed.
  */
 class SER_Recorder : public RecorderInterface
 {
@@ -80,19 +89,26 @@ class SER_Recorder : public RecorderInterface
     virtual bool close();
     virtual bool writeFrame(const uint8_t *frame, uint32_t nbytes);
     virtual void setStreamEnabled(bool enable) { isStreamingActive = enable; }
+    virtual double getWriteRate() { return m_Writer.getRate(); }
+    virtual uint32_t getDroppedFrames() { return m_DroppedFrames; }
 
     // Public constants
     static const uint64_t C_SEPASECONDS_PER_SECOND = 10000000;
 
+    // Little endian serialization of the header, shared with readers of SER files
+    static bool is_little_endian();
+    static uint8_t *encode_int_le(uint8_t *dest, uint32_t i);
+    static uint8_t *encode_long_int_le(uint8_t *dest, uint64_t i);
+    static void encode_header(const ser_header *s, uint8_t *dest);
+
   protected:
     uint64_t utcTo64BitTS();
-    bool is_little_endian();
-    void write_int_le(uint32_t *i);
-    void write_long_int_le(uint64_t *i);
-    void write_header(ser_header *s);
+    uint64_t getUTCTimeStamp();
+    uint64_t getLocalTimeStamp();
     ser_header serh;
     bool isRecordingActive = false, isStreamingActive = false;
-    FILE *f;
+    StreamFileWriter m_Writer;
+    std::atomic<uint32_t> m_DroppedFrames { 0 };
     uint32_t frame_size;
     uint32_t number_of_planes;
     uint16_t rawWidth = 0, rawHeight = 0;
@@ -106,9 +122,6 @@ class SER_Recorder : public RecorderInterface
     void dateTo64BitTS(int32_t year, int32_t month, int32_t day, int32_t hour, int32_t minute, int32_t second,
                        int32_t microsec, uint64_t *p_ts);
 
-    uint64_t getUTCTimeStamp();
-    uint64_t getLocalTimeStamp();
-
     // Calculate if a year is a leap yer
     ///
     static bool is_leap_year(uint32_t year);
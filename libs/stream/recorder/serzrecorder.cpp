@@ -0,0 +1,584 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Compressed SER Recorder
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "serzrecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <zlib.h>
+
+#define ERRMSGSIZ 1024
+
+// After the delta and shuffle filters, run length matching with the fastest level compresses better and faster
+// than the default deflate strategy
+#define SERZ_COMPRESSION_LEVEL      1
+#define SERZ_COMPRESSION_STRATEGY   Z_RLE
+
+namespace INDI
+{
+
+enum
+{
+    SLOT_FREE,
+    SLOT_PENDING,
+    SLOT_BUSY,
+    SLOT_DONE
+};
+
+struct SERZ_Recorder::Slot
+{
+    std::vector<uint8_t> raw, filtered, out;
+    uint32_t outSize { 0 };
+    uint64_t timestamp { 0 };
+    int state { SLOT_FREE };
+};
+
+static uint32_t decode_int_le(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(src[3]) << 24);
+}
+
+static uint64_t decode_long_int_le(const uint8_t *src)
+{
+    return decode_int_le(src) | (static_cast<uint64_t>(decode_int_le(src + 4)) << 32);
+}
+
+// Distance between two samples of the same color
+static uint32_t color_stride(uint32_t colorID)
+{
+    if (colorID >= SER_RGB)
+        return 3;
+    if (colorID >= SER_BAYER_RGGB)
+        return 2;
+    return 1;
+}
+
+SERZ_Recorder::SERZ_Recorder()
+{
+    name = "SERZ";
+    memcpy(serh.FileID, SERZ_FILE_ID, 14);
+    setThreads(0);
+}
+
+SERZ_Recorder::~SERZ_Recorder()
+{
+    close();
+    for (auto slot : m_Slots)
+        delete slot;
+}
+
+void SERZ_Recorder::setThreads(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    m_ThreadCount = std::max(1u, std::min(threads, 4u));
+}
+
+bool SERZ_Recorder::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth)
+{
+    // JPEG frames are already compressed
+    if (pixelFormat == INDI_JPG)
+        return false;
+
+    return SER_Recorder::setPixelFormat(pixelFormat, pixelDepth);
+}
+
+uint32_t SERZ_Recorder::filter(const uint8_t *src, uint8_t *dst, uint32_t nbytes, uint8_t bytesPerSample, uint32_t stride)
+{
+    if (bytesPerSample == 1)
+    {
+        uint32_t head = std::min(stride, nbytes);
+        memcpy(dst, src, head);
+        for (uint32_t i = head; i < nbytes; i++)
+            dst[i] = src[i] - src[i - stride];
+        return SERZ_FLAG_DELTA;
+    }
+
+    // 16 bit little endian samples: deltas are split in a plane of low bytes followed by a plane of high bytes
+    uint32_t nsamples = nbytes / 2;
+    uint8_t *lo = dst, *hi = dst + nsamples;
+    for (uint32_t i = 0; i < nsamples; i++)
+    {
+        uint16_t value    = src[2 * i] | (src[2 * i + 1] << 8);
+        uint16_t previous = i < stride ? 0 : src[2 * (i - stride)] | (src[2 * (i - stride) + 1] << 8);
+        uint16_t delta    = value - previous;
+        lo[i] = delta & 0xFF;
+        hi[i] = delta >> 8;
+    }
+    // Odd trailing byte, if any
+    if (nbytes & 1)
+        dst[nbytes - 1] = src[nbytes - 1];
+
+    return SERZ_FLAG_DELTA | SERZ_FLAG_SHUFFLE;
+}
+
+void SERZ_Recorder::unfilter(const uint8_t *src, uint8_t *dst, uint32_t nbytes, uint8_t bytesPerSample, uint32_t stride,
+                             uint32_t flags)
+{
+    if (!(flags & SERZ_FLAG_DELTA) || (flags & SERZ_FLAG_STORED))
+    {
+        memcpy(dst, src, nbytes);
+        return;
+    }
+
+    if (bytesPerSample == 1)
+    {
+        uint32_t head = std::min(stride, nbytes);
+        memcpy(dst, src, head);
+        for (uint32_t i = head; i < nbytes; i++)
+            dst[i] = src[i] + dst[i - stride];
+        return;
+    }
+
+    uint32_t nsamples = nbytes / 2;
+    const uint8_t *lo = src, *hi = src + nsamples;
+    for (uint32_t i = 0; i < nsamples; i++)
+    {
+        uint16_t previous = i < stride ? 0 : dst[2 * (i - stride)] | (dst[2 * (i - stride) + 1] << 8);
+        uint16_t value    = previous + (lo[i] | (hi[i] << 8));
+        dst[2 * i]     = value & 0xFF;
+        dst[2 * i + 1] = value >> 8;
+    }
+    if (nbytes & 1)
+        dst[nbytes - 1] = src[nbytes - 1];
+}
+
+bool SERZ_Recorder::open(const char *filename, char *errmsg)
+{
+    if (isRecordingActive)
+        return false;
+
+    // Writes the placeholder header
+    if (SER_Recorder::open(filename, errmsg) == false)
+        return false;
+
+    m_BytesPerSample = (serh.PixelDepth <= 8) ? 1 : 2;
+    m_Stride         = color_stride(serh.ColorID);
+    m_Offset         = SER_HEADER_SIZE;
+    m_RawBytes       = 0;
+    m_CompressedBytes = 0;
+    m_FrameOffsets.clear();
+    m_FrameOffsets.reserve(128 * 1024);
+
+    // Enough slots to keep every thread busy while the previous frames are written
+    size_t slotCount = 2 * m_ThreadCount + 1;
+    while (m_Slots.size() < slotCount)
+        m_Slots.push_back(new Slot());
+    while (m_Slots.size() > slotCount)
+    {
+        delete m_Slots.back();
+        m_Slots.pop_back();
+    }
+    for (auto slot : m_Slots)
+    {
+        slot->raw.resize(frame_size);
+        slot->filtered.resize(frame_size);
+        slot->out.resize(SERZ_FRAME_HEADER + compressBound(frame_size));
+        slot->state = SLOT_FREE;
+    }
+
+    m_ProduceIndex = 0;
+    m_WriteIndex   = 0;
+    m_Flushing     = false;
+    m_Exit         = false;
+    for (unsigned int i = 0; i < m_ThreadCount; i++)
+        m_Threads.emplace_back(&SERZ_Recorder::compressThread, this);
+
+    return true;
+}
+
+bool SERZ_Recorder::close()
+{
+    bool rc = true;
+
+    if (m_Writer.isOpen())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Exit = true;
+        }
+        // Threads compress and write all pending frames before exiting
+        m_PendingCV.notify_all();
+        for (auto &thread : m_Threads)
+            thread.join();
+        m_Threads.clear();
+
+        // Index of frame offsets followed by the footer pointing to it
+        std::vector<uint8_t> index(m_FrameOffsets.size() * 8 + SERZ_FOOTER_SIZE);
+        uint8_t *dest = index.data();
+        for (uint64_t offset : m_FrameOffsets)
+            dest = encode_long_int_le(dest, offset);
+        dest = encode_long_int_le(dest, m_Offset);
+        memcpy(dest, SERZ_INDEX_ID, 8);
+        m_Writer.write(index.data(), index.size(), true);
+
+        uint8_t header[SER_HEADER_SIZE];
+        encode_header(&serh, header);
+        rc = m_Writer.close(header, SER_HEADER_SIZE);
+
+        if (m_CompressedBytes > 0)
+            IDLog("SERZ recorder: %u frames, compression ratio %.2f.\n", serh.FrameCount, getCompressionRatio());
+        if (m_DroppedFrames > 0)
+            IDLog("SERZ recorder dropped %u frames, compression or disk could not keep up (%.1f MB/s).\n",
+                  m_DroppedFrames.load(), m_Writer.getRate());
+
+        m_FrameOffsets.clear();
+        m_FrameOffsets.shrink_to_fit();
+    }
+
+    isRecordingActive = false;
+    return rc;
+}
+
+double SERZ_Recorder::getCompressionRatio() const
+{
+    return (m_CompressedBytes > 0) ? static_cast<double>(m_RawBytes) / m_CompressedBytes : 0;
+}
+
+bool SERZ_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
+{
+    if (!isRecordingActive || m_Writer.getError())
+        return false;
+
+    // All frames of a recording must have the size announced in the header
+    if (nbytes != frame_size)
+        return false;
+
+    uint64_t timestamp = getUTCTimeStamp();
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    Slot *slot = m_Slots[m_ProduceIndex];
+    if (slot->state != SLOT_FREE)
+    {
+        // All threads are busy, drop the frame
+        m_DroppedFrames++;
+        return true;
+    }
+
+    // Free slots are only touched by the producer
+    lock.unlock();
+    memcpy(slot->raw.data(), frame, nbytes);
+    slot->timestamp = timestamp;
+    lock.lock();
+
+    slot->state    = SLOT_PENDING;
+    m_ProduceIndex = (m_ProduceIndex + 1) % m_Slots.size();
+    m_PendingCV.notify_one();
+    return true;
+}
+
+void SERZ_Recorder::compressThread()
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    bool deflateOK = (deflateInit2(&stream, SERZ_COMPRESSION_LEVEL, Z_DEFLATED, 15, 8, SERZ_COMPRESSION_STRATEGY) == Z_OK);
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    for (;;)
+    {
+        // Oldest pending frame first
+        Slot *slot = nullptr;
+        m_PendingCV.wait(lock, [&]()
+        {
+            for (size_t i = 0; i < m_Slots.size() && slot == nullptr; i++)
+            {
+                Slot *candidate = m_Slots[(m_WriteIndex + i) % m_Slots.size()];
+                if (candidate->state == SLOT_PENDING)
+                    slot = candidate;
+            }
+            return slot != nullptr || m_Exit;
+        });
+
+        if (slot == nullptr)
+            break;
+
+        slot->state = SLOT_BUSY;
+        lock.unlock();
+        compress(*slot, deflateOK ? &stream : nullptr);
+        lock.lock();
+        slot->state = SLOT_DONE;
+
+        flush(lock);
+    }
+
+    if (deflateOK)
+        deflateEnd(&stream);
+}
+
+void SERZ_Recorder::compress(Slot &slot, void *stream)
+{
+    z_stream *zs = static_cast<z_stream *>(stream);
+    uint8_t *payload = slot.out.data() + SERZ_FRAME_HEADER;
+    uint32_t flags = 0, size = 0;
+
+    if (zs != nullptr)
+    {
+        flags = filter(slot.raw.data(), slot.filtered.data(), frame_size, m_BytesPerSample, m_Stride);
+
+        deflateReset(zs);
+        zs->next_in   = slot.filtered.data();
+        zs->avail_in  = frame_size;
+        zs->next_out  = payload;
+        zs->avail_out = slot.out.size() - SERZ_FRAME_HEADER;
+        if (deflate(zs, Z_FINISH) == Z_STREAM_END)
+            size = zs->total_out;
+    }
+
+    // Noise does not compress, keep the raw frame
+    if (size == 0 || size >= frame_size)
+    {
+        memcpy(payload, slot.raw.data(), frame_size);
+        flags = SERZ_FLAG_STORED;
+        size  = frame_size;
+    }
+
+    uint8_t *header = encode_int_le(slot.out.data(), size);
+    header = encode_int_le(header, flags);
+    encode_long_int_le(header, slot.timestamp);
+    slot.outSize = SERZ_FRAME_HEADER + size;
+}
+
+void SERZ_Recorder::flush(std::unique_lock<std::mutex> &lock)
+{
+    // Frames are written in order by one thread at a time. Threads finishing a frame meanwhile leave it to the
+    // thread already flushing, which checks for the next frame before giving up.
+    if (m_Flushing)
+        return;
+    m_Flushing = true;
+
+    while (m_Slots[m_WriteIndex]->state == SLOT_DONE)
+    {
+        Slot *slot = m_Slots[m_WriteIndex];
+        lock.unlock();
+        // Waiting here stalls compression and eventually makes writeFrame drop frames
+        bool ok = m_Writer.write(slot->out.data(), slot->outSize, true);
+        lock.lock();
+
+        if (ok)
+        {
+            m_FrameOffsets.push_back(m_Offset);
+            m_Offset          += slot->outSize;
+            m_RawBytes        += frame_size;
+            m_CompressedBytes += slot->outSize;
+            serh.FrameCount++;
+        }
+
+        slot->state  = SLOT_FREE;
+        m_WriteIndex = (m_WriteIndex + 1) % m_Slots.size();
+    }
+
+    m_Flushing = false;
+}
+
+SERZ_Reader::~SERZ_Reader()
+{
+    close();
+}
+
+void SERZ_Reader::close()
+{
+    if (m_File)
+        fclose(m_File);
+    m_File = nullptr;
+    m_FrameOffsets.clear();
+}
+
+bool SERZ_Reader::open(const char *filename, char *errmsg)
+{
+    close();
+
+    m_File = fopen(filename, "rb");
+    if (m_File == nullptr)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "Cannot open %s: %s", filename, strerror(errno));
+        return false;
+    }
+
+    uint8_t header[SER_HEADER_SIZE];
+    if (fread(header, 1, SER_HEADER_SIZE, m_File) != SER_HEADER_SIZE || memcmp(header, SERZ_FILE_ID, 14))
+    {
+        snprintf(errmsg, ERRMSGSIZ, "%s is not a compressed SER file.", filename);
+        close();
+        return false;
+    }
+
+    memcpy(m_Header.FileID, header, 14);
+    m_Header.LuID         = decode_int_le(header + 14);
+    m_Header.ColorID      = decode_int_le(header + 18);
+    m_Header.LittleEndian = decode_int_le(header + 22);
+    m_Header.ImageWidth   = decode_int_le(header + 26);
+    m_Header.ImageHeight  = decode_int_le(header + 30);
+    m_Header.PixelDepth   = decode_int_le(header + 34);
+    m_Header.FrameCount   = decode_int_le(header + 38);
+    memcpy(m_Header.Observer, header + 42, 40);
+    memcpy(m_Header.Instrume, header + 82, 40);
+    memcpy(m_Header.Telescope, header + 122, 40);
+    m_Header.DateTime     = decode_long_int_le(header + 162);
+    m_Header.DateTime_UTC = decode_long_int_le(header + 170);
+
+    m_BytesPerSample = (m_Header.PixelDepth <= 8) ? 1 : 2;
+    m_Stride         = color_stride(m_Header.ColorID);
+    m_FrameSize      = m_Header.ImageWidth * m_Header.ImageHeight * m_BytesPerSample * (m_Stride == 3 ? 3 : 1);
+
+    fseeko(m_File, 0, SEEK_END);
+    m_FileSize = ftello(m_File);
+
+    // An interrupted recording has no index, recover the frames written so far
+    if (readIndex() == false && scanFrames() == false)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "%s is corrupted.", filename);
+        close();
+        return false;
+    }
+
+    m_Filtered.resize(m_FrameSize);
+    return true;
+}
+
+bool SERZ_Reader::readIndex()
+{
+    if (m_FileSize < SER_HEADER_SIZE + SERZ_FOOTER_SIZE)
+        return false;
+
+    uint8_t footer[SERZ_FOOTER_SIZE];
+    fseeko(m_File, m_FileSize - SERZ_FOOTER_SIZE, SEEK_SET);
+    if (fread(footer, 1, SERZ_FOOTER_SIZE, m_File) != SERZ_FOOTER_SIZE || memcmp(footer + 8, SERZ_INDEX_ID, 8))
+        return false;
+
+    uint64_t indexOffset = decode_long_int_le(footer);
+    uint64_t indexEnd    = m_FileSize - SERZ_FOOTER_SIZE;
+    if (indexOffset < SER_HEADER_SIZE || indexOffset > indexEnd || (indexEnd - indexOffset) / 8 != m_Header.FrameCount)
+        return false;
+
+    std::vector<uint8_t> index(m_Header.FrameCount * 8);
+    fseeko(m_File, indexOffset, SEEK_SET);
+    if (fread(index.data(), 1, index.size(), m_File) != index.size())
+        return false;
+
+    m_FrameOffsets.resize(m_Header.FrameCount);
+    for (uint32_t i = 0; i < m_Header.FrameCount; i++)
+        m_FrameOffsets[i] = decode_long_int_le(index.data() + i * 8);
+    return true;
+}
+
+bool SERZ_Reader::scanFrames()
+{
+    m_FrameOffsets.clear();
+
+    uint64_t offset = SER_HEADER_SIZE;
+    uint8_t header[SERZ_FRAME_HEADER];
+    while (offset + SERZ_FRAME_HEADER <= m_FileSize)
+    {
+        fseeko(m_File, offset, SEEK_SET);
+        if (fread(header, 1, SERZ_FRAME_HEADER, m_File) != SERZ_FRAME_HEADER)
+            break;
+
+        uint32_t size  = decode_int_le(header);
+        uint32_t flags = decode_int_le(header + 4);
+        if (size == 0 || size > compressBound(m_FrameSize) || flags > (SERZ_FLAG_DELTA | SERZ_FLAG_SHUFFLE | SERZ_FLAG_STORED)
+                || offset + SERZ_FRAME_HEADER + size > m_FileSize)
+            break;
+
+        m_FrameOffsets.push_back(offset);
+        offset += SERZ_FRAME_HEADER + size;
+    }
+
+    m_Header.FrameCount = m_FrameOffsets.size();
+    return !m_FrameOffsets.empty();
+}
+
+bool SERZ_Reader::readFrame(uint32_t index, uint8_t *buffer, uint64_t *timestamp)
+{
+    if (m_File == nullptr || index >= m_FrameOffsets.size())
+        return false;
+
+    uint8_t header[SERZ_FRAME_HEADER];
+    fseeko(m_File, m_FrameOffsets[index], SEEK_SET);
+    if (fread(header, 1, SERZ_FRAME_HEADER, m_File) != SERZ_FRAME_HEADER)
+        return false;
+
+    uint32_t size  = decode_int_le(header);
+    uint32_t flags = decode_int_le(header + 4);
+    if (timestamp)
+        *timestamp = decode_long_int_le(header + 8);
+
+    if (flags & SERZ_FLAG_STORED)
+        return size == m_FrameSize && fread(buffer, 1, size, m_File) == size;
+
+    m_Compressed.resize(size);
+    if (fread(m_Compressed.data(), 1, size, m_File) != size)
+        return false;
+
+    uLongf length = m_FrameSize;
+    if (uncompress(m_Filtered.data(), &length, m_Compressed.data(), size) != Z_OK || length != m_FrameSize)
+        return false;
+
+    SERZ_Recorder::unfilter(m_Filtered.data(), buffer, m_FrameSize, m_BytesPerSample, m_Stride, flags);
+    return true;
+}
+
+bool SERZ_Reader::convertToSER(const char *serzFile, const char *serFile, char *errmsg)
+{
+    SERZ_Reader reader;
+    if (reader.open(serzFile, errmsg) == false)
+        return false;
+
+    FILE *out = fopen(serFile, "wb");
+    if (out == nullptr)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "Cannot create %s: %s", serFile, strerror(errno));
+        return false;
+    }
+
+    ser_header serh = reader.getHeader();
+    memcpy(serh.FileID, "LUCAM-RECORDER", 14);
+
+    uint8_t header[SER_HEADER_SIZE];
+    SER_Recorder::encode_header(&serh, header);
+    bool rc = fwrite(header, 1, SER_HEADER_SIZE, out) == SER_HEADER_SIZE;
+
+    std::vector<uint8_t> frame(reader.getFrameSize());
+    std::vector<uint8_t> stamps(serh.FrameCount * 8);
+    for (uint32_t i = 0; rc && i < serh.FrameCount; i++)
+    {
+        uint64_t timestamp = 0;
+        if (reader.readFrame(i, frame.data(), &timestamp) == false)
+        {
+            snprintf(errmsg, ERRMSGSIZ, "Frame %u of %s is corrupted.", i + 1, serzFile);
+            fclose(out);
+            return false;
+        }
+        SER_Recorder::encode_long_int_le(stamps.data() + i * 8, timestamp);
+        rc = fwrite(frame.data(), 1, frame.size(), out) == frame.size();
+    }
+
+    // SER trailer: one timestamp per frame
+    rc = rc && fwrite(stamps.data(), 1, stamps.size(), out) == stamps.size();
+    rc = (fclose(out) == 0) && rc;
+
+    if (!rc)
+        snprintf(errmsg, ERRMSGSIZ, "Error writing %s: %s", serFile, strerror(errno));
+    return rc;
+}
+
+}
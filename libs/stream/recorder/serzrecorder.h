@@ -0,0 +1,177 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Compressed SER Recorder
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include "serrecorder.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// FileID of compressed files, SER readers refuse them instead of reading garbage
+#define SERZ_FILE_ID        "INDI-SERZ-0001"
+// Magic closing the index footer
+#define SERZ_INDEX_ID       "SERZIDX1"
+// Size of the header preceding every compressed frame
+#define SERZ_FRAME_HEADER   16
+// Size of the footer at the end of the file
+#define SERZ_FOOTER_SIZE    16
+
+// Frame flags
+#define SERZ_FLAG_DELTA     0x01
+#define SERZ_FLAG_SHUFFLE   0x02
+#define SERZ_FLAG_STORED    0x04
+
+namespace INDI
+{
+
+/**
+ * @brief The SERZ_Recorder class records losslessly compressed SER files.
+ *
+ * The file starts with a regular 178 bytes SER header (with a distinct FileID) followed by the frames. Each frame is
+ * stored as a 16 bytes header (compressed size, flags and timestamp, little endian) and the compressed pixels.
+ * Before compression, each sample is replaced by its difference with the previous sample of the same color and
+ * 16 bit samples are split in a plane of low bytes and a plane of high bytes. Both make the noisy low order bits of
+ * astronomical frames much easier to compress. Frames that do not compress are stored as is.
+ *
+ * Frames are compressed in parallel by a small pool of threads and written in order through StreamFileWriter. On
+ * close, an index of the frame offsets is appended so any frame can be read directly, see SERZ_Reader. If the
+ * index is missing (e.g. the recording was interrupted), the reader rebuilds it from the frame headers.
+ *
+ * Use SERZ_Reader::convertToSER() or the indi_serz2ser tool to get a standard SER file back.
+ */
+class SERZ_Recorder : public SER_Recorder
+{
+    public:
+        SERZ_Recorder();
+        virtual ~SERZ_Recorder();
+
+        virtual const char *getExtension()
+        {
+            return ".serz";
+        }
+        virtual bool setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth);
+        virtual bool open(const char *filename, char *errmsg);
+        virtual bool close();
+        virtual bool writeFrame(const uint8_t *frame, uint32_t nbytes);
+
+        /**
+         * @brief setThreads Number of compression threads used by the next recording. 0 selects the number of CPU
+         * cores, up to 4.
+         */
+        void setThreads(unsigned int threads);
+
+        /**
+         * @brief getCompressionRatio Raw over compressed size of the frames recorded so far.
+         */
+        double getCompressionRatio() const;
+
+        /**
+         * @brief filter Apply the delta and shuffle filters to a raw frame.
+         * @param stride Distance in samples between two samples of the same color.
+         * @return Frame flags describing the applied filters.
+         */
+        static uint32_t filter(const uint8_t *src, uint8_t *dst, uint32_t nbytes, uint8_t bytesPerSample, uint32_t stride);
+
+        /**
+         * @brief unfilter Revert filter() according to flags.
+         */
+        static void unfilter(const uint8_t *src, uint8_t *dst, uint32_t nbytes, uint8_t bytesPerSample, uint32_t stride,
+                             uint32_t flags);
+
+    private:
+        struct Slot;
+
+        void compressThread();
+        void compress(Slot &slot, void *stream);
+        void flush(std::unique_lock<std::mutex> &lock);
+
+        std::vector<Slot *> m_Slots;
+        // Next slot filled by writeFrame and next slot written to disk
+        size_t m_ProduceIndex { 0 }, m_WriteIndex { 0 };
+        bool m_Flushing { false }, m_Exit { false };
+        std::mutex m_Lock;
+        std::condition_variable m_PendingCV;
+        std::vector<std::thread> m_Threads;
+        unsigned int m_ThreadCount { 0 };
+
+        uint32_t m_Stride { 1 };
+        uint8_t m_BytesPerSample { 1 };
+        uint64_t m_Offset { 0 }, m_RawBytes { 0 }, m_CompressedBytes { 0 };
+        std::vector<uint64_t> m_FrameOffsets;
+};
+
+/**
+ * @brief The SERZ_Reader class gives random access to the frames of a compressed SER file.
+ */
+class SERZ_Reader
+{
+    public:
+        SERZ_Reader() = default;
+        ~SERZ_Reader();
+
+        /**
+         * @brief open Read the header and the frame index of filename.
+         * @param errmsg buffer receiving the error message, at least 1024 bytes.
+         */
+        bool open(const char *filename, char *errmsg);
+        void close();
+
+        const ser_header &getHeader() const
+        {
+            return m_Header;
+        }
+        uint32_t getFrameCount() const
+        {
+            return m_FrameOffsets.size();
+        }
+        uint32_t getFrameSize() const
+        {
+            return m_FrameSize;
+        }
+
+        /**
+         * @brief readFrame Decompress frame index into buffer, which must hold getFrameSize() bytes.
+         * @param timestamp if not null, receives the UTC timestamp of the frame.
+         */
+        bool readFrame(uint32_t index, uint8_t *buffer, uint64_t *timestamp = nullptr);
+
+        /**
+         * @brief convertToSER Decompress serzFile to a standard SER file, including the frame timestamps.
+         */
+        static bool convertToSER(const char *serzFile, const char *serFile, char *errmsg);
+
+    private:
+        bool readIndex();
+        bool scanFrames();
+
+        FILE *m_File { nullptr };
+        ser_header m_Header;
+        uint32_t m_FrameSize { 0 }, m_Stride { 1 };
+        uint8_t m_BytesPerSample { 1 };
+        uint64_t m_FileSize { 0 };
+        std::vector<uint64_t> m_FrameOffsets;
+        std::vector<uint8_t> m_Compressed, m_Filtered;
+};
+
+}
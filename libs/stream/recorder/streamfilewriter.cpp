@@ -0,0 +1,294 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Buffered Stream File Writer
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+// fallocate and O_DIRECT
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "streamfilewriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ERRMSGSIZ 1024
+
+namespace INDI
+{
+
+// Alignment required by O_DIRECT on all common file systems
+static const size_t WRITER_ALIGNMENT = 4096;
+// The file is preallocated in steps of this size ahead of the write position
+static const uint64_t WRITER_PREALLOCATE = 256 * 1024 * 1024;
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StreamFileWriter::StreamFileWriter(size_t blockSize, size_t blockCount)
+{
+    m_BlockSize = std::max(WRITER_ALIGNMENT, (blockSize + WRITER_ALIGNMENT - 1) & ~(WRITER_ALIGNMENT - 1));
+    m_Blocks.resize(std::max<size_t>(2, blockCount));
+    for (auto &block : m_Blocks)
+    {
+        void *buffer = nullptr;
+        block.data = (posix_memalign(&buffer, WRITER_ALIGNMENT, m_BlockSize) == 0) ? static_cast<uint8_t *>(buffer) : nullptr;
+        block.size = 0;
+    }
+}
+
+StreamFileWriter::~StreamFileWriter()
+{
+    close();
+    for (auto &block : m_Blocks)
+        free(block.data);
+}
+
+bool StreamFileWriter::open(const char *filename, char *errmsg)
+{
+    if (m_FD >= 0)
+        close();
+
+    for (auto &block : m_Blocks)
+    {
+        if (block.data == nullptr)
+        {
+            snprintf(errmsg, ERRMSGSIZ, "recorder open error: out of memory for write buffers\n");
+            return false;
+        }
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    m_Direct = false;
+#ifdef O_DIRECT
+    m_FD = ::open(filename, flags | O_DIRECT, 0644);
+    m_Direct = (m_FD >= 0);
+    // Not every file system supports direct I/O (e.g. tmpfs), fall back to buffered writes.
+    if (m_FD < 0)
+#endif
+        m_FD = ::open(filename, flags, 0644);
+
+    if (m_FD < 0)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    m_Free.clear();
+    m_Full.clear();
+    for (size_t i = 0; i < m_Blocks.size(); i++)
+        m_Free.push_back(i);
+    m_Current      = -1;
+    m_Offset       = 0;
+    m_Allocated    = 0;
+    m_BytesWritten = 0;
+    m_Error        = 0;
+    m_Exit         = false;
+    m_Start        = now();
+
+    m_Thread = std::thread(&StreamFileWriter::ioThread, this);
+    return true;
+}
+
+void StreamFileWriter::submit()
+{
+    // Called with m_Lock held
+    m_Full.push_back(m_Current);
+    m_Current = -1;
+    m_FullCV.notify_one();
+}
+
+bool StreamFileWriter::write(const void *data, size_t size, bool wait)
+{
+    if (m_FD < 0 || m_Error)
+        return false;
+
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    if (!wait)
+    {
+        // All or nothing, a partially written frame would corrupt the file
+        size_t available = m_Free.size() * m_BlockSize;
+        if (m_Current >= 0)
+            available += m_BlockSize - m_Blocks[m_Current].size;
+        if (size > available)
+            return false;
+    }
+
+    while (size > 0)
+    {
+        if (m_Current < 0)
+        {
+            m_FreeCV.wait(lock, [this]()
+            {
+                return !m_Free.empty() || m_Error;
+            });
+            if (m_Error)
+                return false;
+            m_Current = m_Free.front();
+            m_Free.pop_front();
+            m_Blocks[m_Current].size = 0;
+        }
+
+        // Only the producer touches the current block, copy without holding the lock
+        Block &block = m_Blocks[m_Current];
+        size_t chunk = std::min(size, m_BlockSize - block.size);
+        lock.unlock();
+        memcpy(block.data + block.size, source, chunk);
+        lock.lock();
+
+        block.size += chunk;
+        source += chunk;
+        size -= chunk;
+
+        if (block.size == m_BlockSize)
+            submit();
+    }
+
+    return true;
+}
+
+bool StreamFileWriter::close(const void *header, size_t headerSize)
+{
+    if (m_FD < 0)
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (m_Current >= 0 && m_Blocks[m_Current].size > 0)
+            submit();
+        m_Exit = true;
+    }
+    m_FullCV.notify_one();
+    // The I/O thread drains all full blocks before exiting
+    if (m_Thread.joinable())
+        m_Thread.join();
+
+#ifdef O_DIRECT
+    // The header is not aligned
+    int fl = fcntl(m_FD, F_GETFL);
+    if (fl != -1 && (fl & O_DIRECT))
+        fcntl(m_FD, F_SETFL, fl & ~O_DIRECT);
+#endif
+
+    if (header != nullptr && headerSize > 0 && m_Error == 0)
+    {
+        if (pwrite(m_FD, header, headerSize, 0) != static_cast<ssize_t>(headerSize))
+            m_Error = errno ? errno : EIO;
+    }
+
+    // Release the preallocated space past the end of the data
+    if (ftruncate(m_FD, m_Offset) != 0 && m_Error == 0)
+        m_Error = errno;
+
+    ::close(m_FD);
+    m_FD = -1;
+
+    return m_Error == 0;
+}
+
+double StreamFileWriter::getRate() const
+{
+    double elapsed = now() - m_Start;
+    return (elapsed > 0) ? m_BytesWritten / elapsed / (1024.0 * 1024.0) : 0;
+}
+
+void StreamFileWriter::ioThread()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for (;;)
+    {
+        m_FullCV.wait(lock, [this]()
+        {
+            return m_Exit || !m_Full.empty();
+        });
+
+        if (m_Full.empty())
+            break;
+
+        int index = m_Full.front();
+        m_Full.pop_front();
+        lock.unlock();
+
+        bool ok = (m_Error == 0) && writeBlock(m_Blocks[index]);
+
+        lock.lock();
+        m_Free.push_back(index);
+        if (!ok && m_Error == 0)
+            m_Error = EIO;
+        m_FreeCV.notify_all();
+    }
+}
+
+bool StreamFileWriter::writeBlock(const Block &block)
+{
+#ifdef __linux__
+    // Reserve extents ahead of the write position. Not all file systems support it, so errors are ignored.
+    if (m_Offset + block.size > m_Allocated)
+    {
+        if (fallocate(m_FD, FALLOC_FL_KEEP_SIZE, m_Allocated, WRITER_PREALLOCATE) == 0)
+            m_Allocated += WRITER_PREALLOCATE;
+        else
+            m_Allocated = UINT64_MAX;
+    }
+#endif
+
+    size_t written = 0;
+    while (written < block.size)
+    {
+#ifdef O_DIRECT
+        // A partial block (end of recording) or short write cannot continue with O_DIRECT
+        if (m_Direct && ((block.size - written) & (WRITER_ALIGNMENT - 1) || (m_Offset & (WRITER_ALIGNMENT - 1))))
+        {
+            int fl = fcntl(m_FD, F_GETFL);
+            if (fl != -1)
+                fcntl(m_FD, F_SETFL, fl & ~O_DIRECT);
+            m_Direct = false;
+        }
+#endif
+        ssize_t n = pwrite(m_FD, block.data + written, block.size - written, m_Offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            m_Error = errno;
+            return false;
+        }
+
+        written += n;
+        m_Offset += n;
+        m_BytesWritten += n;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Buffered Stream File Writer
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The StreamFileWriter class appends recorded video data to a file from a dedicated I/O thread.
+ *
+ * Data is copied into a fixed set of large, page aligned blocks. Full blocks are handed to the I/O thread which
+ * writes them with direct I/O where the file system supports it, and preallocates the file ahead of the write
+ * position to limit fragmentation. No memory is allocated after open().
+ *
+ * write() never blocks by default: if the disk cannot keep up and all blocks are in use, the data is rejected as a
+ * whole so the recorder can drop the frame and carry on.
+ */
+class StreamFileWriter
+{
+    public:
+        explicit StreamFileWriter(size_t blockSize = 8 * 1024 * 1024, size_t blockCount = 8);
+        ~StreamFileWriter();
+
+        /**
+         * @brief open Create or truncate filename and start the I/O thread.
+         * @param errmsg buffer receiving the error message, at least 1024 bytes.
+         */
+        bool open(const char *filename, char *errmsg);
+
+        /**
+         * @brief write Append data to the file.
+         * @param wait If false, fail without writing anything when the free buffer space is too small.
+         * If true, wait for the I/O thread to free blocks as needed.
+         * @return True if the data was queued. False if it was rejected or a write error occurred, see getError().
+         */
+        bool write(const void *data, size_t size, bool wait = false);
+
+        /**
+         * @brief close Write all pending data, optionally overwrite the beginning of the file with header and close it.
+         * @return False if any write failed since open().
+         */
+        bool close(const void *header = nullptr, size_t headerSize = 0);
+
+        bool isOpen() const
+        {
+            return m_FD >= 0;
+        }
+
+        /**
+         * @return errno of the first failed write, 0 if none.
+         */
+        int getError() const
+        {
+            return m_Error;
+        }
+
+        /**
+         * @return Bytes written to disk since open().
+         */
+        uint64_t getBytesWritten() const
+        {
+            return m_BytesWritten;
+        }
+
+        /**
+         * @return Sustained write rate in MB/s since open().
+         */
+        double getRate() const;
+
+    private:
+        struct Block
+        {
+            uint8_t *data;
+            size_t size;
+        };
+
+        void ioThread();
+        bool writeBlock(const Block &block);
+        void submit();
+
+        size_t m_BlockSize;
+        std::vector<Block> m_Blocks;
+
+        // Block being filled by the producer, -1 if none
+        int m_Current { -1 };
+        std::deque<int> m_Free, m_Full;
+        bool m_Exit { false };
+        std::mutex m_Lock;
+        std::condition_variable m_FullCV, m_FreeCV;
+        std::thread m_Thread;
+
+        int m_FD { -1 };
+        bool m_Direct { false };
+        uint64_t m_Offset { 0 }, m_Allocated { 0 };
+        std::atomic<uint64_t> m_BytesWritten { 0 };
+        std::atomic<int> m_Error { 0 };
+        double m_Start { 0 };
+};
+
+}
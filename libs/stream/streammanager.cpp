@@ -26,11 +26,15 @@
 #include "indiccd.h"
 #include "indidetector.h"
 #include "indilogger.h"
+#include "encoder/mjpegencoder.h"
+#include "recorder/serrecorder.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <signal.h>
 #include <sys/stat.h>
 #include <cmath>
+#include <chrono>
 
 static const char * STREAM_TAB = "Streaming";
 
@@ -45,6 +49,7 @@ StreamManager::StreamManager(DefaultDevice *mainDevice)
     m_isRecording = false;
 
     prepareGammaLUT();
+    m_Stretch.setGammaLUT(gammaLUT_16_8);
 
     // Timer
     // now use BSD setimer to avoi librt dependency
@@ -74,10 +79,21 @@ StreamManager::StreamManager(DefaultDevice *mainDevice)
     encoder->init(currentDevice);
 
     LOGF_DEBUG("Using default encoder (%s)", encoder->getName());
+
+    setFrameQueueSize(4);
+    m_StreamWorker = std::thread(&StreamManager::streamWorker, this);
 }
 
 StreamManager::~StreamManager()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+        m_StreamWorkerExit = true;
+    }
+    m_FrameQueueCV.notify_one();
+    if (m_StreamWorker.joinable())
+        m_StreamWorker.join();
+
     delete (recorderManager);
     delete (encoderManager);
     delete [] downscaleBuffer;
@@ -109,6 +125,80 @@ bool StreamManager::initProperties()
     IUFillNumber(&FpsN[FPS_AVERAGE], "AVG_FPS", "Average (1 sec.)", "%3.2f", 0.0, 999.0, 0.0, 30);
     IUFillNumberVector(&FpsNP, FpsN, NARRAY(FpsN), getDeviceName(), "FPS", "FPS", STREAM_TAB, IP_RO, 60, IPS_IDLE);
 
+    /* Frame Queue */
+    IUFillNumber(&StreamBufferN[0], "STREAM_BUFFER_FRAMES", "Frames", "%.f", 1, 64, 1, 4);
+    IUFillNumberVector(&StreamBufferNP, StreamBufferN, NARRAY(StreamBufferN), getDeviceName(), "STREAM_BUFFER", "Buffer",
+                       STREAM_TAB, IP_RW, 60, IPS_IDLE);
+
+    IUFillSwitch(&StreamDropS[DROP_OLDEST], "DROP_OLDEST", "Oldest", ISS_ON);
+    IUFillSwitch(&StreamDropS[DROP_NEWEST], "DROP_NEWEST", "Newest", ISS_OFF);
+    IUFillSwitchVector(&StreamDropSP, StreamDropS, NARRAY(StreamDropS), getDeviceName(), "STREAM_DROP_POLICY", "Drop",
+                       STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&StreamQueueN[QUEUE_PENDING], "STREAM_QUEUE_PENDING", "Pending", "%.f", 0, 64, 0, 0);
+    IUFillNumber(&StreamQueueN[QUEUE_DROPPED], "STREAM_QUEUE_DROPPED", "Dropped", "%.f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&StreamQueueNP, StreamQueueN, NARRAY(StreamQueueN), getDeviceName(), "STREAM_QUEUE", "Queue",
+                       STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
+    /* 16 to 8 bit conversion */
+    IUFillSwitch(&StreamStretchS[StreamStretch::STRETCH_GAMMA], "STRETCH_GAMMA", "Gamma", ISS_ON);
+    IUFillSwitch(&StreamStretchS[StreamStretch::STRETCH_LINEAR], "STRETCH_LINEAR", "Linear", ISS_OFF);
+    IUFillSwitch(&StreamStretchS[StreamStretch::STRETCH_AUTO], "STRETCH_AUTO", "Auto", ISS_OFF);
+    IUFillSwitchVector(&StreamStretchSP, StreamStretchS, NARRAY(StreamStretchS), getDeviceName(), "STREAM_STRETCH", "Stretch",
+                       STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&StreamStretchN[STRETCH_LOW], "STRETCH_LOW", "Black (%)", "%.2f", 0, 100, 0.1, 0.5);
+    IUFillNumber(&StreamStretchN[STRETCH_HIGH], "STRETCH_HIGH", "White (%)", "%.2f", 0, 100, 0.1, 99.9);
+    IUFillNumberVector(&StreamStretchNP, StreamStretchN, NARRAY(StreamStretchN), getDeviceName(), "STREAM_STRETCH_LEVELS",
+                       "Levels", STREAM_TAB, IP_RW, 60, IPS_IDLE);
+
+    /* Live stacking */
+    IUFillSwitch(&StackS[STACK_OFF], "STACK_OFF", "Off", ISS_ON);
+    IUFillSwitch(&StackS[STACK_MEAN], "STACK_MEAN", "Mean", ISS_OFF);
+    IUFillSwitch(&StackS[STACK_SIGMA], "STACK_SIGMA", "Sigma Clip", ISS_OFF);
+    IUFillSwitch(&StackS[STACK_MAX], "STACK_MAX", "Max", ISS_OFF);
+    IUFillSwitchVector(&StackSP, StackS, NARRAY(StackS), getDeviceName(), "STREAM_STACK", "Stack", STREAM_TAB, IP_RW,
+                       ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&StackDarkS[StreamStacker::DARK_OFF], "DARK_OFF", "Off", ISS_ON);
+    IUFillSwitch(&StackDarkS[StreamStacker::DARK_TAKE], "DARK_TAKE", "Take", ISS_OFF);
+    IUFillSwitch(&StackDarkS[StreamStacker::DARK_SUBTRACT], "DARK_SUBTRACT", "Subtract", ISS_OFF);
+    IUFillSwitchVector(&StackDarkSP, StackDarkS, NARRAY(StackDarkS), getDeviceName(), "STREAM_STACK_DARK", "Stack Dark",
+                       STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&StackAlignS[ALIGN_OFF], "ALIGN_OFF", "Off", ISS_ON);
+    IUFillSwitch(&StackAlignS[ALIGN_TRANSLATION], "ALIGN_TRANSLATION", "Translation", ISS_OFF);
+    IUFillSwitchVector(&StackAlignSP, StackAlignS, NARRAY(StackAlignS), getDeviceName(), "STREAM_STACK_ALIGN", "Stack Align",
+                       STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&StackOptionsN[STACK_KAPPA], "STACK_KAPPA", "Kappa", "%.1f", 1, 10, 0.5, 2.5);
+    IUFillNumber(&StackOptionsN[STACK_PREVIEW], "STACK_PREVIEW", "Preview (s)", "%.1f", 0.1, 600, 1, 2);
+    IUFillNumber(&StackOptionsN[STACK_MAX_SHIFT], "STACK_MAX_SHIFT", "Max Shift (px)", "%.f", 1, 512, 8, 32);
+    IUFillNumberVector(&StackOptionsNP, StackOptionsN, NARRAY(StackOptionsN), getDeviceName(), "STREAM_STACK_OPTIONS",
+                       "Stack Options", STREAM_TAB, IP_RW, 60, IPS_IDLE);
+
+    IUFillSwitch(&StackResetS[0], "STACK_RESET", "Reset", ISS_OFF);
+    IUFillSwitchVector(&StackResetSP, StackResetS, NARRAY(StackResetS), getDeviceName(), "STREAM_STACK_RESET", "Stack Reset",
+                       STREAM_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&StackStatsN[STACK_FRAMES], "STACK_FRAMES", "Frames", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&StackStatsN[STACK_SKIPPED], "STACK_SKIPPED", "Skipped", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&StackStatsN[STACK_DARKS], "STACK_DARKS", "Darks", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&StackStatsN[STACK_SHIFT_X], "STACK_SHIFT_X", "Shift X", "%.f", -512, 512, 0, 0);
+    IUFillNumber(&StackStatsN[STACK_SHIFT_Y], "STACK_SHIFT_Y", "Shift Y", "%.f", -512, 512, 0, 0);
+    IUFillNumber(&StackStatsN[STACK_REJECTED], "STACK_REJECTED", "Rejected (%)", "%.2f", 0, 100, 0, 0);
+    IUFillNumberVector(&StackStatsNP, StackStatsN, NARRAY(StackStatsN), getDeviceName(), "STREAM_STACK_STATS", "Stack Stats",
+                       STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
+    /* Encoder */
+    IUFillNumber(&EncodeTimeN[0], "ENCODE_TIME", "Encode (ms)", "%.2f", 0, 10000, 0, 0);
+    IUFillNumberVector(&EncodeTimeNP, EncodeTimeN, NARRAY(EncodeTimeN), getDeviceName(), "STREAM_ENCODE_TIME", "Encoder",
+                       STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
+    IUFillNumber(&MJPEGOptionsN[MJPEG_QUALITY], "MJPEG_QUALITY", "Quality", "%.f", 1, 100, 5, 70);
+    IUFillNumberVector(&MJPEGOptionsNP, MJPEGOptionsN, NARRAY(MJPEGOptionsN), getDeviceName(), "STREAM_MJPEG", "MJPEG",
+                       STREAM_TAB, IP_RW, 60, IPS_IDLE);
+
     /* Record Frames */
     /* File */
     std::string defaultDirectory = std::string(getenv("HOME")) + std::string("/indi__D_");
@@ -123,6 +213,12 @@ bool StreamManager::initProperties()
     IUFillNumberVector(&RecordOptionsNP, RecordOptionsN, NARRAY(RecordOptionsN), getDeviceName(), "RECORD_OPTIONS",
                        "Record Options", STREAM_TAB, IP_RW, 60, IPS_IDLE);
 
+    /* Record Statistics */
+    IUFillNumber(&RecordStatsN[RECORD_STATS_RATE], "RECORD_RATE", "Rate (MB/s)", "%.1f", 0, 100000, 0, 0);
+    IUFillNumber(&RecordStatsN[RECORD_STATS_DROPPED], "RECORD_DROPPED", "Dropped", "%.f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&RecordStatsNP, RecordStatsN, NARRAY(RecordStatsN), getDeviceName(), "RECORD_STATS",
+                       "Record Stats", STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
     /* Record Switch */
     IUFillSwitch(&RecordStreamS[0], "RECORD_ON", "Record On", ISS_OFF);
     IUFillSwitch(&RecordStreamS[1], "RECORD_DURATION_ON", "Record (Duration)", ISS_OFF);
@@ -142,6 +238,18 @@ bool StreamManager::initProperties()
                            60, IPS_IDLE);
     }
 
+    // Preview Scale, defined for CCDs only
+    IUFillSwitch(&PreviewScaleS[SCALE_FULL], "SCALE_FULL", "Full", ISS_ON);
+    IUFillSwitch(&PreviewScaleS[SCALE_HALF], "SCALE_HALF", "1/2", ISS_OFF);
+    IUFillSwitch(&PreviewScaleS[SCALE_QUARTER], "SCALE_QUARTER", "1/4", ISS_OFF);
+    IUFillSwitch(&PreviewScaleS[SCALE_EIGHTH], "SCALE_EIGHTH", "1/8", ISS_OFF);
+    IUFillSwitchVector(&PreviewScaleSP, PreviewScaleS, NARRAY(PreviewScaleS), getDeviceName(), "STREAM_PREVIEW_SCALE",
+                       "Preview Scale", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+    IUFillNumber(&PreviewSizeN[PREVIEW_WIDTH], "WIDTH", "Width", "%4.0f", 0, 0, 0, 0);
+    IUFillNumber(&PreviewSizeN[PREVIEW_HEIGHT], "HEIGHT", "Height", "%4.0f", 0, 0, 0, 0);
+    IUFillNumberVector(&PreviewSizeNP, PreviewSizeN, NARRAY(PreviewSizeN), getDeviceName(), "STREAM_PREVIEW_SIZE",
+                       "Preview Size", STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
     // Encoder Selection
     IUFillSwitch(&EncoderS[ENCODER_RAW], "RAW", "RAW", ISS_ON);
     IUFillSwitch(&EncoderS[ENCODER_MJPEG], "MJPEG", "MJPEG", ISS_OFF);
@@ -152,14 +260,15 @@ bool StreamManager::initProperties()
 
     // Recorder Selector
     IUFillSwitch(&RecorderS[RECORDER_RAW], "SER", "SER", ISS_ON);
+    IUFillSwitch(&RecorderS[RECORDER_SERZ], "SERZ", "SER Compressed", ISS_OFF);
     IUFillSwitch(&RecorderS[RECORDER_OGV], "OGV", "OGV", ISS_OFF);
     if(currentDevice->getDriverInterface() == INDI::DefaultDevice::DETECTOR_INTERFACE)
         IUFillSwitchVector(&RecorderSP, RecorderS, NARRAY(RecorderS), getDeviceName(), "DETECTOR_STREAM_RECORDER", "Recorder", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
     else
         IUFillSwitchVector(&RecorderSP, RecorderS, NARRAY(RecorderS), getDeviceName(), "CCD_STREAM_RECORDER", "Recorder", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-    // If we do not have theora installed, let's just define SER default recorder
+    // If we do not have theora installed, let's just define the SER recorders
 #ifndef HAVE_THEORA
-    RecorderSP.nsp = 1;
+    RecorderSP.nsp = 2;
 #endif
     return true;
 }
@@ -176,11 +285,30 @@ void StreamManager::ISGetProperties(const char * dev)
         if (m_hasStreamingExposure)
             currentDevice->defineNumber(&StreamExposureNP);
         currentDevice->defineNumber(&FpsNP);
+        currentDevice->defineNumber(&StreamBufferNP);
+        currentDevice->defineSwitch(&StreamDropSP);
+        currentDevice->defineNumber(&StreamQueueNP);
+        currentDevice->defineSwitch(&StreamStretchSP);
+        currentDevice->defineNumber(&StreamStretchNP);
+        currentDevice->defineSwitch(&StackSP);
+        currentDevice->defineSwitch(&StackDarkSP);
+        currentDevice->defineSwitch(&StackAlignSP);
+        currentDevice->defineNumber(&StackOptionsNP);
+        currentDevice->defineSwitch(&StackResetSP);
+        currentDevice->defineNumber(&StackStatsNP);
         currentDevice->defineSwitch(&RecordStreamSP);
         currentDevice->defineText(&RecordFileTP);
         currentDevice->defineNumber(&RecordOptionsNP);
+        currentDevice->defineNumber(&RecordStatsNP);
         currentDevice->defineNumber(&StreamFrameNP);
+        if (currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+        {
+            currentDevice->defineSwitch(&PreviewScaleSP);
+            currentDevice->defineNumber(&PreviewSizeNP);
+        }
         currentDevice->defineSwitch(&EncoderSP);
+        currentDevice->defineNumber(&MJPEGOptionsNP);
+        currentDevice->defineNumber(&EncodeTimeNP);
         currentDevice->defineSwitch(&RecorderSP);
     }
 }
@@ -203,11 +331,30 @@ bool StreamManager::updateProperties()
         if (m_hasStreamingExposure)
             currentDevice->defineNumber(&StreamExposureNP);
         currentDevice->defineNumber(&FpsNP);
+        currentDevice->defineNumber(&StreamBufferNP);
+        currentDevice->defineSwitch(&StreamDropSP);
+        currentDevice->defineNumber(&StreamQueueNP);
+        currentDevice->defineSwitch(&StreamStretchSP);
+        currentDevice->defineNumber(&StreamStretchNP);
+        currentDevice->defineSwitch(&StackSP);
+        currentDevice->defineSwitch(&StackDarkSP);
+        currentDevice->defineSwitch(&StackAlignSP);
+        currentDevice->defineNumber(&StackOptionsNP);
+        currentDevice->defineSwitch(&StackResetSP);
+        currentDevice->defineNumber(&StackStatsNP);
         currentDevice->defineSwitch(&RecordStreamSP);
         currentDevice->defineText(&RecordFileTP);
         currentDevice->defineNumber(&RecordOptionsNP);
+        currentDevice->defineNumber(&RecordStatsNP);
         currentDevice->defineNumber(&StreamFrameNP);
+        if (currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+        {
+            currentDevice->defineSwitch(&PreviewScaleSP);
+            currentDevice->defineNumber(&PreviewSizeNP);
+        }
         currentDevice->defineSwitch(&EncoderSP);
+        currentDevice->defineNumber(&MJPEGOptionsNP);
+        currentDevice->defineNumber(&EncodeTimeNP);
         currentDevice->defineSwitch(&RecorderSP);
     }
     else
@@ -216,47 +363,95 @@ bool StreamManager::updateProperties()
         if (m_hasStreamingExposure)
             currentDevice->deleteProperty(StreamExposureNP.name);
         currentDevice->deleteProperty(FpsNP.name);
+        currentDevice->deleteProperty(StreamBufferNP.name);
+        currentDevice->deleteProperty(StreamDropSP.name);
+        currentDevice->deleteProperty(StreamQueueNP.name);
+        currentDevice->deleteProperty(StreamStretchSP.name);
+        currentDevice->deleteProperty(StreamStretchNP.name);
+        currentDevice->deleteProperty(StackSP.name);
+        currentDevice->deleteProperty(StackDarkSP.name);
+        currentDevice->deleteProperty(StackAlignSP.name);
+        currentDevice->deleteProperty(StackOptionsNP.name);
+        currentDevice->deleteProperty(StackResetSP.name);
+        currentDevice->deleteProperty(StackStatsNP.name);
         currentDevice->deleteProperty(RecordFileTP.name);
         currentDevice->deleteProperty(RecordStreamSP.name);
         currentDevice->deleteProperty(RecordOptionsNP.name);
+        currentDevice->deleteProperty(RecordStatsNP.name);
         currentDevice->deleteProperty(StreamFrameNP.name);
+        if (currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+        {
+            currentDevice->deleteProperty(PreviewScaleSP.name);
+            currentDevice->deleteProperty(PreviewSizeNP.name);
+        }
         currentDevice->deleteProperty(EncoderSP.name);
+        currentDevice->deleteProperty(MJPEGOptionsNP.name);
+        currentDevice->deleteProperty(EncodeTimeNP.name);
         currentDevice->deleteProperty(RecorderSP.name);
     }
 
     return true;
 }
 
-/*
- * The camera driver is expected to send the FULL FRAME of the Camera after BINNING without any subframing at all
- * Subframing for streaming/recording is done in the stream manager.
- * Therefore nbytes is expected to be SubW/BinX * SubH/BinY * Bytes_Per_Pixels * Number_Color_Components
- * Binned frame must be sent from the camera driver for this to work consistentaly for all drivers.*/
-void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
+bool StreamManager::countFrame(double *deltams)
 {
     m_FrameCounterPerSecond += 1;
     if (StreamExposureN[STREAM_DIVISOR].value > 1 && (m_FrameCounterPerSecond % static_cast<int>(StreamExposureN[STREAM_DIVISOR].value)) == 0)
-        return;
+        return false;
 
-    double ms1, ms2, deltams;
+    double ms1, ms2;
     // Measure FPS
     getitimer(ITIMER_REAL, &tframe2);
     ms1 = (1000.0 * tframe1.it_value.tv_sec) + (tframe1.it_value.tv_usec / 1000.0);
     ms2 = (1000.0 * tframe2.it_value.tv_sec) + (tframe2.it_value.tv_usec / 1000.0);
     if (ms2 > ms1)
-        deltams = ms2 - ms1;
+        *deltams = ms2 - ms1;
     else
-        deltams = ms1 - ms2;
+        *deltams = ms1 - ms2;
 
     tframe1 = tframe2;
-    mssum += deltams;
+    mssum += *deltams;
 
-    double newFPS = 1000.0 / deltams;
+    double newFPS = 1000.0 / *deltams;
     if (mssum >= 1000.0)
     {
         FpsN[1].value = (m_FrameCounterPerSecond * 1000.0) / mssum;
         mssum         = 0;
         m_FrameCounterPerSecond = 0;
+
+        // Report queue state and encoding time once per second
+        uint32_t pending, dropped, encoded;
+        double encodeTime;
+        {
+            std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+            pending = m_FrameQueueCount;
+            dropped = m_FramesDropped;
+            encoded = m_EncodedFrames;
+            encodeTime = m_EncodeTime;
+            m_EncodedFrames = 0;
+            m_EncodeTime = 0;
+        }
+        if (m_isRecording)
+        {
+            RecordStatsN[RECORD_STATS_RATE].value    = recorder->getWriteRate();
+            RecordStatsN[RECORD_STATS_DROPPED].value = recorder->getDroppedFrames();
+            RecordStatsNP.s = (RecordStatsN[RECORD_STATS_DROPPED].value > 0) ? IPS_BUSY : IPS_OK;
+            IDSetNumber(&RecordStatsNP, nullptr);
+        }
+
+        if (encoded > 0)
+        {
+            EncodeTimeN[0].value = encodeTime / encoded;
+            EncodeTimeNP.s = IPS_OK;
+            IDSetNumber(&EncodeTimeNP, nullptr);
+        }
+        if (pending != StreamQueueN[QUEUE_PENDING].value || dropped != StreamQueueN[QUEUE_DROPPED].value)
+        {
+            StreamQueueN[QUEUE_PENDING].value = pending;
+            StreamQueueN[QUEUE_DROPPED].value = dropped;
+            StreamQueueNP.s = (dropped > 0) ? IPS_BUSY : IPS_OK;
+            IDSetNumber(&StreamQueueNP, nullptr);
+        }
     }
 
     // Only send FPS when there is a substancial update
@@ -265,137 +460,362 @@ void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
         FpsN[0].value = newFPS;
         IDSetNumber(&FpsNP, nullptr);
     }
-    std::thread(&StreamManager::asyncStream, this, buffer, nbytes, deltams).detach();
+
+    return true;
 }
 
-void StreamManager::asyncStream(const uint8_t *buffer, uint32_t nbytes, double deltams)
+StreamManager::QueuedFrame *StreamManager::queueFrame(std::function<void()> &released)
 {
-    std::unique_lock<std::mutex> guard((currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE) ?
-                                       dynamic_cast<INDI::CCD*>(currentDevice)->ccdBufferLock :
-                                       dynamic_cast<INDI::Detector*>(currentDevice)->detectorBufferLock);
-
-    // For streaming, downscale 16 to 8
-    if (m_PixelDepth == 16 && (StreamSP.s == IPS_BUSY || RecordStreamSP.s == IPS_BUSY))
+    uint32_t capacity = m_FrameQueue.size();
+    if (m_FrameQueueCount == capacity)
     {
-        if (isStreaming() || strcmp(recorder->getName(), "SER"))
-        {
-            uint32_t npixels = 0;
-            if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
-            {
-                npixels = (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubW() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX()) * (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubH() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY()) * ((m_PixelFormat == INDI_RGB) ? 3 : 1);
-                //uint32_t npixels = StreamFrameN[CCDChip::FRAME_W].value * StreamFrameN[CCDChip::FRAME_H].value * ((m_PixelFormat == INDI_RGB) ? 3 : 1);
-            }
-            else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
-            {
-                npixels = nbytes * 8 / dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.getBPS();
-            }
-            // Allocale new buffer if size changes
-            if (downscaleBufferSize != npixels)
-            {
-                downscaleBufferSize = npixels;
-                delete [] downscaleBuffer;
-                downscaleBuffer = new uint8_t[npixels];
-            }
-
-            const uint16_t * srcBuffer = reinterpret_cast<const uint16_t *>(buffer);
-            //buffer = downscaleBuffer;
-
-            // Slow method: proper downscale
-            /*
-
-            uint16_t max = 32768;
-            uint16_t min = 0;
+        m_FramesDropped++;
+        if (StreamDropS[DROP_NEWEST].s == ISS_ON)
+            return nullptr;
+
+        // Drop oldest frame to make room for the new one
+        QueuedFrame &oldest = m_FrameQueue[m_FrameQueueHead];
+        released.swap(oldest.release);
+        oldest.external = nullptr;
+        m_FrameQueueHead = (m_FrameQueueHead + 1) % capacity;
+        m_FrameQueueCount--;
+    }
 
-            for (uint32_t i=0; i < npixels; i++)
-            {
-                if (srcBuffer[i] > max)
-                    max = srcBuffer[i];
-                else if (srcBuffer[i] < min)
-                    min = srcBuffer[i];
-            }
+    return &m_FrameQueue[(m_FrameQueueHead + m_FrameQueueCount) % capacity];
+}
 
-            double bscale = 255. / (max - min);
-            double bzero  = (-min) * (255. / (max - min));
+/*
+ * The camera driver is expected to send the FULL FRAME of the Camera after BINNING without any subframing at all
+ * Subframing for streaming/recording is done in the stream manager.
+ * Therefore nbytes is expected to be SubW/BinX * SubH/BinY * Bytes_Per_Pixels * Number_Color_Components
+ * Binned frame must be sent from the camera driver for this to work consistentaly for all drivers.*/
+void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
+{
+    double deltams = 0;
+    if (countFrame(&deltams) == false)
+        return;
 
-            for (uint32_t i=0; i < npixels; i++)
-                streamBuffer[i] = srcBuffer[i] * bscale + bzero;
-            */
+    // The caller holds the device buffer lock, so copy into the staging buffer before taking the queue lock and
+    // swap it into the slot. The slot storage becomes the next staging buffer, so nothing is allocated once warm.
+    std::lock_guard<std::mutex> staging(m_FrameStagingMutex);
+    m_FrameStaging.assign(buffer, buffer + nbytes);
 
-            // Apply gamma
-            for (uint32_t i = 0; i < npixels; i++)
-                downscaleBuffer[i] = gammaLUT_16_8[srcBuffer[i]];
+    std::function<void()> released;
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
 
-            nbytes /= 2;
+        QueuedFrame *slot = queueFrame(released);
+        if (slot)
+        {
+            slot->data.swap(m_FrameStaging);
+            slot->nbytes  = nbytes;
+            slot->deltams = deltams;
+            m_FrameQueueCount++;
+        }
+    }
+    if (released)
+        released();
+    m_FrameQueueCV.notify_one();
+}
 
-#if 0
-            if (StreamSP.s == IPS_BUSY)
-            {
-                streamframeCount++;
-                if (streamframeCount >= StreamOptionsN[OPTION_RATE_DIVISOR].value)
-                {
-                    uploadStream(downscaleBuffer, nbytes);
-                    streamframeCount = 0;
-                }
-            }
-#endif
+void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes, std::function<void()> release)
+{
+    double deltams = 0;
+    if (countFrame(&deltams) == false)
+    {
+        release();
+        return;
+    }
 
-            if (StreamSP.s == IPS_BUSY)
-                uploadStream(downscaleBuffer, nbytes);
+    std::function<void()> released;
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
 
-            // If anything but SER, let's call recorder. Otherwise, it's been called up before.
-            if (isRecording() && strcmp(recorder->getName(), "SER"))
-            {
-                recordStream(downscaleBuffer, nbytes, deltams);
-            }
+        QueuedFrame *slot = queueFrame(released);
+        if (slot)
+        {
+            slot->external = buffer;
+            slot->release.swap(release);
+            slot->nbytes   = nbytes;
+            slot->deltams  = deltams;
+            m_FrameQueueCount++;
         }
+    }
+    // The driver may take its own locks to reuse the buffer, so release outside of the queue lock.
+    // release is still set if the incoming frame was dropped.
+    if (released)
+        released();
+    if (release)
+        release();
+    m_FrameQueueCV.notify_one();
+}
 
-        // Do not downscale for SER recorder.
-        if (isRecording() && !strcmp(recorder->getName(), "SER"))
+void StreamManager::streamWorker()
+{
+    std::unique_lock<std::mutex> lock(m_FrameQueueMutex);
+    while (true)
+    {
+        m_FrameQueueCV.wait(lock, [this] { return m_StreamWorkerExit || m_FrameQueueCount > 0; });
+        if (m_StreamWorkerExit)
+            break;
+
+        // Swap buffers with the slot so the frame is processed without holding the queue lock
+        QueuedFrame &slot = m_FrameQueue[m_FrameQueueHead];
+        m_WorkFrame.data.swap(slot.data);
+        m_WorkFrame.release.swap(slot.release);
+        m_WorkFrame.external = slot.external;
+        m_WorkFrame.nbytes   = slot.nbytes;
+        m_WorkFrame.deltams  = slot.deltams;
+        slot.external = nullptr;
+        m_FrameQueueHead = (m_FrameQueueHead + 1) % m_FrameQueue.size();
+        m_FrameQueueCount--;
+
+        lock.unlock();
+        asyncStream(m_WorkFrame.external ? m_WorkFrame.external : m_WorkFrame.data.data(), m_WorkFrame.nbytes,
+                    m_WorkFrame.deltams);
+        if (m_WorkFrame.release)
         {
-            recordStream(buffer, nbytes, deltams);
+            m_WorkFrame.release();
+            m_WorkFrame.release = nullptr;
         }
+        m_WorkFrame.external = nullptr;
+        lock.lock();
     }
-    else
+
+    // Hand back the external frames still queued
+    std::vector<std::function<void()>> pending = releaseQueuedFrames();
+    lock.unlock();
+    for (auto &release : pending)
+        release();
+}
+
+void StreamManager::applyMJPEGOptions()
+{
+    for (EncoderInterface * oneEncoder : encoderManager->getEncoderList())
     {
-#if 0
-        if (StreamSP.s == IPS_BUSY)
+        MJPEGEncoder *mjpeg = dynamic_cast<MJPEGEncoder*>(oneEncoder);
+        if (mjpeg == nullptr)
+            continue;
+
+        // Encoder settings are only read by the stream worker
+        std::lock_guard<std::mutex> lock(m_EncoderMutex);
+        mjpeg->setQuality(static_cast<int>(MJPEGOptionsN[MJPEG_QUALITY].value));
+    }
+}
+
+void StreamManager::setFrameQueueSize(uint32_t size)
+{
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+        if (size == m_FrameQueue.size())
+            return;
+
+        // Pending frames are discarded when the ring is resized
+        pending = releaseQueuedFrames();
+        m_FrameQueue.clear();
+        m_FrameQueue.resize(size);
+        m_FrameQueueHead  = 0;
+        m_FrameQueueCount = 0;
+    }
+    for (auto &release : pending)
+        release();
+}
+
+std::vector<std::function<void()>> StreamManager::releaseQueuedFrames()
+{
+    std::vector<std::function<void()>> pending;
+    for (uint32_t i = 0; i < m_FrameQueueCount; i++)
+    {
+        QueuedFrame &slot = m_FrameQueue[(m_FrameQueueHead + i) % m_FrameQueue.size()];
+        if (slot.release)
         {
-            streamframeCount++;
-            if (streamframeCount >= StreamOptionsN[OPTION_RATE_DIVISOR].value)
-            {
-                if (uploadStream(buffer, nbytes) == false)
-                {
-                    LOG_ERROR("Streaming failed.");
-                    setStream(false);
-                    return;
-                }
-                streamframeCount = 0;
-            }
+            pending.push_back(nullptr);
+            pending.back().swap(slot.release);
         }
-#endif
+        slot.external = nullptr;
+    }
+    m_FrameQueueHead  = 0;
+    m_FrameQueueCount = 0;
+    return pending;
+}
 
-        if (StreamSP.s == IPS_BUSY)
+bool StreamManager::encodeFrame(const uint8_t *buffer, uint32_t nbytes, uint16_t width, uint16_t height, bool isCompressed)
+{
+    std::unique_lock<std::mutex> guard(m_EncoderMutex);
+    encoder->setSize(width, height);
+    auto start = std::chrono::steady_clock::now();
+    bool rc = encoder->upload(imageB, buffer, nbytes, isCompressed);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    guard.unlock();
+
+    std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+    m_EncodeTime += elapsed.count();
+    m_EncodedFrames++;
+    return rc;
+}
+
+void StreamManager::resetFrameQueueStats()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+        m_FramesDropped = 0;
+    }
+    StreamQueueN[QUEUE_PENDING].value = 0;
+    StreamQueueN[QUEUE_DROPPED].value = 0;
+    StreamQueueNP.s = IPS_IDLE;
+    IDSetNumber(&StreamQueueNP, nullptr);
+}
+
+void StreamManager::asyncStream(const uint8_t *buffer, uint32_t nbytes, double deltams)
+{
+    // With live stacking, the stacked preview is streamed at a lower rate instead of every frame
+    const uint8_t *streamBuffer = buffer;
+    uint32_t streamBytes = nbytes;
+    bool sendStream = (StreamSP.s == IPS_BUSY) && stackStream(buffer, nbytes, &streamBuffer, &streamBytes);
+
+    // The stream is cropped, binned and converted to 8 bit by uploadStream
+    if (sendStream)
+    {
+        if (uploadStream(streamBuffer, streamBytes) == false)
         {
-            if (uploadStream(buffer, nbytes) == false)
-            {
-                LOG_ERROR("Streaming failed.");
-                setStream(false);
-                return;
-            }
+            LOG_ERROR("Streaming failed.");
+            setStream(false);
+            return;
         }
+    }
 
-        if (RecordStreamSP.s == IPS_BUSY)
+    if (RecordStreamSP.s == IPS_BUSY)
+    {
+        // Do not downscale for SER recorders.
+        bool rc = (m_PixelDepth == 16 && !isRawRecorder()) ? recordStream(downscaleFrame(buffer, nbytes), nbytes / 2, deltams) :
+                  recordStream(buffer, nbytes, deltams);
+        if (rc == false)
         {
-            if (recordStream(buffer, nbytes, deltams) == false)
-            {
-                LOG_ERROR("Recording failed.");
-                stopRecording(true);
-                return;
-            }
+            LOG_ERROR("Recording failed.");
+            stopRecording(true);
+            return;
         }
     }
 }
 
+const uint8_t *StreamManager::downscaleFrame(const uint8_t *buffer, uint32_t nbytes)
+{
+    uint32_t npixels = 0;
+    if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+    {
+        npixels = (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubW() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX()) * (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubH() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY()) * ((m_PixelFormat == INDI_RGB) ? 3 : 1);
+    }
+    else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
+    {
+        npixels = nbytes * 8 / dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.getBPS();
+    }
+    // Never read past the queued frame if the frame size changed after it was captured
+    npixels = std::min(npixels, nbytes / 2);
+    // Allocale new buffer if size changes
+    if (downscaleBufferSize != npixels)
+    {
+        downscaleBufferSize = npixels;
+        delete [] downscaleBuffer;
+        downscaleBuffer = new uint8_t[npixels];
+    }
+
+    m_Stretch.convert(reinterpret_cast<const uint16_t *>(buffer), downscaleBuffer, npixels);
+    return downscaleBuffer;
+}
+
+void StreamManager::applyStackOptions()
+{
+    std::lock_guard<std::mutex> lock(m_StackerMutex);
+    m_StackSettings.kappa           = StackOptionsN[STACK_KAPPA].value;
+    m_StackSettings.align           = StackAlignS[ALIGN_TRANSLATION].s == ISS_ON;
+    m_StackSettings.maxShift        = static_cast<uint32_t>(StackOptionsN[STACK_MAX_SHIFT].value);
+    m_StackSettings.previewInterval = StackOptionsN[STACK_PREVIEW].value;
+}
+
+void StreamManager::resetStack()
+{
+    std::lock_guard<std::mutex> lock(m_StackerMutex);
+    m_StackSettings.reset = true;
+}
+
+bool StreamManager::stackStream(const uint8_t *buffer, uint32_t nbytes, const uint8_t **preview, uint32_t *previewBytes)
+{
+    *preview = buffer;
+    *previewBytes = nbytes;
+
+    StackSettings settings;
+    {
+        std::lock_guard<std::mutex> lock(m_StackerMutex);
+        settings = m_StackSettings;
+        if (settings.enabled)
+            m_StackSettings.reset = false;
+    }
+
+    if (settings.enabled == false || m_PixelFormat == INDI_JPG)
+        return true;
+
+    uint32_t width = 0, height = 0;
+    if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+    {
+        INDI::CCDChip &chip = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD;
+        width  = chip.getSubW() / chip.getBinX();
+        height = chip.getSubH() / chip.getBinY();
+    }
+    else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
+    {
+        width  = nbytes * 8 / dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.getBPS();
+        height = 1;
+    }
+
+    bool bayer = (m_PixelFormat >= INDI_BAYER_RGGB && m_PixelFormat <= INDI_BAYER_MYYC);
+    uint8_t components = (m_PixelFormat == INDI_RGB || m_PixelFormat == INDI_BGR) ? 3 : 1;
+
+    if (settings.reset)
+    {
+        m_Stacker.reset();
+        m_LastStackPreview = std::chrono::steady_clock::time_point();
+    }
+    m_Stacker.setMode(settings.mode);
+    m_Stacker.setDarkMode(settings.darkMode);
+    m_Stacker.setKappa(settings.kappa);
+    m_Stacker.setAlignment(settings.align, settings.maxShift);
+    m_Stacker.setFrame(width, height, components, m_PixelDepth, bayer);
+    m_Stacker.addFrame(buffer, nbytes);
+    m_StackDarkFrames = m_Stacker.getDarkFrameCount();
+
+    auto now = std::chrono::steady_clock::now();
+    bool due = std::chrono::duration<double>(now - m_LastStackPreview).count() >= settings.previewInterval;
+
+    // Show the raw frames while taking darks
+    bool takingDarks = (m_Stacker.getDarkMode() == StreamStacker::DARK_TAKE);
+    if (!takingDarks && due)
+    {
+        const uint8_t *stacked = m_Stacker.getPreview(previewBytes);
+        if (stacked == nullptr)
+            return false;
+        *preview = stacked;
+    }
+
+    if (due)
+    {
+        m_LastStackPreview = now;
+
+        int dx = 0, dy = 0;
+        m_Stacker.getShift(&dx, &dy);
+        StackStatsN[STACK_FRAMES].value   = m_Stacker.getFrameCount();
+        StackStatsN[STACK_SKIPPED].value  = m_Stacker.getSkippedCount();
+        StackStatsN[STACK_DARKS].value    = m_Stacker.getDarkFrameCount();
+        StackStatsN[STACK_SHIFT_X].value  = dx;
+        StackStatsN[STACK_SHIFT_Y].value  = dy;
+        StackStatsN[STACK_REJECTED].value = m_Stacker.getRejectedRatio() * 100;
+        StackStatsNP.s = takingDarks ? IPS_BUSY : IPS_OK;
+        IDSetNumber(&StackStatsNP, nullptr);
+    }
+
+    return takingDarks || due;
+}
+
 void StreamManager::setSize(uint16_t width, uint16_t height)
 {
     if (width != StreamFrameN[CCDChip::FRAME_W].value || height != StreamFrameN[CCDChip::FRAME_H].value)
@@ -429,6 +849,12 @@ void StreamManager::setSize(uint16_t width, uint16_t height)
         oneRecorder->setSize(rawWidth, rawHeight);
 }
 
+bool StreamManager::isRawRecorder()
+{
+    // SER and compressed SER record 16 bit frames as is
+    return dynamic_cast<SER_Recorder*>(recorder) != nullptr;
+}
+
 bool StreamManager::close()
 {
     return recorder->close();
@@ -658,6 +1084,8 @@ bool StreamManager::startRecording()
 #endif
     m_RecordingFrameDuration   = 0.0;
     m_RecordingFrameTotal = 0;
+    if (m_isStreaming == false)
+        resetFrameQueueStats();
 
     getitimer(ITIMER_REAL, &tframe1);
     mssum         = 0;
@@ -739,6 +1167,96 @@ bool StreamManager::ISNewSwitch(const char * dev, const char * name, ISState * s
         return true;
     }
 
+    // Frame drop policy
+    if (!strcmp(name, StreamDropSP.name))
+    {
+        std::lock_guard<std::mutex> lock(m_FrameQueueMutex);
+        IUUpdateSwitch(&StreamDropSP, states, names, n);
+        StreamDropSP.s = IPS_OK;
+        IDSetSwitch(&StreamDropSP, nullptr);
+        return true;
+    }
+
+    // 16 to 8 bit conversion
+    if (!strcmp(name, PreviewScaleSP.name))
+    {
+        IUUpdateSwitch(&PreviewScaleSP, states, names, n);
+        PreviewScaleSP.s = IPS_OK;
+        IDSetSwitch(&PreviewScaleSP, nullptr);
+        return true;
+    }
+
+    if (!strcmp(name, StreamStretchSP.name))
+    {
+        IUUpdateSwitch(&StreamStretchSP, states, names, n);
+        m_Stretch.setMode(static_cast<StreamStretch::Mode>(IUFindOnSwitchIndex(&StreamStretchSP)));
+        StreamStretchSP.s = IPS_OK;
+        IDSetSwitch(&StreamStretchSP, nullptr);
+        return true;
+    }
+
+    // Live stacking
+    if (!strcmp(name, StackSP.name))
+    {
+        IUUpdateSwitch(&StackSP, states, names, n);
+        int mode = IUFindOnSwitchIndex(&StackSP);
+        if (mode != STACK_OFF && m_PixelFormat == INDI_JPG)
+        {
+            LOG_WARN("Cannot stack JPEG streams.");
+            IUResetSwitch(&StackSP);
+            StackS[STACK_OFF].s = ISS_ON;
+            StackSP.s = IPS_ALERT;
+            std::lock_guard<std::mutex> lock(m_StackerMutex);
+            m_StackSettings.enabled = false;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_StackerMutex);
+            m_StackSettings.enabled = (mode != STACK_OFF);
+            if (mode != STACK_OFF)
+                m_StackSettings.mode = static_cast<StreamStacker::Mode>(mode - STACK_MEAN);
+            m_StackSettings.reset = true;
+            StackSP.s = (mode == STACK_OFF) ? IPS_IDLE : IPS_OK;
+        }
+        IDSetSwitch(&StackSP, nullptr);
+        return true;
+    }
+
+    if (!strcmp(name, StackDarkSP.name))
+    {
+        IUUpdateSwitch(&StackDarkSP, states, names, n);
+        auto darkMode = static_cast<StreamStacker::DarkMode>(IUFindOnSwitchIndex(&StackDarkSP));
+        {
+            std::lock_guard<std::mutex> lock(m_StackerMutex);
+            m_StackSettings.darkMode = darkMode;
+        }
+        if (darkMode == StreamStacker::DARK_TAKE)
+            LOG_INFO("Taking master dark from the stream. Cover the telescope, then select Subtract when enough frames are averaged.");
+        else if (darkMode == StreamStacker::DARK_SUBTRACT && m_StackDarkFrames == 0)
+            LOG_WARN("No master dark is available yet.");
+        StackDarkSP.s = IPS_OK;
+        IDSetSwitch(&StackDarkSP, nullptr);
+        return true;
+    }
+
+    if (!strcmp(name, StackAlignSP.name))
+    {
+        IUUpdateSwitch(&StackAlignSP, states, names, n);
+        applyStackOptions();
+        StackAlignSP.s = IPS_OK;
+        IDSetSwitch(&StackAlignSP, nullptr);
+        return true;
+    }
+
+    if (!strcmp(name, StackResetSP.name))
+    {
+        resetStack();
+        IUResetSwitch(&StackResetSP);
+        StackResetSP.s = IPS_OK;
+        IDSetSwitch(&StackResetSP, nullptr);
+        return true;
+    }
+
     // Record Stream
     if (!strcmp(name, RecordStreamSP.name))
     {
@@ -805,6 +1323,7 @@ bool StreamManager::ISNewSwitch(const char * dev, const char * name, ISState * s
         {
             if (!strcmp(selectedEncoder, oneEncoder->getName()))
             {
+                std::lock_guard<std::mutex> lock(m_EncoderMutex);
                 encoderManager->setEncoder(oneEncoder);
 
                 oneEncoder->setPixelFormat(m_PixelFormat, m_PixelDepth);
@@ -880,6 +1399,52 @@ bool StreamManager::ISNewNumber(const char * dev, const char * name, double valu
         return true;
     }
 
+    /* Frame queue size */
+    if (!strcmp(StreamBufferNP.name, name))
+    {
+        IUUpdateNumber(&StreamBufferNP, values, names, n);
+        setFrameQueueSize(static_cast<uint32_t>(StreamBufferN[0].value));
+        StreamBufferNP.s = IPS_OK;
+        IDSetNumber(&StreamBufferNP, nullptr);
+        return true;
+    }
+
+    /* Stretch levels */
+    if (!strcmp(StreamStretchNP.name, name))
+    {
+        IUUpdateNumber(&StreamStretchNP, values, names, n);
+        if (StreamStretchN[STRETCH_HIGH].value <= StreamStretchN[STRETCH_LOW].value)
+        {
+            StreamStretchNP.s = IPS_ALERT;
+            LOG_WARN("White level must be above black level.");
+        }
+        else
+            StreamStretchNP.s = IPS_OK;
+        m_Stretch.setPercentiles(StreamStretchN[STRETCH_LOW].value, StreamStretchN[STRETCH_HIGH].value);
+        IDSetNumber(&StreamStretchNP, nullptr);
+        return true;
+    }
+
+    /* Live stacking options */
+    if (!strcmp(StackOptionsNP.name, name))
+    {
+        IUUpdateNumber(&StackOptionsNP, values, names, n);
+        applyStackOptions();
+        StackOptionsNP.s = IPS_OK;
+        IDSetNumber(&StackOptionsNP, nullptr);
+        return true;
+    }
+
+    /* MJPEG Options */
+    if (!strcmp(MJPEGOptionsNP.name, name))
+    {
+        IUUpdateNumber(&MJPEGOptionsNP, values, names, n);
+        applyMJPEGOptions();
+        MJPEGOptionsNP.s = IPS_OK;
+        IDSetNumber(&MJPEGOptionsNP, nullptr);
+        return true;
+    }
+
     /* Record Options */
     if (!strcmp(RecordOptionsNP.name, name))
     {
@@ -989,6 +1554,9 @@ bool StreamManager::setStream(bool enable)
                 }
             }
             m_isStreaming = true;
+            if (m_isRecording == false)
+                resetFrameQueueStats();
+            resetStack();
             m_Format.clear();
             FpsN[FPS_INSTANT].value = FpsN[FPS_AVERAGE].value = 0;
             IUResetSwitch(&StreamSP);
@@ -1050,6 +1618,15 @@ bool StreamManager::saveConfigItems(FILE * fp)
     IUSaveConfigText(fp, &RecordFileTP);
     IUSaveConfigNumber(fp, &RecordOptionsNP);
     IUSaveConfigSwitch(fp, &RecorderSP);
+    IUSaveConfigNumber(fp, &StreamBufferNP);
+    IUSaveConfigSwitch(fp, &StreamDropSP);
+    IUSaveConfigSwitch(fp, &StreamStretchSP);
+    IUSaveConfigNumber(fp, &StreamStretchNP);
+    IUSaveConfigNumber(fp, &MJPEGOptionsNP);
+    if (currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
+        IUSaveConfigSwitch(fp, &PreviewScaleSP);
+    IUSaveConfigSwitch(fp, &StackAlignSP);
+    IUSaveConfigNumber(fp, &StackOptionsNP);
     return true;
 }
 
@@ -1090,26 +1667,17 @@ bool StreamManager::uploadStream(const uint8_t * buffer, uint32_t nbytes)
         return true;
     }
 
-    //memcpy(dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getFrameBuffer(), buffer, dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getFrameBufferSize());
-
-    // Binning for grayscale frames only for now
-#if 0
-    if (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getNAxis() == 2)
-    {
-        dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.binFrame();
-        nbytes /= dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX() * dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY();
-    }
-#endif
-
     int subX, subY, subW, subH;
     subX = subY = 0;
     subW = subH = 0;
+    uint32_t scale = 1;
     if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
     {
         subX = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubX() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX();
         subY = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubY() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY();
         subW = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubW() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX();
         subH = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getSubH() / dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY();
+        scale = 1 << std::max(0, IUFindOnSwitchIndex(&PreviewScaleSP));
     }
     else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
     {
@@ -1119,140 +1687,60 @@ bool StreamManager::uploadStream(const uint8_t * buffer, uint32_t nbytes)
         subH = 1;
     }
 
-    //uint8_t *streamBuffer = buffer;
+    uint16_t width = rawWidth, height = rawHeight;
 
     // If stream frame was not yet initilized, let's do that now
     if (StreamFrameN[CCDChip::FRAME_W].value == 0 || StreamFrameN[CCDChip::FRAME_H].value == 0)
     {
-        //if (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getNAxis() == 2)
-        //    binFactor = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX();
-
         StreamFrameN[CCDChip::FRAME_X].value = subX;
         StreamFrameN[CCDChip::FRAME_Y].value = subY;
         StreamFrameN[CCDChip::FRAME_W].value = subW;
-        StreamFrameN[CCDChip::FRAME_W].value = subH;
+        StreamFrameN[CCDChip::FRAME_H].value = subH;
         StreamFrameNP.s                      = IPS_IDLE;
         IDSetNumber(&StreamFrameNP, nullptr);
     }
-    // Check if we need to subframe
-    else if ((StreamFrameN[CCDChip::FRAME_W].value > 0 && StreamFrameN[CCDChip::FRAME_H].value > 0) &&
-             (StreamFrameN[CCDChip::FRAME_X].value != subX || StreamFrameN[CCDChip::FRAME_Y].value != subY ||
-              StreamFrameN[CCDChip::FRAME_W].value != subW || StreamFrameN[CCDChip::FRAME_H].value != subH))
-    {
-        uint32_t npixels = StreamFrameN[CCDChip::FRAME_W].value * StreamFrameN[CCDChip::FRAME_H].value * ((m_PixelFormat == INDI_RGB) ? 3 : 1);
-        if (downscaleBufferSize < npixels)
-        {
-            downscaleBufferSize = npixels;
-            delete [] downscaleBuffer;
-            downscaleBuffer = new uint8_t[npixels];
-        }
-
-        uint32_t sourceOffset = (subW * StreamFrameN[CCDChip::FRAME_Y].value) + StreamFrameN[CCDChip::FRAME_X].value;
-        uint8_t components = (m_PixelFormat == INDI_RGB) ? 3 : 1;
-
-        const uint8_t * srcBuffer  = buffer + sourceOffset * components;
-        uint32_t sourceStride = subW * components;
 
-        uint8_t * destBuffer = downscaleBuffer;
-        uint32_t desStride = StreamFrameN[CCDChip::FRAME_W].value * components;
+    bool subframed = StreamFrameN[CCDChip::FRAME_X].value != subX || StreamFrameN[CCDChip::FRAME_Y].value != subY ||
+                     StreamFrameN[CCDChip::FRAME_W].value != subW || StreamFrameN[CCDChip::FRAME_H].value != subH;
 
-        // Copy line-by-line
-        for (int i = 0; i < StreamFrameN[CCDChip::FRAME_H].value; i++)
-            memcpy(destBuffer + i * desStride, srcBuffer + sourceStride * i, desStride);
-
-        nbytes = StreamFrameN[CCDChip::FRAME_W].value * StreamFrameN[CCDChip::FRAME_H].value * components;
-
-        if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
-        {
-            if (encoder->upload(imageB, downscaleBuffer, nbytes, dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.isCompressed()))
-            {
-#ifdef HAVE_WEBSOCKET
-                if (dynamic_cast<INDI::CCD*>(currentDevice)->HasWebSocket() && dynamic_cast<INDI::CCD*>(currentDevice)->WebSocketS[CCD::WEBSOCKET_ENABLED].s == ISS_ON)
-                {
-                    if (m_Format != ".stream")
-                    {
-                        m_Format = ".stream";
-                        dynamic_cast<INDI::CCD*>(currentDevice)->wsServer.send_text(m_Format);
-                    }
-
-                    dynamic_cast<INDI::CCD*>(currentDevice)->wsServer.send_binary(downscaleBuffer, nbytes);
-                    return true;
-                }
-#endif
-                // Upload to client now
-                imageBP->s = IPS_OK;
-                IDSetBLOB(imageBP, nullptr);
-                return true;
-            }
-        }
-        else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
+    // Crop, bin and convert 16 bit frames to 8 bit in a single pass
+    if (subframed || scale > 1 || m_PixelDepth == 16)
+    {
+        uint8_t components = (m_PixelFormat == INDI_RGB || m_PixelFormat == INDI_BGR) ? 3 : 1;
+        bool bayer = (m_PixelFormat >= INDI_BAYER_RGGB && m_PixelFormat <= INDI_BAYER_MYYC);
+        if (nbytes < static_cast<uint32_t>(subW) * subH * components * (m_PixelDepth == 16 ? 2 : 1))
         {
-            if (encoder->upload(imageB, downscaleBuffer, nbytes, false))//dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.isCompressed())
-            {
-                /*
-                            if (dynamic_cast<INDI::Detector*>(currentDevice)->HasWebSocket() && dynamic_cast<INDI::Detector*>(currentDevice)->WebSocketS[Detector::WEBSOCKET_ENABLED].s == ISS_ON)
-                            {
-                                if (m_Format != ".stream")
-                                {
-                                    m_Format = ".stream";
-                                    dynamic_cast<INDI::Detector*>(currentDevice)->wsServer.send_text(m_Format);
-                                }
-
-                                dynamic_cast<INDI::Detector*>(currentDevice)->wsServer.send_binary(downscaleBuffer, nbytes);
-                                return true;
-                            }
-                */
-                // Upload to client now
-                imageBP->s = IPS_OK;
-                IDSetBLOB(imageBP, nullptr);
-                return true;
-            }
+            LOGF_DEBUG("Skipping stream frame of %u bytes, too small for %dx%d.", nbytes, subW, subH);
+            return true;
         }
 
-        return false;
-    }
-#if 0
-    // For MONO
-    if (dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getNAxis() == 2)
-    {
-        int binFactor = dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinX() * dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.getBinY();
-        int offset =
-            ((subW * StreamFrameN[CCDChip::FRAME_Y].value) + StreamFrameN[CCDChip::FRAME_X].value) / binFactor;
-
-        uint8_t * srcBuffer  = buffer + offset;
-        uint8_t * destBuffer = buffer;
-
-        for (int i = 0; i < StreamFrameN[CCDChip::FRAME_H].value; i++)
-            memcpy(destBuffer + i * static_cast<int>(StreamFrameN[CCDChip::FRAME_W].value), srcBuffer + subW * i,
-                   StreamFrameN[CCDChip::FRAME_W].value);
+        uint32_t outWidth = 0, outHeight = 0;
+        m_Scaler.setFrame(subW, subH, components, m_PixelDepth, bayer);
+        const uint8_t *output = m_Scaler.process(buffer, StreamFrameN[CCDChip::FRAME_X].value, StreamFrameN[CCDChip::FRAME_Y].value,
+                                StreamFrameN[CCDChip::FRAME_W].value, StreamFrameN[CCDChip::FRAME_H].value, scale,
+                                m_Stretch, &outWidth, &outHeight);
+        if (output == nullptr)
+            return true;
 
-        streamW = StreamFrameN[CCDChip::FRAME_W].value;
-        streamH = StreamFrameN[CCDChip::FRAME_H].value;
+        buffer = output;
+        nbytes = outWidth * outHeight * components;
+        width  = outWidth;
+        height = outHeight;
     }
-    // For Color
-    else
-    {
-        // Subframe offset in source frame. i.e. where we start copying data from in the original data frame
-        int sourceOffset = (subW * StreamFrameN[CCDChip::FRAME_Y].value) + StreamFrameN[CCDChip::FRAME_X].value;
-        // Total bytes
-        //totalBytes = (StreamFrameN[CCDChip::FRAME_W].value * StreamFrameN[CCDChip::FRAME_H].value) * 3;
 
-        // Copy each color component back into buffer. Since each subframed page is equal or small than source component
-        // no need to a new buffer
-
-        uint8_t * srcBuffer  = buffer + sourceOffset * 3;
-        uint8_t * destBuffer = buffer;
-
-        // RGB
-        for (int i = 0; i < StreamFrameN[CCDChip::FRAME_H].value; i++)
-            memcpy(destBuffer + i * static_cast<int>(StreamFrameN[CCDChip::FRAME_W].value * 3),
-                   srcBuffer + subW * 3 * i, StreamFrameN[CCDChip::FRAME_W].value * 3);
+    // Clients need the size of raw preview frames to decode them
+    if ((currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE) &&
+            (PreviewSizeN[PREVIEW_WIDTH].value != width || PreviewSizeN[PREVIEW_HEIGHT].value != height))
+    {
+        PreviewSizeN[PREVIEW_WIDTH].value  = width;
+        PreviewSizeN[PREVIEW_HEIGHT].value = height;
+        PreviewSizeNP.s = IPS_OK;
+        IDSetNumber(&PreviewSizeNP, nullptr);
     }
-#endif
 
     if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
     {
-        if (encoder->upload(imageB, buffer, nbytes, dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.isCompressed()))
+        if (encodeFrame(buffer, nbytes, width, height, dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.isCompressed()))
         {
 #ifdef HAVE_WEBSOCKET
             if (dynamic_cast<INDI::CCD*>(currentDevice)->HasWebSocket() && dynamic_cast<INDI::CCD*>(currentDevice)->WebSocketS[CCD::WEBSOCKET_ENABLED].s == ISS_ON)
@@ -1275,21 +1763,8 @@ bool StreamManager::uploadStream(const uint8_t * buffer, uint32_t nbytes)
     }
     else if(currentDevice->getDriverInterface() & INDI::DefaultDevice::DETECTOR_INTERFACE)
     {
-        if (encoder->upload(imageB, buffer, nbytes, false))//dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.isCompressed()))
+        if (encodeFrame(buffer, nbytes, width, height, false))//dynamic_cast<INDI::Detector*>(currentDevice)->PrimaryDetector.isCompressed()))
         {
-            /*
-                        if (dynamic_cast<INDI::Detector*>(currentDevice)->HasWebSocket() && dynamic_cast<INDI::Detector*>(currentDevice)->WebSocketS[Detector::WEBSOCKET_ENABLED].s == ISS_ON)
-                        {
-                            if (m_Format != ".stream")
-                            {
-                                m_Format = ".stream";
-                                dynamic_cast<INDI::Detector*>(currentDevice)->wsServer.send_text(m_Format);
-                            }
-
-                            dynamic_cast<INDI::Detector*>(currentDevice)->wsServer.send_binary(buffer, nbytes);
-                            return true;
-                        }
-            */
             // Upload to client now
             imageBP->s = IPS_OK;
             IDSetBLOB(imageBP, nullptr);
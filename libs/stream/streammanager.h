@@ -25,9 +25,19 @@
 #include "indidevapi.h"
 #include "recorder/recordermanager.h"
 #include "encoder/encodermanager.h"
+#include "streamstretch.h"
+#include "streamstacker.h"
+#include "streamscaler.h"
 
+#include <atomic>
 #include <string>
 #include <map>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <sys/time.h>
 
 #include <stdint.h>
@@ -45,7 +55,8 @@
    + Color 24bit RGB frame.
 
    Use setPixelFormat() and setSize() before uploading the stream data. 16bit frames are only supported in some recorders. You can send
-   16bit frames, but they will be downscaled to 8bit when necessary for streaming and recording purposes. Base classes must implement
+   16bit frames, but they will be downscaled to 8bit when necessary for streaming and recording purposes. The STREAM_STRETCH property
+   selects how: gamma curve (default), linear, or automatic stretch between the black and white percentiles set in STREAM_STRETCH_LEVELS. Base classes must implement
    startStreaming() and stopStreaming() functions. When a frame is ready, use uploadStream() to send the data to active encoders and recorders.
 
    It is highly recommended to implement the streaming functionality in a dedicated thread.
@@ -59,7 +70,18 @@
 
    1. RAW Encoder: Frame is sent as is (lossless). If compression is enabled, the frame is compressed with zlib. Uncompressed format is ".stream"
    and compressed format is ".stream.z"
-   2. MJPEG Encoder: Frame is encoded to a JPEG image before being transmitted. Format is ".stream_jpg"
+   2. MJPEG Encoder: Frame is encoded to a JPEG image before being transmitted. Format is ".stream_jpg". Quality and an optional
+   downscale factor for previews are set in the STREAM_MJPEG property.
+
+   The average time spent in the encoder per frame is reported in STREAM_ENCODE_TIME.
+
+   \section Stacking
+
+   Streamed frames can be stacked live (see StreamStacker) by selecting a mode in STREAM_STACK: mean, sigma clipped
+   mean or maximum. While stacking, the stacked image is streamed instead of the individual frames, once every
+   STACK_PREVIEW seconds set in STREAM_STACK_OPTIONS. Recording is not affected. STREAM_STACK_DARK takes a master dark
+   from the stream and subtracts it, STREAM_STACK_ALIGN registers the frames by translation, and STREAM_STACK_RESET
+   starts a new stack. Progress is reported in STREAM_STACK_STATS.
 
    \section Recorders
 
@@ -77,11 +99,26 @@
    2. OGV recorder: Saves video streams in libtheora OGV files. INDI must be compiled with the optional OGG Theora support for this functionality to be
    available. Frame rate is estimated from the average FPS.
 
+   \section Frame Queue
+
+   newFrame() copies each frame into a bounded ring of pooled buffers and returns immediately. A single worker thread
+   encodes and records the queued frames in order. When the worker falls behind and the ring is full, either the oldest
+   queued frame or the incoming frame is dropped according to the STREAM_DROP_POLICY property. The ring size is set by
+   the STREAM_BUFFER property and the number of pending and dropped frames is reported in STREAM_QUEUE.
+
+   Drivers that capture into buffers they can lend, such as V4L2 mmap buffers, may queue the buffer itself instead
+   with the newFrame() overload taking a release function. No copy is made; the function is called once the frame
+   is streamed and recorded, dropped, or discarded, and the driver may then reuse the buffer.
+
    \section Subframing
 
    By default, the full image width and height are used for transmitting the data. Subframing is possible by updating the CCD_STREAM_FRAME
    property. All values set in this property must be set in BINNED coordinates, unlike the CCD_FRAME which is set in UNBINNED coordinates.
 
+   Clients may also request a smaller preview with the STREAM_PREVIEW_SCALE property, which bins the stream frame by 2, 4 or 8
+   before it is encoded. The size of the frames sent to clients is reported in STREAM_PREVIEW_SIZE. Cropping, binning and the conversion of 16 bit frames to 8 bit are done in a single pass over the
+   source frame. Recordings always keep the full frame.
+
    \example Check CCD Simulator, V4L2 CCD, and ZWO ASI drivers for example implementations.
 
 \author Jasem Mutlaq
@@ -119,14 +156,23 @@ class StreamManager
 
         /**
              * @brief newFrame CCD drivers call this function when a new frame is received. It is then streamed, or recorded, or both according to the settings in the streamer.
+             * The caller must hold ccdBufferLock (detectorBufferLock for detectors) while the frame is copied to the frame queue.
+             * The buffer may be reused as soon as the function returns.
              */
         void newFrame(const uint8_t *buffer, uint32_t nbytes);
 
         /**
-         * @brief asyncStream Upload the stream asynchronously in a separate thread. ccdBufferLock mutex shall be locked until the record/upload
-         * operation is complete.
-         * @param buffer Buffer to stream/record
+         * @brief newFrame Queue a frame without copying it. The buffer must stay valid and unchanged until release is
+         * called. release is called exactly once, from any thread, when the frame is no longer needed, including when it
+         * is skipped or dropped.
+         */
+        void newFrame(const uint8_t *buffer, uint32_t nbytes, std::function<void()> release);
+
+        /**
+         * @brief asyncStream Upload and/or record a frame. Called from the stream worker thread for each queued frame.
+         * @param buffer Buffer to stream/record, owned by the frame queue.
          * @param nbytes size of buffer.
+         * @param deltams time in milliseconds since last frame
          */
         void asyncStream(const uint8_t *buffer, uint32_t nbytes, double deltams);
 
@@ -179,6 +225,14 @@ class StreamManager
 
         void setSize(uint16_t width, uint16_t height);
         bool setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth = 8);
+        INDI_PIXEL_FORMAT getPixelFormat() const
+        {
+            return m_PixelFormat;
+        }
+        uint8_t getPixelDepth() const
+        {
+            return m_PixelDepth;
+        }
         void getStreamFrame(uint16_t *x, uint16_t *y, uint16_t *w, uint16_t *h);
 
         /**
@@ -217,8 +271,57 @@ class StreamManager
              */
         bool recordStream(const uint8_t *buffer, uint32_t nbytes, double deltams);
 
+        /**
+         * @return True if the current recorder stores 16 bit frames without downscaling them to 8 bit.
+         */
+        bool isRawRecorder();
+
+        /**
+         * @brief stackStream Add the frame to the live stack if stacking is enabled.
+         * @param preview receives the frame to stream: the frame itself when stacking is off, or the stacked preview.
+         * @return True if a frame should be streamed now.
+         */
+        bool stackStream(const uint8_t *buffer, uint32_t nbytes, const uint8_t **preview, uint32_t *previewBytes);
+
+        /**
+         * @brief downscaleFrame Convert a 16 bit frame to 8 bit in the downscale buffer.
+         */
+        const uint8_t *downscaleFrame(const uint8_t *buffer, uint32_t nbytes);
+        void applyStackOptions();
+
         void prepareGammaLUT(double gamma = 2.4, double a = 12.92, double b = 0.055, double Ii = 0.00304);
 
+        /**
+         * @brief streamWorker Stream worker thread. Processes queued frames in order until the stream manager is destroyed.
+         */
+        void streamWorker();
+        /**
+         * @brief countFrame Update the frame rate and queue statistics for a new frame.
+         * @return False if the frame is skipped by the frame divisor.
+         */
+        bool countFrame(double *deltams);
+        /**
+         * @brief queueFrame Reserve a slot for a new frame, dropping a frame if the queue is full. Called with the queue
+         * locked. The release function of a dropped external frame is moved to released.
+         * @return Slot to fill, or nullptr if the incoming frame is dropped.
+         */
+        struct QueuedFrame;
+        QueuedFrame *queueFrame(std::function<void()> &released);
+        /**
+         * @brief releaseQueuedFrames Empty the queue. Called with the queue locked.
+         * @return Release functions of the external frames that were queued, to be called once unlocked.
+         */
+        std::vector<std::function<void()>> releaseQueuedFrames();
+        void setFrameQueueSize(uint32_t size);
+        void applyMJPEGOptions();
+
+        /**
+         * @brief encodeFrame Encode the frame with the selected encoder into the stream BLOB and measure the time it took.
+         * @param width, height size of the frame, which is smaller than the raw size when cropped or binned.
+         */
+        bool encodeFrame(const uint8_t *buffer, uint32_t nbytes, uint16_t width, uint16_t height, bool isCompressed);
+        void resetFrameQueueStats();
+
         /* Stream switch */
         ISwitch StreamS[2];
         ISwitchVectorProperty StreamSP;
@@ -244,14 +347,72 @@ class StreamManager
         INumberVectorProperty FpsNP;
         enum { FPS_INSTANT, FPS_AVERAGE };
 
+        /* Frame queue */
+        INumber StreamBufferN[1];
+        INumberVectorProperty StreamBufferNP;
+
+        ISwitch StreamDropS[2];
+        ISwitchVectorProperty StreamDropSP;
+        enum { DROP_OLDEST, DROP_NEWEST };
+
+        INumber StreamQueueN[2];
+        INumberVectorProperty StreamQueueNP;
+        enum { QUEUE_PENDING, QUEUE_DROPPED };
+
+        /* 16 to 8 bit conversion */
+        ISwitch StreamStretchS[3];
+        ISwitchVectorProperty StreamStretchSP;
+
+        INumber StreamStretchN[2];
+        INumberVectorProperty StreamStretchNP;
+        enum { STRETCH_LOW, STRETCH_HIGH };
+
+        /* Live stacking */
+        ISwitch StackS[4];
+        ISwitchVectorProperty StackSP;
+        enum { STACK_OFF, STACK_MEAN, STACK_SIGMA, STACK_MAX };
+
+        ISwitch StackDarkS[3];
+        ISwitchVectorProperty StackDarkSP;
+
+        ISwitch StackAlignS[2];
+        ISwitchVectorProperty StackAlignSP;
+        enum { ALIGN_OFF, ALIGN_TRANSLATION };
+
+        INumber StackOptionsN[3];
+        INumberVectorProperty StackOptionsNP;
+        enum { STACK_KAPPA, STACK_PREVIEW, STACK_MAX_SHIFT };
+
+        ISwitch StackResetS[1];
+        ISwitchVectorProperty StackResetSP;
+
+        INumber StackStatsN[6];
+        INumberVectorProperty StackStatsNP;
+        enum { STACK_FRAMES, STACK_SKIPPED, STACK_DARKS, STACK_SHIFT_X, STACK_SHIFT_Y, STACK_REJECTED };
+
         /* Record Options */
         INumber RecordOptionsN[2];
         INumberVectorProperty RecordOptionsNP;
 
+        /* Record Statistics */
+        INumber RecordStatsN[2];
+        INumberVectorProperty RecordStatsNP;
+        enum { RECORD_STATS_RATE, RECORD_STATS_DROPPED };
+
         // Stream Frame
         INumberVectorProperty StreamFrameNP;
         INumber StreamFrameN[4];
 
+        // Preview scale of the stream frame
+        ISwitch PreviewScaleS[4];
+        ISwitchVectorProperty PreviewScaleSP;
+        enum { SCALE_FULL, SCALE_HALF, SCALE_QUARTER, SCALE_EIGHTH };
+
+        // Size of the frames sent to clients
+        INumber PreviewSizeN[2];
+        INumberVectorProperty PreviewSizeNP;
+        enum { PREVIEW_WIDTH, PREVIEW_HEIGHT };
+
         /* BLOBs */
         IBLOBVectorProperty *imageBP = nullptr;
         IBLOB *imageB = nullptr;
@@ -261,10 +422,18 @@ class StreamManager
         ISwitchVectorProperty EncoderSP;
         enum { ENCODER_RAW, ENCODER_MJPEG };
 
+        INumber MJPEGOptionsN[1];
+        INumberVectorProperty MJPEGOptionsNP;
+        enum { MJPEG_QUALITY };
+
+        // Average encoding time per frame
+        INumber EncodeTimeN[1];
+        INumberVectorProperty EncodeTimeNP;
+
         // Recorder Selector. Static but should be implmeneted as a dynamic plugin interface
-        ISwitch RecorderS[2];
+        ISwitch RecorderS[3];
         ISwitchVectorProperty RecorderSP;
-        enum { RECORDER_RAW, RECORDER_OGV };
+        enum { RECORDER_RAW, RECORDER_SERZ, RECORDER_OGV };
 
         bool m_isStreaming { false };
         bool m_isRecording { false };
@@ -282,6 +451,9 @@ class StreamManager
         // Encoders
         EncoderManager *encoderManager = nullptr;
         EncoderInterface *encoder = nullptr;
+        std::mutex m_EncoderMutex;
+        double m_EncodeTime = 0;
+        uint32_t m_EncodedFrames = 0;
 
         // Measure FPS
         struct itimerval tframe1, tframe2;
@@ -297,5 +469,49 @@ class StreamManager
         uint32_t downscaleBufferSize = 0;
 
         uint8_t *gammaLUT_16_8 = nullptr;
+        StreamStretch m_Stretch;
+        StreamScaler m_Scaler;
+
+        // Live stacking. The main thread only changes m_StackSettings, the stream worker copies them under
+        // m_StackerMutex once per frame and owns the stacker.
+        struct StackSettings
+        {
+            bool enabled { false };
+            StreamStacker::Mode mode { StreamStacker::STACK_MEAN };
+            StreamStacker::DarkMode darkMode { StreamStacker::DARK_OFF };
+            double kappa { 2.5 };
+            bool align { false };
+            uint32_t maxShift { 32 };
+            double previewInterval { 2 };
+            bool reset { false };
+        };
+        StackSettings m_StackSettings;
+        std::mutex m_StackerMutex;
+        StreamStacker m_Stacker;
+        std::atomic<uint32_t> m_StackDarkFrames { 0 };
+        std::chrono::steady_clock::time_point m_LastStackPreview;
+        void resetStack();
+
+        // Frame queue. Slots keep their storage so no allocation happens once the ring is warmed up.
+        // External frames point to a driver buffer instead, which is handed back by calling release.
+        struct QueuedFrame
+        {
+            std::vector<uint8_t> data;
+            const uint8_t *external = nullptr;
+            std::function<void()> release;
+            uint32_t nbytes = 0;
+            double deltams = 0;
+        };
+
+        std::vector<QueuedFrame> m_FrameQueue;
+        QueuedFrame m_WorkFrame;
+        std::vector<uint8_t> m_FrameStaging;
+        std::mutex m_FrameStagingMutex;
+        uint32_t m_FrameQueueHead = 0, m_FrameQueueCount = 0;
+        uint32_t m_FramesDropped = 0;
+        std::mutex m_FrameQueueMutex;
+        std::condition_variable m_FrameQueueCV;
+        std::thread m_StreamWorker;
+        bool m_StreamWorkerExit = false;
 };
 }
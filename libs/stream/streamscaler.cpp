@@ -0,0 +1,323 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Stream subframing, binning and depth conversion
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "streamscaler.h"
+#include "streamstretch.h"
+#include "streamthreadpool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Frames reading fewer source samples than this are processed in the calling thread
+#define SCALER_MIN_SAMPLES_PER_THREAD   (512 * 1024)
+
+namespace INDI
+{
+
+StreamScaler::StreamScaler()
+{
+    setThreads(0);
+}
+
+void StreamScaler::setThreads(unsigned int threads)
+{
+    if (threads == 0)
+        threads = StreamThreadPool::instance().size();
+    m_Threads = std::max(1u, std::min(threads, 4u));
+}
+
+void StreamScaler::setFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth, bool bayer)
+{
+    m_Width      = width;
+    m_Height     = height;
+    m_Components = components;
+    m_Depth      = depth;
+    m_Bayer      = bayer;
+}
+
+void StreamScaler::bin2x2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, uint32_t outWidth)
+{
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i two  = _mm_set1_epi16(2);
+    for (; i + 16 <= outWidth; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 2 * i));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 2 * i + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 2 * i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 2 * i + 16));
+        // Sum of even and odd bytes of both rows, 8 blocks per register
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= outWidth; i += 16)
+    {
+        uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * i)), vpaddlq_u8(vld1q_u8(row1 + 2 * i)));
+        uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * i + 16)), vpaddlq_u8(vld1q_u8(row1 + 2 * i + 16)));
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+#endif
+    for (; i < outWidth; i++)
+        dst[i] = (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) >> 2;
+}
+
+void StreamScaler::accumulate(const uint8_t *src, uint32_t *sums, uint32_t count)
+{
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        __m128i *s = reinterpret_cast<__m128i *>(sums + i);
+        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(sums + i, vaddw_u16(vld1q_u32(sums + i), vget_low_u16(lo)));
+        vst1q_u32(sums + i + 4, vaddw_u16(vld1q_u32(sums + i + 4), vget_high_u16(lo)));
+        vst1q_u32(sums + i + 8, vaddw_u16(vld1q_u32(sums + i + 8), vget_low_u16(hi)));
+        vst1q_u32(sums + i + 12, vaddw_u16(vld1q_u32(sums + i + 12), vget_high_u16(hi)));
+    }
+#endif
+    for (; i < count; i++)
+        sums[i] += src[i];
+}
+
+void StreamScaler::accumulate(const uint16_t *src, uint32_t *sums, uint32_t count)
+{
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i *s = reinterpret_cast<__m128i *>(sums + i);
+        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(v, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t v = vld1q_u16(src + i);
+        vst1q_u32(sums + i, vaddw_u16(vld1q_u32(sums + i), vget_low_u16(v)));
+        vst1q_u32(sums + i + 4, vaddw_u16(vld1q_u32(sums + i + 4), vget_high_u16(v)));
+    }
+#endif
+    for (; i < count; i++)
+        sums[i] += src[i];
+}
+
+template <typename T>
+void StreamScaler::processRows(const T *src, uint32_t y0, uint32_t y1, uint32_t thread, const StreamStretch &stretch)
+{
+    const uint32_t components = m_Components, scale = m_Scale;
+    const uint32_t srcStride  = m_Width * components;
+    const uint32_t outSamples = m_OutWidth * components;
+    // Source samples of a row of blocks
+    const uint32_t inSamples  = outSamples * scale;
+    // Scales are powers of two, so the average is a shift
+    uint32_t shift = 0;
+    while ((1u << shift) < scale * scale)
+        shift++;
+    const uint32_t half = (1u << shift) >> 1;
+
+    uint32_t *sums   = m_Sums[thread].data();
+    uint32_t *blocks = m_Blocks[thread].data();
+    uint16_t *row16  = m_Rows[thread].data();
+
+    for (uint32_t oy = y0; oy < y1; oy++)
+    {
+        uint8_t *dst = m_Output.data() + oy * outSamples;
+
+        if (scale == 1)
+        {
+            const T *row = src + (m_Y + oy) * srcStride + m_X * components;
+            if (sizeof(T) == 1)
+                memcpy(dst, row, outSamples);
+            else
+                stretch.convertRow(reinterpret_cast<const uint16_t *>(row), dst, outSamples);
+            continue;
+        }
+
+        if (sizeof(T) == 1 && components == 1 && !m_Bayer && scale == 2)
+        {
+            const uint8_t *row = reinterpret_cast<const uint8_t *>(src) + (m_Y + 2 * oy) * srcStride + m_X;
+            bin2x2(row, row + srcStride, dst, m_OutWidth);
+            continue;
+        }
+
+        // Sum the rows of the block first, which vectorizes well, then the columns of each output pixel.
+        // Samples of the same color of Bayer frames are two rows and two columns apart.
+        const uint32_t rowStep = m_Bayer ? 2 : 1;
+        const uint32_t firstRow = m_Bayer ? m_Y + (oy / 2) * 2 * scale + (oy % 2) : m_Y + oy * scale;
+        std::fill(sums, sums + inSamples, 0);
+        for (uint32_t k = 0; k < scale; k++)
+            accumulate(src + (firstRow + k * rowStep) * srcStride + m_X * components, sums, inSamples);
+
+        if (m_Bayer)
+        {
+            for (uint32_t ox = 0; ox < m_OutWidth; ox++)
+            {
+                const uint32_t *block = sums + (ox / 2) * 2 * scale + (ox % 2);
+                uint32_t sum = 0;
+                for (uint32_t j = 0; j < scale; j++)
+                    sum += block[2 * j];
+                blocks[ox] = sum;
+            }
+        }
+        else if (components == 1 && scale == 2)
+        {
+            for (uint32_t ox = 0; ox < m_OutWidth; ox++)
+                blocks[ox] = sums[2 * ox] + sums[2 * ox + 1];
+        }
+        else
+        {
+            const uint32_t *block = sums;
+            for (uint32_t ox = 0; ox < m_OutWidth; ox++, block += scale * components)
+                for (uint32_t c = 0; c < components; c++)
+                {
+                    uint32_t sum = 0;
+                    for (uint32_t j = 0; j < scale; j++)
+                        sum += block[j * components + c];
+                    blocks[ox * components + c] = sum;
+                }
+        }
+
+        if (sizeof(T) == 1)
+        {
+            for (uint32_t i = 0; i < outSamples; i++)
+                dst[i] = static_cast<uint8_t>((blocks[i] + half) >> shift);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < outSamples; i++)
+                row16[i] = static_cast<uint16_t>((blocks[i] + half) >> shift);
+            stretch.convertRow(row16, dst, outSamples);
+        }
+    }
+}
+
+void StreamScaler::parallelRows(uint32_t rows, uint32_t samplesPerRow,
+                                const std::function<void(uint32_t, uint32_t, uint32_t)> &function)
+{
+    uint32_t threads = std::min<uint32_t>(m_Threads, rows * samplesPerRow / SCALER_MIN_SAMPLES_PER_THREAD);
+    threads = std::max(1u, std::min(threads, rows));
+    if (threads == 1)
+    {
+        function(0, 0, rows);
+        return;
+    }
+
+    uint32_t chunk = (rows + threads - 1) / threads;
+    StreamThreadPool::instance().run((rows + chunk - 1) / chunk, [&](uint32_t t)
+    {
+        uint32_t start = t * chunk;
+        function(t, start, std::min(rows, start + chunk));
+    });
+}
+
+const uint8_t *StreamScaler::process(const uint8_t *src, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                                     uint32_t scale, StreamStretch &stretch, uint32_t *outWidth, uint32_t *outHeight)
+{
+    if (src == nullptr || m_Width == 0 || m_Height == 0)
+        return nullptr;
+
+    x = std::min(x, m_Width);
+    y = std::min(y, m_Height);
+    if (m_Bayer)
+    {
+        x &= ~1u;
+        y &= ~1u;
+    }
+    w = std::min(w, m_Width - x);
+    h = std::min(h, m_Height - y);
+
+    uint32_t factor = 1;
+    while (factor * 2 <= scale)
+        factor *= 2;
+
+    if (m_Bayer && factor > 1)
+    {
+        // Whole 2x2 color cells only
+        m_OutWidth  = (w / (2 * factor)) * 2;
+        m_OutHeight = (h / (2 * factor)) * 2;
+    }
+    else
+    {
+        m_OutWidth  = w / factor;
+        m_OutHeight = h / factor;
+    }
+    if (m_OutWidth == 0 || m_OutHeight == 0)
+        return nullptr;
+
+    m_X     = x;
+    m_Y     = y;
+    m_Scale = factor;
+    m_Output.resize(m_OutWidth * m_OutHeight * m_Components);
+    m_Sums.resize(m_Threads);
+    m_Blocks.resize(m_Threads);
+    m_Rows.resize(m_Threads);
+    for (unsigned int t = 0; t < m_Threads; t++)
+    {
+        m_Sums[t].resize(m_OutWidth * m_Components * factor);
+        m_Blocks[t].resize(m_OutWidth * m_Components);
+        m_Rows[t].resize(m_OutWidth * m_Components);
+    }
+
+    const uint16_t *src16 = reinterpret_cast<const uint16_t *>(src);
+    if (m_Depth > 8)
+        stretch.prepare(src16 + (y * m_Width + x) * m_Components, w * m_Components, h, m_Width * m_Components);
+
+    parallelRows(m_OutHeight, w * m_Components * factor, [&](uint32_t thread, uint32_t y0, uint32_t y1)
+    {
+        if (m_Depth > 8)
+            processRows(src16, y0, y1, thread, stretch);
+        else
+            processRows(src, y0, y1, thread, stretch);
+    });
+
+    *outWidth  = m_OutWidth;
+    *outHeight = m_OutHeight;
+    return m_Output.data();
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Stream subframing, binning and depth conversion
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+class StreamStretch;
+
+/**
+ * @brief The StreamScaler class prepares frames for the stream encoders. It crops the stream subframe, bins it by
+ * the preview scale and converts 16 bit samples to 8 bit in a single pass over the source. Only the output frame is
+ * written.
+ *
+ * Binning averages blocks of scale x scale pixels. Bayer frames are binned per color so the output keeps the same
+ * pattern, and their crop origin is rounded down to even coordinates for the same reason.
+ *
+ * 2x binning of 8 bit mono frames uses SSE2 or NEON kernels when available. Large frames are split by rows over
+ * the threads of the shared StreamThreadPool.
+ */
+class StreamScaler
+{
+    public:
+        StreamScaler();
+
+        /**
+         * @brief setThreads Maximum number of threads used to process a frame. 0 selects the size of the stream thread
+         * pool.
+         */
+        void setThreads(unsigned int threads);
+
+        /**
+         * @brief setFrame Set the geometry of the source frames.
+         * @param components 1 for mono and Bayer frames, 3 for RGB.
+         * @param depth Bits per sample, 8 or 16.
+         */
+        void setFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth, bool bayer);
+
+        /**
+         * @brief process Crop, bin and convert a source frame to 8 bit.
+         * @param x, y, w, h Region to stream, in source pixels. It is clipped to the source frame.
+         * @param scale Bin factor, 1 keeps the full resolution.
+         * @param stretch Converter of 16 bit samples. Its levels are estimated from the region in Auto mode.
+         * @param outWidth, outHeight receive the size of the output frame.
+         * @return Output frame owned by the scaler, valid until the next call, or nullptr if the region is empty.
+         */
+        const uint8_t *process(const uint8_t *src, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t scale,
+                               StreamStretch &stretch, uint32_t *outWidth, uint32_t *outHeight);
+
+        // Kernel, exposed for testing
+        static void bin2x2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, uint32_t outWidth);
+
+    private:
+        static void accumulate(const uint8_t *src, uint32_t *sums, uint32_t count);
+        static void accumulate(const uint16_t *src, uint32_t *sums, uint32_t count);
+        template <typename T> void processRows(const T *src, uint32_t y0, uint32_t y1, uint32_t thread,
+                                               const StreamStretch &stretch);
+        void parallelRows(uint32_t rows, uint32_t samplesPerRow,
+                          const std::function<void(uint32_t, uint32_t, uint32_t)> &function);
+
+        unsigned int m_Threads { 1 };
+
+        uint32_t m_Width { 0 }, m_Height { 0 };
+        uint8_t m_Components { 1 }, m_Depth { 8 };
+        bool m_Bayer { false };
+
+        // Region and output of the frame being processed
+        uint32_t m_X { 0 }, m_Y { 0 }, m_Scale { 1 };
+        uint32_t m_OutWidth { 0 }, m_OutHeight { 0 };
+
+        std::vector<uint8_t> m_Output;
+        // Per thread sums of the source rows and of the blocks, and 16 bit output rows
+        std::vector<std::vector<uint32_t>> m_Sums, m_Blocks;
+        std::vector<std::vector<uint16_t>> m_Rows;
+};
+
+}
@@ -0,0 +1,373 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Live stream stacking
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "streamstacker.h"
+#include "streamthreadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Frames smaller than this are stacked in the calling thread
+#define STACK_MIN_SAMPLES_PER_THREAD    (256 * 1024)
+// Sigma clipping starts once the variance of each sample is estimated from this many frames. With fewer, the
+// estimate is so noisy that a large part of valid samples would be rejected.
+#define STACK_SIGMA_MIN_FRAMES          8
+// Frames whose profiles correlate less than this with the reference are not registered
+#define STACK_MIN_CORRELATION           0.5
+
+namespace INDI
+{
+
+StreamStacker::StreamStacker()
+{
+    setThreads(0);
+}
+
+void StreamStacker::setMode(Mode mode)
+{
+    if (mode != m_Mode)
+    {
+        m_Mode = mode;
+        reset();
+    }
+}
+
+void StreamStacker::setDarkMode(DarkMode mode)
+{
+    if (mode == DARK_TAKE && m_DarkMode != DARK_TAKE)
+    {
+        m_Dark.clear();
+        m_DarkFrames = 0;
+    }
+    m_DarkMode = mode;
+}
+
+void StreamStacker::setAlignment(bool enabled, uint32_t maxShift)
+{
+    if (enabled != m_Align)
+        reset();
+    m_Align    = enabled;
+    m_MaxShift = maxShift;
+}
+
+void StreamStacker::setThreads(unsigned int threads)
+{
+    if (threads == 0)
+        threads = StreamThreadPool::instance().size();
+    m_Threads = std::max(1u, std::min(threads, 4u));
+}
+
+void StreamStacker::setFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth, bool bayer)
+{
+    if (width == m_Width && height == m_Height && components == m_Components && depth == m_Depth && bayer == m_Bayer)
+        return;
+
+    m_Width      = width;
+    m_Height     = height;
+    m_Components = components;
+    m_Depth      = depth;
+    m_Bayer      = bayer;
+
+    m_Dark.clear();
+    m_DarkFrames = 0;
+    reset();
+}
+
+void StreamStacker::reset()
+{
+    m_Mean.clear();
+    m_M2.clear();
+    m_Count.clear();
+    m_RefColumns.clear();
+    m_RefRows.clear();
+    m_Frames   = 0;
+    m_Skipped  = 0;
+    m_ShiftX   = 0;
+    m_ShiftY   = 0;
+    m_Rejected = 0;
+}
+
+void StreamStacker::parallelRows(const std::function<void(uint32_t, uint32_t, uint32_t)> &function)
+{
+    uint32_t samples = m_Width * m_Height * m_Components;
+    uint32_t threads = std::min<uint32_t>(m_Threads, samples / STACK_MIN_SAMPLES_PER_THREAD);
+    threads = std::max(1u, std::min(threads, m_Height));
+    if (threads == 1)
+    {
+        function(0, 0, m_Height);
+        return;
+    }
+
+    uint32_t rows = (m_Height + threads - 1) / threads;
+    StreamThreadPool::instance().run((m_Height + rows - 1) / rows, [&](uint32_t t)
+    {
+        uint32_t start = t * rows;
+        function(t, start, std::min(m_Height, start + rows));
+    });
+}
+
+template <typename T>
+void StreamStacker::loadFrame(const T *frame)
+{
+    bool subtract = (m_DarkMode == DARK_SUBTRACT && !m_Dark.empty());
+    uint32_t stride = m_Width * m_Components;
+
+    parallelRows([&](uint32_t, uint32_t y0, uint32_t y1)
+    {
+        for (uint32_t i = y0 * stride; i < y1 * stride; i++)
+            m_Frame[i] = subtract ? frame[i] - m_Dark[i] : frame[i];
+    });
+}
+
+bool StreamStacker::addFrame(const uint8_t *frame, uint32_t nbytes)
+{
+    uint32_t samples = m_Width * m_Height * m_Components;
+    uint32_t bytesPerSample = (m_Depth > 8) ? 2 : 1;
+    if (samples == 0 || nbytes < samples * bytesPerSample)
+        return false;
+
+    m_Frame.resize(samples);
+    if (bytesPerSample == 2)
+        loadFrame(reinterpret_cast<const uint16_t *>(frame));
+    else
+        loadFrame(frame);
+
+    if (m_DarkMode == DARK_TAKE)
+    {
+        // Running average of the dark frames
+        if (m_Dark.empty())
+            m_Dark.assign(samples, 0);
+        m_DarkFrames++;
+        float weight = 1.0f / m_DarkFrames;
+        for (uint32_t i = 0; i < samples; i++)
+            m_Dark[i] += (m_Frame[i] - m_Dark[i]) * weight;
+        return true;
+    }
+
+    if (m_Mean.empty())
+    {
+        m_Mean.assign(samples, 0);
+        m_Count.assign(samples, 0);
+        if (m_Mode == STACK_SIGMA_CLIP)
+            m_M2.assign(samples, 0);
+    }
+
+    if (m_Align && registerFrame() == false)
+    {
+        m_Skipped++;
+        return false;
+    }
+
+    std::vector<uint64_t> rejected(m_Threads, 0);
+    parallelRows([&](uint32_t thread, uint32_t y0, uint32_t y1)
+    {
+        stackRows(y0, y1, &rejected[thread]);
+    });
+
+    uint64_t total = 0;
+    for (auto count : rejected)
+        total += count;
+    m_Rejected = static_cast<double>(total) / samples;
+    m_Frames++;
+    return true;
+}
+
+void StreamStacker::stackRows(uint32_t y0, uint32_t y1, uint64_t *rejected)
+{
+    // Sample (x, y) of the stack comes from sample (x + dx, y + dy) of the frame
+    int dx = m_ShiftX, dy = m_ShiftY;
+    uint32_t x0 = std::max(0, -dx), x1 = std::min<int>(m_Width, static_cast<int>(m_Width) - dx);
+    uint32_t stride = m_Width * m_Components;
+    float kappa = m_Kappa;
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        int sy = static_cast<int>(y) + dy;
+        if (sy < 0 || sy >= static_cast<int>(m_Height) || x0 >= x1)
+            continue;
+
+        const float *src = m_Frame.data() + sy * stride + (static_cast<int>(x0) + dx) * m_Components;
+        uint32_t start = y * stride + x0 * m_Components, end = y * stride + x1 * m_Components;
+        float *mean = m_Mean.data();
+        uint32_t *count = m_Count.data();
+
+        switch (m_Mode)
+        {
+            case STACK_MEAN:
+                for (uint32_t i = start; i < end; i++, src++)
+                {
+                    uint32_t n = ++count[i];
+                    mean[i] += (*src - mean[i]) / n;
+                }
+                break;
+
+            case STACK_MAX:
+                for (uint32_t i = start; i < end; i++, src++)
+                {
+                    if (count[i]++ == 0 || *src > mean[i])
+                        mean[i] = *src;
+                }
+                break;
+
+            case STACK_SIGMA_CLIP:
+            {
+                float *m2 = m_M2.data();
+                for (uint32_t i = start; i < end; i++, src++)
+                {
+                    float value = *src;
+                    uint32_t n = count[i];
+                    if (n >= STACK_SIGMA_MIN_FRAMES)
+                    {
+                        // Floor of one unit so constant samples do not reject everything
+                        float sigma = std::max(1.0f, std::sqrt(m2[i] / (n - 1)));
+                        if (std::fabs(value - mean[i]) > kappa * sigma)
+                        {
+                            (*rejected)++;
+                            continue;
+                        }
+                    }
+
+                    // Welford's online mean and variance
+                    n = ++count[i];
+                    float delta = value - mean[i];
+                    mean[i] += delta / n;
+                    m2[i]   += delta * (value - mean[i]);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void StreamStacker::computeProfiles(std::vector<double> &columns, std::vector<double> &rows) const
+{
+    columns.assign(m_Width, 0);
+    rows.assign(m_Height, 0);
+
+    const float *src = m_Frame.data();
+    for (uint32_t y = 0; y < m_Height; y++)
+    {
+        double rowSum = 0;
+        for (uint32_t x = 0; x < m_Width; x++)
+        {
+            double value = 0;
+            for (uint8_t c = 0; c < m_Components; c++)
+                value += *src++;
+            columns[x] += value;
+            rowSum += value;
+        }
+        rows[y] = rowSum;
+    }
+
+}
+
+int StreamStacker::correlate(const std::vector<double> &reference, const std::vector<double> &profile, int maxShift,
+                             bool *found)
+{
+    int size = reference.size();
+    maxShift = std::min(maxShift, size / 2);
+
+    int best = 0;
+    double bestScore = -1;
+    for (int shift = -maxShift; shift <= maxShift; shift++)
+    {
+        // Pearson correlation over the overlap, so the score does not depend on its length
+        int i0 = std::max(0, -shift), i1 = std::min(size, size - shift), n = i1 - i0;
+        double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+        for (int i = i0; i < i1; i++)
+        {
+            double a = reference[i], b = profile[i + shift];
+            sa  += a;
+            sb  += b;
+            saa += a * a;
+            sbb += b * b;
+            sab += a * b;
+        }
+        double variance = (saa - sa * sa / n) * (sbb - sb * sb / n);
+        double score = (variance > 0) ? (sab - sa * sb / n) / std::sqrt(variance) : 0;
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = shift;
+        }
+    }
+
+    // A peak at the edge of the search range means the real shift is larger, or there is no match at all
+    *found = (bestScore > STACK_MIN_CORRELATION) && (maxShift == 0 || std::abs(best) < maxShift);
+    return best;
+}
+
+bool StreamStacker::registerFrame()
+{
+    if (m_RefColumns.empty())
+    {
+        computeProfiles(m_RefColumns, m_RefRows);
+        m_ShiftX = m_ShiftY = 0;
+        return true;
+    }
+
+    computeProfiles(m_Columns, m_Rows);
+
+    bool foundX = false, foundY = false;
+    int dx = correlate(m_RefColumns, m_Columns, m_MaxShift, &foundX);
+    int dy = correlate(m_RefRows, m_Rows, m_MaxShift, &foundY);
+    if (!foundX || !foundY)
+        return false;
+
+    if (m_Bayer)
+    {
+        // Keep the same color under each stack sample
+        dx &= ~1;
+        dy &= ~1;
+    }
+
+    m_ShiftX = dx;
+    m_ShiftY = dy;
+    return true;
+}
+
+const uint8_t *StreamStacker::getPreview(uint32_t *nbytes)
+{
+    if (m_Mean.empty() || m_Frames == 0)
+        return nullptr;
+
+    uint32_t samples = m_Mean.size();
+    bool wide = (m_Depth > 8);
+    float maximum = wide ? 65535.0f : 255.0f;
+    m_Preview.resize(samples * (wide ? 2 : 1));
+
+    uint16_t *preview16 = reinterpret_cast<uint16_t *>(m_Preview.data());
+    uint8_t *preview8 = m_Preview.data();
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        float value = (m_Count[i] > 0) ? std::min(maximum, std::max(0.0f, m_Mean[i] + 0.5f)) : 0;
+        if (wide)
+            preview16[i] = static_cast<uint16_t>(value);
+        else
+            preview8[i] = static_cast<uint8_t>(value);
+    }
+
+    *nbytes = m_Preview.size();
+    return m_Preview.data();
+}
+
+}
@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Live stream stacking
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The StreamStacker class stacks streamed frames incrementally for live previews.
+ *
+ * Each frame is folded into per sample accumulators as it arrives, so the cost per frame is constant and no frame
+ * history is kept. Three modes are supported:
+ * + Mean: Running average of all frames.
+ * + Sigma clip: Running average and variance. Samples further than kappa standard deviations from the current
+ *   average are rejected, which removes satellites, planes and hot pixel flicker once a few frames are stacked.
+ * + Max: Per sample maximum, useful for star trails and meteors.
+ *
+ * Frames can be dark subtracted. In DARK_TAKE mode, frames are averaged into the master dark instead of the stack.
+ *
+ * Frames can be registered on the first frame of the stack by translation. The shift is estimated by correlating
+ * the row and column sums of the frame with those of the reference frame. This is cheap and robust for planets,
+ * the Moon and the Sun, and works for star fields with a good signal to noise ratio. Rotation is not corrected.
+ * Shifts of Bayer frames are rounded to even values to preserve the color pattern.
+ *
+ * Mono, Bayer and interleaved RGB frames of 8 or 16 bits per sample are supported. Large frames are split by rows
+ * over the threads of the shared StreamThreadPool.
+ */
+class StreamStacker
+{
+    public:
+        enum Mode
+        {
+            STACK_MEAN,
+            STACK_SIGMA_CLIP,
+            STACK_MAX
+        };
+
+        enum DarkMode
+        {
+            DARK_OFF,
+            DARK_TAKE,
+            DARK_SUBTRACT
+        };
+
+        StreamStacker();
+
+        /**
+         * @brief setMode Select the stacking mode. The stack is reset if the mode changes.
+         */
+        void setMode(Mode mode);
+        Mode getMode() const
+        {
+            return m_Mode;
+        }
+
+        /**
+         * @brief setDarkMode Select how incoming frames are used. Switching to DARK_TAKE discards the master dark.
+         */
+        void setDarkMode(DarkMode mode);
+        DarkMode getDarkMode() const
+        {
+            return m_DarkMode;
+        }
+
+        /**
+         * @brief setKappa Rejection threshold of the sigma clip mode in standard deviations.
+         */
+        void setKappa(double kappa)
+        {
+            m_Kappa = kappa;
+        }
+
+        /**
+         * @brief setAlignment Enable registration by translation.
+         * @param maxShift Largest shift searched in pixels, in each direction.
+         */
+        void setAlignment(bool enabled, uint32_t maxShift);
+
+        /**
+         * @brief setThreads Maximum number of threads used to stack a frame. 0 selects the size of the stream thread
+         * pool.
+         */
+        void setThreads(unsigned int threads);
+
+        /**
+         * @brief setFrame Set the geometry of the incoming frames. The stack and the master dark are reset if it
+         * changes.
+         * @param components 1 for mono and Bayer frames, 3 for RGB.
+         * @param depth Bits per sample, 8 or 16.
+         */
+        void setFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth, bool bayer);
+
+        /**
+         * @brief reset Discard the stack. The master dark is kept.
+         */
+        void reset();
+
+        /**
+         * @brief addFrame Add a frame to the stack, or to the master dark in DARK_TAKE mode.
+         * @return False if the frame does not match the geometry set by setFrame() or could not be registered.
+         */
+        bool addFrame(const uint8_t *frame, uint32_t nbytes);
+
+        /**
+         * @brief getPreview Convert the stack to a frame of the same format as the input.
+         * @param nbytes receives the size of the preview.
+         * @return Preview frame owned by the stacker, valid until the next call, or nullptr if nothing is stacked.
+         */
+        const uint8_t *getPreview(uint32_t *nbytes);
+
+        uint32_t getFrameCount() const
+        {
+            return m_Frames;
+        }
+        uint32_t getDarkFrameCount() const
+        {
+            return m_DarkFrames;
+        }
+        uint32_t getSkippedCount() const
+        {
+            return m_Skipped;
+        }
+        /**
+         * @brief getShift Offset of the last frame relative to the reference frame, in pixels.
+         */
+        void getShift(int *dx, int *dy) const
+        {
+            *dx = m_ShiftX;
+            *dy = m_ShiftY;
+        }
+        /**
+         * @return Fraction of samples rejected in the last frame stacked in sigma clip mode.
+         */
+        double getRejectedRatio() const
+        {
+            return m_Rejected;
+        }
+
+    private:
+        template <typename T> void loadFrame(const T *frame);
+        void stackRows(uint32_t y0, uint32_t y1, uint64_t *rejected);
+        void computeProfiles(std::vector<double> &columns, std::vector<double> &rows) const;
+        bool registerFrame();
+        static int correlate(const std::vector<double> &reference, const std::vector<double> &profile, int maxShift,
+                             bool *found);
+        void parallelRows(const std::function<void(uint32_t, uint32_t, uint32_t)> &function);
+
+        Mode m_Mode { STACK_MEAN };
+        DarkMode m_DarkMode { DARK_OFF };
+        double m_Kappa { 2.5 };
+        bool m_Align { false };
+        uint32_t m_MaxShift { 32 };
+        unsigned int m_Threads { 1 };
+
+        uint32_t m_Width { 0 }, m_Height { 0 };
+        uint8_t m_Components { 1 }, m_Depth { 8 };
+        bool m_Bayer { false };
+
+        // Current frame as float, dark subtracted
+        std::vector<float> m_Frame;
+        // Per sample accumulators: average (or maximum), sum of squared deviations and count
+        std::vector<float> m_Mean, m_M2;
+        std::vector<uint32_t> m_Count;
+        std::vector<float> m_Dark;
+        std::vector<double> m_RefColumns, m_RefRows, m_Columns, m_Rows;
+        std::vector<uint8_t> m_Preview;
+
+        uint32_t m_Frames { 0 }, m_DarkFrames { 0 }, m_Skipped { 0 };
+        int m_ShiftX { 0 }, m_ShiftY { 0 };
+        double m_Rejected { 0 };
+};
+
+}
@@ -0,0 +1,265 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    16 to 8 bit stream conversion
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "streamstretch.h"
+#include "streamthreadpool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Frames smaller than this are converted in the calling thread
+#define STRETCH_MIN_PIXELS_PER_THREAD   (512 * 1024)
+// Number of pixels sampled to estimate the black and white points
+#define STRETCH_HISTOGRAM_SAMPLES       (256 * 1024)
+
+namespace INDI
+{
+
+StreamStretch::StreamStretch()
+{
+    setThreads(0);
+}
+
+void StreamStretch::setMode(Mode mode)
+{
+    std::lock_guard<std::mutex> lock(m_SettingsLock);
+    m_Mode = mode;
+}
+
+StreamStretch::Mode StreamStretch::getMode()
+{
+    std::lock_guard<std::mutex> lock(m_SettingsLock);
+    return m_Mode;
+}
+
+void StreamStretch::setGammaLUT(const uint8_t *lut)
+{
+    std::lock_guard<std::mutex> lock(m_SettingsLock);
+    m_GammaLUT = lut;
+}
+
+void StreamStretch::setPercentiles(double low, double high)
+{
+    std::lock_guard<std::mutex> lock(m_SettingsLock);
+    m_Low  = std::max(0.0, std::min(low, 100.0));
+    m_High = std::max(m_Low, std::min(high, 100.0));
+}
+
+void StreamStretch::setThreads(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    // Conversion is memory bound, more threads do not help
+    m_Threads = std::max(1u, std::min({ threads, 4u, StreamThreadPool::instance().size() }));
+}
+
+void StreamStretch::shift(const uint16_t *src, uint8_t *dst, uint32_t npixels)
+{
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= npixels; i += 16)
+    {
+        __m128i a = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), 8);
+        __m128i b = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= npixels; i += 16)
+    {
+        uint8x8_t a = vshrn_n_u16(vld1q_u16(src + i), 8);
+        uint8x8_t b = vshrn_n_u16(vld1q_u16(src + i + 8), 8);
+        vst1q_u8(dst + i, vcombine_u8(a, b));
+    }
+#endif
+    for (; i < npixels; i++)
+        dst[i] = src[i] >> 8;
+}
+
+void StreamStretch::stretch(const uint16_t *src, uint8_t *dst, uint32_t npixels, uint16_t black, uint16_t white)
+{
+    // out = min(in - black, range) * 255 / range, computed as a 16x16 bit multiply keeping the high word.
+    // Small ranges are shifted up first so the scale factor fits in 16 bits.
+    uint32_t range = std::max(1, white - black);
+    int bits = 0;
+    while ((range << bits) < 256)
+        bits++;
+    uint32_t scaledRange = range << bits;
+    uint16_t scale = static_cast<uint16_t>((255u * 65536u + scaledRange - 1) / scaledRange);
+
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    const __m128i vblack = _mm_set1_epi16(static_cast<int16_t>(black));
+    const __m128i vrange = _mm_set1_epi16(static_cast<int16_t>(range));
+    const __m128i vscale = _mm_set1_epi16(static_cast<int16_t>(scale));
+    const __m128i vbits  = _mm_cvtsi32_si128(bits);
+    for (; i + 16 <= npixels; i += 16)
+    {
+        __m128i a = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), vblack);
+        __m128i b = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)), vblack);
+        // Unsigned min(x, range) without SSE4.1
+        a = _mm_sub_epi16(a, _mm_subs_epu16(a, vrange));
+        b = _mm_sub_epi16(b, _mm_subs_epu16(b, vrange));
+        a = _mm_mulhi_epu16(_mm_sll_epi16(a, vbits), vscale);
+        b = _mm_mulhi_epu16(_mm_sll_epi16(b, vbits), vscale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    const uint16x8_t vblack = vdupq_n_u16(black);
+    const uint16x8_t vrange = vdupq_n_u16(range);
+    const uint16x4_t vscale = vdup_n_u16(scale);
+    const int16x8_t vbits   = vdupq_n_s16(bits);
+    for (; i + 8 <= npixels; i += 8)
+    {
+        uint16x8_t a = vminq_u16(vqsubq_u16(vld1q_u16(src + i), vblack), vrange);
+        a = vshlq_u16(a, vbits);
+        uint16x4_t lo = vshrn_n_u32(vmull_u16(vget_low_u16(a), vscale), 16);
+        uint16x4_t hi = vshrn_n_u32(vmull_u16(vget_high_u16(a), vscale), 16);
+        vst1_u8(dst + i, vqmovn_u16(vcombine_u16(lo, hi)));
+    }
+#endif
+    for (; i < npixels; i++)
+    {
+        uint32_t value = src[i] > black ? std::min<uint32_t>(src[i] - black, range) : 0;
+        dst[i] = static_cast<uint8_t>(((value << bits) * scale) >> 16);
+    }
+}
+
+void StreamStretch::lookup(const uint16_t *src, uint8_t *dst, uint32_t npixels, const uint8_t *lut)
+{
+    // No gather instruction beats a scalar table lookup for byte results, unroll to keep the loads in flight.
+    uint32_t i = 0;
+    for (; i + 4 <= npixels; i += 4)
+    {
+        uint8_t a = lut[src[i]];
+        uint8_t b = lut[src[i + 1]];
+        uint8_t c = lut[src[i + 2]];
+        uint8_t d = lut[src[i + 3]];
+        dst[i]     = a;
+        dst[i + 1] = b;
+        dst[i + 2] = c;
+        dst[i + 3] = d;
+    }
+    for (; i < npixels; i++)
+        dst[i] = lut[src[i]];
+}
+
+void StreamStretch::computeLevels(const uint16_t *src, uint32_t width, uint32_t height, uint32_t stride)
+{
+    m_Histogram.assign(65536, 0);
+
+    uint32_t npixels = width * height;
+    uint32_t step = std::max(1u, npixels / STRETCH_HISTOGRAM_SAMPLES);
+    uint32_t samples = 0;
+    for (uint32_t i = 0; i < npixels; i += step, samples++)
+        m_Histogram[src[(i / width) * stride + i % width]]++;
+
+    uint32_t lowCount  = static_cast<uint32_t>(samples * m_ActiveLow / 100.0);
+    uint32_t highCount = static_cast<uint32_t>(samples * m_ActiveHigh / 100.0);
+
+    uint32_t sum = 0, black = 0, white = 65535;
+    bool blackFound = false;
+    for (uint32_t i = 0; i < 65536; i++)
+    {
+        sum += m_Histogram[i];
+        if (!blackFound && sum > lowCount)
+        {
+            black = i;
+            blackFound = true;
+        }
+        if (sum >= highCount)
+        {
+            white = i;
+            break;
+        }
+    }
+
+    // Keep room for a white point above black
+    black   = std::min(black, 65534u);
+    m_Black = black;
+    m_White = std::max(white, black + 1);
+}
+
+void StreamStretch::prepare(const uint16_t *src, uint32_t width, uint32_t height, uint32_t stride)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SettingsLock);
+        m_Active     = m_Mode;
+        m_ActiveLow  = m_Low;
+        m_ActiveHigh = m_High;
+        m_ActiveLUT  = m_GammaLUT;
+    }
+    if (m_Active == STRETCH_GAMMA && m_ActiveLUT == nullptr)
+        m_Active = STRETCH_LINEAR;
+
+    if (m_Active == STRETCH_AUTO && width > 0 && height > 0)
+        computeLevels(src, width, height, stride);
+    else
+    {
+        m_Black = 0;
+        m_White = 65535;
+    }
+}
+
+void StreamStretch::convertRow(const uint16_t *src, uint8_t *dst, uint32_t npixels) const
+{
+    switch (m_Active)
+    {
+        case STRETCH_GAMMA:
+            lookup(src, dst, npixels, m_ActiveLUT);
+            break;
+        case STRETCH_LINEAR:
+            shift(src, dst, npixels);
+            break;
+        case STRETCH_AUTO:
+            stretch(src, dst, npixels, m_Black, m_White);
+            break;
+    }
+}
+
+void StreamStretch::convert(const uint16_t *src, uint8_t *dst, uint32_t npixels)
+{
+    prepare(src, npixels, 1, npixels);
+
+    uint32_t threads = std::min<uint32_t>(m_Threads, npixels / STRETCH_MIN_PIXELS_PER_THREAD);
+    if (threads <= 1)
+    {
+        convertRow(src, dst, npixels);
+        return;
+    }
+
+    // Split in chunks aligned to 64 pixels so each thread writes whole cache lines
+    uint32_t chunk = ((npixels / threads) + 63) & ~63u;
+    uint32_t chunks = (npixels + chunk - 1) / chunk;
+    StreamThreadPool::instance().run(chunks, [&](uint32_t t)
+    {
+        uint32_t start = t * chunk;
+        convertRow(src + start, dst + start, std::min(chunk, npixels - start));
+    });
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    16 to 8 bit stream conversion
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The StreamStretch class converts 16 bit frames to 8 bit for streaming and recording.
+ *
+ * Three modes are supported:
+ * + Gamma: Each pixel is mapped through a 64K entry lookup table (sRGB gamma by default).
+ * + Linear: The 8 most significant bits are kept.
+ * + Auto: Black and white points are estimated from percentiles of a sampled histogram and the range
+ *   between them is stretched linearly to 0-255.
+ *
+ * Linear and Auto use SSE2 or NEON kernels when available. Large frames are split by rows over the threads of
+ * the shared StreamThreadPool.
+ *
+ * The settings may be changed from another thread while frames are converted. They are picked up by the next
+ * call to prepare() or convert().
+ */
+class StreamStretch
+{
+    public:
+        enum Mode
+        {
+            STRETCH_GAMMA,
+            STRETCH_LINEAR,
+            STRETCH_AUTO
+        };
+
+        StreamStretch();
+
+        void setMode(Mode mode);
+        Mode getMode();
+
+        /**
+         * @brief setPercentiles Set black and white points for the Auto mode.
+         * @param low percent of pixels to clip to black.
+         * @param high percentile mapped to white.
+         */
+        void setPercentiles(double low, double high);
+
+        /**
+         * @brief setGammaLUT Lookup table for the Gamma mode. It must hold 65536 entries and outlive this object.
+         */
+        void setGammaLUT(const uint8_t *lut);
+
+        /**
+         * @brief setThreads Maximum number of threads used to convert a frame. 0 selects the number of CPU cores.
+         */
+        void setThreads(unsigned int threads);
+
+        /**
+         * @brief convert Convert npixels 16 bit pixels from src to 8 bit in dst.
+         */
+        void convert(const uint16_t *src, uint8_t *dst, uint32_t npixels);
+
+        /**
+         * @brief prepare Select the mode and levels used by convertRow(). In Auto mode, the levels are estimated from
+         * a region of a frame.
+         * @param stride distance between the rows of the region in pixels.
+         */
+        void prepare(const uint16_t *src, uint32_t width, uint32_t height, uint32_t stride);
+
+        /**
+         * @brief convertRow Convert npixels 16 bit pixels in the calling thread, with the levels selected by the last
+         * call to prepare() or convert().
+         */
+        void convertRow(const uint16_t *src, uint8_t *dst, uint32_t npixels) const;
+
+        /**
+         * @brief getLevels Black and white points used by the last conversion.
+         */
+        void getLevels(uint16_t *black, uint16_t *white) const
+        {
+            *black = m_Black;
+            *white = m_White;
+        }
+
+        // Kernels, exposed for testing
+        static void shift(const uint16_t *src, uint8_t *dst, uint32_t npixels);
+        static void stretch(const uint16_t *src, uint8_t *dst, uint32_t npixels, uint16_t black, uint16_t white);
+        static void lookup(const uint16_t *src, uint8_t *dst, uint32_t npixels, const uint8_t *lut);
+
+    private:
+        void computeLevels(const uint16_t *src, uint32_t width, uint32_t height, uint32_t stride);
+
+        // Settings, guarded by m_SettingsLock
+        std::mutex m_SettingsLock;
+        Mode m_Mode { STRETCH_GAMMA };
+        double m_Low { 0.5 }, m_High { 99.9 };
+        const uint8_t *m_GammaLUT { nullptr };
+
+        // Snapshot of the settings used by the current frame
+        Mode m_Active { STRETCH_GAMMA };
+        double m_ActiveLow { 0.5 }, m_ActiveHigh { 99.9 };
+        const uint8_t *m_ActiveLUT { nullptr };
+        unsigned int m_Threads { 1 };
+        uint16_t m_Black { 0 }, m_White { 65535 };
+        std::vector<uint32_t> m_Histogram;
+};
+
+}
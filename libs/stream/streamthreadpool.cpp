@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Worker threads shared by the stream stages
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "streamthreadpool.h"
+
+#include <algorithm>
+
+// The stream stages are memory bound, more workers than this do not help
+#define STREAM_POOL_MAX_WORKERS 7
+
+namespace INDI
+{
+
+StreamThreadPool &StreamThreadPool::instance()
+{
+    static StreamThreadPool pool(std::min(std::max(1u, std::thread::hardware_concurrency()) - 1,
+                                          static_cast<unsigned int>(STREAM_POOL_MAX_WORKERS)));
+    return pool;
+}
+
+StreamThreadPool::StreamThreadPool(unsigned int workers)
+{
+    m_Workers.reserve(workers);
+    for (unsigned int i = 0; i < workers; i++)
+        m_Workers.emplace_back(&StreamThreadPool::workerThread, this);
+}
+
+StreamThreadPool::~StreamThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+    }
+    m_JobCV.notify_all();
+
+    for (auto &worker : m_Workers)
+        worker.join();
+}
+
+bool StreamThreadPool::claim(Job &job, uint32_t *index)
+{
+    if (job.next == job.count)
+        return false;
+
+    *index = job.next++;
+    // Nothing left for the workers once the last task is claimed
+    if (job.next == job.count)
+        m_Jobs.erase(std::find(m_Jobs.begin(), m_Jobs.end(), &job));
+    return true;
+}
+
+void StreamThreadPool::finish(Job &job)
+{
+    if (++job.done == job.count)
+        m_DoneCV.notify_all();
+}
+
+void StreamThreadPool::run(uint32_t count, const std::function<void(uint32_t)> &task)
+{
+    if (count == 0)
+        return;
+
+    if (count == 1 || m_Workers.empty())
+    {
+        for (uint32_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    Job job { &task, count, 0, 0 };
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Jobs.push_back(&job);
+    lock.unlock();
+    m_JobCV.notify_all();
+
+    lock.lock();
+    uint32_t index;
+    while (claim(job, &index))
+    {
+        lock.unlock();
+        task(index);
+        lock.lock();
+        finish(job);
+    }
+
+    m_DoneCV.wait(lock, [&job] { return job.done == job.count; });
+}
+
+void StreamThreadPool::workerThread()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true)
+    {
+        m_JobCV.wait(lock, [this] { return m_Exit || !m_Jobs.empty(); });
+        if (m_Exit)
+            return;
+
+        Job &job = *m_Jobs.front();
+        uint32_t index;
+        if (claim(job, &index) == false)
+            continue;
+
+        lock.unlock();
+        (*job.task)(index);
+        lock.lock();
+        finish(job);
+    }
+}
+
+}
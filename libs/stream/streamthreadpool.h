@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2019 by Jasem Mutlaq <mutlaqja@ikarustech.com>
+
+    Worker threads shared by the stream stages
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace INDI
+{
+
+/**
+ * @brief The StreamThreadPool class holds the worker threads used to split a frame between cores.
+ *
+ * The threads are started once and shared by the stretch, scaler, stacker, color conversion and MJPEG stages,
+ * so no thread is created per frame. The calling thread takes part in the work, and several callers may run
+ * jobs at the same time.
+ */
+class StreamThreadPool
+{
+    public:
+        /**
+         * @return The pool shared by all stream stages of the process.
+         */
+        static StreamThreadPool &instance();
+
+        StreamThreadPool(unsigned int workers);
+        ~StreamThreadPool();
+
+        /**
+         * @return Number of threads that can run tasks at once, including the caller.
+         */
+        unsigned int size() const
+        {
+            return m_Workers.size() + 1;
+        }
+
+        /**
+         * @brief run Call task(0) to task(count - 1), split between the calling thread and the workers, and wait
+         * until all of them returned.
+         */
+        void run(uint32_t count, const std::function<void(uint32_t)> &task);
+
+    private:
+        struct Job
+        {
+            const std::function<void(uint32_t)> *task;
+            uint32_t count;
+            uint32_t next;
+            uint32_t done;
+        };
+
+        void workerThread();
+        // Called with the pool locked, returns false once all tasks of job are claimed.
+        bool claim(Job &job, uint32_t *index);
+        void finish(Job &job);
+
+        std::vector<std::thread> m_Workers;
+        std::deque<Job *> m_Jobs;
+        std::mutex m_Mutex;
+        std::condition_variable m_JobCV;
+        std::condition_variable m_DoneCV;
+        bool m_Exit { false };
+};
+
+}
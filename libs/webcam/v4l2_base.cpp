@@ -30,6 +30,7 @@
 // PWC framerate support
 #include "pwc-ioctl.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <sys/ioctl.h>
@@ -139,10 +140,16 @@ V4L2_Base::V4L2_Base()
     xmax = xmin = 160;
     ymax = ymin = 120;
 
-    io        = IO_METHOD_MMAP;
-    fd        = -1;
-    buffers   = nullptr;
-    n_buffers = 0;
+    io          = IO_METHOD_MMAP;
+    fd          = -1;
+    buffers     = nullptr;
+    n_buffers   = 0;
+    buffercount = 4;
+    heldbuffers = std::make_shared<HeldBuffers>();
+    CLEAR(directbuf);
+    directframes = false;
+    directlent   = false;
+    directheld   = false;
 
     callback = nullptr;
 
@@ -623,6 +630,20 @@ int V4L2_Base::read_frame(char * errmsg)
             /* TODO: there is probably a better error handling than asserting the buffer index */
             assert(buf.index < n_buffers);
 
+            if (directframes && callback && lxstate == LX_ACTIVE)
+            {
+                /* Lend the buffer to the callback instead of decoding it, it may keep it with holdDirectFrame() */
+                directbuf  = buf;
+                directlent = true;
+                directheld = false;
+                (*callback)(uptr);
+                directlent = false;
+
+                if (!directheld && -1 == XIOCTL(fd, VIDIOC_QBUF, &directbuf))
+                    return errno_exit("ReadFrame IO_METHOD_MMAP: VIDIOC_QBUF", errmsg);
+                break;
+            }
+
             if (dodecode)
             {
                 DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: [%p] decoding %d-byte buffer %p cropset %c",
@@ -755,6 +776,13 @@ int V4L2_Base::start_capturing(char * errmsg)
                 buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                 buf.memory = V4L2_MEMORY_MMAP;
                 buf.index  = i;
+
+                /* Buffers still held by a consumer are queued when it releases them */
+                {
+                    std::lock_guard<std::mutex> lock(heldbuffers->lock);
+                    if (i < heldbuffers->held.size() && heldbuffers->held[i])
+                        continue;
+                }
                 //DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG,"v4l2_start_capturing: enqueuing buffer %d for fd=%d\n", buf.index, fd);
                 /*if (-1 == XIOCTL(fd, VIDIOC_QBUF, &buf))
                 return errno_exit ("StartCapturing IO_METHOD_MMAP: VIDIOC_QBUF", errmsg);*/
@@ -815,10 +843,24 @@ int V4L2_Base::uninit_device(char * errmsg)
             break;
 
         case IO_METHOD_MMAP:
+        {
+            /* Give consumers some time to release the buffers they hold, the buffers are unmapped below */
+            if (!wait_held_buffers(2000))
+                DEBUGDEVICE(deviceName, INDI::Logger::DBG_WARNING,
+                            "Capture buffers still in use after 2 seconds, they will be unmapped once released");
+
+            std::vector<bool> held;
+            drop_held_buffers(held);
+
             for (unsigned int i = 0; i < n_buffers; ++i)
+            {
+                if (i < held.size() && held[i])
+                    continue;
                 if (-1 == munmap(buffers[i].start, buffers[i].length))
                     return errno_exit("munmap", errmsg);
+            }
             break;
+        }
 
         case IO_METHOD_USERPTR:
             for (unsigned int i = 0; i < n_buffers; ++i)
@@ -827,10 +869,111 @@ int V4L2_Base::uninit_device(char * errmsg)
     }
 
     free(buffers);
+    buffers   = nullptr;
+    n_buffers = 0;
+
+    return 0;
+}
+
+int V4L2_Base::setBufferCount(unsigned int count, char * errmsg)
+{
+    if (streamactive)
+    {
+        snprintf(errmsg, ERRMSGSIZ, "Cannot change the number of buffers while capturing\n");
+        return -1;
+    }
+
+    buffercount = count;
+
+    /* Buffers are allocated on the first capture, release them so they are allocated again with the new count */
+    if (streamedonce && io == IO_METHOD_MMAP)
+    {
+        if (uninit_device(errmsg) == -1)
+            return -1;
+        streamedonce = false;
+    }
 
     return 0;
 }
 
+const unsigned char * V4L2_Base::getDirectFrame(unsigned int * nbytes)
+{
+    if (!directlent)
+        return nullptr;
+
+    *nbytes = directbuf.bytesused;
+    return static_cast<const unsigned char *>(buffers[directbuf.index].start);
+}
+
+std::function<void()> V4L2_Base::holdDirectFrame()
+{
+    if (!directlent || directheld)
+        return nullptr;
+
+    std::shared_ptr<HeldBuffers> state = heldbuffers;
+    struct v4l2_buffer held = directbuf;
+    void * start  = buffers[held.index].start;
+    size_t length = buffers[held.index].length;
+    unsigned int generation;
+    {
+        std::lock_guard<std::mutex> lock(state->lock);
+        state->held[held.index] = true;
+        state->count++;
+        generation = state->generation;
+    }
+    directheld = true;
+
+    return [state, held, generation, start, length]() mutable
+    {
+        std::lock_guard<std::mutex> lock(state->lock);
+        if (generation != state->generation)
+        {
+            /* The device released its buffers while this one was held */
+            auto it = std::find(state->orphaned.begin(), state->orphaned.end(), start);
+            if (it != state->orphaned.end())
+            {
+                munmap(start, length);
+                state->orphaned.erase(it);
+            }
+            return;
+        }
+        if (!state->held[held.index])
+            return;
+
+        /* No logging here, this may run in any thread after the device is gone */
+        int r;
+        do
+            r = ioctl(state->fd, VIDIOC_QBUF, &held);
+        while (-1 == r && EINTR == errno);
+
+        state->held[held.index] = false;
+        state->count--;
+        state->released.notify_all();
+    };
+}
+
+bool V4L2_Base::wait_held_buffers(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(heldbuffers->lock);
+    return heldbuffers->released.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                          [this] { return heldbuffers->count == 0; });
+}
+
+void V4L2_Base::drop_held_buffers(std::vector<bool> &held)
+{
+    std::lock_guard<std::mutex> lock(heldbuffers->lock);
+    held = heldbuffers->held;
+    for (unsigned int i = 0; i < n_buffers && i < held.size(); ++i)
+    {
+        if (held[i])
+            heldbuffers->orphaned.push_back(buffers[i].start);
+    }
+    heldbuffers->generation++;
+    heldbuffers->held.clear();
+    heldbuffers->count = 0;
+    heldbuffers->fd    = -1;
+}
+
 void V4L2_Base::init_read(unsigned int buffer_size)
 {
     buffers = (buffer *)calloc(1, sizeof(*buffers));
@@ -857,7 +1000,7 @@ int V4L2_Base::init_mmap(char * errmsg)
 
     CLEAR(req);
 
-    req.count = 4;
+    req.count = buffercount;
     //req.count               = 1;
     req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
@@ -913,6 +1056,16 @@ int V4L2_Base::init_mmap(char * errmsg)
             return errno_exit("mmap", errmsg);
     }
 
+    DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: %d buffers mapped (%d requested)", __FUNCTION__, n_buffers,
+                 buffercount);
+
+    {
+        std::lock_guard<std::mutex> lock(heldbuffers->lock);
+        heldbuffers->fd = fd;
+        heldbuffers->held.assign(n_buffers, false);
+        heldbuffers->count = 0;
+    }
+
     return 0;
 }
 
@@ -36,6 +36,11 @@
 
 #include <stdio.h>
 #include <cstdlib>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <linux/videodev2.h>
 
@@ -103,6 +108,20 @@ class V4L2_Base
     int stop_capturing(char *errmsg);
     static void newFrame(int fd, void *p);
 
+    /* Capture buffers */
+    /* Number of mmap buffers requested from the device. Buffers already allocated are released, and allocated
+     * again with the new count on the next capture. Fails while capturing. */
+    int setBufferCount(unsigned int count, char *errmsg);
+    unsigned int getBufferCount() { return n_buffers > 0 ? n_buffers : buffercount; }
+
+    /* Direct frames: in mmap mode, frames are not decoded. The dequeued buffer is lent to the frame callback,
+     * which gets it with getDirectFrame(). The buffer is queued again when the callback returns, unless the callback
+     * calls holdDirectFrame() to keep it, in which case it is queued again when the returned function is called. */
+    void setDirectFrames(bool enabled) { directframes = enabled; }
+    bool isDirectFrames() { return directframes; }
+    const unsigned char *getDirectFrame(unsigned int *nbytes);
+    std::function<void()> holdDirectFrame();
+
     //void setDropFrameCount(unsigned int count) { dropFrameCount = count;}
     void enumerate_ctrl();
     void enumerate_menu();
@@ -196,7 +215,32 @@ class V4L2_Base
     int fd;
     struct buffer *buffers;
     unsigned int n_buffers;
+    unsigned int buffercount;
     bool reallocate_buffers;
+
+    /* Buffers held by consumers in direct mode. The state is shared with the release functions so they stay safe
+     * to call after the buffers are freed: the generation changes whenever the buffers are released or reallocated,
+     * and release functions of an older generation do nothing. */
+    struct HeldBuffers
+    {
+        std::mutex lock;
+        std::condition_variable released;
+        int fd = -1;
+        unsigned int generation = 0;
+        std::vector<bool> held;
+        unsigned int count = 0;
+        /* Mappings still held when the buffers were released, unmapped by their release function */
+        std::vector<void *> orphaned;
+    };
+    std::shared_ptr<HeldBuffers> heldbuffers;
+    struct v4l2_buffer directbuf;
+    bool directframes;
+    bool directlent;
+    bool directheld;
+
+    bool wait_held_buffers(int timeout_ms);
+    /* Start a new generation. Buffers still held are orphaned and flagged in held so they are not unmapped now */
+    void drop_held_buffers(std::vector<bool> &held);
     //int		dropFrame;
     //bool      dropFrameEnabled;
     //unsigned int      dropFrameCount;
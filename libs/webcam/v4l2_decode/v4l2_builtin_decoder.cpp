@@ -61,6 +61,7 @@
 
 //#include "indilogger.h"
 #include "ccvt.h"
+#include "ccvt_simd.h"
 #include "v4l2_colorspace.h"
 
 #include <cstring> // memcpy
@@ -453,18 +454,18 @@ void V4L2_Builtin_Decoder::decode(unsigned char *frame, struct v4l2_buffer *buf)
         break;
 
         case V4L2_PIX_FMT_SBGGR8:
-            bayer2rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
+            ccvt_simd_bayer8_rgb24(frame, rgb24_buffer, fmt.fmt.pix.width, fmt.fmt.pix.height, CCVT_BAYER_BGGR, 0);
             break;
 
         case V4L2_PIX_FMT_SRGGB8:
-            bayer_rggb_2rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
+            ccvt_simd_bayer8_rgb24(frame, rgb24_buffer, fmt.fmt.pix.width, fmt.fmt.pix.height, CCVT_BAYER_RGGB, 0);
             break;
 	case V4L2_PIX_FMT_SGRBG8:
-		bayer_grbg_to_rgb24(rgb24_buffer, frame, fmt.fmt.pix.width, fmt.fmt.pix.height);
+            ccvt_simd_bayer8_rgb24(frame, rgb24_buffer, fmt.fmt.pix.width, fmt.fmt.pix.height, CCVT_BAYER_GRBG, 0);
 		break;
         case V4L2_PIX_FMT_SBGGR16:
-            bayer16_2_rgb24((unsigned short *)rgb24_buffer, (unsigned short *)frame, fmt.fmt.pix.width,
-                            fmt.fmt.pix.height);
+            ccvt_simd_bayer16_rgb48((unsigned short *)frame, (unsigned short *)rgb24_buffer, fmt.fmt.pix.width,
+                                    fmt.fmt.pix.height, CCVT_BAYER_BGGR, 0);
             break;
 
         case V4L2_PIX_FMT_JPEG:
@@ -807,7 +808,7 @@ unsigned char *V4L2_Builtin_Decoder::getRGBBuffer()
         case V4L2_PIX_FMT_YVU420:
         case V4L2_PIX_FMT_NV12:
         case V4L2_PIX_FMT_NV21:
-            ccvt_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
+            ccvt_simd_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
             break;
         case V4L2_PIX_FMT_YUYV:
         case V4L2_PIX_FMT_UYVY:
@@ -816,7 +817,7 @@ unsigned char *V4L2_Builtin_Decoder::getRGBBuffer()
             //if (!colorBuffer) colorBuffer = new unsigned char[(bufwidth * bufheight) * 4];
             //ccvt_yuyv_bgr32(bufwidth, bufheight, yuyvBuffer, rgb24_buffer);
             //ccvt_bgr32_rgb24(bufwidth, bufheight, colorBuffer, (void*)rgb24_buffer);
-            ccvt_yuyv_rgb24(bufwidth, bufheight, yuyvBuffer, (void *)rgb24_buffer);
+            ccvt_simd_yuyv_rgb24(bufwidth, bufheight, yuyvBuffer, (void *)rgb24_buffer);
             break;
         case V4L2_PIX_FMT_RGB24:
         case V4L2_PIX_FMT_RGB555:
@@ -827,7 +828,7 @@ unsigned char *V4L2_Builtin_Decoder::getRGBBuffer()
         case V4L2_PIX_FMT_SBGGR16:
             break;
         default:
-            ccvt_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
+            ccvt_simd_420p_rgb24(bufwidth, bufheight, (void *)yuvBuffer, (void *)rgb24_buffer);
             break;
     }
     return rgb24_buffer;
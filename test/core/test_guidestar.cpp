@@ -0,0 +1,130 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "indiguidestar.h"
+
+// Render gaussian stars over a flat background with deterministic pseudo noise
+static std::vector<uint16_t> renderFrame(int width, int height, const std::vector<std::pair<double, double>> &stars,
+        double sigma = 1.5, double peak = 20000)
+{
+    std::vector<uint16_t> frame(width * height);
+    uint32_t seed = 12345;
+    for (auto &pixel : frame)
+    {
+        seed = seed * 1103515245 + 12345;
+        pixel = 1000 + (seed >> 16) % 50;
+    }
+
+    for (const auto &star : stars)
+    {
+        for (int y = std::max(0, int(star.second) - 10); y < std::min(height, int(star.second) + 10); y++)
+            for (int x = std::max(0, int(star.first) - 10); x < std::min(width, int(star.first) + 10); x++)
+            {
+                double r2 = (x - star.first) * (x - star.first) + (y - star.second) * (y - star.second);
+                frame[y * width + x] += static_cast<uint16_t>(peak * std::exp(-r2 / (2 * sigma * sigma)));
+            }
+    }
+
+    return frame;
+}
+
+TEST(CORE_GUIDESTAR, Test_FindSubPixel)
+{
+    const int width = 320, height = 240;
+    auto frame = renderFrame(width, height, { { 123.3, 87.6 } });
+
+    INDI::GuideStarFinder finder;
+    INDI::GuideStar star = finder.find(reinterpret_cast<uint8_t *>(frame.data()), width, height, 16);
+
+    ASSERT_TRUE(star.valid);
+    EXPECT_NEAR(123.3, star.x, 0.1);
+    EXPECT_NEAR(87.6, star.y, 0.1);
+    EXPECT_GT(star.fit, 1000);
+}
+
+TEST(CORE_GUIDESTAR, Test_FindWithHint)
+{
+    const int width = 320, height = 240;
+    // Brighter star outside the search window must be ignored
+    auto frame = renderFrame(width, height, { { 40.0, 40.0 }, { 200.7, 150.2 } });
+    frame[40 * width + 40] = 60000;
+
+    INDI::GuideStarFinder finder;
+    finder.setSearchRadius(20);
+    INDI::GuideStar star = finder.find(reinterpret_cast<uint8_t *>(frame.data()), width, height, 16, 195, 155);
+
+    ASSERT_TRUE(star.valid);
+    EXPECT_NEAR(200.7, star.x, 0.1);
+    EXPECT_NEAR(150.2, star.y, 0.1);
+}
+
+TEST(CORE_GUIDESTAR, Test_NoStar)
+{
+    const int width = 64, height = 64;
+    auto frame = renderFrame(width, height, {});
+
+    INDI::GuideStarFinder finder;
+    INDI::GuideStar star = finder.find(reinterpret_cast<uint8_t *>(frame.data()), width, height, 16);
+    EXPECT_FALSE(star.valid);
+}
+
+TEST(CORE_GUIDESTAR, Test_Find8Bit)
+{
+    const int width = 128, height = 96;
+    std::vector<uint8_t> frame(width * height, 20);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            double r2 = (x - 60.4) * (x - 60.4) + (y - 30.8) * (y - 30.8);
+            frame[y * width + x] += static_cast<uint8_t>(200 * std::exp(-r2 / (2 * 1.5 * 1.5)));
+        }
+
+    INDI::GuideStarFinder finder;
+    INDI::GuideStar star = finder.find(frame.data(), width, height, 8);
+    ASSERT_TRUE(star.valid);
+    EXPECT_NEAR(60.4, star.x, 0.15);
+    EXPECT_NEAR(30.8, star.y, 0.15);
+}
+
+TEST(CORE_GUIDESTAR, Test_TrackMultipleStars)
+{
+    const int width = 320, height = 240;
+    std::vector<std::pair<double, double>> stars = { { 50.2, 60.1 }, { 150.5, 100.4 }, { 250.8, 180.3 } };
+
+    INDI::GuideStarFinder finder;
+    auto frame = renderFrame(width, height, stars);
+    const auto &tracked = finder.track(reinterpret_cast<uint8_t *>(frame.data()), width, height, 16, 5);
+    ASSERT_EQ(3u, tracked.size());
+
+    for (auto &star : stars)
+    {
+        star.first += 2.25;
+        star.second -= 1.5;
+    }
+    frame = renderFrame(width, height, stars);
+    finder.track(reinterpret_cast<uint8_t *>(frame.data()), width, height, 16);
+
+    double dx = 0, dy = 0;
+    ASSERT_TRUE(finder.getOffset(dx, dy));
+    EXPECT_NEAR(2.25, dx, 0.05);
+    EXPECT_NEAR(-1.5, dy, 0.05);
+}
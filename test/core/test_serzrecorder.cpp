@@ -0,0 +1,166 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "stream/recorder/serzrecorder.h"
+
+// Offset of the DateTime fields in the SER header, which differ between two recordings
+#define SER_DATETIME_OFFSET 162
+
+// Noisy gradient frames, with a different pattern per frame so that the delta filter sees real changes
+static std::vector<std::vector<uint8_t>> makeFrames(uint16_t width, uint16_t height, uint8_t depth, uint8_t planes,
+        int count)
+{
+    std::vector<std::vector<uint8_t>> frames;
+    uint32_t seed = 4242;
+    size_t samples = static_cast<size_t>(width) * height * planes;
+    for (int i = 0; i < count; i++)
+    {
+        std::vector<uint8_t> frame(samples * (depth > 8 ? 2 : 1));
+        for (size_t s = 0; s < samples; s++)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint32_t value = (s % width) * 37 + (s / width) * 11 + i * 101 + ((seed >> 16) % 23);
+            if (depth > 8)
+            {
+                uint16_t v = value & ((1 << depth) - 1);
+                memcpy(&frame[s * 2], &v, 2);
+            }
+            else
+                frame[s] = value & 0xFF;
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+static std::vector<uint8_t> readFile(const std::string &filename)
+{
+    std::vector<uint8_t> data;
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == nullptr)
+        return data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    fclose(file);
+    return data;
+}
+
+template <class Recorder> static void record(Recorder &recorder, const std::string &filename, INDI_PIXEL_FORMAT format,
+        uint8_t depth, uint16_t width, uint16_t height, const std::vector<std::vector<uint8_t>> &frames)
+{
+    char errmsg[1024] = {0};
+    ASSERT_TRUE(recorder.setPixelFormat(format, depth));
+    ASSERT_TRUE(recorder.setSize(width, height));
+    ASSERT_TRUE(recorder.open(filename.c_str(), errmsg)) << errmsg;
+    for (const auto &frame : frames)
+        ASSERT_TRUE(recorder.writeFrame(frame.data(), frame.size()));
+    ASSERT_TRUE(recorder.close());
+}
+
+// Record the frames compressed and uncompressed, read the compressed ones back and compare the converted file
+static void roundTrip(INDI_PIXEL_FORMAT format, uint8_t depth, uint8_t planes)
+{
+    const uint16_t width = 97, height = 61;
+    const int count = 5;
+    auto frames = makeFrames(width, height, depth, planes, count);
+
+    char pattern[] = "/tmp/test_serz_XXXXXX";
+    ASSERT_NE(mkdtemp(pattern), nullptr);
+    std::string dir = pattern;
+    std::string serzFile = dir + "/frames.serz", serFile = dir + "/frames.ser", convertedFile = dir + "/converted.ser";
+
+    INDI::SERZ_Recorder serz;
+    serz.setThreads(2);
+    record(serz, serzFile, format, depth, width, height, frames);
+    INDI::SER_Recorder ser;
+    record(ser, serFile, format, depth, width, height, frames);
+
+    char errmsg[1024] = {0};
+    INDI::SERZ_Reader reader;
+    ASSERT_TRUE(reader.open(serzFile.c_str(), errmsg)) << errmsg;
+    ASSERT_EQ(reader.getFrameCount(), static_cast<uint32_t>(count));
+    ASSERT_EQ(reader.getFrameSize(), frames[0].size());
+    std::vector<uint8_t> frame(reader.getFrameSize());
+    // Out of order, through the index
+    for (int i = count - 1; i >= 0; i--)
+    {
+        ASSERT_TRUE(reader.readFrame(i, frame.data()));
+        EXPECT_EQ(frame, frames[i]) << "frame " << i;
+    }
+    reader.close();
+
+    ASSERT_TRUE(INDI::SERZ_Reader::convertToSER(serzFile.c_str(), convertedFile.c_str(), errmsg)) << errmsg;
+
+    // Same header apart from the recording time, same frames, one timestamp per frame
+    auto expected = readFile(serFile), converted = readFile(convertedFile);
+    ASSERT_EQ(converted.size(), expected.size());
+    ASSERT_GE(converted.size(), static_cast<size_t>(SER_HEADER_SIZE));
+    EXPECT_TRUE(std::equal(expected.begin(), expected.begin() + SER_DATETIME_OFFSET, converted.begin()));
+    size_t data = static_cast<size_t>(count) * frames[0].size();
+    EXPECT_TRUE(std::equal(expected.begin() + SER_HEADER_SIZE, expected.begin() + SER_HEADER_SIZE + data,
+                           converted.begin() + SER_HEADER_SIZE));
+
+    unlink(serzFile.c_str());
+    unlink(serFile.c_str());
+    unlink(convertedFile.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(CORE_SERZ, Test_Mono8)
+{
+    roundTrip(INDI_MONO, 8, 1);
+}
+
+TEST(CORE_SERZ, Test_Mono16)
+{
+    roundTrip(INDI_MONO, 16, 1);
+}
+
+TEST(CORE_SERZ, Test_RGB8)
+{
+    roundTrip(INDI_RGB, 8, 3);
+}
+
+TEST(CORE_SERZ, Test_RGB16)
+{
+    roundTrip(INDI_RGB, 16, 3);
+}
+
+TEST(CORE_SERZ, Test_FilterSymmetry)
+{
+    // Odd lengths and strides leave partial samples and colors at the end of the frame
+    for (uint8_t bytesPerSample : { 1, 2 })
+        for (uint32_t stride : { 1, 3, 4 })
+        {
+            std::vector<uint8_t> raw(1001 * bytesPerSample), filtered(raw.size()), restored(raw.size());
+            for (size_t i = 0; i < raw.size(); i++)
+                raw[i] = (i * 131 + (i >> 3)) & 0xFF;
+            uint32_t flags = INDI::SERZ_Recorder::filter(raw.data(), filtered.data(), raw.size(), bytesPerSample, stride);
+            INDI::SERZ_Recorder::unfilter(filtered.data(), restored.data(), raw.size(), bytesPerSample, stride, flags);
+            EXPECT_EQ(restored, raw) << "bytes per sample " << int(bytesPerSample) << ", stride " << stride;
+        }
+}
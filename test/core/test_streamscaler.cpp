@@ -0,0 +1,180 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA  02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "stream/streamscaler.h"
+#include "stream/streamstretch.h"
+
+using INDI::StreamScaler;
+using INDI::StreamStretch;
+
+static std::vector<uint8_t> makeFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth)
+{
+    uint32_t samples = width * height * components;
+    std::vector<uint8_t> frame(samples * (depth > 8 ? 2 : 1));
+    uint32_t seed = 777;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (depth > 8)
+        {
+            uint16_t value = seed >> 16;
+            memcpy(&frame[i * 2], &value, 2);
+        }
+        else
+            frame[i] = seed >> 24;
+    }
+    return frame;
+}
+
+// Straightforward crop and bin, one output sample at a time. Samples of the same Bayer color are two pixels apart.
+static std::vector<uint8_t> reference(const std::vector<uint8_t> &frame, uint32_t width, uint8_t components,
+                                      uint8_t depth, bool bayer, uint32_t x, uint32_t y, uint32_t scale,
+                                      uint32_t outWidth, uint32_t outHeight)
+{
+    std::vector<uint8_t> out(outWidth * outHeight * components);
+    const uint16_t *frame16 = reinterpret_cast<const uint16_t *>(frame.data());
+    for (uint32_t oy = 0; oy < outHeight; oy++)
+        for (uint32_t ox = 0; ox < outWidth; ox++)
+            for (uint32_t c = 0; c < components; c++)
+            {
+                uint32_t sum = 0;
+                for (uint32_t j = 0; j < scale; j++)
+                    for (uint32_t i = 0; i < scale; i++)
+                    {
+                        uint32_t sx, sy;
+                        if (bayer && scale > 1)
+                        {
+                            sx = x + (ox / 2) * 2 * scale + ox % 2 + 2 * i;
+                            sy = y + (oy / 2) * 2 * scale + oy % 2 + 2 * j;
+                        }
+                        else
+                        {
+                            sx = x + ox * scale + i;
+                            sy = y + oy * scale + j;
+                        }
+                        uint32_t index = (sy * width + sx) * components + c;
+                        sum += (depth > 8) ? frame16[index] : frame[index];
+                    }
+                uint32_t average = (sum + scale * scale / 2) / (scale * scale);
+                // Linear stretch keeps the 8 most significant bits
+                out[(oy * outWidth + ox) * components + c] = (depth > 8) ? average >> 8 : average;
+            }
+    return out;
+}
+
+static void check(uint32_t width, uint32_t height, uint8_t components, uint8_t depth, bool bayer,
+                  uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t scale)
+{
+    auto frame = makeFrame(width, height, components, depth);
+
+    StreamStretch stretch;
+    stretch.setMode(StreamStretch::STRETCH_LINEAR);
+    StreamScaler scaler;
+    scaler.setFrame(width, height, components, depth, bayer);
+
+    uint32_t outWidth = 0, outHeight = 0;
+    const uint8_t *output = scaler.process(frame.data(), x, y, w, h, scale, stretch, &outWidth, &outHeight);
+    ASSERT_NE(output, nullptr);
+
+    // Bayer frames are cropped on even coordinates and binned by whole color cells
+    if (bayer)
+    {
+        x &= ~1u;
+        y &= ~1u;
+    }
+    uint32_t expectedWidth = w / scale, expectedHeight = h / scale;
+    if (bayer && scale > 1)
+    {
+        expectedWidth  = (w / (2 * scale)) * 2;
+        expectedHeight = (h / (2 * scale)) * 2;
+    }
+    ASSERT_EQ(outWidth, expectedWidth);
+    ASSERT_EQ(outHeight, expectedHeight);
+
+    auto expected = reference(frame, width, components, depth, bayer, x, y, scale, outWidth, outHeight);
+    EXPECT_EQ(std::vector<uint8_t>(output, output + expected.size()), expected);
+}
+
+TEST(CORE_STREAM_SCALER, Test_Bin2x2)
+{
+    // Odd width so the scalar tail after the SIMD blocks is covered
+    const uint32_t outWidth = 53;
+    std::vector<uint8_t> row0(2 * outWidth), row1(2 * outWidth), dst(outWidth);
+    for (uint32_t i = 0; i < 2 * outWidth; i++)
+    {
+        row0[i] = (i * 97) & 0xFF;
+        row1[i] = 255 - ((i * 31) & 0xFF);
+    }
+    StreamScaler::bin2x2(row0.data(), row1.data(), dst.data(), outWidth);
+    for (uint32_t i = 0; i < outWidth; i++)
+        ASSERT_EQ(dst[i], (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) / 4) << "pixel " << i;
+}
+
+TEST(CORE_STREAM_SCALER, Test_Mono8)
+{
+    check(203, 151, 1, 8, false, 0, 0, 203, 151, 1);
+    check(203, 151, 1, 8, false, 7, 3, 150, 101, 1);
+    check(203, 151, 1, 8, false, 7, 3, 150, 101, 2);
+    check(203, 151, 1, 8, false, 5, 9, 190, 140, 4);
+    check(203, 151, 1, 8, false, 0, 0, 203, 151, 8);
+}
+
+TEST(CORE_STREAM_SCALER, Test_Mono16)
+{
+    check(203, 151, 1, 16, false, 7, 3, 150, 101, 1);
+    check(203, 151, 1, 16, false, 7, 3, 150, 101, 2);
+    check(203, 151, 1, 16, false, 5, 9, 190, 140, 4);
+}
+
+TEST(CORE_STREAM_SCALER, Test_RGB)
+{
+    check(131, 97, 3, 8, false, 3, 1, 120, 90, 1);
+    check(131, 97, 3, 8, false, 3, 1, 120, 90, 2);
+    check(131, 97, 3, 16, false, 3, 1, 120, 90, 4);
+}
+
+TEST(CORE_STREAM_SCALER, Test_Bayer)
+{
+    // Odd origins are rounded down to keep the color pattern
+    check(202, 150, 1, 8, true, 7, 3, 150, 101, 1);
+    check(202, 150, 1, 8, true, 7, 3, 150, 101, 2);
+    check(202, 150, 1, 16, true, 4, 2, 190, 140, 4);
+}
+
+TEST(CORE_STREAM_SCALER, Test_Threads)
+{
+    // Large enough to be split over the stream thread pool
+    check(2048, 1536, 1, 8, false, 16, 8, 2000, 1500, 2);
+    check(2048, 1536, 1, 16, true, 16, 8, 2000, 1500, 4);
+}
+
+TEST(CORE_STREAM_SCALER, Test_Empty)
+{
+    auto frame = makeFrame(64, 64, 1, 8);
+    StreamStretch stretch;
+    StreamScaler scaler;
+    scaler.setFrame(64, 64, 1, 8, false);
+    uint32_t outWidth = 0, outHeight = 0;
+    // Region outside the frame, or smaller than one bin
+    EXPECT_EQ(scaler.process(frame.data(), 64, 0, 10, 10, 1, stretch, &outWidth, &outHeight), nullptr);
+    EXPECT_EQ(scaler.process(frame.data(), 0, 0, 3, 3, 4, stretch, &outWidth, &outHeight), nullptr);
+}
@@ -0,0 +1,215 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA  02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "stream/streamstacker.h"
+
+using INDI::StreamStacker;
+
+static std::vector<uint8_t> makeFrame(uint32_t width, uint32_t height, uint8_t components, uint8_t depth)
+{
+    uint32_t samples = width * height * components;
+    std::vector<uint8_t> frame(samples * (depth > 8 ? 2 : 1));
+    uint32_t seed = 99;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (depth > 8)
+        {
+            uint16_t value = seed >> 16;
+            memcpy(&frame[i * 2], &value, 2);
+        }
+        else
+            frame[i] = seed >> 24;
+    }
+    return frame;
+}
+
+// A few gaussian stars on a dark background, centered on (cx, cy) plus fixed offsets
+static std::vector<uint8_t> makeStars(uint32_t width, uint32_t height, double cx, double cy)
+{
+    const double stars[][3] = { { 0, 0, 200 }, { -40, 25, 120 }, { 35, -30, 160 }, { 20, 40, 90 }, { -25, -35, 140 } };
+    std::vector<uint8_t> frame(width * height);
+    for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+        {
+            double value = 10;
+            for (const auto &star : stars)
+            {
+                double dx = x - cx - star[0], dy = y - cy - star[1];
+                value += star[2] * std::exp(-(dx * dx + dy * dy) / 8.0);
+            }
+            frame[y * width + x] = static_cast<uint8_t>(std::min(255.0, value));
+        }
+    return frame;
+}
+
+static void stackIdentical(StreamStacker::Mode mode, uint32_t width, uint32_t height, uint8_t components,
+                           uint8_t depth)
+{
+    const uint32_t count = 12;
+    auto frame = makeFrame(width, height, components, depth);
+
+    StreamStacker stacker;
+    stacker.setMode(mode);
+    stacker.setFrame(width, height, components, depth, false);
+    for (uint32_t i = 0; i < count; i++)
+        ASSERT_TRUE(stacker.addFrame(frame.data(), frame.size()));
+
+    EXPECT_EQ(stacker.getFrameCount(), count);
+    EXPECT_EQ(stacker.getRejectedRatio(), 0);
+
+    uint32_t nbytes = 0;
+    const uint8_t *preview = stacker.getPreview(&nbytes);
+    ASSERT_NE(preview, nullptr);
+    ASSERT_EQ(nbytes, frame.size());
+    EXPECT_EQ(std::vector<uint8_t>(preview, preview + nbytes), frame) << "mode " << mode;
+}
+
+TEST(CORE_STREAM_STACKER, Test_Identical)
+{
+    // Stacking copies of one frame gives the same frame back, in every mode and format
+    for (StreamStacker::Mode mode : { StreamStacker::STACK_MEAN, StreamStacker::STACK_SIGMA_CLIP, StreamStacker::STACK_MAX })
+    {
+        stackIdentical(mode, 101, 67, 1, 8);
+        stackIdentical(mode, 101, 67, 1, 16);
+        stackIdentical(mode, 101, 67, 3, 8);
+        // Large enough to be split over the stream thread pool
+        stackIdentical(mode, 1024, 768, 1, 16);
+    }
+}
+
+TEST(CORE_STREAM_STACKER, Test_SigmaClip)
+{
+    const uint32_t width = 64, height = 48;
+    auto frame = makeFrame(width, height, 1, 8);
+
+    StreamStacker stacker;
+    stacker.setMode(StreamStacker::STACK_SIGMA_CLIP);
+    stacker.setKappa(3);
+    stacker.setFrame(width, height, 1, 8, false);
+    for (int i = 0; i < 10; i++)
+        ASSERT_TRUE(stacker.addFrame(frame.data(), frame.size()));
+
+    // A satellite trail across one row is rejected, small noise is kept
+    auto trail = frame;
+    for (uint32_t x = 0; x < width; x++)
+        trail[20 * width + x] = (frame[20 * width + x] < 128) ? 255 : 0;
+    trail[5] = frame[5] < 255 ? frame[5] + 1 : frame[5] - 1;
+    ASSERT_TRUE(stacker.addFrame(trail.data(), trail.size()));
+    EXPECT_DOUBLE_EQ(stacker.getRejectedRatio(), static_cast<double>(width) / (width * height));
+
+    uint32_t nbytes = 0;
+    const uint8_t *preview = stacker.getPreview(&nbytes);
+    ASSERT_NE(preview, nullptr);
+    for (uint32_t x = 0; x < width; x++)
+        ASSERT_EQ(preview[20 * width + x], frame[20 * width + x]) << "column " << x;
+
+    // The mean mode keeps everything
+    StreamStacker mean;
+    mean.setFrame(width, height, 1, 8, false);
+    for (int i = 0; i < 10; i++)
+        mean.addFrame(frame.data(), frame.size());
+    mean.addFrame(trail.data(), trail.size());
+    preview = mean.getPreview(&nbytes);
+    bool changed = false;
+    for (uint32_t x = 0; x < width; x++)
+        changed |= preview[20 * width + x] != frame[20 * width + x];
+    EXPECT_TRUE(changed);
+}
+
+TEST(CORE_STREAM_STACKER, Test_Registration)
+{
+    const uint32_t width = 160, height = 120;
+    const double cx = 80, cy = 60;
+    auto reference = makeStars(width, height, cx, cy);
+
+    StreamStacker stacker;
+    stacker.setAlignment(true, 16);
+    stacker.setFrame(width, height, 1, 8, false);
+    ASSERT_TRUE(stacker.addFrame(reference.data(), reference.size()));
+
+    // Sample (x, y) of the stack comes from (x + dx, y + dy) of the frame
+    const int shifts[][2] = { { 3, -2 }, { -7, 5 }, { 0, 11 } };
+    for (const auto &shift : shifts)
+    {
+        auto frame = makeStars(width, height, cx + shift[0], cy + shift[1]);
+        ASSERT_TRUE(stacker.addFrame(frame.data(), frame.size()));
+        int dx = 0, dy = 0;
+        stacker.getShift(&dx, &dy);
+        EXPECT_EQ(dx, shift[0]);
+        EXPECT_EQ(dy, shift[1]);
+    }
+
+    // Registered frames land on the reference, so the stack is the reference itself
+    uint32_t nbytes = 0;
+    const uint8_t *preview = stacker.getPreview(&nbytes);
+    ASSERT_NE(preview, nullptr);
+    EXPECT_EQ(std::vector<uint8_t>(preview, preview + nbytes), reference);
+
+    // Shifts beyond the search range are skipped
+    auto far = makeStars(width, height, cx + 30, cy);
+    EXPECT_FALSE(stacker.addFrame(far.data(), far.size()));
+    EXPECT_EQ(stacker.getSkippedCount(), 1u);
+    EXPECT_EQ(stacker.getFrameCount(), 4u);
+}
+
+TEST(CORE_STREAM_STACKER, Test_Dark)
+{
+    const uint32_t width = 64, height = 48;
+    auto frame = makeFrame(width, height, 1, 16);
+    std::vector<uint8_t> dark(frame.size());
+    for (uint32_t i = 0; i < width * height; i++)
+    {
+        uint16_t value = 100 + i % 7;
+        memcpy(&dark[i * 2], &value, 2);
+    }
+    // Frame plus dark, so subtracting the master dark gives the frame back
+    std::vector<uint8_t> light(frame.size());
+    for (uint32_t i = 0; i < width * height; i++)
+    {
+        uint16_t a, b;
+        memcpy(&a, &frame[i * 2], 2);
+        memcpy(&b, &dark[i * 2], 2);
+        a = std::min(65535 - b, static_cast<int>(a));
+        memcpy(&frame[i * 2], &a, 2);
+        uint16_t sum = a + b;
+        memcpy(&light[i * 2], &sum, 2);
+    }
+
+    StreamStacker stacker;
+    stacker.setFrame(width, height, 1, 16, false);
+    stacker.setDarkMode(StreamStacker::DARK_TAKE);
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(stacker.addFrame(dark.data(), dark.size()));
+    EXPECT_EQ(stacker.getDarkFrameCount(), 4u);
+    EXPECT_EQ(stacker.getFrameCount(), 0u);
+
+    stacker.setDarkMode(StreamStacker::DARK_SUBTRACT);
+    for (int i = 0; i < 3; i++)
+        ASSERT_TRUE(stacker.addFrame(light.data(), light.size()));
+
+    uint32_t nbytes = 0;
+    const uint8_t *preview = stacker.getPreview(&nbytes);
+    ASSERT_NE(preview, nullptr);
+    EXPECT_EQ(std::vector<uint8_t>(preview, preview + nbytes), frame);
+}
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ Copyright(c) 2019 Jasem Mutlaq. All rights reserved.
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA  02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "stream/streamstretch.h"
+
+using INDI::StreamStretch;
+
+// Odd length so the scalar tail after the SIMD blocks is covered
+#define PIXELS 1037
+
+static std::vector<uint16_t> makePixels(uint32_t count)
+{
+    std::vector<uint16_t> pixels(count);
+    uint32_t seed = 1234;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        pixels[i] = seed >> 16;
+    }
+    // Extremes
+    pixels[0] = 0;
+    pixels[1] = 65535;
+    return pixels;
+}
+
+TEST(CORE_STREAM_STRETCH, Test_Shift)
+{
+    auto src = makePixels(PIXELS);
+    std::vector<uint8_t> dst(PIXELS);
+    StreamStretch::shift(src.data(), dst.data(), PIXELS);
+    for (uint32_t i = 0; i < PIXELS; i++)
+        ASSERT_EQ(dst[i], src[i] >> 8) << "pixel " << i;
+}
+
+TEST(CORE_STREAM_STRETCH, Test_Stretch)
+{
+    auto src = makePixels(PIXELS);
+    std::vector<uint8_t> dst(PIXELS);
+
+    // Wide, narrow and single value ranges, the narrow ones take the pre-shift path
+    const uint16_t levels[][2] = { { 0, 65535 }, { 1000, 60000 }, { 30000, 30100 }, { 500, 501 }, { 65534, 65535 } };
+    for (const auto &level : levels)
+    {
+        uint16_t black = level[0], white = level[1];
+        StreamStretch::stretch(src.data(), dst.data(), PIXELS, black, white);
+        for (uint32_t i = 0; i < PIXELS; i++)
+        {
+            double value = std::min(std::max(0, src[i] - black), white - black);
+            double expected = value * 255.0 / (white - black);
+            ASSERT_NEAR(dst[i], expected, 1.0) << "pixel " << i << " black " << black << " white " << white;
+        }
+        // Levels map to the ends of the range
+        uint16_t ends[2] = { black, white };
+        uint8_t out[2];
+        StreamStretch::stretch(ends, out, 2, black, white);
+        EXPECT_EQ(out[0], 0);
+        EXPECT_EQ(out[1], 255);
+    }
+}
+
+TEST(CORE_STREAM_STRETCH, Test_Lookup)
+{
+    auto src = makePixels(PIXELS);
+    std::vector<uint8_t> lut(65536), dst(PIXELS);
+    for (uint32_t i = 0; i < lut.size(); i++)
+        lut[i] = static_cast<uint8_t>(std::sqrt(i / 65535.0) * 255);
+    StreamStretch::lookup(src.data(), dst.data(), PIXELS, lut.data());
+    for (uint32_t i = 0; i < PIXELS; i++)
+        ASSERT_EQ(dst[i], lut[src[i]]) << "pixel " << i;
+}
+
+TEST(CORE_STREAM_STRETCH, Test_Convert)
+{
+    // Large enough to be split over several threads, which must match a single row conversion
+    const uint32_t count = 3 * 1024 * 1024 + 5;
+    auto src = makePixels(count);
+    std::vector<uint8_t> threaded(count), single(count);
+
+    for (StreamStretch::Mode mode : { StreamStretch::STRETCH_LINEAR, StreamStretch::STRETCH_AUTO })
+    {
+        StreamStretch stretch;
+        stretch.setMode(mode);
+        stretch.setThreads(4);
+        stretch.convert(src.data(), threaded.data(), count);
+        stretch.convertRow(src.data(), single.data(), count);
+        EXPECT_EQ(threaded, single) << "mode " << mode;
+    }
+}
+
+TEST(CORE_STREAM_STRETCH, Test_AutoLevels)
+{
+    // Uniform ramp, the percentiles fall at known values
+    std::vector<uint16_t> src(10000);
+    for (uint32_t i = 0; i < src.size(); i++)
+        src[i] = 20000 + i;
+    std::vector<uint8_t> dst(src.size());
+
+    StreamStretch stretch;
+    stretch.setMode(StreamStretch::STRETCH_AUTO);
+    stretch.setPercentiles(1, 99);
+    stretch.convert(src.data(), dst.data(), src.size());
+
+    uint16_t black = 0, white = 0;
+    stretch.getLevels(&black, &white);
+    EXPECT_NEAR(black, 20100, 1);
+    EXPECT_NEAR(white, 29899, 1);
+    EXPECT_EQ(dst.front(), 0);
+    EXPECT_EQ(dst.back(), 255);
+
+    // Gamma without a table falls back to the linear conversion
+    stretch.setMode(StreamStretch::STRETCH_GAMMA);
+    stretch.convert(src.data(), dst.data(), src.size());
+    for (uint32_t i = 0; i < src.size(); i++)
+        ASSERT_EQ(dst[i], src[i] >> 8);
+}
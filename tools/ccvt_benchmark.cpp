@@ -0,0 +1,182 @@
+/* compare the speed of the vectorized color conversion and debayering kernels
+ *   with the original ccvt routines on 1080p and 4K frames, and check that
+ *   they produce the same pixels.
+ * exit status: 0 all outputs match, 1 bad usage, 2 some output differs.
+ */
+
+#include "ccvt.h"
+#include "ccvt_simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+static char *me; /* our name for usage() message */
+static int iterations = 20;
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-t threads]\n", me);
+    fprintf(stderr, "Purpose: benchmark the color conversion kernels on 1080p and 4K frames.\n");
+    fprintf(stderr, "-t sets the maximum number of threads of the vectorized kernels, 0 for the number of cores.\n");
+    exit(1);
+}
+
+/* average time of one call in milliseconds */
+static double timeit(const std::function<void()> &function)
+{
+    function();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        function();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+/* compare two frames of samples per pixel, ignoring a border of the given width */
+template <typename T>
+static bool same(const std::vector<T> &a, const std::vector<T> &b, int width, int height, int samples, int border,
+                 int skip = 0)
+{
+    for (int y = border; y < height - border; y++)
+        for (int x = border; x < width - border; x++)
+            for (int c = 0; c < samples - skip; c++)
+            {
+                size_t i = (static_cast<size_t>(y) * width + x) * samples + c;
+                if (a[i] != b[i])
+                {
+                    fprintf(stderr, "%s: mismatch at %d,%d channel %d: %d != %d\n", me, x, y, c, a[i], b[i]);
+                    return false;
+                }
+            }
+    return true;
+}
+
+/* time the reference then the kernel on every instruction set available */
+static bool run(const char *name, const std::function<void()> &reference, const std::function<void()> &kernel,
+                const std::function<bool()> &check)
+{
+    bool ok = true;
+    double base = reference ? timeit(reference) : 0;
+
+    printf("%-24s", name);
+    if (reference)
+        printf(" %9.2f", base);
+    else
+        printf(" %9s", "-");
+
+    for (int backend = CCVT_SIMD_SCALAR; backend <= CCVT_SIMD_AVX2; backend++)
+    {
+        if (ccvt_simd_set_backend(backend) != backend)
+        {
+            printf(" %9s", "-");
+            continue;
+        }
+        double ms = timeit(kernel);
+        if (reference)
+            printf(" %6.2f/%-4.1f", ms, base / ms);
+        else
+            printf(" %9.2f", ms);
+        if (check && check() == false)
+            ok = false;
+    }
+    printf("\n");
+    ccvt_simd_set_backend(CCVT_SIMD_AUTO);
+    return ok;
+}
+
+static bool benchmark(int width, int height)
+{
+    size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> yuyv(pixels * 2), yuv420(pixels * 3 / 2), bayer8(pixels);
+    std::vector<uint16_t> bayer16(pixels);
+    std::vector<uint8_t> reference(pixels * 4), output(pixels * 4);
+    std::vector<uint16_t> reference16(pixels * 3), output16(pixels * 3);
+    bool ok = true;
+
+    /* a gradient with noise, so the chroma offsets cover their whole range */
+    srand(42);
+    for (size_t i = 0; i < pixels; i++)
+    {
+        int x = i % width, y = i / width;
+        bayer8[i]  = (x * 255 / width + rand() % 32) & 0xFF;
+        bayer16[i] = (y * 65535 / height + rand() % 4096) & 0xFFFF;
+    }
+    for (auto &value : yuyv)
+        value = rand() & 0xFF;
+    for (auto &value : yuv420)
+        value = rand() & 0xFF;
+
+    printf("\n%dx%d, %d iterations, ms per frame and speedup over ccvt\n", width, height, iterations);
+    printf("%-24s %9s %11s %11s %11s\n", "", "ccvt", "C", "SSE4.1", "AVX2");
+
+    ok &= run("YUYV -> RGB24", [&]() { ccvt_yuyv_rgb24(width, height, yuyv.data(), reference.data()); },
+              [&]() { ccvt_simd_yuyv_rgb24(width, height, yuyv.data(), output.data()); },
+              [&]() { return same(reference, output, width, height, 3, 0); });
+    ok &= run("YUYV -> BGR32", [&]() { ccvt_yuyv_bgr32(width, height, yuyv.data(), reference.data()); },
+              [&]() { ccvt_simd_yuyv_bgr32(width, height, yuyv.data(), output.data()); },
+              [&]() { return same(reference, output, width, height, 4, 0, 1); });
+    ok &= run("I420 -> RGB24", [&]() { ccvt_420p_rgb24(width, height, yuv420.data(), reference.data()); },
+              [&]() { ccvt_simd_420p_rgb24(width, height, yuv420.data(), output.data()); },
+              [&]() { return same(reference, output, width, height, 3, 0); });
+    ok &= run("I420 -> BGR32", [&]() { ccvt_420p_bgr32(width, height, yuv420.data(), reference.data()); },
+              [&]() { ccvt_simd_420p_bgr32(width, height, yuv420.data(), output.data()); },
+              [&]() { return same(reference, output, width, height, 4, 0, 1); });
+
+    /* NV12 has no ccvt routine, check all instruction sets against the C kernel */
+    std::vector<uint8_t> nv12(yuv420.size());
+    ccvt_simd_set_backend(CCVT_SIMD_SCALAR);
+    ccvt_simd_nv12_rgb24(width, height, yuv420.data(), reference.data(), 0);
+    ok &= run("NV12 -> RGB24", nullptr, [&]() { ccvt_simd_nv12_rgb24(width, height, yuv420.data(), output.data(), 0); },
+              [&]() { return same(reference, output, width, height, 3, 0); });
+
+    /* the ccvt bayer routines handle the outer pixels differently */
+    ok &= run("Bayer8 -> RGB24", [&]() { bayer2rgb24(reference.data(), bayer8.data(), width, height); },
+              [&]() { ccvt_simd_bayer8_rgb24(bayer8.data(), output.data(), width, height, CCVT_BAYER_BGGR, 0); },
+              [&]() { return same(reference, output, width, height, 3, 1); });
+    ok &= run("Bayer16 -> RGB48", [&]() { bayer16_2_rgb24(reference16.data(), bayer16.data(), width, height); },
+              [&]() { ccvt_simd_bayer16_rgb48(bayer16.data(), output16.data(), width, height, CCVT_BAYER_BGGR, 0); },
+              [&]() { return same(reference16, output16, width, height, 3, 1); });
+
+    ccvt_simd_set_backend(CCVT_SIMD_SCALAR);
+    ccvt_simd_bayer8_rgb24(bayer8.data(), reference.data(), width, height, CCVT_BAYER_RGGB, 1);
+    ok &= run("Bayer8 edge aware", nullptr,
+              [&]() { ccvt_simd_bayer8_rgb24(bayer8.data(), output.data(), width, height, CCVT_BAYER_RGGB, 1); },
+              [&]() { return same(reference, output, width, height, 3, 0); });
+    ccvt_simd_set_backend(CCVT_SIMD_SCALAR);
+    ccvt_simd_bayer16_rgb48(bayer16.data(), reference16.data(), width, height, CCVT_BAYER_GRBG, 1);
+    ok &= run("Bayer16 edge aware", nullptr,
+              [&]() { ccvt_simd_bayer16_rgb48(bayer16.data(), output16.data(), width, height, CCVT_BAYER_GRBG, 1); },
+              [&]() { return same(reference16, output16, width, height, 3, 0); });
+
+    return ok;
+}
+
+int main(int ac, char *av[])
+{
+    me = av[0];
+    for (int i = 1; i < ac; i++)
+    {
+        if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            iterations = atoi(av[++i]);
+        else if (strcmp(av[i], "-t") == 0 && i + 1 < ac)
+            ccvt_simd_set_threads(atoi(av[++i]));
+        else
+            usage();
+    }
+    if (iterations < 1)
+        usage();
+
+    printf("Best instruction set: %s\n", ccvt_simd_backend_name(ccvt_simd_get_backend()));
+
+    bool ok = benchmark(1920, 1080);
+    ok &= benchmark(3840, 2160);
+
+    if (!ok)
+        fprintf(stderr, "%s: some outputs differ\n", me);
+    return ok ? 0 : 2;
+}
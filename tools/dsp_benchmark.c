@@ -0,0 +1,766 @@
+/* benchmark the libdsp kernels on detector and camera sizes, and check each one against a straightforward
+ *   reference implementation, so that optimizations of the library can be measured and guarded.
+ * exit status: 0 success, 1 bad usage, 2 a kernel differs from its reference.
+ */
+
+#include "dsp.h"
+
+#include <fftw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char *me; /* our name for usage() message */
+static int iterations = 5;
+static int quick;        /* only the small sizes */
+static const char *only; /* only the kernels whose name contains this */
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-q] [-k kernel]\n", me);
+    fprintf(stderr, "Purpose: benchmark the libdsp kernels and check them against reference implementations.\n");
+    fprintf(stderr, "-q runs the small sizes only, -k the kernels whose name contains the given text.\n");
+    exit(1);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+static int selected(const char *kernel)
+{
+    return only == NULL || strstr(kernel, only) != NULL;
+}
+
+/* a slow drift with noise, on integer levels when a range is given */
+static void fill(double *buf, int len, int range)
+{
+    for (int x = 0; x < len; x++)
+    {
+        if (range > 1)
+            buf[x] = (x / 97) % (range / 2) + rand() % (range / 2);
+        else
+            buf[x] = sin(x * 1e-4) * 100 + (rand() % 10000) / 100.0;
+    }
+}
+
+static dsp_stream_p new_stream(int width, int height)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, width);
+    if (height > 1)
+        dsp_stream_add_dim(stream, height);
+    dsp_stream_alloc_buffer(stream, stream->len);
+    return stream;
+}
+
+static void free_stream(dsp_stream_p stream)
+{
+    if (stream == NULL)
+        return;
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+}
+
+/* largest difference relative to the largest reference value, absolute below 1, NaN if any value is NaN */
+static double difference(const double *out, const double *reference, long len)
+{
+    double error = 0, peak = 1;
+    for (long x = 0; x < len; x++)
+    {
+        double d = fabs(out[x] - reference[x]);
+        if (!(d <= error))
+            error = d;
+        peak = Max(peak, fabs(reference[x]));
+    }
+    return error / peak;
+}
+
+/* one line of the table, a negative reference time when there is only a check */
+static int report(const char *kernel, int width, int height, double ms, double reference_ms, double error,
+                  double tolerance)
+{
+    char size[32];
+    int ok = error <= tolerance;
+
+    if (height > 1)
+        snprintf(size, sizeof(size), "%dx%d", width, height);
+    else
+        snprintf(size, sizeof(size), "%d", width);
+    if (reference_ms < 0)
+        printf("%-26s %-10s %10.3f %10s %8s %9.1e %s\n", kernel, size, ms, "-", "-", error, ok ? "ok" : "FAIL");
+    else
+        printf("%-26s %-10s %10.3f %10.3f %8.1f %9.1e %s\n", kernel, size, ms, reference_ms, reference_ms / ms, error,
+               ok ? "ok" : "FAIL");
+    if (!ok)
+        fprintf(stderr, "%s: %s on %s differs from the reference by %g\n", me, kernel, size, error);
+    return ok;
+}
+
+/* twiddles of a transform of n samples, exp(-2 pi j k / n) is (cosines[k], -sines[k]) */
+static void twiddles(int n, double *cosines, double *sines)
+{
+    for (int k = 0; k < n; k++)
+    {
+        cosines[k] = cos(2 * M_PI * k / n);
+        sines[k]   = sin(2 * M_PI * k / n);
+    }
+}
+
+/*
+ * complex transform of a real buffer, the last dimension varying slowest. It follows the definition when naive
+ * is set, rows then columns, otherwise it uses a complex FFTW plan made for the call, as dsp_fourier_dft() used to.
+ */
+static void reference_dft(const double *in, int width, int height, dsp_complex *out, int naive)
+{
+    long len = (long)width * height;
+
+    if (!naive)
+    {
+        int sizes[2] = { height, width };
+        for (long x = 0; x < len; x++)
+        {
+            out[x].real      = in[x];
+            out[x].imaginary = 0;
+        }
+        fftw_plan plan = height > 1 ? fftw_plan_dft(2, sizes, (fftw_complex *)out, (fftw_complex *)out, FFTW_FORWARD,
+                                                    FFTW_ESTIMATE)
+                                    : fftw_plan_dft(1, sizes + 1, (fftw_complex *)out, (fftw_complex *)out,
+                                                    FFTW_FORWARD, FFTW_ESTIMATE);
+        fftw_execute(plan);
+        fftw_destroy_plan(plan);
+        return;
+    }
+
+    int n             = Max(width, height);
+    double *cosines   = (double *)malloc(sizeof(double) * n * 2);
+    double *sines     = cosines + n;
+    dsp_complex *rows = (dsp_complex *)malloc(sizeof(dsp_complex) * len);
+    twiddles(width, cosines, sines);
+    for (int y = 0; y < height; y++)
+        for (int k = 0; k < width; k++)
+        {
+            const double *row = in + (long)y * width;
+            double re = 0, im = 0;
+            for (int x = 0; x < width; x++)
+            {
+                int t = (int)(((long)k * x) % width);
+                re += row[x] * cosines[t];
+                im -= row[x] * sines[t];
+            }
+            rows[(long)y * width + k].real      = re;
+            rows[(long)y * width + k].imaginary = im;
+        }
+    twiddles(height, cosines, sines);
+    for (int k = 0; k < height; k++)
+        for (int x = 0; x < width; x++)
+        {
+            double re = 0, im = 0;
+            for (int y = 0; y < height; y++)
+            {
+                int t                = (int)(((long)k * y) % height);
+                const dsp_complex *v = &rows[(long)y * width + x];
+                re += v->real * cosines[t] + v->imaginary * sines[t];
+                im += v->imaginary * cosines[t] - v->real * sines[t];
+            }
+            out[(long)k * width + x].real      = re;
+            out[(long)k * width + x].imaginary = im;
+        }
+    free(rows);
+    free(cosines);
+}
+
+static int fourier(int width, int height)
+{
+    dsp_stream_p stream = new_stream(width, height);
+    double *input       = (double *)malloc(sizeof(double) * stream->len);
+    srand(42);
+    fill(input, stream->len, 0);
+
+    double ms = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        memcpy(stream->buf, input, sizeof(double) * stream->len);
+        double start = now_ms();
+        dsp_fourier_dft_magnitude(stream);
+        ms += now_ms() - start;
+    }
+    ms /= iterations;
+
+    dsp_complex *spectrum = (dsp_complex *)malloc(sizeof(dsp_complex) * stream->len);
+    double *reference     = (double *)malloc(sizeof(double) * stream->len);
+    double start          = now_ms();
+    reference_dft(input, width, height, spectrum, (double)stream->len * (width + height) <= 1e8);
+    for (int x = 0; x < stream->len; x++)
+        reference[x] = sqrt(spectrum[x].real * spectrum[x].real + spectrum[x].imaginary * spectrum[x].imaginary);
+    double reference_ms = now_ms() - start;
+
+    int ok = report("fft magnitude", width, height, ms, reference_ms, difference(stream->buf, reference, stream->len),
+                    1e-9);
+    free(reference);
+    free(spectrum);
+    free(input);
+    free_stream(stream);
+    return ok;
+}
+
+static int histogram(const char *kernel, int width, int height, int bins, dsp_sample_type type)
+{
+    int len         = width * height;
+    double *input   = (double *)malloc(sizeof(double) * len);
+    void *samples   = malloc((size_t)len * dsp_sample_size(type));
+    double *counts  = (double *)calloc(bins, sizeof(double));
+    srand(42);
+    /* some samples beyond the last bin */
+    fill(input, len, bins + bins / 4);
+    dsp_sample_from_double(input, len, samples, type);
+
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        free(dsp_sample_histogram(samples, type, len, bins));
+    double ms = (now_ms() - start) / iterations;
+
+    double *out = dsp_sample_histogram(samples, type, len, bins);
+    dsp_sample_to_double(samples, type, len, input, NULL, NULL);
+    start = now_ms();
+    for (int x = 0; x < len; x++)
+    {
+        if (input[x] < bins)
+            counts[input[x] > 0 ? (int)input[x] : 0]++;
+    }
+    dsp_buffer_stretch(counts, bins, 0, bins);
+    double reference_ms = now_ms() - start;
+
+    int ok = report(kernel, width, height, ms, reference_ms, difference(out, counts, bins), 0);
+    free(out);
+    free(counts);
+    free(samples);
+    free(input);
+    return ok;
+}
+
+/* the matrix applied at every position, samples outside the stream count as zero */
+static void naive_correlation(const double *in, int width, int height, const double *matrix, int kw, int kh,
+                              double *out)
+{
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            double sum = 0;
+            for (int j = 0; j < kh && y + j < height; j++)
+                for (int i = 0; i < kw && x + i < width; i++)
+                    sum += matrix[j * kw + i] * in[(long)(y + j) * width + x + i];
+            out[(long)y * width + x] = sum;
+        }
+}
+
+static int convolution(int width, int height, int kw, int kh)
+{
+    static const char *names[] = { "auto", "direct", "separable", "fft" };
+    dsp_stream_p stream = new_stream(width, height);
+    dsp_stream_p matrix = new_stream(kw, kh);
+    srand(42);
+    fill(stream->buf, stream->len, 0);
+
+    /* a gaussian, so that the separable method applies */
+    for (int j = 0; j < kh; j++)
+        for (int i = 0; i < kw; i++)
+        {
+            double dx = (i - (kw - 1) / 2.0) / kw, dy = (j - (kh - 1) / 2.0) / kh;
+            matrix->buf[j * kw + i] = exp(-8 * (dx * dx + dy * dy));
+        }
+
+    double *reference = (double *)malloc(sizeof(double) * stream->len);
+    double start      = now_ms();
+    naive_correlation(stream->buf, width, height, matrix->buf, kw, kh, reference);
+    double reference_ms = now_ms() - start;
+
+    int ok = 1;
+    for (int method = DSP_CONVOLUTION_AUTO; method <= DSP_CONVOLUTION_FFT; method++)
+    {
+        dsp_stream_p out = NULL;
+        start            = now_ms();
+        for (int i = 0; i < iterations; i++)
+        {
+            free_stream(out);
+            out = dsp_convolution_convolution_method(stream, matrix, method);
+        }
+        double ms = (now_ms() - start) / iterations;
+
+        char kernel[64];
+        if (kh > 1)
+            snprintf(kernel, sizeof(kernel), "convolution %dx%d %s", kw, kh, names[method]);
+        else
+            snprintf(kernel, sizeof(kernel), "convolution %d %s", kw, names[method]);
+        ok &= report(kernel, width, height, ms, reference_ms, difference(out->buf, reference, stream->len), 1e-9);
+        free_stream(out);
+    }
+
+    free(reference);
+    free_stream(matrix);
+    free_stream(stream);
+    return ok;
+}
+
+static int compare(const void *a, const void *b)
+{
+    double va = *(const double *)a, vb = *(const double *)b;
+    return (va > vb) - (va < vb);
+}
+
+static int clamp(int x, int n)
+{
+    return x < 0 ? 0 : (x >= n ? n - 1 : x);
+}
+
+/* copy and sort the centered window of every sample, the edges repeat the outer samples */
+static void sorted_median(const double *in, double *out, int width, int height, int wx, int wy)
+{
+    double *sorted = (double *)malloc(sizeof(double) * wx * wy);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            int k = 0;
+            for (int j = 0; j < wy; j++)
+                for (int i = 0; i < wx; i++)
+                    sorted[k++] = in[clamp(y - (wy - 1) / 2 + j, height) * width + clamp(x - (wx - 1) / 2 + i, width)];
+            qsort(sorted, k, sizeof(double), compare);
+            out[y * width + x] = sorted[(k - 1) / 2];
+        }
+    free(sorted);
+}
+
+static int median(int width, int height, int wx, int wy, int range)
+{
+    dsp_stream_p stream = new_stream(width, height);
+    double *input       = (double *)malloc(sizeof(double) * stream->len);
+    srand(42);
+    fill(input, stream->len, range);
+
+    int sizes[2] = { wx, wy };
+    double ms    = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        memcpy(stream->buf, input, sizeof(double) * stream->len);
+        double start = now_ms();
+        dsp_filter_median(stream, sizes);
+        ms += now_ms() - start;
+    }
+    ms /= iterations;
+
+    double *reference = (double *)malloc(sizeof(double) * stream->len);
+    double start      = now_ms();
+    sorted_median(input, reference, width, height, wx, wy);
+    double reference_ms = now_ms() - start;
+
+    char kernel[64];
+    if (wy > 1)
+        snprintf(kernel, sizeof(kernel), "median %dx%d%s", wx, wy, range > 1 ? " levels" : "");
+    else
+        snprintf(kernel, sizeof(kernel), "median %d%s", wx, range > 1 ? " levels" : "");
+    int ok = report(kernel, width, height, ms, reference_ms, difference(stream->buf, reference, stream->len), 0);
+    free(reference);
+    free(input);
+    free_stream(stream);
+    return ok;
+}
+
+/* 16 bit samples of a detector, fed to the filters in blocks as they are captured */
+#define BENCHMARK_BLOCK_LEN 10000
+
+static uint16_t *detector_samples(int len)
+{
+    double *input     = (double *)malloc(sizeof(double) * len);
+    uint16_t *samples = (uint16_t *)malloc(sizeof(uint16_t) * len);
+    srand(42);
+    fill(input, len, 4096);
+    dsp_sample_from_double(input, len, samples, DSP_SAMPLE_U16);
+    free(input);
+    return samples;
+}
+
+static int fir(int len, int taps, int decimation)
+{
+    uint16_t *samples = detector_samples(len);
+    double *h         = dsp_filter_fir_lowpass_taps(taps, 0.4 / decimation);
+    dsp_fir *filter   = dsp_filter_fir_new(h, taps, decimation);
+    double *out       = (double *)malloc(sizeof(double) * (len / decimation + 1));
+
+    int count = 0;
+    double ms = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        dsp_filter_fir_reset(filter);
+        count        = 0;
+        double start = now_ms();
+        for (int x = 0; x < len; x += BENCHMARK_BLOCK_LEN)
+            count += dsp_filter_fir_decimate(filter, samples + x, DSP_SAMPLE_U16, Min(BENCHMARK_BLOCK_LEN, len - x),
+                                             out + count);
+        ms += now_ms() - start;
+    }
+    ms /= iterations;
+
+    /* output m is at sample m * decimation, samples before the first one are zero */
+    int outputs       = (len + decimation - 1) / decimation;
+    double *reference = (double *)malloc(sizeof(double) * outputs);
+    double start      = now_ms();
+    for (int m = 0; m < outputs; m++)
+    {
+        long t     = (long)m * decimation;
+        double sum = 0;
+        for (int n = 0; n < taps && n <= t; n++)
+            sum += h[n] * samples[t - n];
+        reference[m] = sum;
+    }
+    double reference_ms = now_ms() - start;
+
+    char kernel[64];
+    snprintf(kernel, sizeof(kernel), "fir %d taps / %d", taps, decimation);
+    double error = count == outputs ? difference(out, reference, outputs) : NAN;
+    int ok       = report(kernel, len, 1, ms, reference_ms, error, 1e-9);
+    free(reference);
+    free(out);
+    dsp_filter_fir_free(filter);
+    free(h);
+    free(samples);
+    return ok;
+}
+
+static int channelizer(int len, int taps, int channels)
+{
+    uint16_t *samples = detector_samples(len);
+    double *h         = dsp_filter_fir_lowpass_taps(taps, 0.5 / channels);
+    dsp_fir *filter   = dsp_filter_channelizer_new(h, taps, channels);
+    int bins          = channels / 2 + 1;
+    dsp_complex *out  = (dsp_complex *)malloc(sizeof(dsp_complex) * bins * (len / channels + 1));
+
+    int count = 0;
+    double ms = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        dsp_filter_fir_reset(filter);
+        count        = 0;
+        double start = now_ms();
+        for (int x = 0; x < len; x += BENCHMARK_BLOCK_LEN)
+            count += dsp_filter_fir_channelize(filter, samples + x, DSP_SAMPLE_U16, Min(BENCHMARK_BLOCK_LEN, len - x),
+                                               out + (long)count * bins);
+        ms += now_ms() - start;
+    }
+    ms /= iterations;
+
+    /* channel k is the input shifted down by k / channels of the sample rate, filtered and decimated */
+    int frames             = (len + channels - 1) / channels;
+    dsp_complex *reference = (dsp_complex *)malloc(sizeof(dsp_complex) * bins * frames);
+    double *cosines        = (double *)malloc(sizeof(double) * channels * 2);
+    double *sines          = cosines + channels;
+    double start           = now_ms();
+    twiddles(channels, cosines, sines);
+    for (int m = 0; m < frames; m++)
+        for (int k = 0; k < bins; k++)
+        {
+            long t    = (long)m * channels;
+            double re = 0, im = 0;
+            for (int n = 0; n < taps && n <= t; n++)
+            {
+                int w = (n * k) % channels;
+                re += h[n] * samples[t - n] * cosines[w];
+                im += h[n] * samples[t - n] * sines[w];
+            }
+            reference[(long)m * bins + k].real      = re;
+            reference[(long)m * bins + k].imaginary = im;
+        }
+    double reference_ms = now_ms() - start;
+
+    char kernel[64];
+    snprintf(kernel, sizeof(kernel), "channelizer %d taps / %d", taps, channels);
+    double error = count == frames ? difference((double *)out, (double *)reference, 2L * bins * frames) : NAN;
+    int ok       = report(kernel, len, 1, ms, reference_ms, error, 1e-9);
+    free(cosines);
+    free(reference);
+    free(out);
+    dsp_filter_fir_free(filter);
+    free(h);
+    free(samples);
+    return ok;
+}
+
+static int welch(int len, int size)
+{
+    uint16_t *samples = detector_samples(len);
+    dsp_welch *w      = dsp_fourier_welch_new(size, 0.5);
+    double *out       = (double *)malloc(sizeof(double) * w->bins);
+
+    double ms = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        double start = now_ms();
+        for (int x = 0; x < len; x += BENCHMARK_BLOCK_LEN)
+            dsp_fourier_welch_add(w, samples + x, DSP_SAMPLE_U16, Min(BENCHMARK_BLOCK_LEN, len - x));
+        dsp_fourier_welch_spectrum(w, out, 0);
+        ms += now_ms() - start;
+        dsp_fourier_welch_reset(w);
+    }
+    ms /= iterations;
+
+    /* periodic Hann windows on half overlapping segments, one sided density per bin */
+    double *reference     = (double *)calloc(w->bins, sizeof(double));
+    double *segment       = (double *)malloc(sizeof(double) * size);
+    dsp_complex *spectrum = (dsp_complex *)malloc(sizeof(dsp_complex) * size);
+    double start          = now_ms();
+    double norm           = 0;
+    int segments          = 0;
+    for (int x = 0; x < size; x++)
+        norm += pow(0.5 - 0.5 * cos(2 * M_PI * x / size), 2);
+    for (int s = 0; s + size <= len; s += w->step, segments++)
+    {
+        for (int x = 0; x < size; x++)
+            segment[x] = samples[s + x] * (0.5 - 0.5 * cos(2 * M_PI * x / size));
+        reference_dft(segment, size, 1, spectrum, size <= 1024);
+        for (int k = 0; k < w->bins; k++)
+        {
+            double power = spectrum[k].real * spectrum[k].real + spectrum[k].imaginary * spectrum[k].imaginary;
+            reference[k] += power * (k > 0 && 2 * k != size ? 2 : 1);
+        }
+    }
+    for (int k = 0; k < w->bins; k++)
+        reference[k] /= norm * segments;
+    double reference_ms = now_ms() - start;
+
+    char kernel[64];
+    snprintf(kernel, sizeof(kernel), "welch %d", size);
+    int ok = report(kernel, len, 1, ms, reference_ms, difference(out, reference, w->bins), 1e-9);
+    free(spectrum);
+    free(segment);
+    free(reference);
+    free(out);
+    dsp_fourier_welch_free(w);
+    free(samples);
+    return ok;
+}
+
+/* conversions between native samples and doubles, and stretching to 8 bit */
+static int samples(int width, int height)
+{
+    int len           = width * height;
+    double *input     = (double *)malloc(sizeof(double) * len);
+    double *out       = (double *)malloc(sizeof(double) * len);
+    double *reference = (double *)malloc(sizeof(double) * len);
+    uint16_t *u16     = (uint16_t *)malloc(sizeof(uint16_t) * len);
+    uint8_t *u8       = (uint8_t *)malloc(len);
+    int ok            = 1;
+
+    /* values beyond the 16 bit range and a NaN, that are clamped */
+    srand(42);
+    fill(input, len, 0);
+    for (int x = 0; x < len; x++)
+        input[x] = input[x] * 400 - 2000;
+    input[len / 2] = NAN;
+
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        dsp_sample_from_double(input, len, u16, DSP_SAMPLE_U16);
+    double ms = (now_ms() - start) / iterations;
+    for (int x = 0; x < len; x++)
+        out[x] = u16[x];
+    start = now_ms();
+    for (int x = 0; x < len; x++)
+    {
+        double v = input[x] != input[x] ? 0 : Min(Max(input[x], 0.0), 65535.0);
+        u16[x]   = (uint16_t)v;
+    }
+    double reference_ms = now_ms() - start;
+    for (int x = 0; x < len; x++)
+        reference[x] = u16[x];
+    ok &= report("sample from double u16", width, height, ms, reference_ms, difference(out, reference, len), 0);
+
+    double mn = 0, mx = 0;
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        dsp_sample_to_double(u16, DSP_SAMPLE_U16, len, out, &mn, &mx);
+    ms         = (now_ms() - start) / iterations;
+    start      = now_ms();
+    double rmn = u16[0], rmx = u16[0];
+    for (int x = 0; x < len; x++)
+    {
+        reference[x] = u16[x];
+        rmn          = Min(rmn, reference[x]);
+        rmx          = Max(rmx, reference[x]);
+    }
+    reference_ms = now_ms() - start;
+    double error = (mn == rmn && mx == rmx) ? difference(out, reference, len) : NAN;
+    ok &= report("sample to double u16", width, height, ms, reference_ms, error, 0);
+
+    input[len / 2] = 0;
+    start          = now_ms();
+    for (int i = 0; i < iterations; i++)
+        dsp_sample_stretch_from_double(input, len, u8, DSP_SAMPLE_U8, 0, 255);
+    ms = (now_ms() - start) / iterations;
+    for (int x = 0; x < len; x++)
+        out[x] = u8[x];
+    start = now_ms();
+    memcpy(reference, input, sizeof(double) * len);
+    dsp_buffer_stretch(reference, len, 0, 255);
+    for (int x = 0; x < len; x++)
+        reference[x] = (uint8_t)Min(Max(reference[x], 0.0), 255.0);
+    reference_ms = now_ms() - start;
+    /* the conversion is fused with the scaling, truncation may round the other way */
+    ok &= report("sample stretch u8", width, height, ms, reference_ms, difference(out, reference, len), 1.0 / 255);
+
+    free(u8);
+    free(u16);
+    free(reference);
+    free(out);
+    free(input);
+    return ok;
+}
+
+static int crop(int width, int height)
+{
+    dsp_stream_p stream = new_stream(width, height);
+    srand(42);
+    fill(stream->buf, stream->len, 0);
+    stream->ROI[0].start = width / 8;
+    stream->ROI[0].len   = width / 2;
+    stream->ROI[1].start = height / 4;
+    stream->ROI[1].len   = height / 2;
+
+    dsp_stream_p out = NULL;
+    double start     = now_ms();
+    for (int i = 0; i < iterations; i++)
+    {
+        free_stream(out);
+        out = dsp_stream_crop(stream);
+    }
+    double ms = (now_ms() - start) / iterations;
+
+    int rw = width / 2, rh = height / 2;
+    double *reference = (double *)malloc(sizeof(double) * rw * rh);
+    start             = now_ms();
+    for (int y = 0; y < rh; y++)
+        for (int x = 0; x < rw; x++)
+            reference[y * rw + x] = stream->buf[(long)(y + height / 4) * width + x + width / 8];
+    double reference_ms = now_ms() - start;
+
+    double error = out->len == rw * rh ? difference(out->buf, reference, out->len) : NAN;
+    int ok       = report("stream crop", width, height, ms, reference_ms, error, 0);
+    free(reference);
+    free_stream(out);
+    free_stream(stream);
+    return ok;
+}
+
+/* an elongated star placed rotated in a noisy frame must be found where its first element lies */
+static int align(int width, int height, int size, int steps)
+{
+    dsp_stream_p stream = new_stream(width, height);
+    dsp_stream_p object = new_stream(size, size);
+    double c            = (size - 1) / 2.0;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+            object->buf[y * size + x] = exp(-(pow((x - c) / (size / 3.0), 2) + pow((y - c) / (size / 8.0), 2)));
+
+    double angle = M_PI * 2 * (steps / 4) / steps, center[2] = { c, c };
+    dsp_stream_p rotated = dsp_stream_rotate(object, &angle, center);
+    int px = width / 3, py = height / 2;
+    srand(42);
+    for (int x = 0; x < stream->len; x++)
+        stream->buf[x] = (rand() % 1000) / 10000.0;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+            stream->buf[(long)(py + y) * width + px + x] += rotated->buf[y * size + x];
+
+    dsp_stream_p out = NULL;
+    double start     = now_ms();
+    for (int i = 0; i < iterations; i++)
+    {
+        free_stream(out);
+        out = dsp_align_find_object(stream, object, steps);
+    }
+    double ms = (now_ms() - start) / iterations;
+
+    int peak = 0;
+    for (int x = 1; x < out->len; x++)
+    {
+        if (out->buf[x] > out->buf[peak])
+            peak = x;
+    }
+    char kernel[64];
+    snprintf(kernel, sizeof(kernel), "align %dx%d %d steps", size, size, steps);
+    int ok = report(kernel, width, height, ms, -1, hypot(peak % width - px, peak / width - py), 1);
+    free_stream(out);
+    free_stream(rotated);
+    free_stream(object);
+    free_stream(stream);
+    return ok;
+}
+
+int main(int ac, char *av[])
+{
+    int ok = 1;
+
+    me = av[0];
+    for (int i = 1; i < ac; i++)
+    {
+        if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            iterations = atoi(av[++i]);
+        else if (strcmp(av[i], "-q") == 0)
+            quick = 1;
+        else if (strcmp(av[i], "-k") == 0 && i + 1 < ac)
+            only = av[++i];
+        else
+            usage();
+    }
+    if (iterations < 1)
+        usage();
+
+    printf("%d iterations, ms per call, error relative to the largest reference value\n", iterations);
+    printf("%-26s %-10s %10s %10s %8s %9s\n", "kernel", "size", "libdsp", "reference", "speedup", "error");
+    if (selected("fft"))
+    {
+        ok &= fourier(4096, 1);
+        ok &= fourier(256, 192);
+        if (!quick)
+        {
+            ok &= fourier(1048576, 1);
+            ok &= fourier(2048, 2048);
+        }
+    }
+    if (selected("histogram"))
+    {
+        ok &= histogram("histogram f64", quick ? 256 : 2048, quick ? 256 : 2048, 4096, DSP_SAMPLE_F64);
+        ok &= histogram("histogram u16", quick ? 256 : 2048, quick ? 256 : 2048, 65536, DSP_SAMPLE_U16);
+        ok &= histogram("histogram u8", quick ? 256 : 1920, quick ? 256 : 1080, 256, DSP_SAMPLE_U8);
+    }
+    if (selected("convolution"))
+    {
+        ok &= convolution(256, 256, 7, 7);
+        ok &= convolution(quick ? 65536 : 1048576, 1, quick ? 63 : 255, 1);
+        if (!quick)
+            ok &= convolution(2048, 2048, 9, 9);
+    }
+    if (selected("median"))
+    {
+        ok &= median(quick ? 16384 : 262144, 1, 63, 1, 0);
+        ok &= median(quick ? 256 : 1024, quick ? 256 : 1024, 3, 3, 0);
+        ok &= median(quick ? 256 : 1024, quick ? 256 : 1024, 5, 5, 200);
+    }
+    if (selected("fir"))
+        ok &= fir(quick ? 65536 : 4194304, 128, 8);
+    if (selected("channelizer"))
+        ok &= quick ? channelizer(16384, 256, 16) : channelizer(262144, 1024, 64);
+    if (selected("welch"))
+        ok &= quick ? welch(16384, 256) : welch(4194304, 4096);
+    if (selected("sample"))
+        ok &= samples(quick ? 256 : 2048, quick ? 256 : 2048);
+    if (selected("crop"))
+        ok &= crop(quick ? 256 : 2048, quick ? 256 : 2048);
+    if (selected("align"))
+        ok &= align(quick ? 128 : 512, quick ? 128 : 512, 15, 8);
+    dsp_fourier_cleanup();
+
+    return ok ? 0 : 2;
+}
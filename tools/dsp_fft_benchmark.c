@@ -0,0 +1,141 @@
+/* compare the speed of the cached real to complex Fourier transforms of libdsp
+ *   with planning a complex transform on every call, on typical SDR buffer sizes.
+ * exit status: 0 success, 1 bad usage, 2 the transforms differ.
+ */
+
+#include "dsp.h"
+
+#include <fftw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char *me; /* our name for usage() message */
+static int iterations = 50;
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-t threads] [-m] [-w wisdom]\n", me);
+    fprintf(stderr, "Purpose: benchmark the libdsp Fourier transforms on SDR buffer sizes.\n");
+    fprintf(stderr, "-m measures plans instead of estimating them, -w loads and saves FFTW wisdom.\n");
+    exit(1);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+/* a complex transform planned for every buffer, as dsp_fourier_dft() used to do */
+static void uncached_dft(dsp_stream_p stream, dsp_complex *out)
+{
+    dsp_complex *in = (dsp_complex *)malloc(sizeof(dsp_complex) * stream->len);
+    fftw_plan plan = fftw_plan_dft(stream->dims, stream->sizes, (fftw_complex *)in, (fftw_complex *)out, FFTW_FORWARD,
+                                   FFTW_ESTIMATE);
+    for (int x = 0; x < stream->len; x++)
+    {
+        in[x].real      = stream->buf[x];
+        in[x].imaginary = 0;
+    }
+    fftw_execute(plan);
+    fftw_destroy_plan(plan);
+    free(in);
+}
+
+static int benchmark(int len)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, len);
+    dsp_stream_alloc_buffer(stream, stream->len);
+
+    /* a carrier in noise */
+    srand(42);
+    for (int x = 0; x < len; x++)
+        stream->buf[x] = sin(x * 0.1) + (rand() % 1000) / 1000.0;
+
+    dsp_complex *reference = (dsp_complex *)malloc(sizeof(dsp_complex) * len);
+    dsp_complex *half      = (dsp_complex *)malloc(sizeof(dsp_complex) * dsp_fourier_half_len(stream));
+
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        uncached_dft(stream, reference);
+    double uncached = (now_ms() - start) / iterations;
+
+    /* the first call plans the transform */
+    start = now_ms();
+    dsp_fourier_r2c(stream, half);
+    double planning = now_ms() - start;
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        dsp_fourier_r2c(stream, half);
+    double cached = (now_ms() - start) / iterations;
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        free(dsp_fourier_dft(stream));
+    double full = (now_ms() - start) / iterations;
+
+    /* both transforms must agree on the half spectrum */
+    double error = 0, peak = 0;
+    for (int x = 0; x < dsp_fourier_half_len(stream); x++)
+    {
+        error = Max(error, fabs(reference[x].real - half[x].real) + fabs(reference[x].imaginary - half[x].imaginary));
+        peak  = Max(peak, fabs(reference[x].real) + fabs(reference[x].imaginary));
+    }
+
+    printf("%-10d %10.3f %10.3f %10.3f %10.3f %8.1f\n", len, uncached, planning, cached, full, uncached / cached);
+
+    free(reference);
+    free(half);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+
+    if (error > peak * 1e-9)
+    {
+        fprintf(stderr, "%s: transforms of %d samples differ by %g\n", me, len, error);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int ac, char *av[])
+{
+    static const int sizes[] = { 1024, 2048, 4096, 8192, 16384, 65536, 262144, 1048576 };
+    const char *wisdom = NULL;
+    int ok = 1;
+
+    me = av[0];
+    for (int i = 1; i < ac; i++)
+    {
+        if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            iterations = atoi(av[++i]);
+        else if (strcmp(av[i], "-t") == 0 && i + 1 < ac)
+            dsp_fourier_set_threads(atoi(av[++i]));
+        else if (strcmp(av[i], "-m") == 0)
+            dsp_fourier_set_planning(1);
+        else if (strcmp(av[i], "-w") == 0 && i + 1 < ac)
+            wisdom = av[++i];
+        else
+            usage();
+    }
+    if (iterations < 1)
+        usage();
+
+    if (wisdom != NULL && dsp_fourier_load_wisdom(wisdom) == 0)
+        fprintf(stderr, "%s: no wisdom loaded from %s\n", me, wisdom);
+
+    printf("%d iterations, ms per transform\n", iterations);
+    printf("%-10s %10s %10s %10s %10s %8s\n", "samples", "uncached", "planning", "r2c", "full dft", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        ok &= benchmark(sizes[i]);
+
+    if (wisdom != NULL && dsp_fourier_save_wisdom(wisdom) == 0)
+        fprintf(stderr, "%s: cannot save wisdom to %s\n", me, wisdom);
+    dsp_fourier_cleanup();
+
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,136 @@
+/* compare the speed of the sliding median filters of libdsp with sorting the window
+ *   of every sample, as dsp_buffer_median() used to do, on detector continuum buffers and camera frames.
+ * exit status: 0 success, 1 bad usage, 2 the filters differ.
+ */
+
+#include "dsp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char *me; /* our name for usage() message */
+static int iterations = 5;
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations]\n", me);
+    fprintf(stderr, "Purpose: benchmark the libdsp median filters on continuum buffers and frames.\n");
+    exit(1);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1.0e6;
+}
+
+static int compare(const void *a, const void *b)
+{
+    double va = *(const double *)a, vb = *(const double *)b;
+    return (va > vb) - (va < vb);
+}
+
+static int clamp(int x, int n)
+{
+    return x < 0 ? 0 : (x >= n ? n - 1 : x);
+}
+
+/* copy and sort the centered window of every sample, the edges repeat the outer samples */
+static void sorted_median(const double *in, double *out, int width, int height, int wx, int wy)
+{
+    double *sorted = (double *)malloc(sizeof(double) * wx * wy);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            int k = 0;
+            for (int j = 0; j < wy; j++)
+                for (int i = 0; i < wx; i++)
+                    sorted[k++] = in[clamp(y - (wy - 1) / 2 + j, height) * width + clamp(x - (wx - 1) / 2 + i, width)];
+            qsort(sorted, k, sizeof(double), compare);
+            out[y * width + x] = sorted[(k - 1) / 2];
+        }
+    free(sorted);
+}
+
+static int benchmark(const char *name, int width, int height, int wx, int wy, int range)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, width);
+    if (height > 1)
+        dsp_stream_add_dim(stream, height);
+    dsp_stream_alloc_buffer(stream, stream->len);
+
+    /* a slow drift with noise, and integer samples when a range is given */
+    srand(42);
+    double *input = (double *)malloc(sizeof(double) * stream->len);
+    for (int x = 0; x < stream->len; x++)
+    {
+        if (range > 0)
+            input[x] = (x / 97) % (range / 2) + rand() % (range / 2);
+        else
+            input[x] = sin(x * 1e-4) * 100 + (rand() % 10000) / 100.0;
+    }
+
+    double *reference = (double *)malloc(sizeof(double) * stream->len);
+    double start = now_ms();
+    sorted_median(input, reference, width, height, wx, wy);
+    double sorted = now_ms() - start;
+
+    int sizes[2] = { wx, wy };
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+    {
+        memcpy(stream->buf, input, sizeof(double) * stream->len);
+        dsp_filter_median(stream, sizes);
+    }
+    double sliding = (now_ms() - start) / iterations;
+
+    int differ = 0;
+    for (int x = 0; x < stream->len; x++)
+        differ += stream->buf[x] != reference[x];
+
+    printf("%-24s %5dx%-5d %3dx%-3d %10.2f %10.2f %8.1f\n", name, width, height, wx, wy, sorted, sliding,
+           sorted / sliding);
+
+    free(reference);
+    free(input);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+
+    if (differ > 0)
+    {
+        fprintf(stderr, "%s: %d samples of %s differ\n", me, differ, name);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int ac, char *av[])
+{
+    int ok = 1;
+
+    me = av[0];
+    for (int i = 1; i < ac; i++)
+    {
+        if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            iterations = atoi(av[++i]);
+        else
+            usage();
+    }
+    if (iterations < 1)
+        usage();
+
+    printf("%d iterations, ms per filter\n", iterations);
+    printf("%-24s %11s %7s %10s %10s %8s\n", "", "size", "window", "sorted", "sliding", "speedup");
+    ok &= benchmark("continuum", 1048576, 1, 15, 1, 0);
+    ok &= benchmark("continuum", 1048576, 1, 101, 1, 0);
+    ok &= benchmark("continuum 8 bit", 1048576, 1, 101, 1, 256);
+    ok &= benchmark("frame", 1920, 1080, 3, 3, 0);
+    ok &= benchmark("frame", 1920, 1080, 7, 7, 0);
+    ok &= benchmark("frame 8 bit", 1920, 1080, 7, 7, 256);
+
+    return ok ? 0 : 2;
+}
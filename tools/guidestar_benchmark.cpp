@@ -0,0 +1,110 @@
+/* time the guide star finder on a rendered frame: a windowed search around the
+ *   last position, as in a rapid guide loop, a full frame search and multi star
+ *   tracking.
+ * exit status: 0 the star was found every time, 1 bad usage, 2 the star was lost.
+ */
+
+#include "indiguidestar.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+static char *me; /* our name for usage() message */
+static int iterations = 200;
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-w width] [-h height]\n", me);
+    fprintf(stderr, "Purpose: benchmark the guide star search on a 16 bit frame, 1280x960 by default.\n");
+    exit(1);
+}
+
+/* gaussian stars over a flat background with deterministic pseudo noise */
+static std::vector<uint16_t> render(int width, int height, const std::vector<std::pair<double, double>> &stars)
+{
+    const double sigma = 1.5, peak = 20000;
+    std::vector<uint16_t> frame(static_cast<size_t>(width) * height);
+    uint32_t seed = 12345;
+    for (auto &pixel : frame)
+    {
+        seed = seed * 1103515245 + 12345;
+        pixel = 1000 + (seed >> 16) % 50;
+    }
+
+    for (const auto &star : stars)
+        for (int y = std::max(0, int(star.second) - 10); y < std::min(height, int(star.second) + 10); y++)
+            for (int x = std::max(0, int(star.first) - 10); x < std::min(width, int(star.first) + 10); x++)
+            {
+                double r2 = (x - star.first) * (x - star.first) + (y - star.second) * (y - star.second);
+                frame[static_cast<size_t>(y) * width + x] += static_cast<uint16_t>(peak * exp(-r2 / (2 * sigma * sigma)));
+            }
+
+    return frame;
+}
+
+/* average time of one call in microseconds, false if a call failed */
+static bool timeit(const char *name, int count, const std::function<bool()> &function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        if (!function())
+        {
+            fprintf(stderr, "%s: %s lost the star\n", me, name);
+            return false;
+        }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-24s %12.1f us/frame\n", name, elapsed.count() / count);
+    return true;
+}
+
+int main(int ac, char *av[])
+{
+    int width = 1280, height = 960;
+
+    me = av[0];
+    for (int i = 1; i < ac; i++)
+    {
+        if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            iterations = atoi(av[++i]);
+        else if (strcmp(av[i], "-w") == 0 && i + 1 < ac)
+            width = atoi(av[++i]);
+        else if (strcmp(av[i], "-h") == 0 && i + 1 < ac)
+            height = atoi(av[++i]);
+        else
+            usage();
+    }
+    if (iterations < 1 || width < 64 || height < 64)
+        usage();
+
+    const double cx = width / 2 + 0.3, cy = height / 2 + 0.7;
+    auto frame = render(width, height, { { cx, cy }, { cx - 25.4, cy + 20.1 }, { cx + 30.8, cy - 15.5 } });
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(frame.data());
+
+    INDI::GuideStarFinder finder;
+    printf("Frame %dx%d, 16 bit\n", width, height);
+
+    bool ok = timeit("Windowed search", iterations, [&]()
+    {
+        return finder.find(data, width, height, 16, static_cast<int>(cx), static_cast<int>(cy)).valid;
+    });
+    // Full frame searches are much slower, keep the run short
+    ok &= timeit("Full frame search", std::max(1, iterations / 20), [&]()
+    {
+        return finder.find(data, width, height, 16).valid;
+    });
+    ok &= timeit("Tracking 3 stars", iterations, [&]()
+    {
+        finder.track(data, width, height, 16, 3);
+        double dx = 0, dy = 0;
+        return finder.getOffset(dx, dy);
+    });
+
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,68 @@
+/* convert compressed SER recordings (.serz) made by the INDI stream recorder
+ *   back to standard SER files, frame timestamps included.
+ * exit status: 0 all files converted, 1 bad usage, 2 some conversion failed.
+ */
+
+#include "serzrecorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+static char *me; /* our name for usage() message */
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s file.serz [file.serz ...]\n", me);
+    fprintf(stderr, "       %s -o output.ser file.serz\n", me);
+    fprintf(stderr, "Purpose: convert compressed SER recordings to standard SER files.\n");
+    fprintf(stderr, "Without -o, each file.serz is converted to file.ser.\n");
+    exit(1);
+}
+
+static bool convert(const char *input, const char *output)
+{
+    char errmsg[1024] = {0};
+    if (INDI::SERZ_Reader::convertToSER(input, output, errmsg) == false)
+    {
+        fprintf(stderr, "%s: %s\n", me, errmsg);
+        return false;
+    }
+
+    fprintf(stderr, "%s -> %s\n", input, output);
+    return true;
+}
+
+int main(int ac, char *av[])
+{
+    const char *output = nullptr;
+
+    me = av[0];
+    if (ac > 1 && strcmp(av[1], "-o") == 0)
+    {
+        if (ac != 4)
+            usage();
+        output = av[2];
+        return convert(av[3], output) ? 0 : 2;
+    }
+
+    if (ac < 2 || av[1][0] == '-')
+        usage();
+
+    int rc = 0;
+    for (int i = 1; i < ac; i++)
+    {
+        std::string serFile = av[i];
+        size_t dot = serFile.rfind(".serz");
+        if (dot != std::string::npos && dot + 5 == serFile.size())
+            serFile.erase(dot);
+        serFile += ".ser";
+
+        if (convert(av[i], serFile.c_str()) == false)
+            rc = 2;
+    }
+
+    return rc;
+}